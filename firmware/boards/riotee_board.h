@@ -3,5 +3,9 @@
 
 #define BOARD_RIOTEE_BOARD 1
 
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
 
 #endif /* RIOTEE_BOARD_H_ */
@@ -3,4 +3,8 @@
 
 #define BOARD_RIOTEE_PROBE 1
 
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
 #endif /* RIOTEE_PROBE_H_ */
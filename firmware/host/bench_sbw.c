@@ -0,0 +1,140 @@
+/*
+ * Counts the SBW slots and JTAG scans that the probe spends on its MSP430
+ * operations and estimates their duration on the probe. The estimate is taken
+ * from the virtual clock, which only advances with the SBW bit delays and the
+ * sleeps of the firmware, so it is a lower bound for the time on hardware.
+ *
+ * Usage: bench_sbw [n_iter]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "DAP.h"
+#include "DAP_config.h"
+#include "hal.h"
+#include "msp430_sim.h"
+#include "probe_vendor.h"
+#include "sbw_device.h"
+#include "sim_board.h"
+
+#define ID_DAP_VENDOR_SBW_READ ID_DAP_Vendor7
+#define ID_DAP_VENDOR_SBW_WRITE ID_DAP_Vendor8
+
+#define FRAM_START 0x4400
+#define READ_BLOCK_WORDS ((DAP_PACKET_SIZE - 2) / 2)
+#define WRITE_BLOCK_WORDS ((DAP_PACKET_SIZE - 6) / 2)
+
+static uint8_t request[DAP_PACKET_SIZE];
+static uint8_t response[DAP_PACKET_SIZE];
+
+static int op_connect(void) {
+  int rc = sbw_dev_connect();
+  sbw_dev_disconnect();
+  return rc;
+}
+
+static int op_read_word(void) {
+  uint16_t word;
+  return sbw_dev_mem_read(&word, FRAM_START, 1);
+}
+
+static int op_write_word(void) {
+  uint16_t word = 0x1234;
+  return sbw_dev_mem_write(FRAM_START, &word, 1);
+}
+
+static int vendor_rw(uint8_t id, uint8_t n_words) {
+  uint32_t addr = FRAM_START;
+
+  request[0] = id;
+  memcpy(&request[1], &addr, sizeof(addr));
+  request[5] = n_words;
+  return (sim_board_vendor(request, response) == DAP_OK) ? 0 : -1;
+}
+
+static int op_read_block(void) {
+  return vendor_rw(ID_DAP_VENDOR_SBW_READ, READ_BLOCK_WORDS);
+}
+
+static int op_write_block(void) {
+  return vendor_rw(ID_DAP_VENDOR_SBW_WRITE, WRITE_BLOCK_WORDS);
+}
+
+static int op_reset(void) { return sbw_dev_reset(); }
+
+static int op_halt_resume(void) {
+  if (sbw_dev_halt() < 0)
+    return -1;
+  return sbw_dev_release();
+}
+
+static uint64_t host_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  static const struct {
+    const char *name;
+    int (*run)(void);
+    /* Number of data bytes transferred per operation */
+    unsigned int n_bytes;
+    /* Operation leaves the target disconnected */
+    bool disconnects;
+  } ops[] = {
+      {"connect", op_connect, 0, true},
+      {"read_word", op_read_word, 2, false},
+      {"write_word", op_write_word, 2, false},
+      {"read_block", op_read_block, 2 * READ_BLOCK_WORDS, false},
+      {"write_block", op_write_block, 2 * WRITE_BLOCK_WORDS, false},
+      {"reset", op_reset, 0, false},
+      {"halt_resume", op_halt_resume, 0, false},
+  };
+  unsigned int n_iter = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000;
+  int rc = 0;
+
+  printf("%-12s %8s %6s %6s %6s %11s %10s %10s\n", "operation", "slots", "ir",
+         "dr", "tclk", "target_us", "kB/s", "host_ns");
+
+  for (unsigned int i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+    msp430_sim_counters_t cnt;
+    /* Connecting includes several milliseconds of sleeps */
+    unsigned int n = ops[i].disconnects ? (n_iter + 99) / 100 : n_iter;
+
+    sim_board_init(NULL);
+    programming_enable();
+    if (!ops[i].disconnects && (sbw_dev_connect() < 0)) {
+      fprintf(stderr, "%s: connect failed\n", ops[i].name);
+      return 1;
+    }
+
+    msp430_sim_clear_counters();
+    uint64_t t_start = hal_time_ns();
+    uint64_t host_start = host_ns();
+    for (unsigned int k = 0; k < n; k++) {
+      if (ops[i].run() < 0) {
+        fprintf(stderr, "%s: failed in iteration %u\n", ops[i].name, k);
+        rc = 1;
+        break;
+      }
+    }
+    uint64_t host_total = host_ns() - host_start;
+    double target_us = (hal_time_ns() - t_start) / 1000.0 / n;
+    msp430_sim_get_counters(&cnt);
+
+    printf("%-12s %8.1f %6.1f %6.1f %6.1f %11.1f %10.2f %10.0f\n",
+           ops[i].name, (double)cnt.slots / n, (double)cnt.ir_scans / n,
+           (double)cnt.dr_scans / n, (double)cnt.tclk_cycles / n, target_us,
+           ops[i].n_bytes ? ops[i].n_bytes * 1000.0 / target_us : 0.0,
+           (double)host_total / n);
+
+    if (!ops[i].disconnects)
+      sbw_dev_disconnect();
+    programming_disable();
+  }
+  return rc;
+}
@@ -0,0 +1,23 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+/* The host build runs the probe's code in a single thread without a kernel */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define configNUMBER_OF_CORES 1
+#define configTOTAL_HEAP_SIZE (128 * 1024)
+#define configRUN_TIME_COUNTER_TYPE uint64_t
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef void *TaskHandle_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,4 @@
+#ifndef _BSP_BOARD_H_
+#define _BSP_BOARD_H_
+
+#endif
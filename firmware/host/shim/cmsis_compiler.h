@@ -0,0 +1,12 @@
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#define __ASM __asm
+#define __STATIC_INLINE static inline
+#define __STATIC_FORCEINLINE static inline __attribute__((always_inline))
+#define __WEAK __attribute__((weak))
+#define __NO_RETURN __attribute__((__noreturn__))
+#define __PACKED __attribute__((packed))
+#define __NOP() __ASM volatile("nop")
+
+#endif /* __CMSIS_COMPILER_H */
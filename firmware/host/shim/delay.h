@@ -0,0 +1,11 @@
+#ifndef __DELAY_H_
+#define __DELAY_H_
+
+#include "hal.h"
+
+/* Delay execution by a number of CPU cycles */
+static inline void __delay_cycles(unsigned int cycles) {
+  hal_advance_ns((uint64_t)cycles * 1000000000 / HAL_CLK_SYS_HZ);
+}
+
+#endif /* __DELAY_H_ */
@@ -0,0 +1,10 @@
+#ifndef _TUSB_USBD_PVT_H_
+#define _TUSB_USBD_PVT_H_
+
+#include <stdbool.h>
+
+typedef void (*osal_task_func_t)(void *param);
+
+void usbd_defer_func(osal_task_func_t func, void *param, bool in_isr);
+
+#endif
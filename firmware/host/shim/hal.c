@@ -0,0 +1,329 @@
+#include <string.h>
+
+#include <hardware/clocks.h>
+#include <hardware/flash.h>
+#include <hardware/irq.h>
+#include <hardware/regs/m0plus.h>
+#include <hardware/structs/iobank0.h>
+#include <hardware/structs/systick.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+
+#include "hal.h"
+
+/* Reload value of SysTick for a 1ms RTOS tick */
+#define SYSTICK_RELOAD (HAL_CLK_SYS_HZ / 1000 - 1)
+
+/* Raw GPIO interrupt handlers share the interrupt like on the RP2040 */
+#define HAL_MAX_GPIO_HANDLERS 4
+#define HAL_MAX_ALARMS 4
+
+typedef struct {
+  bool out;
+  bool latch;
+  bool input;
+} gpio_state_t;
+
+static gpio_state_t gpios[HAL_NUM_GPIOS];
+static irq_handler_t gpio_irq_handlers[HAL_MAX_GPIO_HANDLERS];
+static hal_gpio_listener_t gpio_listener;
+
+/* Raw edge events in intr, enables and status per core like on the RP2040 */
+static iobank0_hw_t iobank0;
+iobank0_hw_t *const io_bank0_hw = &iobank0;
+
+/* Core the code runs on and the NVIC enable of the GPIO interrupt per core */
+static unsigned int current_core;
+static bool gpio_irq_enabled[2];
+
+static uint64_t now_ns;
+
+static struct {
+  bool active;
+  uint64_t at_ns;
+  alarm_callback_t callback;
+  void *user_data;
+} alarms[HAL_MAX_ALARMS];
+
+/* Only core 0 runs the RTOS tick, the SysTick of core 1 is stopped */
+static systick_hw_t systicks[2];
+static uint64_t systick_cycles;
+
+uint8_t hal_flash[PICO_FLASH_SIZE_BYTES];
+
+static bool line_level(unsigned int pin) {
+  return gpios[pin].out ? gpios[pin].latch : gpios[pin].input;
+}
+
+static io_irq_ctrl_hw_t *irq_ctrl(unsigned int core) {
+  return (core == 0) ? &iobank0.proc0_irq_ctrl : &iobank0.proc1_irq_ctrl;
+}
+
+/* Derives the interrupt status of both cores from the raw events */
+static void update_ints(void) {
+  for (unsigned int core = 0; core < 2; core++) {
+    io_irq_ctrl_hw_t *ctrl = irq_ctrl(core);
+    for (unsigned int i = 0; i < 4; i++)
+      *(io_rw_32 *)&ctrl->ints[i] = iobank0.intr[i] & ctrl->inte[i];
+  }
+}
+
+/* Runs the raw GPIO handlers on every core whose interrupt is enabled and
+ * pending */
+static void raise_gpio_irq(void) {
+  unsigned int core_before = current_core;
+
+  update_ints();
+  for (unsigned int core = 0; core < 2; core++) {
+    io_irq_ctrl_hw_t *ctrl = irq_ctrl(core);
+    if (!gpio_irq_enabled[core] ||
+        !(ctrl->ints[0] | ctrl->ints[1] | ctrl->ints[2] | ctrl->ints[3]))
+      continue;
+    current_core = core;
+    for (unsigned int i = 0; i < HAL_MAX_GPIO_HANDLERS; i++) {
+      if (gpio_irq_handlers[i])
+        gpio_irq_handlers[i]();
+    }
+  }
+  current_core = core_before;
+}
+
+/* Applies a change to a pin and notifies the listener if its level changed */
+static void update(unsigned int pin, gpio_state_t next) {
+  bool before = line_level(pin);
+  gpios[pin] = next;
+  bool after = line_level(pin);
+
+  if (before == after)
+    return;
+
+  uint32_t event = after ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+  if (!gpios[pin].out) {
+    iobank0.intr[pin / 8] |= event << (4 * (pin % 8));
+    raise_gpio_irq();
+  }
+  if (gpio_listener)
+    gpio_listener(pin, after);
+}
+
+void hal_reset(void) {
+  memset(gpios, 0, sizeof(gpios));
+  memset(gpio_irq_handlers, 0, sizeof(gpio_irq_handlers));
+  memset(alarms, 0, sizeof(alarms));
+  memset(&iobank0, 0, sizeof(iobank0));
+  memset(gpio_irq_enabled, 0, sizeof(gpio_irq_enabled));
+  current_core = 0;
+  gpio_listener = NULL;
+  now_ns = 0;
+  memset(systicks, 0, sizeof(systicks));
+  systicks[0].csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS |
+                    M0PLUS_SYST_CSR_TICKINT_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+  systicks[0].rvr = SYSTICK_RELOAD;
+  systicks[0].cvr = SYSTICK_RELOAD;
+  systick_cycles = 0;
+  memset(hal_flash, 0xFF, sizeof(hal_flash));
+}
+
+void hal_set_gpio_listener(hal_gpio_listener_t listener) {
+  gpio_listener = listener;
+}
+
+void hal_gpio_drive(unsigned int pin, bool level) {
+  gpio_state_t next = gpios[pin];
+  next.input = level;
+  update(pin, next);
+}
+
+bool hal_gpio_level(unsigned int pin) { return line_level(pin); }
+
+void hal_set_core(unsigned int core) { current_core = core; }
+
+unsigned int get_core_num(void) { return current_core; }
+
+systick_hw_t *hal_systick(void) { return &systicks[current_core]; }
+
+uint64_t hal_time_ns(void) { return now_ns; }
+
+void hal_advance_ns(uint64_t ns) {
+  now_ns += ns;
+  uint64_t cycles = now_ns * (HAL_CLK_SYS_HZ / 1000000) / 1000;
+  uint64_t elapsed = cycles - systick_cycles;
+  for (unsigned int core = 0; core < 2; core++) {
+    systick_hw_t *st = &systicks[core];
+    uint64_t period = (uint64_t)st->rvr + 1;
+    if (st->csr & M0PLUS_SYST_CSR_ENABLE_BITS)
+      st->cvr = (st->cvr + period - elapsed % period) % period;
+  }
+  systick_cycles = cycles;
+
+  for (unsigned int i = 0; i < HAL_MAX_ALARMS; i++) {
+    if (alarms[i].active && (alarms[i].at_ns <= now_ns)) {
+      unsigned int core_before = current_core;
+
+      /* The default alarm pool belongs to core 0 */
+      alarms[i].active = false;
+      current_core = 0;
+      alarms[i].callback(i + 1, alarms[i].user_data);
+      current_core = core_before;
+    }
+  }
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past) {
+  (void)fire_if_past;
+  for (unsigned int i = 0; i < HAL_MAX_ALARMS; i++) {
+    if (alarms[i].active)
+      continue;
+    alarms[i].active = true;
+    alarms[i].at_ns = now_ns + us * 1000;
+    alarms[i].callback = callback;
+    alarms[i].user_data = user_data;
+    return i + 1;
+  }
+  return -1;
+}
+
+void gpio_init(unsigned int gpio) {
+  gpio_state_t next = gpios[gpio];
+  next.out = false;
+  next.latch = false;
+  update(gpio, next);
+}
+
+void gpio_put(unsigned int gpio, bool value) {
+  gpio_state_t next = gpios[gpio];
+  next.latch = value;
+  update(gpio, next);
+}
+
+bool gpio_get(unsigned int gpio) { return line_level(gpio); }
+
+void gpio_set_dir(unsigned int gpio, bool out) {
+  gpio_state_t next = gpios[gpio];
+  next.out = out;
+  update(gpio, next);
+}
+
+void gpio_set_pulls(unsigned int gpio, bool up, bool down) {
+  (void)down;
+  /* A pull-up is the only thing that drives an unconnected input */
+  if (up)
+    hal_gpio_drive(gpio, true);
+}
+
+void gpio_pull_up(unsigned int gpio) { gpio_set_pulls(gpio, true, false); }
+
+void gpio_disable_pulls(unsigned int gpio) { (void)gpio; }
+
+/* Like the SDK, acts on the enables of the calling core */
+void gpio_set_irq_enabled(unsigned int gpio, uint32_t events, bool enabled) {
+  io_rw_32 *inte = &irq_ctrl(current_core)->inte[gpio / 8];
+
+  if (enabled)
+    hw_set_bits(inte, events << (4 * (gpio % 8)));
+  else
+    hw_clear_bits(inte, events << (4 * (gpio % 8)));
+}
+
+/* Enabling an edge that is already pending does not raise the interrupt, the
+ * handlers only run on edges */
+void hw_set_bits(io_rw_32 *addr, uint32_t mask) {
+  *addr |= mask;
+  update_ints();
+}
+
+void hw_clear_bits(io_rw_32 *addr, uint32_t mask) {
+  *addr &= ~mask;
+  update_ints();
+}
+
+void gpio_add_raw_irq_handler_masked(uint32_t gpio_mask,
+                                     irq_handler_t handler) {
+  (void)gpio_mask;
+  for (unsigned int i = 0; i < HAL_MAX_GPIO_HANDLERS; i++) {
+    if (gpio_irq_handlers[i] == NULL) {
+      gpio_irq_handlers[i] = handler;
+      return;
+    }
+  }
+}
+
+void gpio_add_raw_irq_handler(unsigned int gpio, irq_handler_t handler) {
+  gpio_add_raw_irq_handler_masked(1u << gpio, handler);
+}
+
+/* Like the SDK, returns the status of the calling core */
+uint32_t gpio_get_irq_event_mask(unsigned int gpio) {
+  return (irq_ctrl(current_core)->ints[gpio / 8] >> (4 * (gpio % 8))) & 0xF;
+}
+
+void gpio_acknowledge_irq(unsigned int gpio, uint32_t events) {
+  iobank0.intr[gpio / 8] &= ~(events << (4 * (gpio % 8)));
+  update_ints();
+}
+
+void irq_set_enabled(unsigned int num, bool enabled) {
+  if (num == IO_IRQ_BANK0)
+    gpio_irq_enabled[current_core] = enabled;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+  (void)clk_index;
+  return HAL_CLK_SYS_HZ;
+}
+
+void sleep_us(uint64_t us) { hal_advance_ns(us * 1000); }
+
+void sleep_ms(uint32_t ms) { hal_advance_ns((uint64_t)ms * 1000000); }
+
+void busy_wait_us_32(uint32_t us) { hal_advance_ns((uint64_t)us * 1000); }
+
+/* Reading the timer takes a cycle, so polling loops always make progress */
+uint64_t time_us_64(void) {
+  hal_advance_ns(1000000000 / HAL_CLK_SYS_HZ);
+  return now_ns / 1000;
+}
+
+uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+
+void tight_loop_contents(void) {}
+
+uint32_t save_and_disable_interrupts(void) { return 0; }
+
+void restore_interrupts(uint32_t status) { (void)status; }
+
+unsigned int __get_current_exception(void) { return 0; }
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+  memset(&hal_flash[flash_offs], 0xFF, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data,
+                         size_t count) {
+  /* Programming can only clear bits */
+  for (size_t i = 0; i < count; i++)
+    hal_flash[flash_offs + i] &= data[i];
+}
+
+static spin_lock_t spin_locks[32];
+static unsigned int n_spin_locks;
+
+int spin_lock_claim_unused(bool required) {
+  (void)required;
+  return n_spin_locks++;
+}
+
+spin_lock_t *spin_lock_instance(unsigned int lock_num) {
+  return &spin_locks[lock_num];
+}
+
+uint32_t spin_lock_blocking(spin_lock_t *lock) {
+  *lock = 1;
+  return 0;
+}
+
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+  (void)saved_irq;
+  *lock = 0;
+}
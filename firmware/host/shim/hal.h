@@ -0,0 +1,60 @@
+#ifndef __HAL_H_
+#define __HAL_H_
+
+/*
+ * Host implementation of the parts of the Pico SDK, FreeRTOS and TinyUSB that
+ * the probe's core sources use. Time is virtual: it only advances with delays
+ * and sleeps, so that SBW timing is reproducible and independent of the host.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HAL_NUM_GPIOS 30
+#define HAL_CLK_SYS_HZ 125000000
+
+/* Called whenever the level of a GPIO changes */
+typedef void (*hal_gpio_listener_t)(unsigned int pin, bool level);
+
+/* Restores the power-on state of GPIOs, flash and the virtual clock */
+void hal_reset(void);
+
+void hal_set_gpio_listener(hal_gpio_listener_t listener);
+
+/**
+ * Sets the level that an external device drives onto a GPIO
+ *
+ * The level is returned by gpio_get() while the pin is an input and may fire
+ * the pin's edge interrupts.
+ */
+void hal_gpio_drive(unsigned int pin, bool level);
+
+/* Level of a GPIO as seen from outside the probe */
+bool hal_gpio_level(unsigned int pin);
+
+/**
+ * Sets the core that the following calls run on
+ *
+ * GPIO interrupt enables and the NVIC act on the calling core like on the
+ * RP2040. Interrupt handlers and alarms run on their own core.
+ */
+void hal_set_core(unsigned int core);
+
+uint64_t hal_time_ns(void);
+
+void hal_advance_ns(uint64_t ns);
+
+/**
+ * Makes the stream interface appear connected and collects the frames sent on
+ * it. A NULL buffer disconnects it again.
+ *
+ * @param buf destination of the frames
+ * @param size size of the buffer
+ * @param len receives the number of bytes collected
+ */
+void hal_stream_capture(uint8_t *buf, uint32_t size, uint32_t *len);
+
+/* Backing store of the probe's flash, mapped at XIP_BASE */
+extern uint8_t hal_flash[];
+
+#endif /* __HAL_H_ */
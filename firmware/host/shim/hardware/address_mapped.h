@@ -0,0 +1,14 @@
+#ifndef _HARDWARE_ADDRESS_MAPPED_H
+#define _HARDWARE_ADDRESS_MAPPED_H
+
+#include <stdint.h>
+
+typedef volatile uint32_t io_rw_32;
+typedef const volatile uint32_t io_ro_32;
+
+/* Atomic set and clear aliases. Writes to the GPIO interrupt enables update
+ * the interrupt status. */
+void hw_set_bits(io_rw_32 *addr, uint32_t mask);
+void hw_clear_bits(io_rw_32 *addr, uint32_t mask);
+
+#endif
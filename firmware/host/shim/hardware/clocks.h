@@ -0,0 +1,10 @@
+#ifndef _HARDWARE_CLOCKS_H
+#define _HARDWARE_CLOCKS_H
+
+#include <stdint.h>
+
+enum clock_index { clk_gpout0, clk_ref, clk_sys, clk_peri, clk_usb, clk_adc };
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _HARDWARE_GPIO_H
+#define _HARDWARE_GPIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GPIO_IN false
+#define GPIO_OUT true
+
+enum gpio_irq_level {
+  GPIO_IRQ_LEVEL_LOW = 0x1u,
+  GPIO_IRQ_LEVEL_HIGH = 0x2u,
+  GPIO_IRQ_EDGE_FALL = 0x4u,
+  GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+typedef void (*irq_handler_t)(void);
+
+void gpio_init(unsigned int gpio);
+void gpio_put(unsigned int gpio, bool value);
+bool gpio_get(unsigned int gpio);
+void gpio_set_dir(unsigned int gpio, bool out);
+void gpio_set_pulls(unsigned int gpio, bool up, bool down);
+void gpio_pull_up(unsigned int gpio);
+void gpio_disable_pulls(unsigned int gpio);
+void gpio_set_irq_enabled(unsigned int gpio, uint32_t events, bool enabled);
+void gpio_add_raw_irq_handler(unsigned int gpio, irq_handler_t handler);
+void gpio_add_raw_irq_handler_masked(uint32_t gpio_mask, irq_handler_t handler);
+uint32_t gpio_get_irq_event_mask(unsigned int gpio);
+void gpio_acknowledge_irq(unsigned int gpio, uint32_t events);
+
+#endif
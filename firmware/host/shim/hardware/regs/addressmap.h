@@ -0,0 +1,10 @@
+#ifndef _HARDWARE_REGS_ADDRESSMAP_H
+#define _HARDWARE_REGS_ADDRESSMAP_H
+
+#include "hal.h"
+
+#include <stdint.h>
+
+#define XIP_BASE ((uintptr_t)hal_flash)
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _HARDWARE_REGS_M0PLUS_H
+#define _HARDWARE_REGS_M0PLUS_H
+
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x00000001
+#define M0PLUS_SYST_CSR_TICKINT_BITS 0x00000002
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004
+#define M0PLUS_SYST_RVR_BITS 0x00ffffff
+
+#endif
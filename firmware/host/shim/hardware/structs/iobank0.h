@@ -0,0 +1,22 @@
+#ifndef _HARDWARE_STRUCTS_IOBANK0_H
+#define _HARDWARE_STRUCTS_IOBANK0_H
+
+#include "hardware/address_mapped.h"
+
+/* Four bits per GPIO, eight GPIOs per register */
+typedef struct {
+  io_rw_32 inte[4];
+  io_rw_32 intf[4];
+  io_ro_32 ints[4];
+} io_irq_ctrl_hw_t;
+
+/* Only the interrupt registers, every core has its own enables and status */
+typedef struct {
+  io_rw_32 intr[4];
+  io_irq_ctrl_hw_t proc0_irq_ctrl;
+  io_irq_ctrl_hw_t proc1_irq_ctrl;
+} iobank0_hw_t;
+
+extern iobank0_hw_t *const io_bank0_hw;
+
+#endif
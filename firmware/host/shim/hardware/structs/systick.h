@@ -0,0 +1,18 @@
+#ifndef _HARDWARE_STRUCTS_SYSTICK_H
+#define _HARDWARE_STRUCTS_SYSTICK_H
+
+#include <stdint.h>
+
+typedef struct {
+  volatile uint32_t csr;
+  volatile uint32_t rvr;
+  volatile uint32_t cvr;
+  volatile uint32_t calib;
+} systick_hw_t;
+
+/* Every core has its own SysTick, which counts down with the virtual clock
+ * while it is enabled */
+systick_hw_t *hal_systick(void);
+#define systick_hw (hal_systick())
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+typedef unsigned int uint;
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define __not_in_flash_func(x) x
+#define __time_critical_func(x) x
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us_32(uint32_t us);
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void tight_loop_contents(void);
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                           void *user_data, bool fire_if_past);
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+unsigned int __get_current_exception(void);
+unsigned int get_core_num(void);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Kernel, USB, SWD and UART bridge functions used by the core sources. The
+ * host build has neither a scheduler nor a USB device and no SWD target is
+ * attached.
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP.h"
+#include "FreeRTOS.h"
+#include "device/usbd_pvt.h"
+#include "task.h"
+#include "tusb.h"
+
+#include "cdc_uart.h"
+#include "hal.h"
+#include "probe_logic.h"
+#include "swd_transport.h"
+
+DAP_Data_t DAP_Data;
+
+uint8_t SWD_Transfer(uint32_t request, uint32_t *data) {
+  (void)request;
+  (void)data;
+  /* Nothing answers on the SWD lines */
+  return DAP_TRANSFER_ERROR;
+}
+
+void cdc_uart_get_stats(uart_stats_t *dst) {
+  /* The UART bridge is not part of the host build */
+  memset(dst, 0, sizeof(*dst));
+}
+
+void cdc_uart_replay(void) {}
+
+void cdc_uart_set_framed(bool enable) {}
+
+void cdc_uart_low_latency(bool enable) {}
+
+int logic_start(const logic_config_t *config) {
+  /* The logic analyzer needs the PIO and is not part of the host build */
+  return -1;
+}
+
+void logic_stop(void) {}
+
+void logic_get_status(logic_status_t *status) {
+  memset(status, 0, sizeof(*status));
+}
+
+void swd_transport_connect() {}
+
+void swd_transport_disconnect() {}
+
+void SWJ_Sequence(uint32_t count, const uint8_t *data) {
+  (void)data;
+  /* Two cycles per bit at the default clock */
+  hal_advance_ns((uint64_t)count * 1000);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay) {
+  sleep_ms(xTicksToDelay);
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray,
+                                 const UBaseType_t uxArraySize,
+                                 configRUN_TIME_COUNTER_TYPE *const pulTotalRunTime) {
+  (void)pxTaskStatusArray;
+  (void)uxArraySize;
+  if (pulTotalRunTime)
+    *pulTotalRunTime = time_us_64();
+  return 0;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                            BaseType_t *pxHigherPriorityTaskWoken) {
+  (void)xTaskToNotify;
+  *pxHigherPriorityTaskWoken = pdFALSE;
+}
+
+size_t xPortGetFreeHeapSize(void) { return configTOTAL_HEAP_SIZE; }
+
+void usbd_defer_func(osal_task_func_t func, void *param, bool in_isr) {
+  (void)in_isr;
+  func(param);
+}
+
+/* Frames sent on the stream interface while a test captures them */
+static uint8_t *capture_buf;
+static uint32_t capture_size;
+static uint32_t *capture_len;
+
+void hal_stream_capture(uint8_t *buf, uint32_t size, uint32_t *len) {
+  capture_buf = buf;
+  capture_size = size;
+  capture_len = len;
+  if (len)
+    *len = 0;
+}
+
+bool tud_vendor_n_mounted(uint8_t itf) {
+  (void)itf;
+  return capture_buf != NULL;
+}
+
+uint32_t tud_vendor_n_write_available(uint8_t itf) {
+  (void)itf;
+  return capture_buf ? capture_size - *capture_len : 0;
+}
+
+uint32_t tud_vendor_n_write(uint8_t itf, void const *buffer,
+                            uint32_t bufsize) {
+  (void)itf;
+  if (capture_buf == NULL)
+    return 0;
+  bufsize = MIN(bufsize, capture_size - *capture_len);
+  memcpy(&capture_buf[*capture_len], buffer, bufsize);
+  *capture_len += bufsize;
+  return bufsize;
+}
+
+uint32_t tud_vendor_n_write_flush(uint8_t itf) {
+  (void)itf;
+  return 0;
+}
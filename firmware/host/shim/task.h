@@ -0,0 +1,36 @@
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef enum {
+  eRunning = 0,
+  eReady,
+  eBlocked,
+  eSuspended,
+  eDeleted,
+  eInvalid
+} eTaskState;
+
+typedef struct xTASK_STATUS {
+  TaskHandle_t xHandle;
+  const char *pcTaskName;
+  UBaseType_t xTaskNumber;
+  eTaskState eCurrentState;
+  UBaseType_t uxCurrentPriority;
+  UBaseType_t uxBasePriority;
+  configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+  void *pxStackBase;
+  uint16_t usStackHighWaterMark;
+  UBaseType_t uxCoreAffinityMask;
+} TaskStatus_t;
+
+void vTaskDelay(const TickType_t xTicksToDelay);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray,
+                                 const UBaseType_t uxArraySize,
+                                 configRUN_TIME_COUNTER_TYPE *const pulTotalRunTime);
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                            BaseType_t *pxHigherPriorityTaskWoken);
+size_t xPortGetFreeHeapSize(void);
+
+#endif /* INC_TASK_H */
@@ -0,0 +1,20 @@
+#ifndef _TUSB_H_
+#define _TUSB_H_
+
+/* The host build has no USB device; all interfaces report not mounted */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OPT_MODE_DEVICE 0x0001
+#define OPT_OS_FREERTOS 2
+#define CFG_TUSB_MCU 0
+
+#include "tusb_config.h"
+
+bool tud_vendor_n_mounted(uint8_t itf);
+uint32_t tud_vendor_n_write_available(uint8_t itf);
+uint32_t tud_vendor_n_write(uint8_t itf, void const *buffer, uint32_t bufsize);
+uint32_t tud_vendor_n_write_flush(uint8_t itf);
+
+#endif
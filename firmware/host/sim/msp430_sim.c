@@ -0,0 +1,406 @@
+#include <string.h>
+
+#include "hal.h"
+#include "msp430_sim.h"
+#include "rioteeprobe_config.h"
+#include "sbw_jtag.h"
+
+/* Holding SBWTCK low for longer than this takes the device out of SBW mode */
+#define SBW_TIMEOUT_NS 7000
+
+/* Bits of the JTAG control signal register */
+#define CNTRL_RW 0x0001
+#define CNTRL_HALT_JTAG 0x0008
+#define CNTRL_TCE 0x0200
+#define CNTRL_TCE1 0x0400
+#define CNTRL_POR 0x0800
+
+/* Returned by the CNTRL_SIG_CAPTURE lock check of a protected device */
+#define LOCKED_CAPTURE 0x5555
+/* Vacant memory reads as 'JMP $' */
+#define VACANT_WORD 0x3FFF
+
+#define MEM_TOP 0x24000
+
+enum {
+  TAP_RESET,
+  TAP_IDLE,
+  TAP_SELECT_DR,
+  TAP_CAPTURE_DR,
+  TAP_SHIFT_DR,
+  TAP_EXIT1_DR,
+  TAP_PAUSE_DR,
+  TAP_EXIT2_DR,
+  TAP_UPDATE_DR,
+  TAP_SELECT_IR,
+  TAP_CAPTURE_IR,
+  TAP_SHIFT_IR,
+  TAP_EXIT1_IR,
+  TAP_PAUSE_IR,
+  TAP_EXIT2_IR,
+  TAP_UPDATE_IR,
+};
+
+/* Next TAP state for TMS=0 and TMS=1 */
+static const uint8_t tap_next[][2] = {
+    [TAP_RESET] = {TAP_IDLE, TAP_RESET},
+    [TAP_IDLE] = {TAP_IDLE, TAP_SELECT_DR},
+    [TAP_SELECT_DR] = {TAP_CAPTURE_DR, TAP_SELECT_IR},
+    [TAP_CAPTURE_DR] = {TAP_SHIFT_DR, TAP_EXIT1_DR},
+    [TAP_SHIFT_DR] = {TAP_SHIFT_DR, TAP_EXIT1_DR},
+    [TAP_EXIT1_DR] = {TAP_PAUSE_DR, TAP_UPDATE_DR},
+    [TAP_PAUSE_DR] = {TAP_PAUSE_DR, TAP_EXIT2_DR},
+    [TAP_EXIT2_DR] = {TAP_SHIFT_DR, TAP_UPDATE_DR},
+    [TAP_UPDATE_DR] = {TAP_IDLE, TAP_SELECT_DR},
+    [TAP_SELECT_IR] = {TAP_CAPTURE_IR, TAP_RESET},
+    [TAP_CAPTURE_IR] = {TAP_SHIFT_IR, TAP_EXIT1_IR},
+    [TAP_SHIFT_IR] = {TAP_SHIFT_IR, TAP_EXIT1_IR},
+    [TAP_EXIT1_IR] = {TAP_PAUSE_IR, TAP_UPDATE_IR},
+    [TAP_PAUSE_IR] = {TAP_PAUSE_IR, TAP_EXIT2_IR},
+    [TAP_EXIT2_IR] = {TAP_SHIFT_IR, TAP_UPDATE_IR},
+    [TAP_UPDATE_IR] = {TAP_IDLE, TAP_SELECT_DR},
+};
+
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+  bool writable;
+} mem_region_t;
+
+/* Memory map of the MSP430FR5962 */
+static const mem_region_t regions[] = {
+    /* Peripherals */
+    {0x00000, 0x01000, true},
+    /* Information FRAM */
+    {0x01800, 0x01A00, true},
+    /* Device descriptors */
+    {0x01A00, 0x01B00, false},
+    /* RAM */
+    {0x01C00, 0x02400, true},
+    /* Main FRAM */
+    {0x04400, MEM_TOP, true},
+};
+
+const msp430_sim_config_t msp430_sim_default_config = {
+    .jtag_id = JTAG_ID98,
+    .coreip_id = 0x0091,
+    .device_id_ptr = 0x01A04,
+    .locked = false,
+};
+
+static msp430_sim_config_t config;
+static msp430_sim_counters_t counters;
+
+static uint16_t mem[MEM_TOP / 2];
+
+/* SBW decoder */
+static struct {
+  bool active;
+  unsigned int slot;
+  uint64_t t_fall;
+  bool tms;
+  bool tdi;
+} sbw;
+
+/* JTAG TAP controller and CPU interface */
+static struct {
+  uint8_t state;
+  uint8_t ir;
+  uint32_t shift;
+  unsigned int len;
+  bool tclk;
+  uint16_t cntrl_sig;
+  uint32_t mab;
+  uint16_t mdb;
+  bool write_pending;
+  bool released;
+} tap;
+
+#define JMB_LOG_LEN 64
+
+static struct {
+  bool data_next;
+  unsigned int n_in;
+  uint16_t in[JMB_LOG_LEN];
+  /* Word written by the target until the probe reads it */
+  bool out_valid;
+  bool out_next;
+  uint16_t out;
+} jmb;
+
+static const mem_region_t *find_region(uint32_t addr) {
+  for (unsigned int i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+    if ((addr >= regions[i].start) && (addr < regions[i].end))
+      return &regions[i];
+  }
+  return NULL;
+}
+
+static uint16_t mem_read(uint32_t addr) {
+  addr &= 0xFFFFE;
+  counters.mem_reads++;
+  if (find_region(addr) == NULL) {
+    counters.vacant_accesses++;
+    return VACANT_WORD;
+  }
+  return mem[addr / 2];
+}
+
+static void mem_write(uint32_t addr, uint16_t data) {
+  addr &= 0xFFFFE;
+  counters.mem_writes++;
+  const mem_region_t *region = find_region(addr);
+  if (region == NULL) {
+    counters.vacant_accesses++;
+    return;
+  }
+  if (region->writable)
+    mem[addr / 2] = data;
+}
+
+/*
+ * The probe's tap_shift() reassembles the bits of a 20-bit scan in a different
+ * order, so the device shifts out the lower 16 bits first.
+ */
+static uint32_t scramble20(uint32_t value) {
+  return ((value & 0xFFFF) << 4) | ((value >> 16) & 0xF);
+}
+
+static void load(uint32_t value, unsigned int len) {
+  tap.shift = value;
+  tap.len = len;
+}
+
+static void capture_dr(void) {
+  switch (tap.ir) {
+  case IR_CNTRL_SIG_16BIT:
+  case IR_CNTRL_SIG_CAPTURE:
+    if (config.locked) {
+      load(LOCKED_CAPTURE, 16);
+    } else {
+      /* The CPU is synchronized with JTAG as soon as TCE1 is set */
+      uint16_t tce = (tap.cntrl_sig & CNTRL_TCE1) ? CNTRL_TCE : 0;
+      load(tap.cntrl_sig | tce, 16);
+    }
+    break;
+  case IR_ADDR_16BIT:
+  case IR_ADDR_CAPTURE:
+    load(scramble20(tap.mab), 20);
+    break;
+  case IR_DATA_TO_ADDR:
+    load((tap.cntrl_sig & CNTRL_RW) ? mem_read(tap.mab) : tap.mdb, 16);
+    break;
+  case IR_DATA_16BIT:
+  case IR_DATA_QUICK:
+  case IR_DATA_CAPTURE:
+    load(tap.mdb, 16);
+    break;
+  case IR_COREIP_ID:
+    load(config.coreip_id, 16);
+    break;
+  case IR_DEVICE_ID:
+    load(scramble20(config.device_id_ptr), 20);
+    break;
+  case IR_JMB_EXCHANGE:
+    /* The device is always ready to receive */
+    if (jmb.out_next)
+      load(jmb.out, 16);
+    else
+      load(IN0RDY | (jmb.out_valid ? OUT1RDY : 0), 16);
+    break;
+  default:
+    load(0, 1);
+  }
+}
+
+static void update_dr(void) {
+  uint16_t word = tap.shift & 0xFFFF;
+
+  counters.dr_scans++;
+  switch (tap.ir) {
+  case IR_CNTRL_SIG_16BIT:
+    if ((word & CNTRL_POR) && !(tap.cntrl_sig & CNTRL_POR))
+      counters.por_resets++;
+    tap.cntrl_sig = word;
+    tap.released = false;
+    break;
+  case IR_ADDR_16BIT:
+    tap.mab = tap.shift & 0xFFFFF;
+    break;
+  case IR_DATA_TO_ADDR:
+    tap.mdb = word;
+    /* The word is written with the next falling edge of TCLK */
+    if (!(tap.cntrl_sig & CNTRL_RW))
+      tap.write_pending = true;
+    break;
+  case IR_DATA_16BIT:
+  case IR_DATA_QUICK:
+    tap.mdb = word;
+    break;
+  case IR_JMB_EXCHANGE:
+    if (jmb.out_next) {
+      jmb.out_next = false;
+      jmb.out_valid = false;
+    } else if (jmb.data_next) {
+      if (jmb.n_in < JMB_LOG_LEN)
+        jmb.in[jmb.n_in] = word;
+      jmb.n_in++;
+      jmb.data_next = false;
+    } else if ((word & OUTREQ) && jmb.out_valid) {
+      jmb.out_next = true;
+    } else if (word & INREQ) {
+      jmb.data_next = true;
+    }
+    break;
+  }
+}
+
+static void update_ir(void) {
+  counters.ir_scans++;
+  tap.ir = tap.shift & 0xFF;
+  if (tap.ir == IR_CNTRL_SIG_RELEASE)
+    tap.released = true;
+}
+
+static void set_tclk(bool tclk) {
+  if (tap.tclk && !tclk) {
+    counters.tclk_cycles++;
+    if (tap.write_pending) {
+      mem_write(tap.mab, tap.mdb);
+      tap.write_pending = false;
+    }
+  }
+  tap.tclk = tclk;
+}
+
+/* Bit that the device drives in the TDO slot of the current JTAG cycle */
+static bool tap_tdo(void) {
+  if ((tap.state == TAP_SHIFT_DR) || (tap.state == TAP_SHIFT_IR))
+    return (tap.shift >> (tap.len - 1)) & 1;
+  return true;
+}
+
+static void tap_clock(bool tms, bool tdi) {
+  counters.jtag_clocks++;
+
+  switch (tap.state) {
+  case TAP_RESET:
+    tap.ir = IR_BYPASS;
+    break;
+  case TAP_IDLE:
+    /* In Run-Test/Idle, TDI drives the CPU clock */
+    set_tclk(tdi);
+    break;
+  case TAP_CAPTURE_DR:
+    capture_dr();
+    break;
+  case TAP_CAPTURE_IR:
+    load(config.jtag_id, 8);
+    break;
+  case TAP_SHIFT_DR:
+  case TAP_SHIFT_IR:
+    tap.shift = ((tap.shift << 1) | tdi) & ((1u << tap.len) - 1);
+    break;
+  case TAP_UPDATE_DR:
+    update_dr();
+    break;
+  case TAP_UPDATE_IR:
+    update_ir();
+    break;
+  }
+  tap.state = tap_next[tap.state][tms];
+}
+
+static bool powered(void) {
+  return hal_gpio_level(PROBE_PIN_TARGET_POWER) &&
+         hal_gpio_level(PROBE_PIN_TRANS_PROG_EN);
+}
+
+static void on_gpio(unsigned int pin, bool level) {
+  if ((pin != PROBE_PIN_SBWCLK) || !powered())
+    return;
+
+  if (!level) {
+    sbw.t_fall = hal_time_ns();
+    if (!sbw.active)
+      return;
+    /* Inputs are sampled and TDO is driven while SBWTCK is low */
+    if (sbw.slot == 0) {
+      sbw.tms = hal_gpio_level(PROBE_PIN_SBWIO);
+    } else if (sbw.slot == 1) {
+      sbw.tdi = hal_gpio_level(PROBE_PIN_SBWIO);
+    } else {
+      hal_gpio_drive(PROBE_PIN_SBWIO, tap_tdo());
+    }
+    return;
+  }
+
+  if (hal_time_ns() - sbw.t_fall >= SBW_TIMEOUT_NS) {
+    if (sbw.active)
+      counters.sbw_timeouts++;
+    sbw.active = false;
+    return;
+  }
+  if (!sbw.active) {
+    /* A short SBWTCK pulse with RST/SBWTDIO high enters SBW mode */
+    if (hal_gpio_level(PROBE_PIN_SBWIO)) {
+      sbw.active = true;
+      sbw.slot = 0;
+      counters.sbw_entries++;
+    }
+    return;
+  }
+
+  counters.slots++;
+  if (sbw.slot == 2)
+    tap_clock(sbw.tms, sbw.tdi);
+  sbw.slot = (sbw.slot + 1) % 3;
+}
+
+void msp430_sim_init(const msp430_sim_config_t *cfg) {
+  config = cfg ? *cfg : msp430_sim_default_config;
+
+  memset(&counters, 0, sizeof(counters));
+  memset(&sbw, 0, sizeof(sbw));
+  memset(&tap, 0, sizeof(tap));
+  memset(&jmb, 0, sizeof(jmb));
+  tap.state = TAP_RESET;
+  tap.ir = IR_BYPASS;
+
+  /* Erased FRAM and uninitialized RAM read as all ones */
+  memset(mem, 0xFF, sizeof(mem));
+
+  hal_set_gpio_listener(on_gpio);
+}
+
+void msp430_sim_get_counters(msp430_sim_counters_t *dst) { *dst = counters; }
+
+void msp430_sim_clear_counters(void) { memset(&counters, 0, sizeof(counters)); }
+
+uint16_t msp430_sim_peek(uint32_t addr) {
+  if (find_region(addr & 0xFFFFE) == NULL)
+    return VACANT_WORD;
+  return mem[(addr & 0xFFFFE) / 2];
+}
+
+void msp430_sim_poke(uint32_t addr, uint16_t data) {
+  if (find_region(addr & 0xFFFFE) != NULL)
+    mem[(addr & 0xFFFFE) / 2] = data;
+}
+
+bool msp430_sim_halted(void) {
+  return !tap.released && (tap.cntrl_sig & CNTRL_HALT_JTAG);
+}
+
+bool msp430_sim_released(void) { return tap.released; }
+
+void msp430_sim_jmb_out(uint16_t word) {
+  jmb.out = word;
+  jmb.out_valid = true;
+}
+
+unsigned int msp430_sim_jmb_in(uint16_t *dst, unsigned int index) {
+  if ((index < jmb.n_in) && (index < JMB_LOG_LEN))
+    *dst = jmb.in[index];
+  return jmb.n_in;
+}
@@ -0,0 +1,76 @@
+#ifndef __MSP430_SIM_H_
+#define __MSP430_SIM_H_
+
+/*
+ * Software model of an MSP430FR5962 attached to the probe's SBW pins. It
+ * decodes SBW slots from the pin activity, runs the JTAG TAP controller and
+ * implements the JTAG instructions from sbw_jtag.h on top of a model of the
+ * device's memory.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  /* Returned by every IR scan */
+  uint8_t jtag_id;
+  uint16_t coreip_id;
+  uint32_t device_id_ptr;
+  /* Device is protected by a JTAG lock key */
+  bool locked;
+} msp430_sim_config_t;
+
+typedef struct {
+  uint64_t slots;
+  uint64_t jtag_clocks;
+  uint64_t ir_scans;
+  uint64_t dr_scans;
+  uint64_t tclk_cycles;
+  uint64_t mem_reads;
+  uint64_t mem_writes;
+  /* Accesses to addresses without memory */
+  uint64_t vacant_accesses;
+  uint32_t sbw_entries;
+  /* Number of times SBWTCK was held low for longer than the SBW timeout */
+  uint32_t sbw_timeouts;
+  uint32_t por_resets;
+} msp430_sim_counters_t;
+
+/* Configuration of an FR5962 as found on the Riotee module */
+extern const msp430_sim_config_t msp430_sim_default_config;
+
+/**
+ * Powers up the simulated device and attaches it to the probe's pins
+ *
+ * Must be called after hal_reset(). The device only responds while the probe
+ * enables target power and the programming level translators.
+ *
+ * @param config device configuration, NULL selects the default configuration
+ */
+void msp430_sim_init(const msp430_sim_config_t *config);
+
+void msp430_sim_get_counters(msp430_sim_counters_t *dst);
+void msp430_sim_clear_counters(void);
+
+/* Accesses memory without going through JTAG */
+uint16_t msp430_sim_peek(uint32_t addr);
+void msp430_sim_poke(uint32_t addr, uint16_t data);
+
+/* Returns true while the CPU is halted by the JTAG_HALT signal */
+bool msp430_sim_halted(void);
+
+/* Returns true if the CPU was released from JTAG control */
+bool msp430_sim_released(void);
+
+/**
+ * Retrieves a word that the probe wrote to the JTAG mailbox
+ *
+ * @returns number of words received so far, the word is only stored if index
+ * is smaller than that
+ */
+unsigned int msp430_sim_jmb_in(uint16_t *dst, unsigned int index);
+
+/* Writes a word to the JTAG mailbox from the target's side */
+void msp430_sim_jmb_out(uint16_t word);
+
+#endif /* __MSP430_SIM_H_ */
@@ -0,0 +1,47 @@
+#include <pico/stdlib.h>
+
+#include "DAP.h"
+#include "DAP_config.h"
+#include "hal.h"
+#include "probe_boot.h"
+#include "probe_events.h"
+#include "probe_stats.h"
+#include "probe_stream.h"
+#include "probe_trigger.h"
+#include "rioteeprobe_config.h"
+#include "sbw_device.h"
+#include "sim_board.h"
+
+static void init_output(unsigned int pin) {
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_OUT);
+}
+
+void sim_board_init(const msp430_sim_config_t *config) {
+  hal_reset();
+  msp430_sim_init(config);
+
+  init_output(PROBE_PIN_LED);
+  init_output(PROBE_PIN_TARGET_POWER);
+  init_output(PROBE_PIN_TRANS_PROG_EN);
+  init_output(PROBE_PIN_PROG_DIR);
+
+  sbw_pins_t pins = {.sbw_tck = PROBE_PIN_SBWCLK,
+                     .sbw_tdio = PROBE_PIN_SBWIO,
+                     .sbw_dir = PROBE_PIN_PROG_DIR};
+  sbw_dev_setup(&pins);
+
+  stream_init();
+  stats_init();
+  events_init();
+  trigger_init(NULL);
+  boot_init(NULL);
+}
+
+uint8_t sim_board_vendor(const uint8_t *request, uint8_t *response) {
+  /* The DAP task is pinned to core 1, initialization runs on core 0 */
+  hal_set_core(1);
+  DAP_ProcessVendorCommand(request, response);
+  hal_set_core(0);
+  return response[1];
+}
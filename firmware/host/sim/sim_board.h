@@ -0,0 +1,30 @@
+#ifndef __SIM_BOARD_H_
+#define __SIM_BOARD_H_
+
+/*
+ * Brings the probe's core up on the host the way main.c does on the RP2040,
+ * with a simulated MSP430 attached to the SBW pins.
+ */
+
+#include <stdint.h>
+
+#include "msp430_sim.h"
+
+/**
+ * Resets the host HAL and the simulated target and initializes the probe
+ *
+ * @param config target configuration, NULL selects the default configuration
+ */
+void sim_board_init(const msp430_sim_config_t *config);
+
+/**
+ * Processes a vendor command like the DAP task does for a USB request
+ *
+ * @param request request buffer of DAP_PACKET_SIZE bytes
+ * @param response response buffer of DAP_PACKET_SIZE bytes
+ *
+ * @returns return code of the response
+ */
+uint8_t sim_board_vendor(const uint8_t *request, uint8_t *response);
+
+#endif /* __SIM_BOARD_H_ */
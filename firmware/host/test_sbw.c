@@ -0,0 +1,878 @@
+/*
+ * Regression tests of the SBW stack and the vendor commands against the
+ * simulated MSP430.
+ */
+
+#include <hardware/regs/m0plus.h>
+#include <hardware/structs/iobank0.h>
+#include <hardware/structs/systick.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DAP.h"
+#include "DAP_config.h"
+#include "cdc_uart.h"
+#include "hal.h"
+#include "msp430_sim.h"
+#include "probe_bench.h"
+#include "probe_boot.h"
+#include "probe_bulk.h"
+#include "probe_events.h"
+#include "probe_image.h"
+#include "probe_sequence.h"
+#include "probe_stream.h"
+#include "probe_trigger.h"
+#include "probe_vendor.h"
+#include "sbw_device.h"
+#include "sbw_jtag.h"
+#include "sim_board.h"
+#include "uart_history.h"
+
+#define ID_DAP_VENDOR_VERSION ID_DAP_Vendor0
+#define ID_DAP_VENDOR_SBW_CONNECT ID_DAP_Vendor2
+#define ID_DAP_VENDOR_SBW_DISCONNECT ID_DAP_Vendor3
+#define ID_DAP_VENDOR_SBW_RESET ID_DAP_Vendor4
+#define ID_DAP_VENDOR_SBW_HALT ID_DAP_Vendor5
+#define ID_DAP_VENDOR_SBW_RESUME ID_DAP_Vendor6
+#define ID_DAP_VENDOR_SBW_READ ID_DAP_Vendor7
+#define ID_DAP_VENDOR_SBW_WRITE ID_DAP_Vendor8
+#define ID_DAP_VENDOR_BATCH ID_DAP_Vendor12
+#define ID_DAP_VENDOR_BULK ID_DAP_Vendor14
+#define ID_DAP_VENDOR_TAGGED ID_DAP_Vendor15
+#define ID_DAP_VENDOR_CAPS ID_DAP_Vendor16
+#define ID_DAP_VENDOR_STREAM ID_DAP_Vendor17
+#define ID_DAP_VENDOR_BENCH ID_DAP_Vendor20
+#define ID_DAP_VENDOR_BOOTLOADER ID_DAP_Vendor22
+#define ID_DAP_VENDOR_TIME ID_DAP_Vendor23
+#define ID_DAP_VENDOR_UART ID_DAP_Vendor24
+#define ID_DAP_VENDOR_TRIGGER ID_DAP_Vendor25
+#define ID_DAP_VENDOR_EVENTS ID_DAP_Vendor26
+#define ID_DAP_VENDOR_BOOT ID_DAP_Vendor27
+
+#define FRAM_START 0x4400
+#define RAM_START 0x1C00
+#define WDTCTL 0x01CC
+
+static int n_failed;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      n_failed++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static uint8_t request[DAP_PACKET_SIZE];
+static uint8_t response[DAP_PACKET_SIZE];
+
+static uint8_t vendor(uint8_t id) {
+  request[0] = id;
+  return sim_board_vendor(request, response);
+}
+
+static uint8_t vendor_rw(uint8_t id, uint32_t addr, uint8_t n_words) {
+  memcpy(&request[1], &addr, sizeof(addr));
+  request[5] = n_words;
+  return vendor(id);
+}
+
+static uint32_t crc32(const uint8_t *data, uint32_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (unsigned int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static void test_connect(void) {
+  msp430_sim_counters_t cnt;
+
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+  msp430_sim_get_counters(&cnt);
+  CHECK(cnt.sbw_entries == 1);
+  CHECK(cnt.sbw_timeouts == 0);
+  CHECK(cnt.por_resets == 1);
+  /* The reset holds the watchdog */
+  CHECK(msp430_sim_peek(WDTCTL) == 0x5A80);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+}
+
+static void test_connect_unpowered(void) {
+  sim_board_init(NULL);
+  /* The target only answers while the probe enables power and translators */
+  CHECK(sbw_dev_connect() != SBW_ERR_NONE);
+}
+
+static void test_connect_locked(void) {
+  msp430_sim_config_t config = msp430_sim_default_config;
+
+  config.locked = true;
+  sim_board_init(&config);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_ERROR);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+}
+
+static void test_write_read(void) {
+  const uint16_t words[] = {0x1234, 0xABCD, 0x0000, 0xFFFF, 0x5A5A};
+  uint16_t readback[5];
+
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+
+  memcpy(&request[6], words, sizeof(words));
+  CHECK(vendor_rw(ID_DAP_VENDOR_SBW_WRITE, FRAM_START, 5) == DAP_OK);
+  for (unsigned int i = 0; i < 5; i++)
+    CHECK(msp430_sim_peek(FRAM_START + 2 * i) == words[i]);
+
+  CHECK(vendor_rw(ID_DAP_VENDOR_SBW_READ, FRAM_START, 5) == DAP_OK);
+  memcpy(readback, &response[2], sizeof(readback));
+  CHECK(memcmp(readback, words, sizeof(words)) == 0);
+
+  /* Maximum number of words in one response */
+  for (unsigned int i = 0; i < 31; i++)
+    msp430_sim_poke(RAM_START + 2 * i, 0x100 + i);
+  CHECK(vendor_rw(ID_DAP_VENDOR_SBW_READ, RAM_START, 31) == DAP_OK);
+  for (unsigned int i = 0; i < 31; i++)
+    CHECK(response[2 + 2 * i] == (uint8_t)i);
+  CHECK(vendor_rw(ID_DAP_VENDOR_SBW_READ, RAM_START, 32) == DAP_ERROR);
+
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+}
+
+static void test_vacant_memory(void) {
+  uint16_t word = 0x1234;
+
+  sim_board_init(NULL);
+  programming_enable();
+  CHECK(sbw_dev_connect() == SBW_ERR_NONE);
+  CHECK(sbw_dev_mem_write(0x2800, &word, 1) == SBW_ERR_NONE);
+  CHECK(sbw_dev_mem_read(&word, 0x2800, 1) == SBW_ERR_NONE);
+  CHECK(word == 0x3FFF);
+  sbw_dev_disconnect();
+  programming_disable();
+}
+
+static void test_reset_halt_resume(void) {
+  msp430_sim_counters_t cnt;
+
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+
+  msp430_sim_poke(WDTCTL, 0);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_RESET) == DAP_OK);
+  msp430_sim_get_counters(&cnt);
+  CHECK(cnt.por_resets == 2);
+  CHECK(msp430_sim_peek(WDTCTL) == 0x5A80);
+
+  CHECK(vendor(ID_DAP_VENDOR_SBW_HALT) == DAP_OK);
+  CHECK(msp430_sim_halted());
+  CHECK(vendor(ID_DAP_VENDOR_SBW_RESUME) == DAP_OK);
+  CHECK(!msp430_sim_halted());
+  CHECK(msp430_sim_released());
+
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+}
+
+static void test_device_id(void) {
+  uint16_t coreip_id, device_id_ptr;
+
+  sim_board_init(NULL);
+  programming_enable();
+  CHECK(sbw_dev_connect() == SBW_ERR_NONE);
+  CHECK(sbw_dev_get_coreip_id(&coreip_id) == SBW_ERR_NONE);
+  CHECK(coreip_id == msp430_sim_default_config.coreip_id);
+  CHECK(sbw_dev_get_device_id(&device_id_ptr) == SBW_ERR_NONE);
+  CHECK(device_id_ptr == msp430_sim_default_config.device_id_ptr);
+  sbw_dev_disconnect();
+  programming_disable();
+}
+
+static void test_mailbox(void) {
+  uint16_t word = 0;
+
+  sim_board_init(NULL);
+  programming_enable();
+  CHECK(sbw_dev_connect() == SBW_ERR_NONE);
+  CHECK(sbw_jtag_write_jmb_in16(0xBEEF) == SBW_ERR_NONE);
+  CHECK(msp430_sim_jmb_in(&word, 0) == 1);
+  CHECK(word == 0xBEEF);
+  sbw_dev_disconnect();
+  programming_disable();
+}
+
+static void test_version(void) {
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_VERSION) == DAP_OK);
+  CHECK((response[2] >= '0') && (response[2] <= '9'));
+}
+
+static void test_time(void) {
+  uint64_t t_first, t_second;
+
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_TIME) == DAP_OK);
+  memcpy(&t_first, &response[2], sizeof(t_first));
+  sleep_ms(5);
+  CHECK(vendor(ID_DAP_VENDOR_TIME) == DAP_OK);
+  memcpy(&t_second, &response[2], sizeof(t_second));
+  CHECK(t_second - t_first >= 5000);
+  CHECK(t_second - t_first < 6000);
+}
+
+static void test_batch(void) {
+  /* Five times fill the response up to 53 bytes, the version needs 7 */
+  static const uint8_t ops[] = {
+      ID_DAP_VENDOR_TIME, ID_DAP_VENDOR_TIME,    ID_DAP_VENDOR_TIME,
+      ID_DAP_VENDOR_TIME, ID_DAP_VENDOR_TIME,    ID_DAP_VENDOR_VERSION,
+      ID_DAP_VENDOR_TIME, ID_DAP_VENDOR_TIME};
+  const uint16_t words[] = {0x1234, 0xABCD};
+  uint32_t addr = FRAM_START + 0x200;
+
+  sim_board_init(NULL);
+  request[1] = sizeof(ops);
+  memcpy(&request[2], ops, sizeof(ops));
+  CHECK(vendor(ID_DAP_VENDOR_BATCH) == DAP_ERROR);
+  /* The time that ran without room for its response counts as failed */
+  CHECK(response[2] == 7);
+  CHECK((response[3 + 5 * 10] == ID_DAP_VENDOR_VERSION) &&
+        (response[4 + 5 * 10] == DAP_OK));
+  CHECK((response[60] == ID_DAP_VENDOR_TIME) && (response[61] == DAP_ERROR));
+
+  /* Batch and tagged requests do not nest */
+  request[1] = 2;
+  request[2] = ID_DAP_VENDOR_TIME;
+  request[3] = ID_DAP_VENDOR_TAGGED;
+  request[4] = 0x42;
+  request[5] = ID_DAP_VENDOR_TIME;
+  CHECK(vendor(ID_DAP_VENDOR_BATCH) == DAP_ERROR);
+  CHECK(response[2] == 1);
+
+  request[1] = 0x42;
+  request[2] = ID_DAP_VENDOR_BATCH;
+  request[3] = 1;
+  request[4] = ID_DAP_VENDOR_TIME;
+  CHECK((vendor(ID_DAP_VENDOR_TAGGED) == 0x42) &&
+        (response[2] == ID_DAP_VENDOR_BATCH) && (response[3] == DAP_ERROR));
+  request[2] = ID_DAP_VENDOR_TIME;
+  CHECK((vendor(ID_DAP_VENDOR_TAGGED) == 0x42) && (response[3] == DAP_OK));
+
+  /* Nor does the USB echo, it returns a full packet */
+  memset(&request[1], 0, DAP_PACKET_SIZE - 1);
+  request[1] = 1;
+  request[2] = ID_DAP_VENDOR_BENCH;
+  request[3] = BENCH_USB_ECHO;
+  CHECK((vendor(ID_DAP_VENDOR_BATCH) == DAP_ERROR) && (response[2] == 0));
+  request[1] = 0x42;
+  CHECK((vendor(ID_DAP_VENDOR_TAGGED) == 0x42) && (response[3] == DAP_ERROR));
+
+  /* Operations start at odd offsets, here the write data at request + 9 */
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+  request[1] = 2;
+  request[2] = ID_DAP_VENDOR_TIME;
+  request[3] = ID_DAP_VENDOR_SBW_WRITE;
+  memcpy(&request[4], &addr, sizeof(addr));
+  request[8] = 2;
+  memcpy(&request[9], words, sizeof(words));
+  CHECK((vendor(ID_DAP_VENDOR_BATCH) == DAP_OK) && (response[2] == 2));
+  for (unsigned int i = 0; i < 2; i++)
+    CHECK(msp430_sim_peek(addr + 2 * i) == words[i]);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+}
+
+static void test_sequence(void) {
+  static const uint8_t delay[] = {SEQ_OP_DELAY_US, 0x00, 0xCA, 0x9A, 0x3B};
+  static const uint8_t power[] = {SEQ_OP_POWER, 2};
+  /* The header has GPIOs 0 to 3 at most */
+  static const uint8_t gpio[] = {SEQ_OP_GPIO_GET, 4};
+  uint64_t t_start;
+  uint16_t pc;
+
+  sim_board_init(NULL);
+  /* A delay of 1000s ends with the timeout */
+  CHECK(seq_load(0, delay, sizeof(delay)) == 0);
+  t_start = hal_time_ns();
+  CHECK(seq_run(1000, &pc) == SEQ_RC_ERR_TIMEOUT);
+  CHECK(hal_time_ns() - t_start < 2000000);
+
+  CHECK(seq_load(0, power, sizeof(power)) == 0);
+  CHECK(seq_run(1000, &pc) == SEQ_RC_ERR_OPERAND);
+  CHECK(seq_load(0, gpio, sizeof(gpio)) == 0);
+  CHECK(seq_run(1000, &pc) == SEQ_RC_ERR_OPERAND);
+}
+
+static void test_bench(void) {
+  uint32_t n_iter = 10, arg = 0;
+  bench_result_t result;
+
+  sim_board_init(NULL);
+  /* The DAP task runs on core 1, where the RTOS leaves SysTick stopped */
+  request[1] = BENCH_SBW_SLOT;
+  memcpy(&request[2], &n_iter, sizeof(n_iter));
+  memcpy(&request[6], &arg, sizeof(arg));
+  CHECK(vendor(ID_DAP_VENDOR_BENCH) == DAP_OK);
+  memcpy(&result, &response[2], sizeof(result));
+  CHECK((result.n_iter == n_iter) && (result.min_cycles > 0));
+  /* Slots are shorter than 20us, so they are timed with SysTick */
+  CHECK(result.max_cycles < 20 * (HAL_CLK_SYS_HZ / 1000000));
+  hal_set_core(1);
+  CHECK(!(systick_hw->csr & M0PLUS_SYST_CSR_ENABLE_BITS));
+  hal_set_core(0);
+}
+
+static uint8_t enable_mask(uint8_t id, uint8_t cmd, uint32_t mask) {
+  request[1] = cmd;
+  memcpy(&request[2], &mask, sizeof(mask));
+  return vendor(id);
+}
+
+static void test_stream_stall(void) {
+  static uint8_t frames[4 * STREAM_FRAME_SIZE];
+  uint32_t len, n_frames = 1000;
+  uint64_t t_start;
+
+  /* The host reads four frames, then stops */
+  sim_board_init(NULL);
+  hal_stream_capture(frames, sizeof(frames), &len);
+  CHECK(enable_mask(ID_DAP_VENDOR_STREAM, STREAM_CMD_ENABLE,
+                    1 << STREAM_ID_TEST) == DAP_OK);
+  request[1] = STREAM_CMD_TEST;
+  memcpy(&request[2], &n_frames, sizeof(n_frames));
+  t_start = hal_time_ns();
+  CHECK(vendor(ID_DAP_VENDOR_STREAM) == DAP_ERROR);
+  CHECK(hal_time_ns() - t_start < 2ULL * STREAM_STALL_MS * 1000000);
+  CHECK(len == sizeof(frames));
+
+  CHECK(enable_mask(ID_DAP_VENDOR_STREAM, STREAM_CMD_ENABLE, 0) == DAP_OK);
+  hal_stream_capture(NULL, 0, NULL);
+  /* Discards the frames left in the ring */
+  stream_pump();
+}
+
+static void test_uart_history(void) {
+  static uint8_t data[UART_HISTORY_SIZE + 100];
+  uint8_t chunk[64];
+  uint32_t pos = 0, lost;
+
+  for (unsigned int i = 0; i < sizeof(data); i++)
+    data[i] = i * 7;
+
+  sim_board_init(NULL);
+  uart_history_init();
+  CHECK(uart_history_read(&pos, chunk, sizeof(chunk), &lost) == 0);
+
+  /* A loss is reported together with the first byte after it */
+  uart_history_write(data, 10);
+  uart_history_mark_loss(3);
+  CHECK(uart_history_read(&pos, chunk, sizeof(chunk), &lost) == 10);
+  CHECK((lost == 0) && (pos == 10));
+  CHECK(uart_history_read(&pos, chunk, sizeof(chunk), &lost) == 0);
+  uart_history_write(&data[10], 5);
+  CHECK(uart_history_read(&pos, chunk, sizeof(chunk), &lost) == 5);
+  CHECK((lost == 3) && (memcmp(chunk, &data[10], 5) == 0));
+
+  /* Bytes overwritten before they were read count as lost */
+  uart_history_write(&data[15], sizeof(data) - 15);
+  pos = 0;
+  CHECK(uart_history_read(&pos, chunk, sizeof(chunk), &lost) == sizeof(chunk));
+  CHECK(lost == 100);
+  CHECK(memcmp(chunk, &data[100], sizeof(chunk)) == 0);
+
+  /* Through the vendor command */
+  request[1] = UART_CMD_HISTORY_INFO;
+  CHECK(vendor(ID_DAP_VENDOR_UART) == DAP_OK);
+  uart_history_info_t info;
+  memcpy(&info, &response[2], sizeof(info));
+  CHECK(info.head == sizeof(data));
+  CHECK(info.oldest == 100);
+  CHECK(info.lost == 3);
+
+  request[1] = UART_CMD_HISTORY_READ;
+  pos = info.head - 20;
+  memcpy(&request[2], &pos, sizeof(pos));
+  CHECK(vendor(ID_DAP_VENDOR_UART) == DAP_OK);
+  memcpy(&pos, &response[2], sizeof(pos));
+  memcpy(&lost, &response[6], sizeof(lost));
+  CHECK((pos == info.head - 20) && (lost == 0));
+  CHECK(memcmp(&response[10], &data[sizeof(data) - 20], 20) == 0);
+}
+
+static void test_uart_stamps(void) {
+  uint8_t data[100], chunk[64];
+  uint32_t pos = 0, lost;
+  uart_stamp_t stamp;
+
+  memset(data, 'x', sizeof(data));
+  uart_history_init();
+
+  /* Two bursts, the second one ends up in a single read */
+  uart_history_mark_time(1000);
+  uart_history_write(data, 30);
+  uart_history_mark_time(5000);
+  uart_history_write(data, 70);
+
+  CHECK(uart_history_read_stamped(&pos, chunk, sizeof(chunk), &lost,
+                                  &stamp) == 30);
+  CHECK((stamp.pos == 0) && (stamp.time_us == 1000));
+  CHECK(uart_history_read_stamped(&pos, chunk, sizeof(chunk), &lost,
+                                  &stamp) == sizeof(chunk));
+  CHECK((stamp.pos == 30) && (stamp.time_us == 5000));
+  /* Continuing within a burst returns the stamp of its start */
+  CHECK(uart_history_read_stamped(&pos, chunk, sizeof(chunk), &lost,
+                                  &stamp) == 6);
+  CHECK((stamp.pos == 30) && (pos == 100));
+
+  /* Plain reads ignore stamps */
+  pos = 0;
+  CHECK(uart_history_read(&pos, chunk, sizeof(chunk), &lost) == 64);
+
+  /* Bytes older than all remembered stamps get the oldest one */
+  for (unsigned int i = 0; i < UART_HISTORY_MAX_STAMPS; i++) {
+    uart_history_mark_time(10000 + i);
+    uart_history_write(data, 1);
+  }
+  pos = 0;
+  CHECK(uart_history_read_stamped(&pos, chunk, sizeof(chunk), &lost,
+                                  &stamp) == sizeof(chunk));
+  CHECK((stamp.pos == 100) && (stamp.time_us == 10000));
+  pos = 99;
+  CHECK(uart_history_read_stamped(&pos, chunk, sizeof(chunk), &lost,
+                                  &stamp) == 1);
+}
+
+static uint8_t arm(uint8_t slot, const trigger_rule_t *rule) {
+  request[1] = TRIGGER_CMD_ARM;
+  request[2] = slot;
+  memcpy(&request[3], rule, sizeof(*rule));
+  return vendor(ID_DAP_VENDOR_TRIGGER);
+}
+
+static trigger_status_t trigger_status(uint8_t slot) {
+  trigger_status_t status;
+
+  request[1] = TRIGGER_CMD_STATUS;
+  request[2] = slot;
+  CHECK(vendor(ID_DAP_VENDOR_TRIGGER) == DAP_OK);
+  memcpy(&status, &response[2], sizeof(status));
+  return status;
+}
+
+static void test_trigger(void) {
+  const char *text = "xxOK\r\n";
+  trigger_rule_t rule;
+  trigger_status_t status;
+
+  sim_board_init(NULL);
+
+  /* A UART pattern records the reception time of its last byte */
+  memset(&rule, 0, sizeof(rule));
+  rule.source = TRIGGER_SRC_UART;
+  rule.action = TRIGGER_ACT_TIMESTAMP;
+  rule.pattern_len = 4;
+  memcpy(rule.pattern, "OK\r\n", 4);
+  CHECK(arm(0, &rule) == DAP_OK);
+  for (unsigned int i = 0; i < strlen(text); i++)
+    trigger_uart_byte(text[i], 100 + i);
+  status = trigger_status(0);
+  CHECK((status.n_fired == 1) && (status.event_us == 105));
+  CHECK(!status.armed);
+
+  /* A rising edge cuts the power */
+  rule.source = TRIGGER_SRC_GPIO_RISE;
+  rule.src_pin = 1;
+  rule.action = TRIGGER_ACT_POWER_OFF;
+  /* Boards without header GPIOs only trigger on the UART */
+  if (probe_gpio_pin(1) < 0) {
+    CHECK(arm(1, &rule) == DAP_ERROR);
+    return;
+  }
+  CHECK(arm(1, &rule) == DAP_OK);
+  /* Armed from the DAP task on core 1, the edge is enabled for core 0, which
+   * handles the interrupt */
+  for (unsigned int i = 0; i < 4; i++)
+    CHECK(io_bank0_hw->proc1_irq_ctrl.inte[i] == 0);
+  target_power_enable();
+  CHECK(gpio_get(PROBE_PIN_TARGET_POWER));
+  hal_gpio_drive(probe_gpio_pin(1), true);
+  CHECK(!gpio_get(PROBE_PIN_TARGET_POWER));
+  CHECK(trigger_status(1).n_fired == 1);
+  /* The host restores power */
+  target_power_enable();
+  CHECK(gpio_get(PROBE_PIN_TARGET_POWER));
+
+  /* Every 'A' pulses GPIO2 for 50us */
+  rule.source = TRIGGER_SRC_UART;
+  rule.action = TRIGGER_ACT_GPIO_PULSE;
+  rule.act_pin = 2;
+  rule.pulse_us = 50;
+  rule.flags = TRIGGER_FLAG_REPEAT;
+  rule.pattern_len = 1;
+  rule.pattern[0] = 'A';
+  CHECK(arm(2, &rule) == DAP_OK);
+  for (unsigned int i = 0; i < 2; i++) {
+    trigger_uart_byte('A', time_us_32());
+    CHECK(hal_gpio_level(probe_gpio_pin(2)));
+    hal_advance_ns(60000);
+    CHECK(!hal_gpio_level(probe_gpio_pin(2)));
+  }
+  status = trigger_status(2);
+  CHECK((status.n_fired == 2) && status.armed && (status.result == 0));
+
+  /* The halt waits for the DAP task */
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_RESUME) == DAP_OK);
+  hal_gpio_drive(probe_gpio_pin(3), true);
+  rule.source = TRIGGER_SRC_GPIO_FALL;
+  rule.src_pin = 3;
+  rule.action = TRIGGER_ACT_SBW_HALT;
+  rule.flags = 0;
+  CHECK(arm(3, &rule) == DAP_OK);
+  hal_gpio_drive(probe_gpio_pin(3), false);
+  CHECK(!msp430_sim_halted());
+  trigger_run_deferred();
+  CHECK(msp430_sim_halted());
+  status = trigger_status(3);
+  CHECK((status.n_fired == 1) && (status.result == 0));
+  CHECK(status.max_latency_us == status.action_us - status.event_us);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+
+  /* Falling edges of GPIO0 belong to the image store */
+  rule.src_pin = 0;
+  CHECK(arm(0, &rule) == DAP_ERROR);
+  request[1] = TRIGGER_CMD_DISARM;
+  request[2] = 2;
+  CHECK(vendor(ID_DAP_VENDOR_TRIGGER) == DAP_OK);
+  CHECK(!trigger_status(2).armed);
+}
+
+static void test_events(void) {
+  static uint8_t frames[16 * STREAM_FRAME_SIZE];
+  static const struct {
+    uint8_t type, arg;
+    uint16_t value;
+  } timeline[] = {
+      {EVENT_POWER, EVENT_CAUSE_STATE, 0},
+#ifdef PROBE_PIN_BYPASS_ENABLE
+      {EVENT_BYPASS, EVENT_CAUSE_STATE, 0},
+#endif
+      /* GPIO0 belongs to the image store */
+      {EVENT_GPIO, 1, 0},
+      {EVENT_GPIO, 2, 0},
+      {EVENT_GPIO, 3, 0},
+      {EVENT_POWER, EVENT_CAUSE_COMMAND, 1},
+      {EVENT_GPIO, 1, 1},
+      {EVENT_UART, 4, 2},
+      {EVENT_SBW, EVENT_SBW_CONNECT, SBW_ERR_NONE},
+      {EVENT_SBW, EVENT_SBW_HALT, SBW_ERR_NONE},
+      {EVENT_SBW, EVENT_SBW_DISCONNECT, SBW_ERR_NONE},
+  };
+  const bool has_gpios = probe_gpio_pin(1) >= 0;
+  struct {
+    uint8_t type, arg;
+    uint16_t value;
+  } expected[sizeof(timeline) / sizeof(timeline[0])];
+  unsigned int n_expected = 0;
+  uint32_t len, sent, n = 0, prev_us = 0;
+  event_status_t status;
+
+  /* Boards without header GPIOs record no GPIO events */
+  for (unsigned int i = 0; i < sizeof(timeline) / sizeof(timeline[0]); i++) {
+    if (has_gpios || (timeline[i].type != EVENT_GPIO))
+      memcpy(&expected[n_expected++], &timeline[i], sizeof(expected[0]));
+  }
+
+  sim_board_init(NULL);
+  hal_stream_capture(frames, sizeof(frames), &len);
+  CHECK(enable_mask(ID_DAP_VENDOR_STREAM, STREAM_CMD_ENABLE,
+                    1 << STREAM_ID_EVENT) == DAP_OK);
+  CHECK(enable_mask(ID_DAP_VENDOR_EVENTS, EVENT_CMD_ENABLE, 0xFFFFFFFF) ==
+        DAP_OK);
+
+  target_power_enable();
+  hal_advance_ns(1000);
+  if (has_gpios)
+    hal_gpio_drive(probe_gpio_pin(1), true);
+  event_uart((const uint8_t *)"boot", 4, time_us_32(), 2);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_HALT) == DAP_OK);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+  /* The last records wait for an alarm */
+  sent = len;
+  hal_advance_ns(EVENT_FLUSH_US * 1000ULL);
+  CHECK((len > sent) && (len % STREAM_FRAME_SIZE == 0));
+
+  for (uint8_t *frame = frames; frame < frames + len;
+       frame += STREAM_FRAME_SIZE) {
+    stream_hdr_t hdr;
+    memcpy(&hdr, frame, sizeof(hdr));
+    CHECK((hdr.stream_id == STREAM_ID_EVENT) && (hdr.dropped == 0));
+
+    for (uint8_t *p = frame + sizeof(hdr); p < frame + sizeof(hdr) + hdr.len;
+         n++) {
+      event_t ev;
+      memcpy(&ev, p, sizeof(ev));
+      p += sizeof(ev) + ((ev.type == EVENT_UART) ? ev.arg : 0);
+      if (n >= n_expected)
+        continue;
+      CHECK((ev.type == expected[n].type) && (ev.arg == expected[n].arg) &&
+            (ev.value == expected[n].value));
+      CHECK(ev.time_us >= prev_us);
+      prev_us = ev.time_us;
+      if (ev.type == EVENT_UART)
+        CHECK(memcmp(p - ev.arg, "boot", 4) == 0);
+    }
+  }
+  CHECK(n == n_expected);
+
+  request[1] = EVENT_CMD_STATUS;
+  CHECK(vendor(ID_DAP_VENDOR_EVENTS) == DAP_OK);
+  memcpy(&status, &response[2], sizeof(status));
+  CHECK((status.recorded == n_expected) && (status.dropped == 0));
+
+  CHECK(enable_mask(ID_DAP_VENDOR_EVENTS, EVENT_CMD_ENABLE, 0) == DAP_OK);
+  CHECK(enable_mask(ID_DAP_VENDOR_STREAM, STREAM_CMD_ENABLE, 0) == DAP_OK);
+  hal_stream_capture(NULL, 0, NULL);
+}
+
+static uint8_t boot_start_cmd(const boot_config_t *config) {
+  request[1] = BOOT_CMD_START;
+  memcpy(&request[2], config, sizeof(*config));
+  return vendor(ID_DAP_VENDOR_BOOT);
+}
+
+static boot_status_t boot_status(void) {
+  boot_status_t status;
+
+  request[1] = BOOT_CMD_STATUS;
+  CHECK(vendor(ID_DAP_VENDOR_BOOT) == DAP_OK);
+  memcpy(&status, &response[2], sizeof(status));
+  return status;
+}
+
+static void test_boot(void) {
+  boot_config_t config = {.n_cycles = 2,
+                          .wait = BOOT_WAIT_UART | BOOT_WAIT_GPIO |
+                                  BOOT_WAIT_MAILBOX,
+                          .gpio_pin = 1,
+                          .gpio_rising = 1,
+                          .off_us = 20000,
+                          .timeout_us = 100000};
+  boot_cycle_t cycles[2];
+  boot_status_t status;
+  uint16_t index = 0;
+
+  sim_board_init(NULL);
+  config.n_cycles = 0;
+  CHECK(boot_start_cmd(&config) == DAP_ERROR);
+  config.n_cycles = 2;
+  config.gpio_pin = 0;
+  CHECK(boot_start_cmd(&config) == DAP_ERROR);
+  config.gpio_pin = 1;
+  /* Boards without header GPIOs wait for the UART and the mailbox only */
+  if (probe_gpio_pin(config.gpio_pin) < 0) {
+    CHECK(boot_start_cmd(&config) == DAP_ERROR);
+    config.wait &= ~BOOT_WAIT_GPIO;
+  }
+
+  CHECK(boot_start_cmd(&config) == DAP_OK);
+  CHECK(boot_start_cmd(&config) == DAP_ERROR);
+  CHECK(!hal_gpio_level(PROBE_PIN_TARGET_POWER));
+  hal_advance_ns(config.off_us * 1000ULL);
+  CHECK(hal_gpio_level(PROBE_PIN_TARGET_POWER));
+
+  /* First cycle reaches all milestones */
+  hal_advance_ns(500000);
+  boot_uart_rx(time_us_32() - 100);
+  if (config.wait & BOOT_WAIT_GPIO)
+    hal_gpio_drive(probe_gpio_pin(config.gpio_pin), true);
+  msp430_sim_jmb_out(0x1234);
+  boot_run_deferred();
+  CHECK(!hal_gpio_level(PROBE_PIN_TARGET_POWER));
+  status = boot_status();
+  CHECK(status.running && (status.n_cycles == 2) && (status.n_done == 1));
+
+  /* Second cycle times out while polling the mailbox */
+  hal_advance_ns(config.off_us * 1000ULL);
+  CHECK(hal_gpio_level(PROBE_PIN_TARGET_POWER));
+  boot_run_deferred();
+  status = boot_status();
+  CHECK(!status.running && (status.n_done == 2));
+  CHECK(!hal_gpio_level(PROBE_PIN_TARGET_POWER));
+
+  request[1] = BOOT_CMD_READ;
+  memcpy(&request[2], &index, sizeof(index));
+  CHECK(vendor(ID_DAP_VENDOR_BOOT) == DAP_OK);
+  CHECK(response[2] == 2);
+  memcpy(cycles, &response[3], sizeof(cycles));
+  CHECK(cycles[0].uart_us == 400);
+  CHECK(cycles[0].gpio_us ==
+        ((config.wait & BOOT_WAIT_GPIO) ? 500 : BOOT_NOT_SEEN));
+  CHECK((cycles[0].mailbox_us > 500) && (cycles[0].mailbox_word == 0x1234));
+  CHECK((cycles[1].uart_us == BOOT_NOT_SEEN) &&
+        (cycles[1].gpio_us == BOOT_NOT_SEEN) &&
+        (cycles[1].mailbox_us == BOOT_NOT_SEEN));
+
+  /* Stopping restores power */
+  target_power_enable();
+  config.wait = BOOT_WAIT_UART;
+  CHECK(boot_start_cmd(&config) == DAP_OK);
+  CHECK(!hal_gpio_level(PROBE_PIN_TARGET_POWER));
+  request[1] = BOOT_CMD_STOP;
+  CHECK(vendor(ID_DAP_VENDOR_BOOT) == DAP_OK);
+  CHECK(!boot_status().running);
+  CHECK(hal_gpio_level(PROBE_PIN_TARGET_POWER));
+  target_power_disable();
+}
+
+static void test_bootloader(void) {
+  probe_caps_t caps;
+
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_CAPS) == DAP_OK);
+  memcpy(&caps, &response[2], sizeof(caps));
+  CHECK(caps.features & PROBE_FEATURE_BOOTLOADER);
+
+  /* The reboot itself is left to the DAP task */
+  CHECK(!bootloader_requested());
+  CHECK(vendor(ID_DAP_VENDOR_BOOTLOADER) == DAP_OK);
+  CHECK(bootloader_requested());
+}
+
+/* Expands the tokens of a compressed bulk read, returns the number of words */
+static unsigned int rle_decode(uint16_t *dst, const uint8_t *src,
+                               unsigned int len) {
+  unsigned int n_words = 0;
+
+  for (unsigned int i = 0; i < len;) {
+    if (src[i] & BULK_RLE_RUN) {
+      unsigned int run = (((src[i] & 0x7F) << 8) | src[i + 1]) + 1;
+      for (unsigned int k = 0; k < run; k++)
+        memcpy(&dst[n_words++], &src[i + 2], 2);
+      i += 4;
+    } else {
+      unsigned int n = src[i] + 1;
+      memcpy(&dst[n_words], &src[i + 1], 2 * n);
+      n_words += n;
+      i += 1 + 2 * n;
+    }
+  }
+  return n_words;
+}
+
+static void test_bulk_rle(void) {
+  static uint16_t decoded[4096];
+  uint32_t n_words = 3000;
+  uint32_t addr = FRAM_START;
+  unsigned int n_pkts = 0, n_words_rx = 0;
+
+  sim_board_init(NULL);
+  CHECK(vendor(ID_DAP_VENDOR_SBW_CONNECT) == DAP_OK);
+  /* Erased FRAM with a counter, a short run and a long run of zeros */
+  for (unsigned int i = 0; i < 200; i++)
+    msp430_sim_poke(addr + 2 * (100 + i), i);
+  for (unsigned int i = 0; i < 2; i++)
+    msp430_sim_poke(addr + 2 * (400 + i), 0xABCD);
+  for (unsigned int i = 0; i < 1500; i++)
+    msp430_sim_poke(addr + 2 * (1000 + i), 0);
+
+  request[1] = BULK_CMD_READ;
+  request[2] = BULK_FLAG_RLE;
+  memcpy(&request[3], &addr, sizeof(addr));
+  memcpy(&request[7], &n_words, sizeof(n_words));
+  CHECK(vendor(ID_DAP_VENDOR_BULK) == DAP_OK);
+
+  while ((n_words_rx < n_words) && (n_pkts < 200)) {
+    request[1] = BULK_CMD_DATA;
+    if (vendor(ID_DAP_VENDOR_BULK) != DAP_OK)
+      break;
+    CHECK(response[2] <= DAP_PACKET_SIZE - 3);
+    n_words_rx += rle_decode(&decoded[n_words_rx], &response[3], response[2]);
+    n_pkts++;
+  }
+  CHECK(n_words_rx == n_words);
+  for (unsigned int i = 0; i < n_words; i++)
+    CHECK(decoded[i] == msp430_sim_peek(addr + 2 * i));
+  /* The counter dominates, raw reads would need 97 packets */
+  CHECK(n_pkts < 20);
+
+  request[1] = BULK_CMD_STATUS;
+  CHECK(vendor(ID_DAP_VENDOR_BULK) == DAP_OK);
+  CHECK(response[2] == BULK_STATE_DONE);
+  request[1] = BULK_CMD_DATA;
+  CHECK(vendor(ID_DAP_VENDOR_BULK) == DAP_ERROR);
+
+  /* nRF52 reads take whole 32-bit words */
+  request[1] = BULK_CMD_READ;
+  request[2] = BULK_FLAG_RLE | BULK_FLAG_NRF52;
+  n_words = 3;
+  memcpy(&request[7], &n_words, sizeof(n_words));
+  CHECK(vendor(ID_DAP_VENDOR_BULK) == DAP_ERROR);
+
+  CHECK(vendor(ID_DAP_VENDOR_SBW_DISCONNECT) == DAP_OK);
+}
+
+static void test_image(void) {
+  const uint16_t words[] = {0x4031, 0x2400, 0x3FFF, 0xC0DE};
+  uint8_t records[sizeof(image_record_t) + sizeof(words)];
+  image_record_t rec = {.addr = FRAM_START + 0x100, .len = sizeof(words)};
+  char name[IMAGE_NAME_LEN] = "test";
+  image_result_t result;
+
+  memcpy(records, &rec, sizeof(rec));
+  memcpy(records + sizeof(rec), words, sizeof(words));
+
+  sim_board_init(NULL);
+  CHECK(image_begin(0, IMAGE_TARGET_MSP430, sizeof(records), name) == 0);
+  CHECK(image_data(records, sizeof(records)) == 0);
+  CHECK(image_commit(crc32(records, sizeof(records)), false) == 0);
+  CHECK(image_run(1 << 0) == 0);
+
+  image_get_result(&result);
+  CHECK(result.result == IMAGE_RESULT_PASS);
+  for (unsigned int i = 0; i < 4; i++)
+    CHECK(msp430_sim_peek(rec.addr + 2 * i) == words[i]);
+  CHECK(msp430_sim_released());
+  CHECK(image_erase(0) == 0);
+}
+
+int main(void) {
+  static const struct {
+    const char *name;
+    void (*run)(void);
+  } tests[] = {
+      {"connect", test_connect},
+      {"connect_unpowered", test_connect_unpowered},
+      {"connect_locked", test_connect_locked},
+      {"write_read", test_write_read},
+      {"vacant_memory", test_vacant_memory},
+      {"reset_halt_resume", test_reset_halt_resume},
+      {"device_id", test_device_id},
+      {"mailbox", test_mailbox},
+      {"version", test_version},
+      {"time", test_time},
+      {"batch", test_batch},
+      {"sequence", test_sequence},
+      {"bench", test_bench},
+      {"stream_stall", test_stream_stall},
+      {"uart_history", test_uart_history},
+      {"uart_stamps", test_uart_stamps},
+      {"trigger", test_trigger},
+      {"events", test_events},
+      {"boot", test_boot},
+      {"bootloader", test_bootloader},
+      {"bulk_rle", test_bulk_rle},
+      {"image", test_image},
+  };
+
+  for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    int n_failed_before = n_failed;
+    tests[i].run();
+    printf("%-20s %s\n", tests[i].name,
+           (n_failed == n_failed_before) ? "ok" : "FAILED");
+  }
+  return (n_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#ifndef __PROBE_BENCH_H_
+#define __PROBE_BENCH_H_
+
+#include <stdint.h>
+
+/* Primitives that can be benchmarked */
+enum {
+  /* Loop overhead only */
+  BENCH_NOP,
+  /* A single SBW slot (TMS low, TDI high) */
+  BENCH_SBW_SLOT,
+  /* A 16-bit JTAG data register scan */
+  BENCH_TAP_DR_SHIFT16,
+  /* Reading one word from MSP430 memory at the given address */
+  BENCH_MEM_READ_WORD,
+  /* Writing one word to MSP430 memory at the given address */
+  BENCH_MEM_WRITE_WORD,
+  /* Reading the SWD DP IDCODE register */
+  BENCH_SWD_TRANSFER,
+  /* Returns the request without executing anything, timed by the host */
+  BENCH_USB_ECHO,
+};
+
+typedef struct __attribute__((packed)) {
+  /* Number of iterations executed */
+  uint32_t n_iter;
+  /* CPU cycles spent in all iterations */
+  uint64_t total_cycles;
+  /* CPU cycles spent in the fastest and slowest iteration */
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  /* CPU clock frequency in Hz */
+  uint32_t clk_hz;
+} bench_result_t;
+
+/**
+ * Runs a primitive repeatedly and measures the execution time
+ *
+ * The target must be connected for the SBW, memory and SWD primitives.
+ *
+ * @param result pointer to result
+ * @param primitive one of BENCH_*
+ * @param n_iter number of iterations
+ * @param arg address for the memory primitives
+ *
+ * @returns 0 on success, <0 if the primitive is unknown or failed
+ */
+int bench_run(bench_result_t *result, uint8_t primitive, uint32_t n_iter,
+              uint32_t arg);
+
+#endif /* __PROBE_BENCH_H_ */
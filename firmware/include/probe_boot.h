@@ -0,0 +1,105 @@
+#ifndef __PROBE_BOOT_H_
+#define __PROBE_BOOT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Boot latency measurement. The probe switches target power off and on
+ * repeatedly and records how long after each power-on the target reaches its
+ * milestones: the first UART byte, an edge on a header GPIO and a word in the
+ * MSP430's JTAG mailbox. Power is switched and UART bytes and edges are
+ * stamped in interrupts. The mailbox is polled over SBW by the task passed to
+ * boot_init(). The SBW entry sequence resets the MSP430 about 2ms after
+ * power-on, so cycles that wait for the mailbox boot twice. Releasing the SBW
+ * lines takes 15ms of the following off-time.
+ */
+#define BOOT_MAX_CYCLES 256
+
+/* Time of a milestone that was not reached before the timeout */
+#define BOOT_NOT_SEEN 0xFFFFFFFF
+
+/* Milestones, ORed together */
+enum {
+  BOOT_WAIT_UART = 0x01,
+  BOOT_WAIT_GPIO = 0x02,
+  BOOT_WAIT_MAILBOX = 0x04,
+};
+
+/* Sub-commands of the boot vendor command */
+enum { BOOT_CMD_START, BOOT_CMD_STOP, BOOT_CMD_STATUS, BOOT_CMD_READ };
+
+typedef struct __attribute__((packed)) {
+  uint16_t n_cycles;
+  /* BOOT_WAIT_* */
+  uint8_t wait;
+  /* Header GPIO number and edge, 1 for rising, 0 for falling */
+  uint8_t gpio_pin;
+  uint8_t gpio_rising;
+  /* Time without power before each cycle */
+  uint32_t off_us;
+  /* Time after power-on after which a cycle ends without its milestones */
+  uint32_t timeout_us;
+} boot_config_t;
+
+typedef struct __attribute__((packed)) {
+  /* Times from switching power on to the start bit of the first UART byte,
+   * to the GPIO interrupt and to reading the mailbox */
+  uint32_t uart_us;
+  uint32_t gpio_us;
+  uint32_t mailbox_us;
+  uint16_t mailbox_word;
+} boot_cycle_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t running;
+  uint16_t n_cycles;
+  /* Number of completed cycles */
+  uint16_t n_done;
+} boot_status_t;
+
+/**
+ * Prepares the measurement
+ *
+ * @param task task that polls the mailbox via boot_run_deferred()
+ */
+void boot_init(TaskHandle_t task);
+
+/**
+ * Starts a measurement with the first off-time. Only called from a task.
+ *
+ * @returns 0 on success, <0 if the configuration is invalid or a measurement
+ * is running
+ */
+int boot_start(const boot_config_t *config);
+
+/* Aborts a running measurement and restores the power state from before */
+void boot_stop(void);
+
+void boot_get_status(boot_status_t *status);
+
+/**
+ * Copies results of completed cycles
+ *
+ * @returns number of cycles copied
+ */
+unsigned int boot_read(boot_cycle_t *dst, unsigned int index, unsigned int n);
+
+/* Returns true while a cycle waits for the first UART byte */
+bool boot_uart_armed(void);
+
+/**
+ * Reports received UART bytes. Only called from the UART receive interrupt.
+ *
+ * @param first_us probe time at which the first byte started
+ */
+void boot_uart_rx(uint32_t first_us);
+
+/* Polls the mailbox and finishes measurements. Only called from the task
+ * passed to boot_init(). */
+void boot_run_deferred(void);
+
+#endif /* __PROBE_BOOT_H_ */
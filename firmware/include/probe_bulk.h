@@ -0,0 +1,120 @@
+#ifndef __PROBE_BULK_H_
+#define __PROBE_BULK_H_
+
+#include <stdint.h>
+
+/* Number of 16-bit words carried by one bulk data packet */
+#define BULK_WORDS_PER_PKT 31
+
+/* Sub-commands of the bulk vendor command */
+enum {
+  BULK_CMD_WRITE,
+  BULK_CMD_READ,
+  BULK_CMD_DATA,
+  BULK_CMD_STATUS,
+  BULK_CMD_ABORT
+};
+
+/* Number of 16-bit words fetched from the target at once by compressed reads */
+#define BULK_RLE_CHUNK_WORDS 30
+
+/* Maximum number of words that one compressed data packet covers */
+#define BULK_RLE_MAX_WORDS 1024
+
+enum {
+  BULK_FLAG_VERIFY = 0x01,
+  /* Run-length encode the data of a read */
+  BULK_FLAG_RLE = 0x02,
+  /* Read from an nRF52 through the probe's MEM-AP access, requires RLE */
+  BULK_FLAG_NRF52 = 0x04
+};
+
+/*
+ * Tokens of a compressed read, all values little endian:
+ *  0x00-0x7F: literal, followed by (header + 1) words
+ *  0x80-0xFF: run, followed by the low byte of the run length minus one
+ *             (upper 7 bits in the header) and the repeated word
+ */
+#define BULK_RLE_RUN 0x80
+#define BULK_RLE_LITERAL_MAX 128
+
+enum {
+  BULK_STATE_IDLE,
+  BULK_STATE_WRITE,
+  BULK_STATE_READ,
+  BULK_STATE_DONE,
+  BULK_STATE_ERROR
+};
+
+typedef struct __attribute__((packed)) {
+  uint8_t state;
+  /* Number of words not yet transferred */
+  uint32_t remaining;
+  /* Address at which an error occurred */
+  uint32_t err_addr;
+} bulk_status_t;
+
+/**
+ * Starts a streaming write to MSP430 memory
+ *
+ * @param addr address of first word
+ * @param n_words total number of words in the transfer
+ * @param flags BULK_FLAG_* options
+ */
+int bulk_start_write(uint32_t addr, uint32_t n_words, uint8_t flags);
+
+/**
+ * Starts a streaming read from target memory
+ *
+ * nRF52 reads connect to the target and release it when the transfer ends.
+ *
+ * @param addr address of first word
+ * @param n_words total number of 16-bit words in the transfer
+ * @param flags BULK_FLAG_* options
+ */
+int bulk_start_read(uint32_t addr, uint32_t n_words, uint8_t flags);
+
+/* Returns one of BULK_STATE_* */
+uint8_t bulk_state(void);
+
+/* Returns the BULK_FLAG_* options of the current transfer */
+uint8_t bulk_flags(void);
+
+/* Returns number of words expected in the next data packet */
+unsigned int bulk_next_words(void);
+
+/**
+ * Writes the next chunk of a streaming write
+ *
+ * @param data pointer to up to BULK_WORDS_PER_PKT words
+ *
+ * @returns 0 on success, <0 if this or any earlier chunk failed
+ */
+int bulk_write_data(const uint16_t *data);
+
+/**
+ * Reads the next chunk of a streaming read
+ *
+ * @param dst pointer to buffer for up to BULK_WORDS_PER_PKT words
+ *
+ * @returns number of words read or <0 on error
+ */
+int bulk_read_data(uint16_t *dst);
+
+/**
+ * Reads and run-length encodes the next part of a compressed read
+ *
+ * @param dst pointer to buffer for the tokens
+ * @param max_len size of the buffer in bytes
+ *
+ * @returns number of bytes written to dst or <0 on error
+ */
+int bulk_read_rle(uint8_t *dst, unsigned int max_len);
+
+/* Retrieves the status of the current transfer */
+void bulk_get_status(bulk_status_t *status);
+
+/* Stops the current transfer */
+void bulk_abort(void);
+
+#endif /* __PROBE_BULK_H_ */
@@ -0,0 +1,116 @@
+#ifndef __PROBE_EVENTS_H_
+#define __PROBE_EVENTS_H_
+
+#include <pico/stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Timeline of what happens at the target: UART output, edges on the header
+ * GPIOs, power and bypass switching and SBW debug operations. All records are
+ * stamped with the probe's microsecond clock and packed into frames of
+ * STREAM_ID_EVENT. Records appear in the order in which they were added, the
+ * time of UART data may lie before that of the preceding record.
+ */
+
+/* Longest time a record waits for more records to fill its frame */
+#define EVENT_FLUSH_US 2000
+
+/* Record types, each one can be enabled separately */
+enum {
+  /* Target UART output, arg is the number of data bytes following the record
+   * and value the number of bytes lost before them */
+  EVENT_UART,
+  /* arg is the header GPIO number and value the new level */
+  EVENT_GPIO,
+  /* arg is one of EVENT_CAUSE_* and value the new level */
+  EVENT_POWER,
+  /* arg is one of EVENT_CAUSE_* and value 1 if the bypass is enabled */
+  EVENT_BYPASS,
+  /* arg is one of EVENT_SBW_* and value the return code */
+  EVENT_SBW,
+  EVENT_TYPE_NUM
+};
+
+enum {
+  EVENT_SBW_CONNECT,
+  EVENT_SBW_DISCONNECT,
+  EVENT_SBW_HALT,
+  EVENT_SBW_RELEASE
+};
+
+enum {
+  /* State when the type was enabled */
+  EVENT_CAUSE_STATE,
+  EVENT_CAUSE_COMMAND,
+  EVENT_CAUSE_TRIGGER,
+  /* Boot latency measurement */
+  EVENT_CAUSE_BOOT
+};
+
+/* Sub-commands of the event vendor command */
+enum { EVENT_CMD_ENABLE, EVENT_CMD_STATUS };
+
+typedef struct __attribute__((packed)) {
+  /* Probe time in microseconds */
+  uint32_t time_us;
+  /* One of EVENT_* */
+  uint8_t type;
+  uint8_t arg;
+  uint16_t value;
+} event_t;
+
+/* Most data bytes of a UART record, such that it fits one frame */
+#define EVENT_DATA_MAX 48
+
+typedef struct __attribute__((packed)) {
+  /* Bitmask of enabled record types */
+  uint32_t enabled;
+  /* Number of records handed to the stream */
+  uint32_t recorded;
+  /* Number of records lost because the stream was full */
+  uint32_t dropped;
+} event_status_t;
+
+/* Bitmask of enabled record types */
+extern volatile uint32_t event_types;
+
+void event_add(uint8_t type, uint8_t arg, uint16_t value, uint32_t time_us,
+               const uint8_t *data, size_t len);
+
+/* Adds a record stamped with the current time if its type is enabled. Safe to
+ * call from tasks and interrupts. */
+static inline void event_record(uint8_t type, uint8_t arg, uint16_t value) {
+  if (event_types & (1UL << type))
+    event_add(type, arg, value, time_us_32(), NULL, 0);
+}
+
+/* Sets up the record buffer */
+void events_init(void);
+
+/**
+ * Enables the record types in a bitmask and disables all others. Newly enabled
+ * types start with a record of the current state where there is one.
+ *
+ * Records are only sent while STREAM_ID_EVENT is enabled as well.
+ */
+void events_enable(uint32_t mask);
+
+/**
+ * Adds a record of UART data. Only called from the UART receive interrupt.
+ *
+ * @param data received bytes
+ * @param len number of bytes, longer data is split into several records
+ * @param time_us probe time at which the first byte started
+ * @param lost number of bytes lost before the data
+ */
+void event_uart(const uint8_t *data, size_t len, uint32_t time_us,
+                uint32_t lost);
+
+/* Sends the partially filled frame */
+void events_flush(void);
+
+void events_get_status(event_status_t *status);
+
+#endif /* __PROBE_EVENTS_H_ */
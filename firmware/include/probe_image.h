@@ -0,0 +1,128 @@
+#ifndef __PROBE_IMAGE_H_
+#define __PROBE_IMAGE_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Images are stored in slots at the end of the probe's flash. The first sector
+ * of a slot holds the header, followed by a list of records, each consisting
+ * of an image_record_t and the data padded to a multiple of 4 bytes.
+ */
+#define IMAGE_N_SLOTS 4
+#define IMAGE_SLOT_SIZE (256 * 1024)
+
+#define IMAGE_NAME_LEN 16
+
+/* Sub-commands of the image vendor command */
+enum {
+  IMAGE_CMD_INFO,
+  IMAGE_CMD_BEGIN,
+  IMAGE_CMD_DATA,
+  IMAGE_CMD_COMMIT,
+  IMAGE_CMD_ERASE,
+  IMAGE_CMD_AUTORUN,
+  IMAGE_CMD_RUN,
+  IMAGE_CMD_RESULT,
+};
+
+enum { IMAGE_TARGET_MSP430, IMAGE_TARGET_NRF52 };
+
+/* Steps of programming an image, reported with a failure */
+enum {
+  IMAGE_STEP_NONE,
+  IMAGE_STEP_CHECK,
+  IMAGE_STEP_CONNECT,
+  IMAGE_STEP_ERASE,
+  IMAGE_STEP_WRITE,
+  IMAGE_STEP_VERIFY,
+};
+
+enum { IMAGE_RESULT_NONE, IMAGE_RESULT_PASS, IMAGE_RESULT_FAIL };
+
+typedef struct __attribute__((packed)) {
+  uint32_t addr;
+  /* Number of data bytes without padding */
+  uint32_t len;
+} image_record_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t valid;
+  uint8_t target;
+  uint8_t autorun;
+  char name[IMAGE_NAME_LEN];
+  /* Number of bytes in the record list */
+  uint32_t size;
+  /* CRC-32 of the record list */
+  uint32_t crc32;
+} image_info_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t result;
+  /* Slot, step and target address at which programming failed */
+  uint8_t slot;
+  uint8_t step;
+  uint32_t err_addr;
+  /* Time from trigger to result */
+  uint32_t cycle_us;
+  uint32_t n_pass;
+  uint32_t n_fail;
+} image_result_t;
+
+/**
+ * Sets up the trigger and result pins
+ *
+ * @param task task that runs triggered programming via image_run_triggered()
+ */
+void image_init(TaskHandle_t task);
+
+/* Retrieves information about a slot */
+int image_get_info(image_info_t *info, unsigned int slot);
+
+/**
+ * Invalidates a slot and starts uploading a new image to it
+ *
+ * @param slot slot number
+ * @param target one of IMAGE_TARGET_*
+ * @param size number of bytes in the record list
+ * @param name zero-padded name of the image
+ */
+int image_begin(unsigned int slot, uint8_t target, uint32_t size,
+                const char *name);
+
+/* Appends data to the image being uploaded */
+int image_data(const uint8_t *data, unsigned int len);
+
+/**
+ * Completes an upload after checking the CRC of the received records
+ *
+ * @param crc32 CRC-32 of the record list computed by the host
+ * @param autorun true if the image is programmed when triggered by GPIO
+ */
+int image_commit(uint32_t crc32, bool autorun);
+
+/* Invalidates a slot */
+int image_erase(unsigned int slot);
+
+/* Includes or excludes a slot from programming triggered by GPIO */
+int image_set_autorun(unsigned int slot, bool autorun);
+
+/**
+ * Programs the images in the given slots to the target(s) and verifies them
+ *
+ * @param slot_mask bitmap of slots, 0 selects all slots marked for autorun
+ *
+ * @returns 0 if all images were programmed successfully, <0 otherwise
+ */
+int image_run(uint8_t slot_mask);
+
+/* Runs the autorun slots if the trigger pin fired since the last call */
+void image_run_triggered(void);
+
+/* Retrieves the result of the last run */
+void image_get_result(image_result_t *result);
+
+#endif /* __PROBE_IMAGE_H_ */
@@ -0,0 +1,121 @@
+#ifndef __PROBE_LOGIC_H_
+#define __PROBE_LOGIC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Logic analyzer on the header GPIOs and the UART RX pin. A PIO state machine
+ * samples at up to a third of the system clock into a RAM ring while waiting
+ * for the trigger, so that samples from before the trigger are kept. Once the
+ * capture is complete, the samples are sent on STREAM_ID_LOGIC, one byte per
+ * sample or run-length encoded.
+ */
+#ifndef LOGIC_BUFFER_SIZE
+#define LOGIC_BUFFER_SIZE (8 * 1024)
+#endif
+
+/* The DMA ring wraps at most at 32kB */
+#if ((LOGIC_BUFFER_SIZE & (LOGIC_BUFFER_SIZE - 1)) != 0) ||                    \
+    (LOGIC_BUFFER_SIZE > 32768)
+#error "LOGIC_BUFFER_SIZE must be a power of two of at most 32768"
+#endif
+
+/* Every sample takes a full GPIO snapshot of 4 bytes */
+#define LOGIC_MAX_SAMPLES (LOGIC_BUFFER_SIZE / 4)
+
+/* PIO cycles per sample */
+#define LOGIC_CYCLES_PER_SAMPLE 3
+
+/* Channels 0 to 3 are the header GPIOs, always low on boards without them,
+ * channel 4 is the UART RX pin */
+#define LOGIC_N_CHANNELS 5
+
+/* An RLE record is a 16-bit word with the channel levels in the low bits and
+ * the number of samples minus one in the bits above them */
+#define LOGIC_RLE_RUN_MAX (1 << (16 - LOGIC_N_CHANNELS))
+
+/* Sub-commands of the logic analyzer vendor command */
+enum { LOGIC_CMD_START, LOGIC_CMD_STOP, LOGIC_CMD_STATUS };
+
+enum {
+  /* Capture right away */
+  LOGIC_TRIG_NONE,
+  LOGIC_TRIG_RISE,
+  LOGIC_TRIG_FALL
+};
+
+enum { LOGIC_ENC_RAW, LOGIC_ENC_RLE };
+
+enum {
+  LOGIC_STATE_IDLE,
+  /* Waiting for the trigger */
+  LOGIC_STATE_ARMED,
+  /* Sampling after the trigger */
+  LOGIC_STATE_TRIGGERED,
+  /* Complete, waiting for the task */
+  LOGIC_STATE_CAPTURED,
+  LOGIC_STATE_SENDING,
+  LOGIC_STATE_DONE,
+  /* Sending failed, the stream was disabled or the host stopped reading */
+  LOGIC_STATE_FAILED
+};
+
+typedef struct __attribute__((packed)) {
+  /* Requested rate, the closest one with an integer clock divider is used */
+  uint32_t rate_hz;
+  /* Samples before the trigger, fewer if the trigger comes early */
+  uint32_t n_pre;
+  /* Samples after the trigger, at least one */
+  uint32_t n_post;
+  /* LOGIC_TRIG_* and the channel it watches */
+  uint8_t trig_mode;
+  uint8_t trig_channel;
+  /* LOGIC_ENC_* */
+  uint8_t encoding;
+} logic_config_t;
+
+typedef struct __attribute__((packed)) {
+  /* LOGIC_STATE_* */
+  uint8_t state;
+  /* Rate actually used */
+  uint32_t rate_hz;
+  /* Probe time at which the trigger was seen */
+  uint32_t trigger_us;
+  /* Samples sent before the one at which the trigger was seen */
+  uint32_t n_pre;
+  /* Total samples sent */
+  uint32_t n_samples;
+  /* Frames queued on the stream */
+  uint32_t n_frames;
+} logic_status_t;
+
+/**
+ * Claims the PIO state machine and DMA channel
+ *
+ * @param task task that sends the capture via logic_run_deferred()
+ */
+void logic_init(TaskHandle_t task);
+
+/**
+ * Starts a capture. STREAM_ID_LOGIC must be enabled before it completes. Only
+ * called from a task.
+ *
+ * @returns 0 on success, <0 if the configuration is invalid or the analyzer is
+ * in use
+ */
+int logic_start(const logic_config_t *config);
+
+/* Aborts a capture that has not completed yet */
+void logic_stop(void);
+
+void logic_get_status(logic_status_t *status);
+
+/* Sends a completed capture. Only called from the task passed to
+ * logic_init(). */
+void logic_run_deferred(void);
+
+#endif /* __PROBE_LOGIC_H_ */
@@ -0,0 +1,104 @@
+#ifndef __PROBE_SEQUENCE_H_
+#define __PROBE_SEQUENCE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum size of a sequence program in bytes */
+#define SEQ_MAX_PROG_SIZE 1024
+/* Maximum number of values captured during one run */
+#define SEQ_MAX_CAPTURES 256
+/* Maximum nesting depth of loops */
+#define SEQ_MAX_LOOP_DEPTH 4
+
+/* Sub-commands of the sequence vendor command */
+enum { SEQ_CMD_LOAD, SEQ_CMD_RUN, SEQ_CMD_READ };
+
+/*
+ * Sequence opcodes. Operands follow the opcode in little-endian byte order.
+ * Most instructions load their result into a 32-bit accumulator that can be
+ * compared by the branch instructions and stored by SEQ_OP_CAPTURE.
+ */
+enum {
+  /* Stops execution */
+  SEQ_OP_END = 0x00,
+  /* [State (1B)] Switches target power on or off */
+  SEQ_OP_POWER = 0x01,
+  /* [Pin (1B) | IOSET state (1B)] Configures a probe GPIO */
+  SEQ_OP_GPIO_SET = 0x02,
+  /* [Pin (1B)] Loads state of a probe GPIO into accumulator */
+  SEQ_OP_GPIO_GET = 0x03,
+  /* Halts the MSP430 */
+  SEQ_OP_SBW_HALT = 0x04,
+  /* Releases the MSP430 from halt */
+  SEQ_OP_SBW_RESUME = 0x05,
+  /* Executes a power on reset of the MSP430 */
+  SEQ_OP_SBW_RESET = 0x06,
+  /* [Address (4B)] Loads a word from MSP430 memory into accumulator */
+  SEQ_OP_SBW_READ = 0x07,
+  /* [Address (4B) | Data (2B)] Writes a word to MSP430 memory */
+  SEQ_OP_SBW_WRITE = 0x08,
+  /* [Microseconds (4B)] Busy waits, fails if the wait exceeds the timeout */
+  SEQ_OP_DELAY_US = 0x09,
+  /* [Count (2B)] Repeats the instructions up to SEQ_OP_END_LOOP */
+  SEQ_OP_LOOP = 0x0A,
+  /* Closes the innermost loop */
+  SEQ_OP_END_LOOP = 0x0B,
+  /* [Target (2B)] Continues execution at target offset */
+  SEQ_OP_JUMP = 0x0C,
+  /* [Mask (2B) | Value (2B) | Target (2B)] Jumps if (acc & mask) == value */
+  SEQ_OP_BRANCH_EQ = 0x0D,
+  /* [Mask (2B) | Value (2B) | Target (2B)] Jumps if (acc & mask) != value */
+  SEQ_OP_BRANCH_NE = 0x0E,
+  /* Stores accumulator in the capture buffer */
+  SEQ_OP_CAPTURE = 0x0F,
+  /* Stores the microseconds elapsed since the start in the capture buffer */
+  SEQ_OP_CAPTURE_TIME = 0x10,
+};
+
+/* Status of a sequence run */
+enum {
+  SEQ_RC_OK,
+  SEQ_RC_ERR_OPCODE,
+  SEQ_RC_ERR_OPERAND,
+  SEQ_RC_ERR_TARGET,
+  SEQ_RC_ERR_TIMEOUT,
+  SEQ_RC_ERR_OVERFLOW,
+};
+
+/**
+ * Copies part of a sequence program into the program buffer
+ *
+ * @param offset offset of the data in the program
+ * @param data pointer to program data
+ * @param len number of bytes
+ *
+ * @returns 0 on success, <0 if the data does not fit into the program buffer
+ */
+int seq_load(unsigned int offset, const uint8_t *data, size_t len);
+
+/**
+ * Executes the loaded sequence program
+ *
+ * @param timeout_us maximum execution time in microseconds
+ * @param pc returns offset of the last executed instruction
+ *
+ * @returns one of SEQ_RC_*
+ */
+int seq_run(uint32_t timeout_us, uint16_t *pc);
+
+/* Returns the number of values captured during the last run */
+unsigned int seq_n_captures(void);
+
+/**
+ * Copies values captured during the last run
+ *
+ * @param dst pointer to destination buffer
+ * @param index index of the first value
+ * @param n maximum number of values
+ *
+ * @returns number of values copied
+ */
+size_t seq_read_captures(uint32_t *dst, unsigned int index, size_t n);
+
+#endif /* __PROBE_SEQUENCE_H_ */
@@ -0,0 +1,123 @@
+#ifndef __PROBE_STATS_H_
+#define __PROBE_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Command statistics are kept for the standard DAP commands 0x00-0x1F and the
+ * vendor commands 0x80-0x9F.
+ */
+#define STATS_N_SLOTS 64
+
+/* Bucket k counts latencies in [2^k, 2^(k+1)) us, the last bucket all above */
+#define STATS_N_BUCKETS 15
+
+/* Maximum number of tasks reported by the task statistics */
+#define STATS_MAX_TASKS 12
+
+#define STATS_TASK_NAME_LEN 12
+
+/* Sub-commands of the statistics vendor command */
+enum {
+  STATS_CMD_INFO,
+  STATS_CMD_ENABLE,
+  STATS_CMD_RESET,
+  STATS_CMD_READ,
+  STATS_CMD_HIST,
+  STATS_CMD_SYSTEM,
+  STATS_CMD_TASK,
+};
+
+typedef struct __attribute__((packed)) {
+  uint8_t enabled;
+  /* Measured cost of recording one command in nanoseconds */
+  uint16_t overhead_ns;
+  uint8_t n_slots;
+  /* Bitmap of slots that recorded at least one command */
+  uint8_t active[STATS_N_SLOTS / 8];
+} stats_info_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t cmd_id;
+  uint32_t count;
+  uint32_t errors;
+  uint32_t max_us;
+} stats_counters_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t n_cores;
+  /* Number of tasks in the snapshot */
+  uint8_t n_tasks;
+  uint64_t uptime_us;
+  uint32_t heap_size;
+  uint32_t heap_free;
+} stats_system_t;
+
+typedef struct __attribute__((packed)) {
+  char name[STATS_TASK_NAME_LEN];
+  uint8_t priority;
+  /* One of FreeRTOS' eTaskState */
+  uint8_t state;
+  /* Bitmap of cores the task may run on */
+  uint8_t core_mask;
+  /* Smallest amount of free stack since the task was started, in words */
+  uint16_t stack_free_min;
+  /* Time the task has spent running */
+  uint64_t run_time_us;
+} stats_task_t;
+
+/* Measures the recording overhead and clears all statistics */
+void stats_init(void);
+
+/* Starts or stops recording */
+void stats_enable(bool enable);
+
+/* Returns true if commands are recorded */
+bool stats_enabled(void);
+
+/* Clears all statistics */
+void stats_reset(void);
+
+/**
+ * Records the execution of a command
+ *
+ * @param cmd_id command ID of the request
+ * @param t_start value of time_us_32() before the command was executed
+ * @param error true if the command failed
+ */
+void stats_record(uint8_t cmd_id, uint32_t t_start, bool error);
+
+void stats_get_info(stats_info_t *info);
+
+/**
+ * Retrieves counters of one slot
+ *
+ * @returns 0 on success, <0 if the slot does not exist
+ */
+int stats_get_counters(stats_counters_t *dst, unsigned int slot);
+
+/**
+ * Retrieves the latency histogram of one slot
+ *
+ * @param dst pointer to STATS_N_BUCKETS counters
+ *
+ * @returns 0 on success, <0 if the slot does not exist
+ */
+int stats_get_histogram(uint32_t *dst, unsigned int slot);
+
+/**
+ * Takes a snapshot of all tasks and retrieves uptime and heap usage
+ *
+ * Task details are read from the snapshot with stats_get_task().
+ */
+void stats_get_system(stats_system_t *dst);
+
+/**
+ * Retrieves one task of the last snapshot
+ *
+ * @returns 0 on success, <0 if the task does not exist
+ */
+int stats_get_task(stats_task_t *dst, unsigned int index);
+
+#endif /* __PROBE_STATS_H_ */
@@ -0,0 +1,109 @@
+#ifndef __PROBE_STREAM_H_
+#define __PROBE_STREAM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous data streams are sent to the host on a dedicated vendor
+ * interface, such that they never delay responses to commands. Every frame
+ * occupies exactly one USB packet.
+ */
+#define STREAM_FRAME_SIZE 64
+
+/* Number of frames buffered on the probe */
+#define STREAM_RING_FRAMES 64
+
+/* Time after which a task stops waiting for the host to read frames */
+#define STREAM_STALL_MS 500
+
+typedef struct __attribute__((packed)) {
+  /* One of STREAM_ID_* */
+  uint8_t stream_id;
+  /* Number of valid payload bytes */
+  uint8_t len;
+  /* Frames of this stream dropped since the previous frame */
+  uint16_t dropped;
+  /* Probe time in microseconds when the frame was queued */
+  uint32_t timestamp;
+} stream_hdr_t;
+
+#define STREAM_MAX_PAYLOAD (STREAM_FRAME_SIZE - sizeof(stream_hdr_t))
+
+enum {
+  /* Counter values generated on request of the host */
+  STREAM_ID_TEST,
+  /* Target UART output, sent on the serial port in framed mode. The dropped
+   * field counts bytes. */
+  STREAM_ID_UART,
+  /* Records of the event timeline, see probe_events.h */
+  STREAM_ID_EVENT,
+  /* Samples of the logic analyzer, see probe_logic.h */
+  STREAM_ID_LOGIC,
+  STREAM_ID_NUM
+};
+
+/* Sub-commands of the stream vendor command */
+enum { STREAM_CMD_ENABLE, STREAM_CMD_STATUS, STREAM_CMD_TEST };
+
+typedef struct __attribute__((packed)) {
+  /* Bitmask of enabled streams */
+  uint32_t enabled;
+  /* Total number of frames handed to USB */
+  uint32_t sent;
+  /* Total number of frames dropped */
+  uint32_t dropped;
+} stream_status_t;
+
+/* Sets up the frame buffer */
+void stream_init(void);
+
+/* Enables the streams in a bitmask and disables all others */
+void stream_enable(uint32_t mask);
+
+/* Returns true if the stream is enabled */
+bool stream_enabled(uint8_t stream_id);
+
+/**
+ * Queues a frame for transmission. Safe to call from tasks and interrupts.
+ *
+ * @param stream_id one of STREAM_ID_*
+ * @param data pointer to payload
+ * @param len number of payload bytes, at most STREAM_MAX_PAYLOAD
+ *
+ * @returns 0 on success, <0 if the stream is disabled or the frame was dropped
+ */
+int stream_send(uint8_t stream_id, const void *data, size_t len);
+
+/* Returns the number of frames that can be queued without dropping */
+unsigned int stream_free(void);
+
+/**
+ * Waits until a frame can be queued. Only called from a task.
+ *
+ * @param stream_id stream the frame is for
+ *
+ * @returns 0 on success, <0 if the stream is disabled or the host has not
+ * read any frame for STREAM_STALL_MS
+ */
+int stream_wait_free(uint8_t stream_id);
+
+/**
+ * Sends frames with consecutive 32-bit counter values on STREAM_ID_TEST.
+ * Waits for free space instead of dropping frames. Only called from a task.
+ *
+ * @param n_frames number of frames
+ *
+ * @returns 0 on success, <0 if the test stream is disabled or the host stops
+ * reading
+ */
+int stream_test(uint32_t n_frames);
+
+/* Moves queued frames to USB. Only called from the USB task. */
+void stream_pump(void);
+
+/* Retrieves stream counters */
+void stream_get_status(stream_status_t *status);
+
+#endif /* __PROBE_STREAM_H_ */
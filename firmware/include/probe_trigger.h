@@ -0,0 +1,122 @@
+#ifndef __PROBE_TRIGGER_H_
+#define __PROBE_TRIGGER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/*
+ * Rules that react to the target without a round trip to the host. A rule
+ * fires on a byte sequence in the target's UART output or on an edge of a
+ * header GPIO and then switches target power, pulses a header GPIO, halts the
+ * MSP430 or only records the time. Matching and all actions except the halt
+ * run in the interrupt that saw the event.
+ */
+#define TRIGGER_N_RULES 4
+#define TRIGGER_PATTERN_MAX 16
+
+enum {
+  /* Last byte of the pattern received on the UART */
+  TRIGGER_SRC_UART,
+  TRIGGER_SRC_GPIO_RISE,
+  TRIGGER_SRC_GPIO_FALL
+};
+
+enum {
+  TRIGGER_ACT_TIMESTAMP,
+  TRIGGER_ACT_POWER_OFF,
+  TRIGGER_ACT_POWER_ON,
+  /* Drives a header GPIO high for pulse_us, then low */
+  TRIGGER_ACT_GPIO_PULSE,
+  /* Halts the MSP430, which must be connected via SBW */
+  TRIGGER_ACT_SBW_HALT
+};
+
+/* The rule stays armed after firing */
+#define TRIGGER_FLAG_REPEAT 0x01
+
+/* Sub-commands of the trigger vendor command */
+enum { TRIGGER_CMD_ARM, TRIGGER_CMD_DISARM, TRIGGER_CMD_STATUS };
+
+typedef struct __attribute__((packed)) {
+  uint8_t source;
+  /* Header GPIO number of edge sources */
+  uint8_t src_pin;
+  uint8_t action;
+  /* Header GPIO number of pulses */
+  uint8_t act_pin;
+  uint32_t pulse_us;
+  uint8_t flags;
+  uint8_t pattern_len;
+  uint8_t pattern[TRIGGER_PATTERN_MAX];
+} trigger_rule_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t armed;
+  /* 0 if the last action succeeded, <0 otherwise */
+  int8_t result;
+  uint32_t n_fired;
+  /* Probe time of the last event: reception of the last pattern byte or the
+   * interrupt of the edge */
+  uint32_t event_us;
+  /* Probe time at which the last action was complete */
+  uint32_t action_us;
+  uint32_t max_latency_us;
+} trigger_status_t;
+
+/**
+ * Sets up the GPIO interrupt on the calling core
+ *
+ * @param task task that runs deferred actions via trigger_run_deferred()
+ */
+void trigger_init(TaskHandle_t task);
+
+/**
+ * Replaces the rule in a slot and arms it
+ *
+ * @returns 0 on success, <0 if the rule is invalid
+ */
+int trigger_arm(unsigned int slot, const trigger_rule_t *rule);
+
+int trigger_disarm(unsigned int slot);
+
+int trigger_get_status(trigger_status_t *status, unsigned int slot);
+
+/* Returns true if any armed rule watches the UART */
+bool trigger_uart_armed(void);
+
+/**
+ * Matches a received byte against the armed UART rules. Only called from the
+ * UART receive interrupt.
+ *
+ * @param c received byte
+ * @param rx_us probe time at which the byte was complete
+ */
+void trigger_uart_byte(uint8_t c, uint32_t rx_us);
+
+/* Records both edges of the header GPIOs as EVENT_GPIO or stops doing so.
+ * The edges of the image store's trigger pin are not recorded. */
+void trigger_log_gpio(bool enable);
+
+typedef void (*trigger_edge_cb_t)(uint32_t time_us);
+
+/**
+ * Reports an edge of a header GPIO to a callback, which runs in the GPIO
+ * interrupt with the probe time of the interrupt. Only one edge is watched at
+ * a time.
+ *
+ * @param pin_no header GPIO number
+ * @param rising true for rising, false for falling edges
+ * @param cb callback, NULL stops watching
+ *
+ * @returns 0 on success, <0 if the GPIO cannot be watched
+ */
+int trigger_watch_edge(unsigned int pin_no, bool rising, trigger_edge_cb_t cb);
+
+/* Runs actions that cannot be taken in an interrupt. Only called from the
+ * task passed to trigger_init(). */
+void trigger_run_deferred(void);
+
+#endif /* __PROBE_TRIGGER_H_ */
@@ -0,0 +1,73 @@
+#ifndef __PROBE_VENDOR_H_
+#define __PROBE_VENDOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sbw_protocol.h"
+
+/* Features reported by the capability command */
+enum {
+  PROBE_FEATURE_BATCH = (1 << 0),
+  PROBE_FEATURE_SEQUENCE = (1 << 1),
+  PROBE_FEATURE_BULK = (1 << 2),
+  PROBE_FEATURE_BULK_VERIFY = (1 << 3),
+  PROBE_FEATURE_TAGGED = (1 << 4),
+  PROBE_FEATURE_STREAM = (1 << 5),
+  PROBE_FEATURE_STATS = (1 << 6),
+  PROBE_FEATURE_TRACE = (1 << 7),
+  PROBE_FEATURE_BENCH = (1 << 8),
+  PROBE_FEATURE_IMAGE = (1 << 9),
+  PROBE_FEATURE_BOOTLOADER = (1 << 10),
+  PROBE_FEATURE_BULK_RLE = (1 << 11),
+  PROBE_FEATURE_TIME = (1 << 12),
+  PROBE_FEATURE_UART_STATS = (1 << 13),
+  PROBE_FEATURE_UART_HISTORY = (1 << 14),
+  PROBE_FEATURE_UART_FRAMED = (1 << 15),
+  PROBE_FEATURE_TRIGGER = (1 << 16),
+  PROBE_FEATURE_EVENTS = (1 << 17),
+  PROBE_FEATURE_BOOT = (1 << 18),
+  PROBE_FEATURE_LOGIC = (1 << 19),
+};
+
+/* Response payload of the capability command */
+typedef struct __attribute__((packed)) {
+  /* Bitfield of PROBE_FEATURE_* */
+  uint32_t features;
+  /* Maximum size of a vendor request or response in bytes */
+  uint16_t max_payload;
+  /* Number of requests that the host may keep in flight */
+  uint16_t max_outstanding;
+  /* Number of request bytes the probe can buffer */
+  uint16_t staging_size;
+  /* Range of the SBW clock frequency in Hz */
+  uint32_t sbw_clk_min_hz;
+  uint32_t sbw_clk_max_hz;
+} probe_caps_t;
+
+/* Reads the state of one of the probe's header GPIOs */
+int probe_ioget(uint8_t *dst, unsigned int pin_no);
+/* Configures one of the probe's header GPIOs */
+int probe_ioset(unsigned int pin_no, probe_io_state_t state);
+/* Returns the RP2040 pin of a header GPIO or <0 if there is none */
+int probe_gpio_pin(unsigned int pin_no);
+
+/* Switches on the target power supply (reference counted). Also restores
+ * power that a trigger switched off. */
+void target_power_enable(void);
+/* Switches off the target power supply if no one else is using it */
+int target_power_disable(void);
+
+/* Controls the power supply bypass switch (Riotee Board only) */
+int bypass_enable(void);
+int bypass_disable(void);
+
+/* Powers the target and the programming level translators */
+int programming_enable(void);
+/* Releases the target power and the programming level translators */
+int programming_disable(void);
+
+/* Returns true once the host requested a reboot into the USB bootloader */
+bool bootloader_requested(void);
+
+#endif /* __PROBE_VENDOR_H_ */
@@ -92,6 +92,11 @@
 #define PROBE_PIN_GPIO2 25
 #define PROBE_PIN_GPIO3 26
 
+/* Header GPIOs used for programming from the image store */
+#define PROBE_PIN_IMAGE_TRIGGER PROBE_PIN_GPIO0
+#define PROBE_PIN_IMAGE_BUSY PROBE_PIN_GPIO1
+#define PROBE_PIN_IMAGE_PASS PROBE_PIN_GPIO2
+
 #endif
 
 #define PROBE_UART_BAUDRATE 115200
@@ -137,6 +137,17 @@ int sbw_jtag_disconnect(void);
  */
 int sbw_jtag_write_jmb_in16(uint16_t data);
 
+/**
+ * Reads a 16bit value that the target wrote into the JTAG mailbox. Does not
+ * wait for the target.
+ *
+ * @param data receives the value
+ *
+ * @returns SBW_ERR_NONE if a value was read, SBW_ERR_GENERIC if the mailbox
+ * is empty
+ */
+int sbw_jtag_read_jmb_out16(uint16_t *data);
+
 /**
  * Resync the JTAG connection
  *
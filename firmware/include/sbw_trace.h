@@ -0,0 +1,82 @@
+#ifndef __SBW_TRACE_H_
+#define __SBW_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of entries retained in the trace buffer */
+#define TRACE_N_ENTRIES 512
+
+/* Number of entries returned by one read request */
+#define TRACE_ENTRIES_PER_PKT 4
+
+enum {
+  /* Instruction register scan, data_in is the instruction */
+  TRACE_IR_SHIFT,
+  /* 16-bit data register scan */
+  TRACE_DR_SHIFT16,
+  /* 20-bit data register scan */
+  TRACE_DR_SHIFT20,
+  /* TCLK set high */
+  TRACE_TCLK_SET,
+  /* TCLK set low */
+  TRACE_TCLK_CLR,
+  /* TAP controller reset */
+  TRACE_TAP_RESET,
+  /* Start of a vendor command, data_in is the command ID */
+  TRACE_CMD,
+};
+
+/* Sub-commands of the trace vendor command */
+enum { TRACE_CMD_INFO, TRACE_CMD_ENABLE, TRACE_CMD_CLEAR, TRACE_CMD_READ };
+
+typedef struct __attribute__((packed)) {
+  /* Probe time in microseconds */
+  uint32_t timestamp;
+  /* One of TRACE_* */
+  uint8_t type;
+  /* Instruction in the IR at the time of the entry */
+  uint8_t instr;
+  uint32_t data_in;
+  uint32_t data_out;
+} trace_entry_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t enabled;
+  /* Number of entries recorded since the last clear, including overwritten */
+  uint32_t total;
+  /* Number of entries that can be read */
+  uint16_t available;
+} trace_info_t;
+
+extern bool trace_active;
+
+void trace_add(uint8_t type, uint32_t data_in, uint32_t data_out);
+
+/* Records an entry if tracing is enabled */
+static inline void trace_record(uint8_t type, uint32_t data_in,
+                                uint32_t data_out) {
+  if (trace_active)
+    trace_add(type, data_in, data_out);
+}
+
+/* Starts or stops recording */
+void trace_enable(bool enable);
+
+/* Discards all entries */
+void trace_clear(void);
+
+void trace_get_info(trace_info_t *info);
+
+/**
+ * Copies entries from the trace buffer
+ *
+ * @param dst destination buffer
+ * @param index index of the first entry, 0 being the oldest entry retained
+ * @param n maximum number of entries
+ *
+ * @returns number of entries copied
+ */
+unsigned int trace_read(trace_entry_t *dst, unsigned int index, unsigned int n);
+
+#endif /* __SBW_TRACE_H_ */
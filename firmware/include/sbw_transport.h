@@ -2,6 +2,7 @@
 #define __SBW_TRANSPORT_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct {
   int sbw_tck;
@@ -45,5 +46,7 @@ int sbw_transport_setup(sbw_pins_t *sbw_pins);
 int sbw_transport_disconnect(void);
 /* Starts driving the SBW pins */
 int sbw_transport_connect(void);
+/* Returns the SBW clock frequency in Hz */
+uint32_t sbw_transport_clk_hz(void);
 
 #endif /* __SBW_TRANSPORT_H_ */
@@ -0,0 +1,58 @@
+#ifndef __SWD_MEM_H_
+#define __SWD_MEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Connects to the debug port of an ARM target and powers up the debug domain
+ *
+ * SWD pins and level translators must be enabled before.
+ *
+ * @returns 0 on success, <0 if the target does not respond
+ */
+int swd_mem_connect(void);
+
+/**
+ * Reads a 32-bit word through the MEM-AP
+ *
+ * @param dst pointer to result
+ * @param addr word-aligned address
+ *
+ * @returns 0 on success, <0 otherwise
+ */
+int swd_mem_read32(uint32_t *dst, uint32_t addr);
+
+/**
+ * Writes a 32-bit word through the MEM-AP
+ *
+ * @param addr word-aligned address
+ * @param value value to write
+ *
+ * @returns 0 on success, <0 otherwise
+ */
+int swd_mem_write32(uint32_t addr, uint32_t value);
+
+/**
+ * Writes consecutive 32-bit words through the MEM-AP
+ *
+ * @param addr word-aligned address of first word
+ * @param data pointer to words
+ * @param n_words number of words
+ *
+ * @returns 0 on success, <0 otherwise
+ */
+int swd_mem_write_block(uint32_t addr, const uint32_t *data, size_t n_words);
+
+/**
+ * Reads consecutive 32-bit words through the MEM-AP
+ *
+ * @param dst pointer to buffer for n_words words
+ * @param addr word-aligned address of first word
+ * @param n_words number of words
+ *
+ * @returns 0 on success, <0 otherwise
+ */
+int swd_mem_read_block(uint32_t *dst, uint32_t addr, size_t n_words);
+
+#endif /* __SWD_MEM_H_ */
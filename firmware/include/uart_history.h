@@ -0,0 +1,93 @@
+#ifndef __UART_HISTORY_H_
+#define __UART_HISTORY_H_
+
+#include <stdint.h>
+
+/*
+ * Keeps the most recent output of the target UART, whether or not a host has
+ * the serial port open, so that boot messages can be read after the fact.
+ * Positions count bytes since power-up and wrap after 4 GB.
+ */
+#ifndef UART_HISTORY_SIZE
+#define UART_HISTORY_SIZE (8 * 1024)
+#endif
+
+#if (UART_HISTORY_SIZE & (UART_HISTORY_SIZE - 1)) != 0
+#error "UART_HISTORY_SIZE must be a power of two"
+#endif
+
+/* Number of positions at which data was lost that are remembered */
+#define UART_HISTORY_MAX_LOSSES 16
+
+/* Number of reception times that are remembered */
+#ifndef UART_HISTORY_MAX_STAMPS
+#define UART_HISTORY_MAX_STAMPS (UART_HISTORY_SIZE / 32)
+#endif
+
+/* Reception time of the byte at a position */
+typedef struct {
+  uint32_t pos;
+  uint32_t time_us;
+} uart_stamp_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t size;
+  /* Position after the newest byte */
+  uint32_t head;
+  /* Position of the oldest byte still held */
+  uint32_t oldest;
+  /* Number of bytes lost before they reached the history since power-up */
+  uint32_t lost;
+} uart_history_info_t;
+
+/* Sets up an empty history */
+void uart_history_init(void);
+
+/* Appends received bytes */
+void uart_history_write(const uint8_t *data, unsigned int len);
+
+/* Records that n_lost bytes were lost before the next byte written */
+void uart_history_mark_loss(uint32_t n_lost);
+
+/* Records the probe time at which the next byte written was received. Bytes
+ * up to the next stamp are assumed to have arrived back-to-back. */
+void uart_history_mark_time(uint32_t time_us);
+
+/**
+ * Copies bytes from the history
+ *
+ * Copying stops before the next loss, so that every loss is reported at the
+ * start of a read together with the first byte after it.
+ *
+ * @param pos position of the first byte, moved forward to the oldest byte
+ *            if it was already overwritten
+ * @param dst pointer to buffer for up to max_len bytes
+ * @param max_len size of the buffer
+ * @param lost set to the number of bytes lost right before the returned data,
+ *             including bytes that were overwritten
+ *
+ * @returns number of bytes copied
+ */
+unsigned int uart_history_read(uint32_t *pos, uint8_t *dst,
+                               unsigned int max_len, uint32_t *lost);
+
+/**
+ * Copies bytes from the history like uart_history_read(), but also stops
+ * before the next stamp
+ *
+ * @param stamp set to the stamp of the returned data, which may lie before
+ *              its first byte. Bytes older than all remembered stamps get the
+ *              oldest stamp, which then lies after them.
+ *
+ * @returns number of bytes copied
+ */
+unsigned int uart_history_read_stamped(uint32_t *pos, uint8_t *dst,
+                                       unsigned int max_len, uint32_t *lost,
+                                       uart_stamp_t *stamp);
+
+/* Returns the position of the oldest byte still held */
+uint32_t uart_history_oldest(void);
+
+void uart_history_get_info(uart_history_info_t *info);
+
+#endif /* __UART_HISTORY_H_ */
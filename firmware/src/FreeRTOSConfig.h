@@ -71,7 +71,10 @@
 /* Memory allocation related definitions. */
 #define configSUPPORT_STATIC_ALLOCATION         0
 #define configSUPPORT_DYNAMIC_ALLOCATION        1
-#define configTOTAL_HEAP_SIZE                   (128*1024)
+/* heap_1 only holds the task stacks and TCBs, the timer queue and the
+ * TinyUSB queue and mutexes. The image runs from RAM, the rest of the RAM
+ * holds the code and the static buffers. */
+#define configTOTAL_HEAP_SIZE                   (32*1024)
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
 /* Hook function related definitions. */
@@ -80,7 +83,11 @@
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+#define configGENERATE_RUN_TIME_STATS           1
+/* Run time is counted in microseconds by the free-running hardware timer */
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        time_us_64()
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
@@ -102,15 +109,24 @@
 */
 
 /* SMP port only */
-#define configNUM_CORES                         1
-#define configTICK_CORE                         1
+#define configNUMBER_OF_CORES                   2
+#define configNUM_CORES                         configNUMBER_OF_CORES
+#define configTICK_CORE                         0
 #define configRUN_MULTIPLE_PRIORITIES           1
+#define configUSE_CORE_AFFINITY                 1
+#define configUSE_PASSIVE_IDLE_HOOK             0
 
 /* RP2040 specific */
 #define configSUPPORT_PICO_SYNC_INTEROP         1
 #define configSUPPORT_PICO_TIME_INTEROP         1
 
 #include <assert.h>
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+/* Provided by hardware_timer, used for the run time stats */
+extern uint64_t time_us_64(void);
+#endif
+
 /* Define to trap errors during development. */
 #define configASSERT(x)                         assert(x)
 
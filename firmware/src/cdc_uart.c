@@ -25,57 +25,375 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include <hardware/dma.h>
+#include <hardware/irq.h>
 #include <pico/stdlib.h>
+#include <string.h>
 
 #include "tusb.h"
 
+#include "cdc_uart.h"
+#include "probe_stream.h"
+#include "probe_boot.h"
+#include "probe_events.h"
+#include "probe_trigger.h"
 #include "rioteeprobe_config.h"
+#include "uart_history.h"
+
+/* Ring buffer between the RX interrupt and the CDC task, power of two */
+#define UART_RX_RING_SIZE 8192
+/* Maximum number of bytes sent to the target with one DMA transfer */
+#define UART_TX_CHUNK 256
+/* Longest text inserted into the serial port where data was lost */
+#define LOSS_MARKER_MAX_LEN 27
+/* Reception times between the RX interrupt and the CDC task, power of two */
+#define UART_RX_STAMPS 64
 
 TaskHandle_t uart_taskhandle;
-TickType_t last_wake, interval = 100;
 
-static uint8_t tx_buf[CFG_TUD_CDC_TX_BUFSIZE];
-static uint8_t rx_buf[CFG_TUD_CDC_RX_BUFSIZE];
+/* The free-running head is only written by the interrupt, the tail only by
+ * the task */
+static struct {
+  uint8_t buf[UART_RX_RING_SIZE];
+  uint32_t head;
+  uint32_t tail;
+} rx_ring;
+
+/* Reception times of bytes in the ring buffer, written like the ring */
+static struct {
+  uart_stamp_t buf[UART_RX_STAMPS];
+  uint32_t head;
+  uint32_t tail;
+} rx_stamps;
+/* Duration of one bit in nanoseconds and the time at which the next byte
+ * arrives if the target keeps sending */
+static uint32_t bit_ns;
+static uint32_t rx_next_us;
+/* RX FIFO level that raises the interrupt, 0 for 1/8 and 2 for 1/2 */
+static uint32_t rx_level = 2;
+
+static uint8_t tx_buf[UART_TX_CHUNK];
+static int tx_dma_chan;
+/* Ticks until the current TX transfer has left the UART */
+static TickType_t tx_wait;
+
+static uart_stats_t stats;
+/* Loss counters of the interrupt that are already marked in the history */
+static uint32_t marked_overrun, marked_dropped;
+/* Sum of the loss counters at the last event record */
+static uint32_t event_lost;
+
+/* History position of the next byte for the serial port */
+static uint32_t cdc_pos;
+static volatile bool replay_requested = false;
+static uint8_t cdc_chunk[64];
+static volatile bool framed = false;
+
+static unsigned int uart_irq(void) {
+  return (uart_get_index(PROBE_UART_INTERFACE) == 0) ? UART0_IRQ : UART1_IRQ;
+}
+
+static uint32_t bits_to_us(uint32_t n_bits) {
+  return ((uint64_t)n_bits * bit_ns) / 1000;
+}
+
+/* Records when the first of n bytes stored at pos was received, unless it
+ * directly followed the previous byte. end_us is the time at which the last
+ * of them was complete. */
+static void rx_stamp(uint32_t pos, uint32_t n, uint32_t end_us) {
+  /* Start, data and stop bit */
+  uint32_t first_us = end_us - bits_to_us(n * 10);
+  uint32_t stamp_head = rx_stamps.head;
+  int32_t gap_us = first_us - rx_next_us;
+  int32_t tolerance_us = bits_to_us(10);
+
+  rx_next_us = end_us;
+  /* One character of tolerance covers the interrupt latency */
+  if ((gap_us <= tolerance_us) && (gap_us >= -tolerance_us))
+    return;
+  /* The bytes are attributed to the previous stamp if the task lags behind */
+  if (stamp_head - __atomic_load_n(&rx_stamps.tail, __ATOMIC_ACQUIRE) >=
+      UART_RX_STAMPS)
+    return;
+  rx_stamps.buf[stamp_head % UART_RX_STAMPS].pos = pos;
+  rx_stamps.buf[stamp_head % UART_RX_STAMPS].time_us = first_us;
+  __atomic_store_n(&rx_stamps.head, stamp_head + 1, __ATOMIC_RELEASE);
+}
+
+/* Adds the bytes stored from start to head to the event timeline. first_us is
+ * the time at which the first of them started. */
+static void rx_event(uint32_t start, uint32_t head, uint32_t first_us) {
+  uint32_t lost = stats.rx_overrun + stats.rx_dropped;
+  uint32_t offset = start % UART_RX_RING_SIZE;
+  uint32_t n = MIN(head - start, UART_RX_RING_SIZE - offset);
+
+  event_uart(&rx_ring.buf[offset], n, first_us, lost - event_lost);
+  /* The rest wrapped around the end of the ring */
+  if (start + n != head)
+    event_uart(rx_ring.buf, head - start - n, first_us + bits_to_us(n * 10),
+               0);
+  event_lost = lost;
+}
+
+/* Drains the RX FIFO into the ring buffer when it is half full or when the
+ * line has been idle for 32 bit periods */
+static void uart_rx_isr(void) {
+  uart_hw_t *hw = uart_get_hw(PROBE_UART_INTERFACE);
+  uint32_t now_us = time_us_32();
+  uint32_t head = rx_ring.head;
+  uint32_t tail = __atomic_load_n(&rx_ring.tail, __ATOMIC_ACQUIRE);
+  uint32_t start = head;
+  BaseType_t woken = pdFALSE;
+
+  while (uart_is_readable(PROBE_UART_INTERFACE)) {
+    uint32_t dr = hw->dr;
+
+    if (dr & UART_UARTDR_OE_BITS)
+      stats.rx_overrun++;
+    if (dr & UART_UARTDR_BE_BITS) {
+      stats.rx_break++;
+      continue;
+    }
+    if (dr & UART_UARTDR_FE_BITS)
+      stats.rx_framing++;
+    if (dr & UART_UARTDR_PE_BITS)
+      stats.rx_parity++;
+
+    if (head - tail >= UART_RX_RING_SIZE) {
+      stats.rx_dropped++;
+      continue;
+    }
+    rx_ring.buf[head % UART_RX_RING_SIZE] = dr & 0xFF;
+    head++;
+    stats.rx_bytes++;
+  }
+  if (head != start) {
+    /* A timeout fires 32 bit periods after the last byte */
+    uint32_t end_us = (hw->mis & UART_UARTMIS_RTMIS_BITS)
+                          ? now_us - bits_to_us(32)
+                          : now_us;
+    rx_stamp(start, head - start, end_us);
+    if (event_types & (1UL << EVENT_UART))
+      rx_event(start, head, end_us - bits_to_us((head - start) * 10));
+    if (boot_uart_armed())
+      boot_uart_rx(end_us - bits_to_us((head - start) * 10));
+    /* Bytes are matched once complete, each one took 10 bit periods */
+    if (trigger_uart_armed()) {
+      for (uint32_t pos = start; pos != head; pos++)
+        trigger_uart_byte(rx_ring.buf[pos % UART_RX_RING_SIZE],
+                          end_us - bits_to_us((head - 1 - pos) * 10));
+    }
+  }
+  hw->icr = UART_UARTICR_RXIC_BITS | UART_UARTICR_RTIC_BITS;
+
+  stats.rx_peak = MAX(stats.rx_peak, head - tail);
+  __atomic_store_n(&rx_ring.head, head, __ATOMIC_RELEASE);
+  vTaskNotifyGiveFromISR(uart_taskhandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void uart_setup(uint32_t baudrate) {
+  uart_hw_t *hw = uart_get_hw(PROBE_UART_INTERFACE);
+
+  /* Also enables the DMA requests */
+  stats.baudrate = uart_init(PROBE_UART_INTERFACE, baudrate);
+  bit_ns = 1000000000UL / stats.baudrate;
+  hw_write_masked(&hw->ifls, rx_level << UART_UARTIFLS_RXIFLSEL_LSB,
+                  UART_UARTIFLS_RXIFLSEL_BITS);
+  hw->imsc = UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS;
+}
 
 void cdc_uart_init(void) {
+  dma_channel_config c;
+
   gpio_set_function(PROBE_UART_TX, GPIO_FUNC_UART);
   gpio_set_function(PROBE_UART_RX, GPIO_FUNC_UART);
   gpio_set_pulls(PROBE_UART_TX, 1, 0);
   gpio_set_pulls(PROBE_UART_RX, 1, 0);
-  uart_init(PROBE_UART_INTERFACE, PROBE_UART_BAUDRATE);
+  uart_setup(PROBE_UART_BAUDRATE);
+  uart_history_init();
+
+  tx_dma_chan = dma_claim_unused_channel(true);
+  c = dma_channel_get_default_config(tx_dma_chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, uart_get_dreq(PROBE_UART_INTERFACE, true));
+  dma_channel_configure(tx_dma_chan, &c,
+                        &uart_get_hw(PROBE_UART_INTERFACE)->dr, tx_buf, 0,
+                        false);
+
+  irq_set_exclusive_handler(uart_irq(), uart_rx_isr);
 }
 
-void cdc_task(void) {
-  static int was_connected = 0;
-  uint rx_len = 0;
+void cdc_uart_get_stats(uart_stats_t *dst) {
+  memcpy(dst, &stats, sizeof(stats));
+}
+
+void cdc_uart_replay(void) {
+  replay_requested = true;
+  xTaskNotifyGive(uart_taskhandle);
+}
+
+void cdc_uart_low_latency(bool enable) {
+  rx_level = enable ? 0 : 2;
+  hw_write_masked(&uart_get_hw(PROBE_UART_INTERFACE)->ifls,
+                  rx_level << UART_UARTIFLS_RXIFLSEL_LSB,
+                  UART_UARTIFLS_RXIFLSEL_BITS);
+}
 
-  // Consume uart fifo regardless even if not connected
-  while (uart_is_readable(PROBE_UART_INTERFACE) && (rx_len < sizeof(rx_buf))) {
-    rx_buf[rx_len++] = uart_getc(PROBE_UART_INTERFACE);
+void cdc_uart_set_framed(bool enable) {
+  framed = enable;
+  xTaskNotifyGive(uart_taskhandle);
+}
+
+/* Moves received bytes from the ring buffer into the history, marking bytes
+ * that the interrupt could not store and reception times */
+static void rx_drain(void) {
+  uint32_t head = __atomic_load_n(&rx_ring.head, __ATOMIC_ACQUIRE);
+  uint32_t tail = rx_ring.tail;
+  uint32_t stamp_head = __atomic_load_n(&rx_stamps.head, __ATOMIC_ACQUIRE);
+  uint32_t stamp_tail = rx_stamps.tail;
+  uint32_t overrun = stats.rx_overrun, dropped = stats.rx_dropped;
+
+  /* Each overrun loses at least one byte. The marker precedes the bytes that
+   * were drained together with the loss. */
+  if ((overrun != marked_overrun) || (dropped != marked_dropped)) {
+    uart_history_mark_loss((overrun - marked_overrun) +
+                           (dropped - marked_dropped));
+    marked_overrun = overrun;
+    marked_dropped = dropped;
   }
 
-  if (tud_cdc_n_connected(0)) {
-    was_connected = 1;
-    int written = 0;
-    /* Implicit overflow if we don't write all the bytes to the host.
-     * Also throw away bytes if we can't write... */
-    if (rx_len) {
-      written = MIN(tud_cdc_n_write_available(0), rx_len);
-      if (written > 0) {
-        tud_cdc_n_write(0, rx_buf, written);
-        tud_cdc_n_write_flush(0);
+  while (head != tail) {
+    uint32_t end = head;
+    uint32_t offset = tail % UART_RX_RING_SIZE;
+    uint32_t n;
+
+    /* A stamp may belong to bytes the interrupt has not published yet, it is
+     * left for the next round */
+    if (stamp_tail != stamp_head) {
+      uart_stamp_t *stamp = &rx_stamps.buf[stamp_tail % UART_RX_STAMPS];
+      if (stamp->pos == tail) {
+        uart_history_mark_time(stamp->time_us);
+        stamp_tail++;
+        continue;
       }
+      if (stamp->pos - tail < head - tail)
+        end = stamp->pos;
     }
 
-    /* Reading from a firehose and writing to a FIFO. */
-    size_t watermark = MIN(tud_cdc_n_available(0), sizeof(tx_buf));
-    if (watermark > 0) {
-      size_t tx_len;
-      /* Batch up to half a FIFO of data - don't clog up on RX */
-      watermark = MIN(watermark, 16);
-      tx_len = tud_cdc_n_read(0, tx_buf, watermark);
-      uart_write_blocking(PROBE_UART_INTERFACE, tx_buf, tx_len);
+    n = MIN(end - tail, UART_RX_RING_SIZE - offset);
+    uart_history_write(&rx_ring.buf[offset], n);
+    tail += n;
+  }
+  __atomic_store_n(&rx_stamps.tail, stamp_tail, __ATOMIC_RELEASE);
+  __atomic_store_n(&rx_ring.tail, tail, __ATOMIC_RELEASE);
+}
+
+/* Writes a marker like "\r\n[123 bytes lost]\r\n", returns its length */
+static unsigned int format_loss(char *dst, uint32_t n_lost) {
+  char digits[10];
+  unsigned int n_digits = 0, len = 3;
+
+  do {
+    digits[n_digits++] = '0' + n_lost % 10;
+    n_lost /= 10;
+  } while (n_lost > 0);
+
+  memcpy(dst, "\r\n[", 3);
+  while (n_digits > 0)
+    dst[len++] = digits[--n_digits];
+  memcpy(&dst[len], " bytes lost]\r\n", 14);
+  return len + 14;
+}
+
+/* Sends bytes from the history as stream frames with the reception time of
+ * their first byte and the number of bytes lost before them */
+static void forward_frames(void) {
+  static uint8_t frame[STREAM_FRAME_SIZE];
+  stream_hdr_t *hdr = (stream_hdr_t *)frame;
+  uart_stamp_t stamp;
+  uint32_t lost, pos;
+  int32_t offset;
+
+  while (tud_cdc_n_write_available(0) >= STREAM_FRAME_SIZE) {
+    pos = cdc_pos;
+    hdr->len = uart_history_read_stamped(&pos, &frame[sizeof(stream_hdr_t)],
+                                         STREAM_MAX_PAYLOAD, &lost, &stamp);
+    if (hdr->len == 0)
+      break;
+    stats.host_lost += lost;
+    hdr->stream_id = STREAM_ID_UART;
+    hdr->dropped = MIN(lost, UINT16_MAX);
+    /* Bytes after the stamp arrived back-to-back */
+    offset = (pos - hdr->len) - stamp.pos;
+    hdr->timestamp = stamp.time_us + ((int64_t)offset * 10 * bit_ns) / 1000;
+    memset(&frame[sizeof(stream_hdr_t) + hdr->len], 0,
+           STREAM_MAX_PAYLOAD - hdr->len);
+    tud_cdc_n_write(0, frame, STREAM_FRAME_SIZE);
+    cdc_pos = pos;
+  }
+}
+
+/* Moves bytes from the history into the CDC FIFO. Whatever the host has not
+ * read yet, e.g. the output from before it opened the port, is sent first. */
+static void cdc_forward(void) {
+  char marker[LOSS_MARKER_MAX_LEN];
+  uint32_t avail, lost, pos;
+  unsigned int n;
+
+  if (replay_requested) {
+    replay_requested = false;
+    cdc_pos = uart_history_oldest();
+  }
+
+  if (framed) {
+    forward_frames();
+    tud_cdc_n_write_flush(0);
+    return;
+  }
+
+  while ((avail = tud_cdc_n_write_available(0)) > LOSS_MARKER_MAX_LEN) {
+    pos = cdc_pos;
+    n = uart_history_read(&pos, cdc_chunk,
+                          MIN(sizeof(cdc_chunk), avail - LOSS_MARKER_MAX_LEN),
+                          &lost);
+    if (n == 0)
+      break;
+    if (lost > 0) {
+      stats.host_lost += lost;
+      tud_cdc_n_write(0, marker, format_loss(marker, lost));
     }
+    tud_cdc_n_write(0, cdc_chunk, n);
+    cdc_pos = pos;
+  }
+  tud_cdc_n_write_flush(0);
+}
+
+/* Hands the next chunk from the host to the TX DMA once the last one is out */
+static void tx_forward(void) {
+  uint32_t n;
+
+  if (dma_channel_is_busy(tx_dma_chan) || !tud_cdc_n_available(0))
+    return;
+  n = tud_cdc_n_read(0, tx_buf, sizeof(tx_buf));
+  dma_channel_transfer_from_buffer_now(tx_dma_chan, tx_buf, n);
+  stats.tx_bytes += n;
+  /* 10 bit periods per byte */
+  tx_wait = MAX(1, ((uint64_t)n * 10 * configTICK_RATE_HZ) / stats.baudrate);
+}
+
+void cdc_task(void) {
+  static int was_connected = 0;
+
+  /* The history records the target's output even without a host */
+  rx_drain();
+
+  if (tud_cdc_n_connected(0)) {
+    was_connected = 1;
+    cdc_forward();
+    tx_forward();
   } else if (was_connected) {
     tud_cdc_n_write_clear(0);
     was_connected = 0;
@@ -83,38 +401,40 @@ void cdc_task(void) {
 }
 
 void cdc_thread(void *ptr) {
-  BaseType_t delayed;
-  last_wake = xTaskGetTickCount();
-  /* Threaded with a polling interval that scales according to linerate */
+  /* The interrupt is handled on the core that this task is pinned to */
+  irq_set_enabled(uart_irq(), true);
+
   while (1) {
     cdc_task();
-    delayed = xTaskDelayUntil(&last_wake, interval);
-    if (delayed == pdFALSE)
-      last_wake = xTaskGetTickCount();
+    /* Woken by the RX interrupt and USB events, the timeout polls the end of
+     * a TX transfer */
+    ulTaskNotifyTake(pdTRUE, dma_channel_is_busy(tx_dma_chan)
+                                 ? tx_wait
+                                 : portMAX_DELAY);
   }
 }
 
 void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *line_coding) {
-  /* Set the tick thread interval to the amount of time it takes to
-   * fill up half a FIFO. Millis is too coarse for integer divide.
-   */
-  uint32_t micros = (1000 * 1000 * 16 * 10) / MAX(line_coding->bit_rate, 1);
-
   /* Modifying state, so park the thread before changing it. */
   vTaskSuspend(uart_taskhandle);
-  interval = MAX(1, micros / ((1000 * 1000) / configTICK_RATE_HZ));
+  irq_set_enabled(uart_irq(), false);
+  dma_channel_abort(tx_dma_chan);
   uart_deinit(PROBE_UART_INTERFACE);
   tud_cdc_write_clear();
   tud_cdc_read_flush();
-  uart_init(PROBE_UART_INTERFACE, line_coding->bit_rate);
+  uart_setup(MAX(line_coding->bit_rate, 1));
+  irq_set_enabled(uart_irq(), true);
   vTaskResume(uart_taskhandle);
 }
 
 void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
   /* CDC drivers use linestate as a bodge to activate/deactivate the interface.
-   * Resume our UART polling on activate, stop on deactivate */
-  if (!dtr && !rts)
-    vTaskSuspend(uart_taskhandle);
-  else
-    vTaskResume(uart_taskhandle);
+   * Output received while the port was closed is sent once it opens. */
+  xTaskNotifyGive(uart_taskhandle);
 }
+
+/* Data from the host is waiting */
+void tud_cdc_rx_cb(uint8_t itf) { xTaskNotifyGive(uart_taskhandle); }
+
+/* The host has read data, there is room in the CDC FIFO again */
+void tud_cdc_tx_complete_cb(uint8_t itf) { xTaskNotifyGive(uart_taskhandle); }
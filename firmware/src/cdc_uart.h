@@ -28,11 +28,58 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sub-commands of the UART vendor command */
+enum {
+  UART_CMD_STATS,
+  UART_CMD_HISTORY_INFO,
+  UART_CMD_HISTORY_READ,
+  UART_CMD_HISTORY_REPLAY,
+  UART_CMD_FRAMED
+};
+
+/* Byte counters of the UART bridge since power-up */
+typedef struct __attribute__((packed)) {
+  /* Received from the target and sent to the target */
+  uint32_t rx_bytes;
+  uint32_t tx_bytes;
+  /* Number of times the RX FIFO overflowed, each loses at least one byte */
+  uint32_t rx_overrun;
+  /* Bytes lost because the UART task did not empty the receive buffer */
+  uint32_t rx_dropped;
+  uint32_t rx_framing;
+  uint32_t rx_parity;
+  uint32_t rx_break;
+  /* Highest fill level of the RX ring buffer in bytes */
+  uint32_t rx_peak;
+  uint32_t baudrate;
+  /* Bytes the serial port skipped, because they were lost or overwritten in
+   * the history before the host read them */
+  uint32_t host_lost;
+} uart_stats_t;
 
 void cdc_thread(void *ptr);
 void cdc_uart_init(void);
 void cdc_task(void);
 
+/* Copies the counters of the UART bridge */
+void cdc_uart_get_stats(uart_stats_t *dst);
+
+/* Sends the whole UART history to the serial port again */
+void cdc_uart_replay(void);
+
+/* Raises the RX interrupt after 4 instead of 16 bytes, such that triggers
+ * see UART bytes earlier while the target keeps sending */
+void cdc_uart_low_latency(bool enable);
+
+/* Switches the serial port between plain bytes and stream frames of
+ * STREAM_ID_UART, which carry the probe time at which their first byte was
+ * received. The switch happens between two frames and lasts until it is
+ * reverted or the probe resets. */
+void cdc_uart_set_framed(bool enable);
+
 extern TaskHandle_t uart_taskhandle;
 
 #endif
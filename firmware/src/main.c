@@ -26,21 +26,30 @@
  */
 
 #include "FreeRTOS.h"
-#include "message_buffer.h"
 #include "queue.h"
 #include "semphr.h"
 #include "task.h"
 
+#include <pico/bootrom.h>
 #include <pico/stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "bsp/board.h"
+#include "device/usbd_pvt.h"
 #include "tusb.h"
 
 #include "DAP.h"
 #include "cdc_uart.h"
 #include "get_serial.h"
+#include "probe_boot.h"
+#include "probe_events.h"
+#include "probe_image.h"
+#include "probe_logic.h"
+#include "probe_stats.h"
+#include "probe_stream.h"
+#include "probe_trigger.h"
+#include "probe_vendor.h"
 #include "rioteeprobe_config.h"
 #include "sbw_device.h"
 
@@ -51,35 +60,125 @@
 #define TUD_TASK_PRIO (tskIDLE_PRIORITY + 2)
 #define DAP_TASK_PRIO (tskIDLE_PRIORITY + 1)
 
+/* Stack of the DAP task in words. Nested batch operations, the image store
+ * with a flash page on the stack and the vendor handlers run in it. */
+#define DAP_TASK_STACK_SIZE 1024
+
+#define USB_CORE_MASK (1 << 0)
+#define DAP_CORE_MASK (1 << 1)
+
+/* Time for the host to collect the response before the USB device vanishes */
+#define BOOTLOADER_DELAY_MS 100
+
+/* Number of request slots handed between the USB and DAP tasks */
+#define DAP_N_SLOTS 8
+
 static TaskHandle_t dap_taskhandle, tud_taskhandle;
-static MessageBufferHandle_t dap_req_buf;
 
-int programming_enable(void);
+/* A DAP request and its response. Requests are read from the USB FIFO
+ * directly into a slot and processed in place by the DAP task. */
+typedef struct {
+  uint8_t req[CFG_TUD_VENDOR_EPSIZE] __attribute__((aligned(4)));
+  uint8_t rsp[CFG_TUD_VENDOR_EPSIZE] __attribute__((aligned(4)));
+} dap_slot_t;
+
+static dap_slot_t dap_slots[DAP_N_SLOTS];
+
+/* Lock-free queue of slot indices with a single producer and consumer. The
+ * free-running head is only written by the consumer and the tail only by the
+ * producer. */
+typedef struct {
+  uint8_t idx[DAP_N_SLOTS];
+  uint32_t head;
+  uint32_t tail;
+} slot_queue_t;
+
+/* Slots owned by the USB task (free_slots) and the DAP task (ready_slots) */
+static slot_queue_t free_slots, ready_slots;
+
+static bool slot_queue_put(slot_queue_t *q, uint8_t idx) {
+  uint32_t tail = q->tail;
+
+  if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) >= DAP_N_SLOTS)
+    return false;
+  q->idx[tail % DAP_N_SLOTS] = idx;
+  __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static bool slot_queue_get(slot_queue_t *q, uint8_t *idx) {
+  uint32_t head = q->head;
+
+  if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+    return false;
+  *idx = q->idx[head % DAP_N_SLOTS];
+  __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Moves DAP requests from the USB vendor FIFO into free slots and hands them
+ * to the DAP task.
+ *
+ * Requests for which there is no free slot stay in TinyUSB's vendor FIFO,
+ * which NAKs the host once it is full. Only one packet is read at a time, so a
+ * host keeping several requests in flight must pad them to the full packet
+ * size. Never blocks. Only called from the USB task.
+ */
+static void vendor_rx_drain(void) {
+  uint8_t idx;
+
+  while (tud_vendor_available() && slot_queue_get(&free_slots, &idx)) {
+    tud_vendor_read(dap_slots[idx].req, CFG_TUD_VENDOR_EPSIZE);
+    slot_queue_put(&ready_slots, idx);
+    xTaskNotifyGive(dap_taskhandle);
+  }
+}
+
+/* Set by the DAP task when it queued a drain, cleared by the USB task */
+static volatile bool drain_pending = false;
 
-int programming_disable(void);
+static void vendor_rx_deferred(void *param) {
+  drain_pending = false;
+  vendor_rx_drain();
+}
+
+/* Makes the USB task pick up requests that were left in the FIFO while all
+ * slots were in use. Only called from the DAP task after freeing a slot. */
+static void vendor_rx_wake(void) {
+  if (drain_pending || !tud_vendor_available())
+    return;
+  drain_pending = true;
+  usbd_defer_func(vendor_rx_deferred, NULL, false);
+}
 
 void usb_thread(void *ptr) {
   do {
+    /* Blocks until the USB interrupt or another task queues an event */
     tud_task();
-    // Trivial delay to save power
-    vTaskDelay(1);
   } while (1);
 }
 
 /* Gets DAP requests from USB vendor interface and queues them for processing
  */
 void tud_vendor_rx_cb(uint8_t itf) {
-  uint8_t req_buf[CFG_TUD_VENDOR_EPSIZE];
+  uint8_t discard[CFG_TUD_VENDOR_EPSIZE];
 
-  uint32_t req_len = tud_vendor_n_read(itf, req_buf, sizeof(req_buf));
-  xMessageBufferSend(dap_req_buf, req_buf, req_len, portMAX_DELAY);
+  if (itf == 0) {
+    vendor_rx_drain();
+    return;
+  }
+  /* The stream interface ignores data from the host */
+  while (tud_vendor_n_available(itf))
+    tud_vendor_n_read(itf, discard, sizeof(discard));
 }
 
+/* Moves further stream frames into the FIFO once the previous ones are sent */
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes) { stream_pump(); }
+
 /* Processes DAP requests */
 void dap_thread(void *ptr) {
   uint32_t resp_len;
-  uint8_t req_buf[CFG_TUD_VENDOR_EPSIZE];
-  uint8_t rsp_buf[CFG_TUD_VENDOR_EPSIZE];
+  uint8_t idx;
 
   sbw_pins_t pins = {.sbw_tck = PROBE_PIN_SBWCLK,
                      .sbw_tdio = PROBE_PIN_SBWIO,
@@ -89,13 +188,27 @@ void dap_thread(void *ptr) {
   sbw_dev_setup(&pins);
 
   while (1) {
-    xMessageBufferReceive(dap_req_buf, req_buf, CFG_TUD_VENDOR_EPSIZE,
-                          portMAX_DELAY);
+    /* Programming from the image store was triggered by the GPIO */
+    image_run_triggered();
+    /* Halts requested by triggers */
+    trigger_run_deferred();
+    /* Mailbox polls and cleanup of boot latency measurements */
+    boot_run_deferred();
+    /* Captures of the logic analyzer */
+    logic_run_deferred();
+    if (!slot_queue_get(&ready_slots, &idx)) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    uint8_t *req_buf = dap_slots[idx].req;
+    uint8_t *rsp_buf = dap_slots[idx].rsp;
 
     if (req_buf[0] == ID_DAP_Connect) {
       if (programming_enable() != 0) {
         rsp_buf[0] = DAP_ERROR;
         tud_vendor_write(rsp_buf, ((4U << 16) | 1U));
+        slot_queue_put(&free_slots, idx);
+        vendor_rx_wake();
         continue;
       }
     } else if (req_buf[0] == ID_DAP_Disconnect) {
@@ -105,9 +218,23 @@ void dap_thread(void *ptr) {
       gpio_put(PROBE_PIN_LED, !gpio_get(PROBE_PIN_LED));
     }
 
+    uint32_t t_start = time_us_32();
     resp_len = DAP_ProcessCommand(req_buf, rsp_buf);
+    /* Vendor commands record their statistics themselves */
+    if ((req_buf[0] < ID_DAP_Vendor0) || (req_buf[0] > ID_DAP_Vendor31))
+      stats_record(req_buf[0], t_start,
+                   (rsp_buf[0] == ID_DAP_Invalid) || (rsp_buf[1] == DAP_ERROR));
     tud_vendor_write(rsp_buf, resp_len);
     tud_vendor_flush();
+    /* TinyUSB has copied the response, the slot can take the next request */
+    slot_queue_put(&free_slots, idx);
+    vendor_rx_wake();
+
+    if (bootloader_requested()) {
+      vTaskDelay(pdMS_TO_TICKS(BOOTLOADER_DELAY_MS));
+      /* Enter the ROM's mass storage bootloader, blinking the LED on access */
+      reset_usb_boot(1u << PROBE_PIN_LED, 0);
+    }
   }
 }
 
@@ -165,16 +292,33 @@ int main(void) {
 
   printf("Welcome to Rioteeprobe!\n");
 
-  dap_req_buf = xMessageBufferCreate(256);
+  stream_init();
+  stats_init();
+  events_init();
+
+  for (uint8_t i = 0; i < DAP_N_SLOTS; i++)
+    slot_queue_put(&free_slots, i);
 
   /* UART needs to preempt USB as if we don't, characters get lost */
   xTaskCreate(cdc_thread, "UART", configMINIMAL_STACK_SIZE, NULL,
               UART_TASK_PRIO, &uart_taskhandle);
   xTaskCreate(usb_thread, "TUD", configMINIMAL_STACK_SIZE, NULL, TUD_TASK_PRIO,
               &tud_taskhandle);
-  xTaskCreate(dap_thread, "DAP", configMINIMAL_STACK_SIZE, NULL, DAP_TASK_PRIO,
+  xTaskCreate(dap_thread, "DAP", DAP_TASK_STACK_SIZE, NULL, DAP_TASK_PRIO,
               &dap_taskhandle);
 
+  /* The USB interrupt is handled on the core that called tusb_init(). Long
+   * SBW/JTAG sequences run on the other core so that they cannot delay UART
+   * and USB. */
+  vTaskCoreAffinitySet(uart_taskhandle, USB_CORE_MASK);
+  vTaskCoreAffinitySet(tud_taskhandle, USB_CORE_MASK);
+  vTaskCoreAffinitySet(dap_taskhandle, DAP_CORE_MASK);
+
+  image_init(dap_taskhandle);
+  trigger_init(dap_taskhandle);
+  boot_init(dap_taskhandle);
+  logic_init(dap_taskhandle);
+
   vTaskStartScheduler();
 
   return 0;
@@ -0,0 +1,103 @@
+/*
+ * Measures the execution time of the probe's primitives. Short iterations are
+ * timed with the SysTick counter, which runs at the CPU clock but wraps with
+ * every RTOS tick. Iterations longer than that are timed with the microsecond
+ * timer.
+ *
+ * SysTick is private to each core and the RTOS only runs it on configTICK_CORE.
+ * On the other core, the benchmark runs it freely and stops it afterwards.
+ */
+
+#include <hardware/clocks.h>
+#include <hardware/regs/m0plus.h>
+#include <hardware/structs/systick.h>
+#include <pico/stdlib.h>
+
+#include "DAP.h"
+#include "DAP_config.h"
+
+#include "probe_bench.h"
+#include "sbw_device.h"
+#include "sbw_jtag.h"
+#include "sbw_transport.h"
+
+/* Iterations shorter than this are timed with SysTick */
+#define BENCH_SYSTICK_MAX_US 20
+
+static uint32_t cycles_since(uint32_t systick_start, uint32_t us_start,
+                             uint32_t cycles_per_us) {
+  uint32_t systick_end = systick_hw->cvr;
+  uint32_t us = time_us_32() - us_start;
+
+  if (us < BENCH_SYSTICK_MAX_US) {
+    /* SysTick counts down from the reload value */
+    uint32_t reload = systick_hw->rvr + 1;
+    return (systick_start + reload - systick_end) % reload;
+  }
+  return us * cycles_per_us;
+}
+
+static int run_once(uint8_t primitive, uint32_t arg) {
+  uint16_t word = 0;
+  uint32_t data;
+
+  switch (primitive) {
+  case BENCH_NOP:
+    return 0;
+  case BENCH_SBW_SLOT:
+    tmsl_tdih();
+    return 0;
+  case BENCH_TAP_DR_SHIFT16:
+    tap_dr_shift16(0);
+    return 0;
+  case BENCH_MEM_READ_WORD:
+    return sbw_dev_mem_read(&word, arg, 1);
+  case BENCH_MEM_WRITE_WORD:
+    return sbw_dev_mem_write(arg, &word, 1);
+  case BENCH_SWD_TRANSFER:
+    return (SWD_Transfer(DAP_TRANSFER_RnW, &data) == DAP_TRANSFER_OK) ? 0 : -1;
+  default:
+    return -1;
+  }
+}
+
+int bench_run(bench_result_t *result, uint8_t primitive, uint32_t n_iter,
+              uint32_t arg) {
+  uint32_t clk_hz = clock_get_hz(clk_sys);
+  uint32_t cycles_per_us = clk_hz / 1000000;
+  uint32_t systick_csr = systick_hw->csr;
+  uint32_t systick_rvr = systick_hw->rvr;
+  int rc = 0;
+
+  if (!(systick_csr & M0PLUS_SYST_CSR_ENABLE_BITS)) {
+    systick_hw->rvr = M0PLUS_SYST_RVR_BITS;
+    systick_hw->cvr = 0;
+    systick_hw->csr =
+        M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+  }
+  uint64_t us_total_start = time_us_64();
+
+  result->n_iter = 0;
+  result->min_cycles = UINT32_MAX;
+  result->max_cycles = 0;
+  result->clk_hz = clk_hz;
+
+  while ((result->n_iter < n_iter) && (rc == 0)) {
+    uint32_t systick_start = systick_hw->cvr;
+    uint32_t us_start = time_us_32();
+
+    rc = run_once(primitive, arg);
+
+    uint32_t cycles = cycles_since(systick_start, us_start, cycles_per_us);
+    result->min_cycles = MIN(result->min_cycles, cycles);
+    result->max_cycles = MAX(result->max_cycles, cycles);
+    result->n_iter++;
+  }
+  result->total_cycles = (time_us_64() - us_total_start) * cycles_per_us;
+
+  if (!(systick_csr & M0PLUS_SYST_CSR_ENABLE_BITS)) {
+    systick_hw->csr = systick_csr;
+    systick_hw->rvr = systick_rvr;
+  }
+  return rc;
+}
@@ -0,0 +1,311 @@
+/*
+ * Boot latency measurement. Alarms switch power and end cycles, the UART and
+ * GPIO interrupts report milestones and the task polls the mailbox. The state
+ * changes under a hardware spin lock. Alarms carry the generation of the cycle
+ * they belong to, so that alarms of an ended cycle do nothing.
+ *
+ * Alarms, records and notifications are issued after releasing the lock: an
+ * alarm that is already due runs its callback right away.
+ */
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "probe_boot.h"
+#include "probe_events.h"
+#include "probe_trigger.h"
+#include "probe_vendor.h"
+#include "rioteeprobe_config.h"
+#include "sbw_jtag.h"
+
+enum { STATE_IDLE, STATE_OFF, STATE_ON };
+
+/* Work left for after releasing the lock */
+enum {
+  DO_POWER_OFF = 0x01,
+  DO_POWER_ON = 0x02,
+  /* Wait for the off-time of the next cycle */
+  DO_NEXT = 0x04,
+  /* Wait for the timeout of the current cycle */
+  DO_TIMEOUT = 0x08,
+  DO_POLL = 0x10,
+  DO_FINISH = 0x20,
+};
+
+static spin_lock_t *lock;
+static TaskHandle_t run_task;
+
+static boot_config_t config;
+static boot_cycle_t results[BOOT_MAX_CYCLES];
+
+static volatile uint8_t state;
+static volatile uint32_t generation;
+/* Milestones the current cycle still waits for */
+static volatile uint8_t pending;
+static uint16_t n_done;
+static uint32_t on_us;
+
+/* Power state before the measurement */
+static bool was_on;
+/* programming_disable() waits for the task */
+static volatile bool disable_pending;
+
+static int64_t power_on(alarm_id_t id, void *gen);
+static int64_t cycle_timeout(alarm_id_t id, void *gen);
+
+void boot_init(TaskHandle_t task) {
+  run_task = task;
+  if (lock == NULL)
+    lock = spin_lock_instance(spin_lock_claim_unused(true));
+  state = STATE_IDLE;
+  pending = 0;
+  n_done = 0;
+  disable_pending = false;
+  memset(&config, 0, sizeof(config));
+}
+
+/* Wakes the task unless running in it */
+static void wake_task(void) {
+  BaseType_t woken = pdFALSE;
+
+  if ((run_task == NULL) || (__get_current_exception() == 0))
+    return;
+  vTaskNotifyGiveFromISR(run_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+/* Restores what the measurement changed after it ended. powered is the power
+ * state it ended with. */
+static void finish(bool powered) {
+  if (powered != was_on)
+    event_record(EVENT_POWER, EVENT_CAUSE_BOOT, was_on);
+  if (config.wait & BOOT_WAIT_GPIO)
+    trigger_watch_edge(0, false, NULL);
+  if (config.wait & BOOT_WAIT_MAILBOX) {
+    disable_pending = true;
+    wake_task();
+  }
+}
+
+/* Ends the measurement if it is still in the given generation */
+static void stop(uint32_t gen) {
+  bool ended = false, powered = false;
+  uint32_t irq = spin_lock_blocking(lock);
+
+  if ((state != STATE_IDLE) && (gen == generation)) {
+    ended = true;
+    powered = gpio_get(PROBE_PIN_TARGET_POWER);
+    generation++;
+    state = STATE_IDLE;
+    pending = 0;
+    gpio_put(PROBE_PIN_TARGET_POWER, was_on);
+  }
+  spin_unlock(lock, irq);
+
+  if (ended)
+    finish(powered);
+}
+
+/* Carries out the work of a state change that led to generation gen */
+static void apply(unsigned int todo, uint32_t gen) {
+  if (todo & DO_POWER_OFF)
+    event_record(EVENT_POWER, EVENT_CAUSE_BOOT, 0);
+  if (todo & DO_POWER_ON)
+    event_record(EVENT_POWER, EVENT_CAUSE_BOOT, 1);
+  if ((todo & DO_NEXT) && (add_alarm_in_us(config.off_us, power_on,
+                                           (void *)(uintptr_t)gen, true) < 0))
+    stop(gen);
+  if ((todo & DO_TIMEOUT) &&
+      (add_alarm_in_us(config.timeout_us, cycle_timeout,
+                       (void *)(uintptr_t)gen, true) < 0))
+    stop(gen);
+  if (todo & DO_POLL)
+    wake_task();
+  if (todo & DO_FINISH)
+    finish(false);
+}
+
+/* Switches power off and continues with the next cycle or finishes. Called
+ * with the lock held. */
+static unsigned int end_cycle(void) {
+  gpio_put(PROBE_PIN_TARGET_POWER, false);
+  generation++;
+  pending = 0;
+  if (++n_done < config.n_cycles) {
+    state = STATE_OFF;
+    return DO_POWER_OFF | DO_NEXT;
+  }
+  state = STATE_IDLE;
+  gpio_put(PROBE_PIN_TARGET_POWER, was_on);
+  return DO_POWER_OFF | DO_FINISH;
+}
+
+static int64_t cycle_timeout(alarm_id_t id, void *gen) {
+  unsigned int todo = 0;
+  uint32_t irq = spin_lock_blocking(lock);
+
+  if ((state == STATE_ON) && ((uintptr_t)gen == generation))
+    todo = end_cycle();
+  uint32_t current = generation;
+  spin_unlock(lock, irq);
+
+  apply(todo, current);
+  return 0;
+}
+
+static int64_t power_on(alarm_id_t id, void *gen) {
+  unsigned int todo = 0;
+  uint32_t irq = spin_lock_blocking(lock);
+
+  if ((state == STATE_OFF) && ((uintptr_t)gen == generation)) {
+    boot_cycle_t *cycle = &results[n_done];
+
+    cycle->uart_us = BOOT_NOT_SEEN;
+    cycle->gpio_us = BOOT_NOT_SEEN;
+    cycle->mailbox_us = BOOT_NOT_SEEN;
+    cycle->mailbox_word = 0;
+    pending = config.wait;
+    state = STATE_ON;
+    on_us = time_us_32();
+    gpio_put(PROBE_PIN_TARGET_POWER, true);
+    todo = DO_POWER_ON | DO_TIMEOUT;
+    if (pending & BOOT_WAIT_MAILBOX)
+      todo |= DO_POLL;
+  }
+  spin_unlock(lock, irq);
+
+  apply(todo, (uintptr_t)gen);
+  return 0;
+}
+
+/* Stores the time of a milestone and ends the cycle when it was the last
+ * one */
+static void reached(uint8_t milestone, uint32_t time_us, uint16_t word) {
+  unsigned int todo = 0;
+  uint32_t irq = spin_lock_blocking(lock);
+  int32_t delay = time_us - on_us;
+
+  if ((state == STATE_ON) && (pending & milestone) && (delay >= 0)) {
+    boot_cycle_t *cycle = &results[n_done];
+
+    switch (milestone) {
+    case BOOT_WAIT_UART:
+      cycle->uart_us = delay;
+      break;
+    case BOOT_WAIT_GPIO:
+      cycle->gpio_us = delay;
+      break;
+    case BOOT_WAIT_MAILBOX:
+      cycle->mailbox_us = delay;
+      cycle->mailbox_word = word;
+      break;
+    }
+    pending &= ~milestone;
+    if (pending == 0)
+      todo = end_cycle();
+  }
+  uint32_t current = generation;
+  spin_unlock(lock, irq);
+
+  apply(todo, current);
+}
+
+static void gpio_reached(uint32_t time_us) {
+  reached(BOOT_WAIT_GPIO, time_us, 0);
+}
+
+int boot_start(const boot_config_t *cfg) {
+  if ((state != STATE_IDLE) || disable_pending)
+    return -1;
+  if ((cfg->n_cycles == 0) || (cfg->n_cycles > BOOT_MAX_CYCLES) ||
+      (cfg->wait == 0) ||
+      (cfg->wait & ~(BOOT_WAIT_UART | BOOT_WAIT_GPIO | BOOT_WAIT_MAILBOX)) ||
+      (cfg->timeout_us == 0))
+    return -1;
+  if ((cfg->wait & BOOT_WAIT_GPIO) &&
+      (trigger_watch_edge(cfg->gpio_pin, cfg->gpio_rising, gpio_reached) < 0))
+    return -1;
+
+  memcpy(&config, cfg, sizeof(config));
+  was_on = gpio_get(PROBE_PIN_TARGET_POWER);
+  /* Connects the SBW lines through the level translators */
+  if (config.wait & BOOT_WAIT_MAILBOX)
+    programming_enable();
+
+  uint32_t irq = spin_lock_blocking(lock);
+  uint32_t gen = ++generation;
+  n_done = 0;
+  pending = 0;
+  state = STATE_OFF;
+  gpio_put(PROBE_PIN_TARGET_POWER, false);
+  spin_unlock(lock, irq);
+
+  apply(DO_POWER_OFF | DO_NEXT, gen);
+  if (state == STATE_IDLE) {
+    /* The alarm failed, undo programming_enable() */
+    boot_run_deferred();
+    return -1;
+  }
+  return 0;
+}
+
+void boot_stop(void) {
+  stop(generation);
+  boot_run_deferred();
+}
+
+void boot_get_status(boot_status_t *status) {
+  uint32_t irq = spin_lock_blocking(lock);
+  status->running = (state != STATE_IDLE);
+  status->n_cycles = config.n_cycles;
+  status->n_done = n_done;
+  spin_unlock(lock, irq);
+}
+
+unsigned int boot_read(boot_cycle_t *dst, unsigned int index, unsigned int n) {
+  uint32_t irq = spin_lock_blocking(lock);
+
+  if (index >= n_done)
+    n = 0;
+  else
+    n = MIN(n, n_done - index);
+  memcpy(dst, &results[index], n * sizeof(boot_cycle_t));
+  spin_unlock(lock, irq);
+  return n;
+}
+
+bool boot_uart_armed(void) {
+  return (state == STATE_ON) && (pending & BOOT_WAIT_UART);
+}
+
+void boot_uart_rx(uint32_t first_us) {
+  reached(BOOT_WAIT_UART, first_us, 0);
+}
+
+/* Reads the mailbox until the target writes it or the cycle ends. Blocks the
+ * task for up to the timeout. */
+static void poll_mailbox(void) {
+  uint32_t gen = generation;
+  uint16_t word;
+
+  if (sbw_jtag_connect() != SBW_ERR_NONE)
+    return;
+  while ((state == STATE_ON) && (generation == gen) &&
+         (pending & BOOT_WAIT_MAILBOX)) {
+    if (sbw_jtag_read_jmb_out16(&word) == SBW_ERR_NONE) {
+      reached(BOOT_WAIT_MAILBOX, time_us_32(), word);
+      break;
+    }
+  }
+  sbw_jtag_disconnect();
+}
+
+void boot_run_deferred(void) {
+  if ((state == STATE_ON) && (pending & BOOT_WAIT_MAILBOX))
+    poll_mailbox();
+  if (disable_pending) {
+    disable_pending = false;
+    programming_disable();
+  }
+}
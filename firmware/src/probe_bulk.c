@@ -0,0 +1,256 @@
+/*
+ * Streaming transfers to and from MSP430 memory. The host announces an
+ * address range and then streams data packets without per-packet address
+ * headers, keeping several packets in flight. Requests that the DAP thread
+ * cannot take yet remain in TinyUSB's vendor FIFO.
+ *
+ * Compressed reads run-length encode the data so that erased or zeroed
+ * memory takes a fraction of the packets. They also give access to nRF52
+ * memory through the probe's MEM-AP routines.
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "probe_bulk.h"
+#include "probe_vendor.h"
+#include "sbw_device.h"
+#include "swd_mem.h"
+
+/* Runs shorter than this are cheaper to send as literals */
+#define RLE_MIN_RUN 3
+/*
+ * Worst case output of one encoder step: two literal words, one of which
+ * opens a new literal token
+ */
+#define RLE_STEP_MAX_LEN 5
+
+static struct {
+  uint8_t state;
+  uint8_t flags;
+  uint32_t addr;
+  uint32_t remaining;
+  uint32_t err_addr;
+} xfer = {.state = BULK_STATE_IDLE};
+
+static uint16_t verify_buf[BULK_WORDS_PER_PKT];
+
+/* Words of a compressed read that were fetched but not yet encoded */
+static struct {
+  union {
+    uint16_t u16[BULK_RLE_CHUNK_WORDS];
+    uint32_t u32[BULK_RLE_CHUNK_WORDS / 2];
+  } buf;
+  unsigned int pos;
+  unsigned int len;
+} lookahead;
+
+static bool swd_connected = false;
+
+static void release_target(void) {
+  if (!swd_connected)
+    return;
+  PORT_OFF();
+  programming_disable();
+  swd_connected = false;
+}
+
+static int connect_nrf52(void) {
+  programming_enable();
+  PORT_SWD_SETUP();
+  swd_connected = true;
+  if (swd_mem_connect() < 0) {
+    release_target();
+    return -1;
+  }
+  return 0;
+}
+
+static int start(uint8_t state, uint32_t addr, uint32_t n_words,
+                 uint8_t flags) {
+  release_target();
+  if (n_words == 0)
+    return -1;
+  xfer.state = state;
+  xfer.flags = flags;
+  xfer.addr = addr;
+  xfer.remaining = n_words;
+  xfer.err_addr = 0;
+  lookahead.pos = 0;
+  lookahead.len = 0;
+  return 0;
+}
+
+static void advance(unsigned int n_words) {
+  xfer.addr += 2 * n_words;
+  xfer.remaining -= n_words;
+  if (xfer.remaining == 0)
+    xfer.state = BULK_STATE_DONE;
+}
+
+static int fail(uint32_t addr) {
+  release_target();
+  xfer.state = BULK_STATE_ERROR;
+  xfer.err_addr = addr;
+  return -1;
+}
+
+int bulk_start_write(uint32_t addr, uint32_t n_words, uint8_t flags) {
+  return start(BULK_STATE_WRITE, addr, n_words, flags);
+}
+
+int bulk_start_read(uint32_t addr, uint32_t n_words, uint8_t flags) {
+  if (flags & BULK_FLAG_NRF52) {
+    /* The MEM-AP is accessed in whole 32-bit words */
+    if (!(flags & BULK_FLAG_RLE) || (addr & 0x3) || (n_words & 0x1))
+      return -1;
+  }
+  if (start(BULK_STATE_READ, addr, n_words, flags) < 0)
+    return -1;
+  if ((flags & BULK_FLAG_NRF52) && (connect_nrf52() < 0))
+    return fail(addr);
+  return 0;
+}
+
+uint8_t bulk_state(void) { return xfer.state; }
+
+uint8_t bulk_flags(void) { return xfer.flags; }
+
+unsigned int bulk_next_words(void) {
+  if ((xfer.state != BULK_STATE_WRITE) && (xfer.state != BULK_STATE_READ))
+    return 0;
+  return MIN(xfer.remaining, BULK_WORDS_PER_PKT);
+}
+
+int bulk_write_data(const uint16_t *data) {
+  unsigned int n_words = bulk_next_words();
+
+  /* Packets still in flight after an error are discarded */
+  if (xfer.state != BULK_STATE_WRITE)
+    return -1;
+
+  if (sbw_dev_mem_write(xfer.addr, (uint16_t *)data, n_words) != 0)
+    return fail(xfer.addr);
+
+  if (xfer.flags & BULK_FLAG_VERIFY) {
+    if (sbw_dev_mem_read(verify_buf, xfer.addr, n_words) != 0)
+      return fail(xfer.addr);
+    for (unsigned int i = 0; i < n_words; i++) {
+      if (verify_buf[i] != data[i])
+        return fail(xfer.addr + 2 * i);
+    }
+  }
+  advance(n_words);
+  return 0;
+}
+
+int bulk_read_data(uint16_t *dst) {
+  unsigned int n_words = bulk_next_words();
+
+  if (xfer.state != BULK_STATE_READ)
+    return -1;
+
+  if (sbw_dev_mem_read(dst, xfer.addr, n_words) != 0)
+    return fail(xfer.addr);
+
+  advance(n_words);
+  return n_words;
+}
+
+/**
+ * Makes sure that the next word of a compressed read is buffered
+ *
+ * @returns 1 if a word is available, 0 at the end of the transfer, <0 on error
+ */
+static int lookahead_fill(void) {
+  unsigned int n_words;
+  int rc;
+
+  if (lookahead.pos < lookahead.len)
+    return 1;
+  if (xfer.remaining == 0)
+    return 0;
+
+  n_words = MIN(xfer.remaining, BULK_RLE_CHUNK_WORDS);
+  if (xfer.flags & BULK_FLAG_NRF52)
+    rc = swd_mem_read_block(lookahead.buf.u32, xfer.addr, n_words / 2);
+  else
+    rc = (sbw_dev_mem_read(lookahead.buf.u16, xfer.addr, n_words) == 0) ? 0
+                                                                        : -1;
+  if (rc < 0)
+    return fail(xfer.addr);
+
+  lookahead.pos = 0;
+  lookahead.len = n_words;
+  xfer.addr += 2 * n_words;
+  xfer.remaining -= n_words;
+  return 1;
+}
+
+int bulk_read_rle(uint8_t *dst, unsigned int max_len) {
+  unsigned int len = 0;
+  unsigned int n_words = 0;
+  /* Offset of the header of the literal token that is still open */
+  int lit = -1;
+  int rc = 0;
+
+  if ((xfer.state != BULK_STATE_READ) || !(xfer.flags & BULK_FLAG_RLE))
+    return -1;
+
+  while ((len + RLE_STEP_MAX_LEN <= max_len) &&
+         (n_words < BULK_RLE_MAX_WORDS)) {
+    if ((rc = lookahead_fill()) <= 0)
+      break;
+
+    uint16_t value = lookahead.buf.u16[lookahead.pos];
+    unsigned int run = 0;
+    while ((n_words + run < BULK_RLE_MAX_WORDS) &&
+           ((rc = lookahead_fill()) > 0) &&
+           (lookahead.buf.u16[lookahead.pos] == value)) {
+      lookahead.pos++;
+      run++;
+    }
+    if (rc < 0)
+      break;
+    n_words += run;
+
+    if (run >= RLE_MIN_RUN) {
+      dst[len++] = BULK_RLE_RUN | ((run - 1) >> 8);
+      dst[len++] = (run - 1) & 0xFF;
+      memcpy(&dst[len], &value, sizeof(value));
+      len += sizeof(value);
+      lit = -1;
+      continue;
+    }
+    for (unsigned int i = 0; i < run; i++) {
+      if ((lit < 0) || (dst[lit] == BULK_RLE_LITERAL_MAX - 1)) {
+        lit = len;
+        dst[len++] = 0;
+      } else {
+        dst[lit]++;
+      }
+      memcpy(&dst[len], &value, sizeof(value));
+      len += sizeof(value);
+    }
+  }
+
+  if (rc < 0)
+    return -1;
+  if ((xfer.remaining == 0) && (lookahead.pos == lookahead.len)) {
+    xfer.state = BULK_STATE_DONE;
+    release_target();
+  }
+  return len;
+}
+
+void bulk_get_status(bulk_status_t *status) {
+  status->state = xfer.state;
+  status->remaining = xfer.remaining + lookahead.len - lookahead.pos;
+  status->err_addr = xfer.err_addr;
+}
+
+void bulk_abort(void) {
+  release_target();
+  xfer.state = BULK_STATE_IDLE;
+}
@@ -0,0 +1,149 @@
+/*
+ * Event timeline. Records from tasks and interrupts are collected in one
+ * frame under a hardware spin lock. A frame is queued on the stream when the
+ * next record does not fit or when an alarm fires EVENT_FLUSH_US after its
+ * first record.
+ */
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "probe_events.h"
+#include "probe_stream.h"
+#include "probe_trigger.h"
+#include "rioteeprobe_config.h"
+
+volatile uint32_t event_types = 0;
+
+static spin_lock_t *lock;
+
+static uint8_t frame[STREAM_MAX_PAYLOAD];
+static size_t frame_len;
+static uint32_t frame_records;
+/* An alarm will send the frame */
+static bool flush_scheduled;
+
+static uint32_t n_recorded, n_dropped;
+
+void events_init(void) {
+  if (lock == NULL)
+    lock = spin_lock_instance(spin_lock_claim_unused(true));
+  event_types = 0;
+  frame_len = 0;
+  frame_records = 0;
+  flush_scheduled = false;
+  n_recorded = 0;
+  n_dropped = 0;
+}
+
+/* Queues records that were taken out of the frame. Called without the lock,
+ * as stream_send() may wake the USB task. */
+static void send(const uint8_t *data, size_t len, uint32_t n_records) {
+  int rc = stream_send(STREAM_ID_EVENT, data, len);
+
+  uint32_t irq = spin_lock_blocking(lock);
+  if (rc == 0)
+    n_recorded += n_records;
+  else
+    n_dropped += n_records;
+  spin_unlock(lock, irq);
+}
+
+void events_flush(void) {
+  uint8_t full[STREAM_MAX_PAYLOAD];
+  uint32_t irq = spin_lock_blocking(lock);
+  size_t len = frame_len;
+  uint32_t n = frame_records;
+
+  memcpy(full, frame, len);
+  frame_len = 0;
+  frame_records = 0;
+  spin_unlock(lock, irq);
+
+  if (len > 0)
+    send(full, len, n);
+}
+
+static int64_t flush_alarm(alarm_id_t id, void *param) {
+  flush_scheduled = false;
+  events_flush();
+  return 0;
+}
+
+void event_add(uint8_t type, uint8_t arg, uint16_t value, uint32_t time_us,
+               const uint8_t *data, size_t len) {
+  event_t ev = {.time_us = time_us, .type = type, .arg = arg, .value = value};
+  uint8_t full[STREAM_MAX_PAYLOAD];
+  size_t full_len = 0;
+  uint32_t full_records = 0;
+  bool schedule = false;
+
+  if (!stream_enabled(STREAM_ID_EVENT))
+    return;
+
+  uint32_t irq = spin_lock_blocking(lock);
+  if (frame_len + sizeof(ev) + len > STREAM_MAX_PAYLOAD) {
+    memcpy(full, frame, frame_len);
+    full_len = frame_len;
+    full_records = frame_records;
+    frame_len = 0;
+    frame_records = 0;
+  }
+  memcpy(&frame[frame_len], &ev, sizeof(ev));
+  memcpy(&frame[frame_len + sizeof(ev)], data, len);
+  frame_len += sizeof(ev) + len;
+  frame_records++;
+  if (!flush_scheduled) {
+    flush_scheduled = true;
+    schedule = true;
+  }
+  spin_unlock(lock, irq);
+
+  if (full_len > 0)
+    send(full, full_len, full_records);
+  /* Without an alarm the frame waits for the next full one */
+  if (schedule &&
+      (add_alarm_in_us(EVENT_FLUSH_US, flush_alarm, NULL, true) < 0))
+    flush_scheduled = false;
+}
+
+void event_uart(const uint8_t *data, size_t len, uint32_t time_us,
+                uint32_t lost) {
+  if (!(event_types & (1UL << EVENT_UART)))
+    return;
+
+  while (len > 0) {
+    size_t n = MIN(len, EVENT_DATA_MAX);
+
+    event_add(EVENT_UART, n, MIN(lost, UINT16_MAX), time_us, data, n);
+    data += n;
+    len -= n;
+    lost = 0;
+  }
+}
+
+void events_enable(uint32_t mask) {
+  uint32_t added = mask & ~event_types;
+
+  event_types = mask;
+  if (added & (1UL << EVENT_POWER))
+    event_record(EVENT_POWER, EVENT_CAUSE_STATE,
+                 gpio_get(PROBE_PIN_TARGET_POWER));
+#ifdef PROBE_PIN_BYPASS_ENABLE
+  if (added & (1UL << EVENT_BYPASS))
+    event_record(EVENT_BYPASS, EVENT_CAUSE_STATE,
+                 gpio_get(PROBE_PIN_BYPASS_ENABLE));
+#endif
+  trigger_log_gpio(mask & (1UL << EVENT_GPIO));
+  if (mask == 0)
+    events_flush();
+}
+
+void events_get_status(event_status_t *status) {
+  uint32_t irq = spin_lock_blocking(lock);
+  status->enabled = event_types;
+  status->recorded = n_recorded;
+  status->dropped = n_dropped;
+  spin_unlock(lock, irq);
+}
@@ -0,0 +1,452 @@
+/*
+ * Image store and standalone programming. Images are uploaded once into slots
+ * at the end of the probe's flash and can then be programmed to MSP430 (SBW)
+ * or nRF52 (SWD) targets without a host, triggered by a GPIO or a vendor
+ * command. The result is reported on the LED and, on the Riotee Probe, on two
+ * header GPIOs.
+ *
+ * The firmware runs from RAM (copy_to_ram), so the other core does not have to
+ * be stopped while the flash is erased or programmed.
+ */
+
+#include <hardware/flash.h>
+#include <hardware/irq.h>
+#include <hardware/regs/addressmap.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP.h"
+#include "DAP_config.h"
+
+#include "probe_image.h"
+#include "probe_vendor.h"
+#include "rioteeprobe_config.h"
+#include "sbw_device.h"
+#include "swd_mem.h"
+
+#define IMAGE_STORE_OFFSET                                                     \
+  (PICO_FLASH_SIZE_BYTES - IMAGE_N_SLOTS * IMAGE_SLOT_SIZE)
+
+#define IMAGE_MAGIC 0x474D4952
+
+/* Number of words written and verified at once */
+#define IMAGE_CHUNK_WORDS 32
+
+/* nRF52 non-volatile memory controller */
+#define NVMC_READY 0x4001E400
+#define NVMC_CONFIG 0x4001E504
+#define NVMC_ERASEALL 0x4001E50C
+#define NVMC_CONFIG_REN 0
+#define NVMC_CONFIG_WEN 1
+#define NVMC_CONFIG_EEN 2
+#define NVMC_TIMEOUT_US 1000000
+
+#define SCB_AIRCR 0xE000ED0C
+#define AIRCR_SYSRESETREQ 0x05FA0004
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  image_info_t info;
+} image_header_t;
+
+static struct {
+  bool active;
+  unsigned int slot;
+  image_info_t info;
+  /* Number of bytes received */
+  uint32_t n_recv;
+  uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+} upload = {.active = false};
+
+static image_result_t result = {.result = IMAGE_RESULT_NONE};
+
+static TaskHandle_t run_task;
+static volatile bool triggered = false;
+static volatile bool running = false;
+static uint32_t t_trigger;
+static uint8_t autorun_mask = 0;
+
+static union {
+  uint16_t u16[IMAGE_CHUNK_WORDS];
+  uint32_t u32[IMAGE_CHUNK_WORDS];
+} verify_buf;
+
+static inline uint32_t slot_offset(unsigned int slot) {
+  return IMAGE_STORE_OFFSET + slot * IMAGE_SLOT_SIZE;
+}
+
+/* Records start after the header sector */
+static inline uint32_t data_offset(unsigned int slot) {
+  return slot_offset(slot) + FLASH_SECTOR_SIZE;
+}
+
+static inline const image_header_t *header_of(unsigned int slot) {
+  return (const image_header_t *)(XIP_BASE + slot_offset(slot));
+}
+
+static inline bool slot_valid(unsigned int slot) {
+  return header_of(slot)->magic == IMAGE_MAGIC;
+}
+
+static uint32_t crc32(const uint8_t *data, uint32_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (unsigned int k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static void write_header(unsigned int slot, const image_info_t *info) {
+  uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned(4)));
+  image_header_t hdr = {.magic = IMAGE_MAGIC, .info = *info};
+
+  memset(page, 0xFF, sizeof(page));
+  memcpy(page, &hdr, sizeof(hdr));
+  flash_range_erase(slot_offset(slot), FLASH_SECTOR_SIZE);
+  flash_range_program(slot_offset(slot), page, sizeof(page));
+}
+
+/* Programs the upload page buffer, erasing sectors on the way */
+static void flush_page(void) {
+  uint32_t offset = data_offset(upload.slot) +
+                    ((upload.n_recv - 1) / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE;
+
+  if ((offset % FLASH_SECTOR_SIZE) == 0)
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+  flash_range_program(offset, upload.page, FLASH_PAGE_SIZE);
+  memset(upload.page, 0xFF, FLASH_PAGE_SIZE);
+}
+
+static void update_pins(void) {
+#ifdef PROBE_PIN_IMAGE_TRIGGER
+  if (autorun_mask == 0)
+    return;
+  gpio_set_dir(PROBE_PIN_IMAGE_TRIGGER, GPIO_IN);
+  gpio_pull_up(PROBE_PIN_IMAGE_TRIGGER);
+  gpio_set_dir(PROBE_PIN_IMAGE_BUSY, GPIO_OUT);
+  gpio_set_dir(PROBE_PIN_IMAGE_PASS, GPIO_OUT);
+  gpio_put(PROBE_PIN_IMAGE_BUSY, running);
+  gpio_put(PROBE_PIN_IMAGE_PASS, result.result == IMAGE_RESULT_PASS);
+#endif
+}
+
+static void update_autorun_mask(void) {
+  autorun_mask = 0;
+  for (unsigned int i = 0; i < IMAGE_N_SLOTS; i++) {
+    if (slot_valid(i) && header_of(i)->info.autorun)
+      autorun_mask |= (1 << i);
+  }
+  update_pins();
+}
+
+#ifdef PROBE_PIN_IMAGE_TRIGGER
+static void trigger_isr(void) {
+  BaseType_t woken = pdFALSE;
+
+  if (!(gpio_get_irq_event_mask(PROBE_PIN_IMAGE_TRIGGER) & GPIO_IRQ_EDGE_FALL))
+    return;
+  gpio_acknowledge_irq(PROBE_PIN_IMAGE_TRIGGER, GPIO_IRQ_EDGE_FALL);
+
+  /* The header GPIOs are general purpose IOs unless a slot is armed */
+  if ((autorun_mask == 0) || running || triggered)
+    return;
+  t_trigger = time_us_32();
+  triggered = true;
+  vTaskNotifyGiveFromISR(run_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+#endif
+
+void image_init(TaskHandle_t task) {
+  run_task = task;
+  update_autorun_mask();
+
+#ifdef PROBE_PIN_IMAGE_TRIGGER
+  gpio_add_raw_irq_handler(PROBE_PIN_IMAGE_TRIGGER, trigger_isr);
+  gpio_set_irq_enabled(PROBE_PIN_IMAGE_TRIGGER, GPIO_IRQ_EDGE_FALL, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+#endif
+}
+
+int image_get_info(image_info_t *info, unsigned int slot) {
+  if (slot >= IMAGE_N_SLOTS)
+    return -1;
+  if (slot_valid(slot))
+    memcpy(info, &header_of(slot)->info, sizeof(image_info_t));
+  else
+    memset(info, 0, sizeof(image_info_t));
+  return 0;
+}
+
+int image_begin(unsigned int slot, uint8_t target, uint32_t size,
+                const char *name) {
+  if ((slot >= IMAGE_N_SLOTS) || (size == 0) ||
+      (size > IMAGE_SLOT_SIZE - FLASH_SECTOR_SIZE) ||
+      (target > IMAGE_TARGET_NRF52))
+    return -1;
+
+  image_erase(slot);
+  upload.active = true;
+  upload.slot = slot;
+  upload.n_recv = 0;
+  upload.info.valid = 1;
+  upload.info.target = target;
+  upload.info.autorun = 0;
+  memcpy(upload.info.name, name, IMAGE_NAME_LEN);
+  upload.info.size = size;
+  memset(upload.page, 0xFF, FLASH_PAGE_SIZE);
+  return 0;
+}
+
+int image_data(const uint8_t *data, unsigned int len) {
+  if (!upload.active || (upload.n_recv + len > upload.info.size)) {
+    upload.active = false;
+    return -1;
+  }
+
+  for (unsigned int i = 0; i < len; i++) {
+    upload.page[upload.n_recv % FLASH_PAGE_SIZE] = data[i];
+    upload.n_recv++;
+    if ((upload.n_recv % FLASH_PAGE_SIZE) == 0)
+      flush_page();
+  }
+  return 0;
+}
+
+int image_commit(uint32_t crc, bool autorun) {
+  if (!upload.active || (upload.n_recv != upload.info.size))
+    return -1;
+  upload.active = false;
+
+  if (upload.n_recv % FLASH_PAGE_SIZE)
+    flush_page();
+
+  upload.info.crc32 = crc32((const uint8_t *)XIP_BASE + data_offset(upload.slot),
+                            upload.info.size);
+  if (upload.info.crc32 != crc)
+    return -1;
+
+  upload.info.autorun = autorun;
+  write_header(upload.slot, &upload.info);
+  update_autorun_mask();
+  return 0;
+}
+
+int image_erase(unsigned int slot) {
+  if (slot >= IMAGE_N_SLOTS)
+    return -1;
+  if (upload.active && (upload.slot == slot))
+    upload.active = false;
+  if (slot_valid(slot)) {
+    flash_range_erase(slot_offset(slot), FLASH_SECTOR_SIZE);
+    update_autorun_mask();
+  }
+  return 0;
+}
+
+int image_set_autorun(unsigned int slot, bool autorun) {
+  image_info_t info;
+
+  if ((slot >= IMAGE_N_SLOTS) || !slot_valid(slot))
+    return -1;
+  memcpy(&info, &header_of(slot)->info, sizeof(info));
+  info.autorun = autorun;
+  write_header(slot, &info);
+  update_autorun_mask();
+  return 0;
+}
+
+static int fail(uint8_t step, uint32_t addr) {
+  result.step = step;
+  result.err_addr = addr;
+  return -1;
+}
+
+static int msp430_write_record(uint32_t addr, const uint8_t *data,
+                               uint32_t len) {
+  uint32_t n_words = len / 2;
+
+  for (uint32_t i = 0; i < n_words; i += IMAGE_CHUNK_WORDS) {
+    uint32_t n = MIN(n_words - i, IMAGE_CHUNK_WORDS);
+    uint16_t *words = (uint16_t *)data + i;
+
+    if (sbw_dev_mem_write(addr + 2 * i, words, n) != 0)
+      return fail(IMAGE_STEP_WRITE, addr + 2 * i);
+    if (sbw_dev_mem_read(verify_buf.u16, addr + 2 * i, n) != 0)
+      return fail(IMAGE_STEP_VERIFY, addr + 2 * i);
+    for (uint32_t k = 0; k < n; k++) {
+      if (verify_buf.u16[k] != words[k])
+        return fail(IMAGE_STEP_VERIFY, addr + 2 * (i + k));
+    }
+    gpio_put(PROBE_PIN_LED, !gpio_get(PROBE_PIN_LED));
+  }
+  return 0;
+}
+
+static int nvmc_wait_ready(void) {
+  uint32_t ready;
+  uint32_t t_start = time_us_32();
+
+  do {
+    if (swd_mem_read32(&ready, NVMC_READY) < 0)
+      return -1;
+    if (time_us_32() - t_start > NVMC_TIMEOUT_US)
+      return -1;
+  } while (!(ready & 1));
+  return 0;
+}
+
+static int nrf52_write_record(uint32_t addr, const uint8_t *data,
+                              uint32_t len) {
+  uint32_t n_words = len / 4;
+
+  for (uint32_t i = 0; i < n_words; i += IMAGE_CHUNK_WORDS) {
+    uint32_t n = MIN(n_words - i, IMAGE_CHUNK_WORDS);
+    const uint32_t *words = (const uint32_t *)data + i;
+
+    /* Accesses to flash stall with WAIT until the NVMC is ready again */
+    if ((swd_mem_write32(NVMC_CONFIG, NVMC_CONFIG_WEN) < 0) ||
+        (swd_mem_write_block(addr + 4 * i, words, n) < 0) ||
+        (nvmc_wait_ready() < 0))
+      return fail(IMAGE_STEP_WRITE, addr + 4 * i);
+    if ((swd_mem_write32(NVMC_CONFIG, NVMC_CONFIG_REN) < 0) ||
+        (swd_mem_read_block(verify_buf.u32, addr + 4 * i, n) < 0))
+      return fail(IMAGE_STEP_VERIFY, addr + 4 * i);
+    for (uint32_t k = 0; k < n; k++) {
+      if (verify_buf.u32[k] != words[k])
+        return fail(IMAGE_STEP_VERIFY, addr + 4 * (i + k));
+    }
+    gpio_put(PROBE_PIN_LED, !gpio_get(PROBE_PIN_LED));
+  }
+  return 0;
+}
+
+static int nrf52_erase(void) {
+  if ((swd_mem_write32(NVMC_CONFIG, NVMC_CONFIG_EEN) < 0) ||
+      (swd_mem_write32(NVMC_ERASEALL, 1) < 0) || (nvmc_wait_ready() < 0) ||
+      (swd_mem_write32(NVMC_CONFIG, NVMC_CONFIG_REN) < 0))
+    return fail(IMAGE_STEP_ERASE, 0);
+  return 0;
+}
+
+/* Calls write_record for every record of an image */
+static int write_records(unsigned int slot,
+                         int (*write_record)(uint32_t, const uint8_t *,
+                                             uint32_t)) {
+  const uint8_t *ptr = (const uint8_t *)XIP_BASE + data_offset(slot);
+  const uint8_t *end = ptr + header_of(slot)->info.size;
+  uint32_t align = (header_of(slot)->info.target == IMAGE_TARGET_NRF52) ? 4 : 2;
+
+  while (ptr < end) {
+    image_record_t rec;
+
+    memcpy(&rec, ptr, sizeof(rec));
+    ptr += sizeof(rec);
+    if ((rec.len > (uint32_t)(end - ptr)) || (rec.len % align) ||
+        (rec.addr % align))
+      return fail(IMAGE_STEP_CHECK, rec.addr);
+    if (write_record(rec.addr, ptr, rec.len) < 0)
+      return -1;
+    ptr += (rec.len + 3) & ~3UL;
+  }
+  return 0;
+}
+
+static int program_msp430(unsigned int slot) {
+  int rc;
+
+  programming_enable();
+  if ((sbw_dev_connect() != SBW_ERR_NONE) ||
+      (sbw_dev_halt() != SBW_ERR_NONE))
+    rc = fail(IMAGE_STEP_CONNECT, 0);
+  else
+    rc = write_records(slot, msp430_write_record);
+
+  if (rc == 0)
+    sbw_dev_release();
+  sbw_dev_disconnect();
+  programming_disable();
+  return rc;
+}
+
+static int program_nrf52(unsigned int slot) {
+  int rc;
+
+  programming_enable();
+  PORT_SWD_SETUP();
+  if (swd_mem_connect() < 0)
+    rc = fail(IMAGE_STEP_CONNECT, 0);
+  else if (nrf52_erase() < 0)
+    rc = -1;
+  else
+    rc = write_records(slot, nrf52_write_record);
+
+  if (rc == 0)
+    swd_mem_write32(SCB_AIRCR, AIRCR_SYSRESETREQ);
+  PORT_OFF();
+  programming_disable();
+  return rc;
+}
+
+static int program_slot(unsigned int slot) {
+  const image_header_t *hdr = header_of(slot);
+
+  if (!slot_valid(slot))
+    return fail(IMAGE_STEP_CHECK, 0);
+  if (crc32((const uint8_t *)XIP_BASE + data_offset(slot), hdr->info.size) !=
+      hdr->info.crc32)
+    return fail(IMAGE_STEP_CHECK, 0);
+
+  if (hdr->info.target == IMAGE_TARGET_MSP430)
+    return program_msp430(slot);
+  return program_nrf52(slot);
+}
+
+static int run(uint8_t slot_mask, uint32_t t_start) {
+  int rc = 0;
+
+  if (slot_mask == 0)
+    slot_mask = autorun_mask;
+
+  running = true;
+  update_pins();
+  result.step = IMAGE_STEP_NONE;
+  result.err_addr = 0;
+
+  if (slot_mask == 0)
+    rc = fail(IMAGE_STEP_CHECK, 0);
+  for (unsigned int i = 0; (i < IMAGE_N_SLOTS) && (rc == 0); i++) {
+    if (slot_mask & (1 << i)) {
+      result.slot = i;
+      rc = program_slot(i);
+    }
+  }
+
+  result.cycle_us = time_us_32() - t_start;
+  if (rc == 0) {
+    result.result = IMAGE_RESULT_PASS;
+    result.n_pass++;
+  } else {
+    result.result = IMAGE_RESULT_FAIL;
+    result.n_fail++;
+  }
+  gpio_put(PROBE_PIN_LED, rc == 0);
+  running = false;
+  update_pins();
+  return rc;
+}
+
+int image_run(uint8_t slot_mask) { return run(slot_mask, time_us_32()); }
+
+void image_run_triggered(void) {
+  if (!triggered)
+    return;
+  run(0, t_trigger);
+  /* Edges while programming are bounces of the same trigger */
+  triggered = false;
+}
+
+void image_get_result(image_result_t *dst) { *dst = result; }
@@ -0,0 +1,316 @@
+/*
+ * Logic analyzer. A PIO state machine takes snapshots of all GPIOs and a DMA
+ * channel writes them into a ring that wraps in hardware. The program is
+ * assembled for each capture: it samples while waiting for the trigger edge,
+ * raises PIO IRQ 0 at the trigger, takes the post-trigger samples counted in
+ * X and raises PIO IRQ 1. Every path through the program takes
+ * LOGIC_CYCLES_PER_SAMPLE cycles per sample, so the samples are evenly spaced
+ * across the trigger.
+ *
+ * The DAP task extracts the channels from the snapshots and sends them.
+ */
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/pio.h>
+#include <hardware/pio_instructions.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "probe_logic.h"
+#include "probe_stream.h"
+#include "probe_vendor.h"
+#include "rioteeprobe_config.h"
+
+static uint32_t ring[LOGIC_MAX_SAMPLES]
+    __attribute__((aligned(LOGIC_BUFFER_SIZE)));
+
+static const PIO pio = pio0;
+static int sm = -1;
+static int dma_chan = -1;
+static TaskHandle_t run_task;
+
+static uint16_t instructions[16];
+static pio_program_t program = {.instructions = instructions, .origin = -1};
+static unsigned int prog_offset;
+static bool loaded;
+
+/* GPIO of each channel, -1 where the board has none */
+static int channel_pins[LOGIC_N_CHANNELS];
+
+static logic_config_t config;
+static volatile uint8_t state;
+static uint32_t rate_hz, trigger_us, n_pre, n_samples, n_frames;
+
+/* Frame being filled by put() */
+static uint8_t frame[STREAM_MAX_PAYLOAD];
+static size_t frame_len;
+
+static void pio_isr(void) {
+  uint32_t now = time_us_32();
+  BaseType_t woken = pdFALSE;
+
+  if (pio_interrupt_get(pio, 0)) {
+    pio_interrupt_clear(pio, 0);
+    trigger_us = now;
+    state = LOGIC_STATE_TRIGGERED;
+  }
+  if (pio_interrupt_get(pio, 1)) {
+    pio_interrupt_clear(pio, 1);
+    state = LOGIC_STATE_CAPTURED;
+    vTaskNotifyGiveFromISR(run_task, &woken);
+  }
+  portYIELD_FROM_ISR(woken);
+}
+
+void logic_init(TaskHandle_t task) {
+  run_task = task;
+  for (unsigned int i = 0; i < LOGIC_N_CHANNELS - 1; i++)
+    channel_pins[i] = probe_gpio_pin(i);
+  channel_pins[LOGIC_N_CHANNELS - 1] = PROBE_UART_RX;
+
+  /* Without either one the vendor command fails */
+  sm = pio_claim_unused_sm(pio, false);
+  dma_chan = dma_claim_unused_channel(false);
+  if ((sm < 0) || (dma_chan < 0))
+    return;
+
+  pio_set_irq0_source_enabled(pio, pis_interrupt0, true);
+  pio_set_irq0_source_enabled(pio, pis_interrupt1, true);
+  irq_set_exclusive_handler(PIO0_IRQ_0, pio_isr);
+  irq_set_enabled(PIO0_IRQ_0, true);
+}
+
+/**
+ * Assembles the program for a trigger mode. Loops that wait for a level take
+ * one cycle less when they are left through their jump, a nop or the trigger
+ * IRQ makes up for it.
+ *
+ * @returns number of instructions
+ */
+static unsigned int assemble(uint16_t *prog, uint8_t mode) {
+  const uint16_t sample = pio_encode_in(pio_pins, 32);
+  unsigned int n = 0, back = 0, post;
+
+  switch (mode) {
+  case LOGIC_TRIG_RISE:
+    /* While high */
+    prog[n++] = sample | pio_encode_delay(1);
+    prog[n++] = pio_encode_jmp_pin(0);
+    /* While low */
+    prog[n++] = sample;
+    prog[n++] = pio_encode_jmp_pin(5);
+    prog[n++] = pio_encode_jmp(2);
+    break;
+  case LOGIC_TRIG_FALL:
+    /* While low */
+    prog[n++] = sample;
+    prog[n++] = pio_encode_jmp_pin(3);
+    prog[n++] = pio_encode_jmp(0);
+    prog[n++] = pio_encode_nop();
+    /* While high, the jump back is placed after the program */
+    prog[n++] = sample;
+    back = n++;
+    break;
+  }
+  prog[n++] = pio_encode_irq_set(false, 0);
+  post = n;
+  prog[n++] = sample | pio_encode_delay(1);
+  prog[n++] = pio_encode_jmp_x_dec(post);
+  prog[n++] = pio_encode_irq_set(false, 1);
+  prog[n] = pio_encode_jmp(n);
+  n++;
+  if (back != 0) {
+    prog[back] = pio_encode_jmp_pin(n);
+    prog[n++] = pio_encode_jmp(back - 1);
+  }
+  return n;
+}
+
+/* Stops the state machine and the DMA channel and unloads the program */
+static void release(void) {
+  if (!loaded)
+    return;
+  pio_sm_set_enabled(pio, sm, false);
+  dma_channel_abort(dma_chan);
+  pio_interrupt_clear(pio, 0);
+  pio_interrupt_clear(pio, 1);
+  pio_remove_program(pio, &program, prog_offset);
+  loaded = false;
+}
+
+int logic_start(const logic_config_t *cfg) {
+  uint32_t n_max = LOGIC_MAX_SAMPLES;
+  uint32_t clk_hz = clock_get_hz(clk_sys) / LOGIC_CYCLES_PER_SAMPLE;
+
+  if ((sm < 0) || (dma_chan < 0) || loaded)
+    return -1;
+  if ((cfg->rate_hz == 0) || (cfg->n_post == 0) ||
+      (cfg->trig_mode > LOGIC_TRIG_FALL) || (cfg->encoding > LOGIC_ENC_RLE))
+    return -1;
+  if (cfg->trig_mode != LOGIC_TRIG_NONE) {
+    if ((cfg->trig_channel >= LOGIC_N_CHANNELS) ||
+        (channel_pins[cfg->trig_channel] < 0))
+      return -1;
+    /* Pre-trigger samples, the trigger sample and the post-trigger samples
+     * must fit the ring */
+    if (cfg->n_pre >= n_max)
+      return -1;
+    n_max -= cfg->n_pre + 1;
+  }
+  if (cfg->n_post > n_max)
+    return -1;
+
+  memcpy(&config, cfg, sizeof(config));
+  program.length = assemble(instructions, config.trig_mode);
+  if (!pio_can_add_program(pio, &program))
+    return -1;
+  prog_offset = pio_add_program(pio, &program);
+  loaded = true;
+
+  /* An integer divider keeps the samples evenly spaced */
+  uint32_t div = (clk_hz + config.rate_hz / 2) / config.rate_hz;
+  div = MAX(1, MIN(div, UINT16_MAX));
+  rate_hz = clk_hz / div;
+
+  pio_sm_config c = pio_get_default_sm_config();
+  sm_config_set_in_pins(&c, 0);
+  sm_config_set_in_shift(&c, false, true, 32);
+  sm_config_set_wrap(&c, prog_offset, prog_offset + program.length - 1);
+  sm_config_set_clkdiv_int_frac(&c, div, 0);
+  if (config.trig_mode != LOGIC_TRIG_NONE)
+    sm_config_set_jmp_pin(&c, channel_pins[config.trig_channel]);
+  pio_sm_init(pio, sm, prog_offset, &c);
+
+  /* X is loaded through the TX FIFO before that is joined to the RX FIFO */
+  pio_sm_put(pio, sm, config.n_post - 1);
+  pio_sm_exec(pio, sm, pio_encode_pull(false, false));
+  pio_sm_exec(pio, sm, pio_encode_mov(pio_x, pio_osr));
+  sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+  pio_sm_set_config(pio, sm, &c);
+
+  dma_channel_config d = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&d, DMA_SIZE_32);
+  channel_config_set_read_increment(&d, false);
+  channel_config_set_write_increment(&d, true);
+  channel_config_set_ring(&d, true, __builtin_ctz(LOGIC_BUFFER_SIZE));
+  channel_config_set_dreq(&d, pio_get_dreq(pio, sm, false));
+  dma_channel_configure(dma_chan, &d, ring, &pio->rxf[sm], UINT32_MAX, true);
+
+  trigger_us = 0;
+  n_pre = 0;
+  n_samples = 0;
+  n_frames = 0;
+  state = LOGIC_STATE_ARMED;
+  pio_sm_set_enabled(pio, sm, true);
+  return 0;
+}
+
+void logic_stop(void) {
+  release();
+  state = LOGIC_STATE_IDLE;
+}
+
+void logic_get_status(logic_status_t *status) {
+  status->state = state;
+  status->rate_hz = rate_hz;
+  status->trigger_us = trigger_us;
+  status->n_pre = n_pre;
+  status->n_samples = n_samples;
+  status->n_frames = n_frames;
+}
+
+/* Returns the channel levels in a GPIO snapshot */
+static uint8_t levels_of(uint32_t snapshot) {
+  uint8_t levels = 0;
+
+  for (unsigned int i = 0; i < LOGIC_N_CHANNELS; i++) {
+    if (channel_pins[i] >= 0)
+      levels |= ((snapshot >> channel_pins[i]) & 1) << i;
+  }
+  return levels;
+}
+
+/* Queues the frame, waiting for space instead of dropping it */
+static int flush(void) {
+  int rc;
+
+  if (frame_len == 0)
+    return 0;
+  if (stream_wait_free(STREAM_ID_LOGIC) < 0)
+    return -1;
+  rc = stream_send(STREAM_ID_LOGIC, frame, frame_len);
+  frame_len = 0;
+  if (rc == 0)
+    n_frames++;
+  return rc;
+}
+
+static int put(const void *data, size_t len) {
+  if ((frame_len + len > STREAM_MAX_PAYLOAD) && (flush() < 0))
+    return -1;
+  memcpy(&frame[frame_len], data, len);
+  frame_len += len;
+  return 0;
+}
+
+static int put_run(uint8_t levels, uint32_t run) {
+  uint16_t record = levels | ((run - 1) << LOGIC_N_CHANNELS);
+  return put(&record, sizeof(record));
+}
+
+/* Sends n samples starting at the ring position first */
+static int send_capture(uint32_t first, uint32_t n) {
+  uint8_t prev = 0;
+  uint32_t run = 0;
+
+  frame_len = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t levels = levels_of(ring[(first + i) % LOGIC_MAX_SAMPLES]);
+
+    if (config.encoding == LOGIC_ENC_RAW) {
+      if (put(&levels, sizeof(levels)) < 0)
+        return -1;
+      continue;
+    }
+    if ((run > 0) && ((levels != prev) || (run == LOGIC_RLE_RUN_MAX))) {
+      if (put_run(prev, run) < 0)
+        return -1;
+      run = 0;
+    }
+    prev = levels;
+    run++;
+  }
+  if ((run > 0) && (put_run(prev, run) < 0))
+    return -1;
+  return flush();
+}
+
+void logic_run_deferred(void) {
+  uint32_t written, first;
+
+  if (state != LOGIC_STATE_CAPTURED)
+    return;
+
+  /* The DMA channel empties the FIFO within a few cycles */
+  while (!pio_sm_is_rx_fifo_empty(pio, sm))
+    tight_loop_contents();
+  written = UINT32_MAX - dma_channel_hw_addr(dma_chan)->transfer_count;
+  release();
+
+  if (config.trig_mode == LOGIC_TRIG_NONE) {
+    n_pre = 0;
+    n_samples = config.n_post;
+    first = written - n_samples;
+  } else {
+    /* The last sample before the post-trigger samples saw the trigger */
+    uint32_t trigger = written - config.n_post - 1;
+    n_pre = MIN(config.n_pre, trigger);
+    n_samples = n_pre + 1 + config.n_post;
+    first = trigger - n_pre;
+  }
+  state = LOGIC_STATE_SENDING;
+  state = (send_capture(first, n_samples) == 0) ? LOGIC_STATE_DONE
+                                                : LOGIC_STATE_FAILED;
+}
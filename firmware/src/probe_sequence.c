@@ -0,0 +1,210 @@
+/*
+ * Interpreter for small programs that are uploaded by the host and executed
+ * on the probe. Sequences combine the probe's primitives (power, GPIO, SBW
+ * memory access, halt/resume) with delays, loops and branches, such that
+ * timing-critical test sequences don't suffer from USB latency.
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "probe_sequence.h"
+#include "probe_vendor.h"
+#include "sbw_device.h"
+#include "sbw_protocol.h"
+
+static uint8_t prog[SEQ_MAX_PROG_SIZE];
+
+static uint32_t captures[SEQ_MAX_CAPTURES];
+static unsigned int n_captures = 0;
+
+typedef struct {
+  uint16_t start;
+  uint16_t remaining;
+} seq_loop_t;
+
+/* Number of operand bytes following each opcode */
+static const uint8_t operand_len[] = {
+    [SEQ_OP_END] = 0,       [SEQ_OP_POWER] = 1,        [SEQ_OP_GPIO_SET] = 2,
+    [SEQ_OP_GPIO_GET] = 1,  [SEQ_OP_SBW_HALT] = 0,     [SEQ_OP_SBW_RESUME] = 0,
+    [SEQ_OP_SBW_RESET] = 0, [SEQ_OP_SBW_READ] = 4,     [SEQ_OP_SBW_WRITE] = 6,
+    [SEQ_OP_DELAY_US] = 4,  [SEQ_OP_LOOP] = 2,         [SEQ_OP_END_LOOP] = 0,
+    [SEQ_OP_JUMP] = 2,      [SEQ_OP_BRANCH_EQ] = 6,    [SEQ_OP_BRANCH_NE] = 6,
+    [SEQ_OP_CAPTURE] = 0,   [SEQ_OP_CAPTURE_TIME] = 0,
+};
+
+static inline uint16_t get16(const uint8_t *src) {
+  uint16_t val;
+  memcpy(&val, src, sizeof(val));
+  return val;
+}
+
+static inline uint32_t get32(const uint8_t *src) {
+  uint32_t val;
+  memcpy(&val, src, sizeof(val));
+  return val;
+}
+
+static int capture(uint32_t value) {
+  if (n_captures >= SEQ_MAX_CAPTURES)
+    return SEQ_RC_ERR_OVERFLOW;
+  captures[n_captures++] = value;
+  return SEQ_RC_OK;
+}
+
+int seq_load(unsigned int offset, const uint8_t *data, size_t len) {
+  if (offset + len > SEQ_MAX_PROG_SIZE)
+    return -1;
+  memcpy(&prog[offset], data, len);
+  return 0;
+}
+
+int seq_run(uint32_t timeout_us, uint16_t *pc_out) {
+  seq_loop_t loops[SEQ_MAX_LOOP_DEPTH];
+  unsigned int loop_depth = 0;
+  unsigned int pc = 0;
+  uint32_t acc = 0;
+  uint16_t data;
+  int rc = SEQ_RC_OK;
+
+  uint32_t t_start = time_us_32();
+  n_captures = 0;
+
+  while (rc == SEQ_RC_OK) {
+    *pc_out = pc;
+    uint8_t opcode = prog[pc];
+    if (opcode >= sizeof(operand_len)) {
+      rc = SEQ_RC_ERR_OPCODE;
+      break;
+    }
+    if (pc + 1 + operand_len[opcode] > SEQ_MAX_PROG_SIZE) {
+      rc = SEQ_RC_ERR_OPERAND;
+      break;
+    }
+    if (time_us_32() - t_start > timeout_us) {
+      rc = SEQ_RC_ERR_TIMEOUT;
+      break;
+    }
+
+    const uint8_t *op = &prog[pc + 1];
+    pc += 1 + operand_len[opcode];
+
+    switch (opcode) {
+    case SEQ_OP_END:
+      return SEQ_RC_OK;
+    case SEQ_OP_POWER:
+      if (op[0] == TARGET_POWER_ON)
+        target_power_enable();
+      else if (op[0] != TARGET_POWER_OFF)
+        rc = SEQ_RC_ERR_OPERAND;
+      else if (target_power_disable() < 0)
+        rc = SEQ_RC_ERR_TARGET;
+      break;
+    case SEQ_OP_GPIO_SET:
+      if (probe_gpio_pin(op[0]) < 0)
+        rc = SEQ_RC_ERR_OPERAND;
+      else if (probe_ioset(op[0], op[1]) != SBW_RC_OK)
+        rc = SEQ_RC_ERR_TARGET;
+      break;
+    case SEQ_OP_GPIO_GET: {
+      uint8_t state;
+      if (probe_gpio_pin(op[0]) < 0) {
+        rc = SEQ_RC_ERR_OPERAND;
+        break;
+      }
+      if (probe_ioget(&state, op[0]) != SBW_RC_OK)
+        rc = SEQ_RC_ERR_TARGET;
+      acc = state;
+      break;
+    }
+    case SEQ_OP_SBW_HALT:
+      if (sbw_dev_halt() != SBW_ERR_NONE)
+        rc = SEQ_RC_ERR_TARGET;
+      break;
+    case SEQ_OP_SBW_RESUME:
+      if (sbw_dev_release() != SBW_ERR_NONE)
+        rc = SEQ_RC_ERR_TARGET;
+      break;
+    case SEQ_OP_SBW_RESET:
+      if (sbw_dev_reset() != 0)
+        rc = SEQ_RC_ERR_TARGET;
+      break;
+    case SEQ_OP_SBW_READ:
+      if (sbw_dev_mem_read(&data, get32(op), 1) != 0)
+        rc = SEQ_RC_ERR_TARGET;
+      acc = data;
+      break;
+    case SEQ_OP_SBW_WRITE:
+      data = get16(op + 4);
+      if (sbw_dev_mem_write(get32(op), &data, 1) != 0)
+        rc = SEQ_RC_ERR_TARGET;
+      break;
+    case SEQ_OP_DELAY_US: {
+      /* Delays do not extend the run beyond its timeout */
+      uint32_t elapsed = time_us_32() - t_start;
+      uint32_t left = (elapsed < timeout_us) ? timeout_us - elapsed : 0;
+      if (get32(op) > left) {
+        busy_wait_us_32(left);
+        rc = SEQ_RC_ERR_TIMEOUT;
+        break;
+      }
+      busy_wait_us_32(get32(op));
+      break;
+    }
+    case SEQ_OP_LOOP:
+      if (loop_depth >= SEQ_MAX_LOOP_DEPTH) {
+        rc = SEQ_RC_ERR_OVERFLOW;
+        break;
+      }
+      if (get16(op) == 0) {
+        rc = SEQ_RC_ERR_OPERAND;
+        break;
+      }
+      loops[loop_depth].start = pc;
+      loops[loop_depth].remaining = get16(op);
+      loop_depth++;
+      break;
+    case SEQ_OP_END_LOOP:
+      if (loop_depth == 0) {
+        rc = SEQ_RC_ERR_OPCODE;
+        break;
+      }
+      if (--loops[loop_depth - 1].remaining > 0)
+        pc = loops[loop_depth - 1].start;
+      else
+        loop_depth--;
+      break;
+    case SEQ_OP_JUMP:
+      pc = get16(op);
+      break;
+    case SEQ_OP_BRANCH_EQ:
+      if ((acc & get16(op)) == get16(op + 2))
+        pc = get16(op + 4);
+      break;
+    case SEQ_OP_BRANCH_NE:
+      if ((acc & get16(op)) != get16(op + 2))
+        pc = get16(op + 4);
+      break;
+    case SEQ_OP_CAPTURE:
+      rc = capture(acc);
+      break;
+    case SEQ_OP_CAPTURE_TIME:
+      rc = capture(time_us_32() - t_start);
+      break;
+    }
+
+    if (pc >= SEQ_MAX_PROG_SIZE)
+      rc = SEQ_RC_ERR_OPERAND;
+  }
+  return rc;
+}
+
+unsigned int seq_n_captures(void) { return n_captures; }
+
+size_t seq_read_captures(uint32_t *dst, unsigned int index, size_t n) {
+  if (index >= n_captures)
+    return 0;
+  n = MIN(n, n_captures - index);
+  memcpy(dst, &captures[index], n * sizeof(uint32_t));
+  return n;
+}
@@ -0,0 +1,137 @@
+/*
+ * Per-command call counts, error counts and latency histograms. Latencies are
+ * measured with the microsecond timer and sorted into log2 buckets, such that
+ * recording a command costs only a few instructions. Also reports per-task run
+ * time and stack usage as well as heap usage from FreeRTOS.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "DAP.h"
+
+#include "probe_stats.h"
+
+/* Number of dummy recordings used to measure the overhead */
+#define STATS_CALIBRATION_RUNS 1000
+
+typedef struct {
+  uint32_t count;
+  uint32_t errors;
+  uint32_t max_us;
+  uint32_t hist[STATS_N_BUCKETS];
+} stats_entry_t;
+
+static stats_entry_t table[STATS_N_SLOTS];
+static bool enabled = true;
+static uint16_t overhead_ns;
+
+static TaskStatus_t tasks[STATS_MAX_TASKS];
+static unsigned int n_tasks = 0;
+
+/* Maps a command ID to a slot or returns -1 if the command is not tracked */
+static inline int slot_of(uint8_t cmd_id) {
+  if (cmd_id < (STATS_N_SLOTS / 2))
+    return cmd_id;
+  if ((cmd_id >= ID_DAP_Vendor0) && (cmd_id <= ID_DAP_Vendor31))
+    return (STATS_N_SLOTS / 2) + cmd_id - ID_DAP_Vendor0;
+  return -1;
+}
+
+static inline uint8_t cmd_id_of(unsigned int slot) {
+  if (slot < (STATS_N_SLOTS / 2))
+    return slot;
+  return ID_DAP_Vendor0 + slot - (STATS_N_SLOTS / 2);
+}
+
+static inline void update(stats_entry_t *entry, uint32_t t_start, bool error) {
+  uint32_t latency = time_us_32() - t_start;
+  unsigned int bucket = (latency == 0) ? 0 : 31 - __builtin_clz(latency);
+
+  entry->count++;
+  if (error)
+    entry->errors++;
+  if (latency > entry->max_us)
+    entry->max_us = latency;
+  entry->hist[MIN(bucket, STATS_N_BUCKETS - 1)]++;
+}
+
+void stats_init(void) {
+  stats_entry_t scratch = {0};
+
+  uint32_t t_start = time_us_32();
+  for (unsigned int i = 0; i < STATS_CALIBRATION_RUNS; i++)
+    update(&scratch, time_us_32(), false);
+  overhead_ns = (time_us_32() - t_start) * 1000 / STATS_CALIBRATION_RUNS;
+
+  stats_reset();
+}
+
+void stats_enable(bool enable) { enabled = enable; }
+
+bool stats_enabled(void) { return enabled; }
+
+void stats_reset(void) { memset(table, 0, sizeof(table)); }
+
+void stats_record(uint8_t cmd_id, uint32_t t_start, bool error) {
+  int slot = slot_of(cmd_id);
+
+  if (enabled && (slot >= 0))
+    update(&table[slot], t_start, error);
+}
+
+void stats_get_info(stats_info_t *info) {
+  info->enabled = enabled;
+  info->overhead_ns = overhead_ns;
+  info->n_slots = STATS_N_SLOTS;
+  memset(info->active, 0, sizeof(info->active));
+  for (unsigned int i = 0; i < STATS_N_SLOTS; i++) {
+    if (table[i].count > 0)
+      info->active[i / 8] |= (1 << (i % 8));
+  }
+}
+
+int stats_get_counters(stats_counters_t *dst, unsigned int slot) {
+  if (slot >= STATS_N_SLOTS)
+    return -1;
+  dst->cmd_id = cmd_id_of(slot);
+  dst->count = table[slot].count;
+  dst->errors = table[slot].errors;
+  dst->max_us = table[slot].max_us;
+  return 0;
+}
+
+int stats_get_histogram(uint32_t *dst, unsigned int slot) {
+  if (slot >= STATS_N_SLOTS)
+    return -1;
+  memcpy(dst, table[slot].hist, sizeof(table[slot].hist));
+  return 0;
+}
+
+void stats_get_system(stats_system_t *dst) {
+  n_tasks = uxTaskGetSystemState(tasks, STATS_MAX_TASKS, NULL);
+
+  dst->n_cores = configNUMBER_OF_CORES;
+  dst->n_tasks = n_tasks;
+  dst->uptime_us = time_us_64();
+  dst->heap_size = configTOTAL_HEAP_SIZE;
+  /* heap_1 never frees, so the current value is also the minimum */
+  dst->heap_free = xPortGetFreeHeapSize();
+}
+
+int stats_get_task(stats_task_t *dst, unsigned int index) {
+  if (index >= n_tasks)
+    return -1;
+
+  TaskStatus_t *task = &tasks[index];
+  strncpy(dst->name, task->pcTaskName, STATS_TASK_NAME_LEN);
+  dst->priority = task->uxCurrentPriority;
+  dst->state = task->eCurrentState;
+  dst->core_mask = task->uxCoreAffinityMask;
+  dst->stack_free_min = task->usStackHighWaterMark;
+  dst->run_time_us = task->ulRunTimeCounter;
+  return 0;
+}
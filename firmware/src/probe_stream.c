@@ -0,0 +1,143 @@
+/*
+ * Frame buffer for the asynchronous stream interface. Producers on any task
+ * or interrupt queue frames under a hardware spin lock and wake the USB task,
+ * which moves them into TinyUSB's FIFO for the stream interface.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "device/usbd_pvt.h"
+#include "tusb.h"
+
+#include "probe_stream.h"
+
+/* TinyUSB vendor instance of the stream interface */
+#define STREAM_ITF 1
+
+static uint8_t ring[STREAM_RING_FRAMES][STREAM_FRAME_SIZE]
+    __attribute__((aligned(4)));
+/* Free-running indices, head is written by producers, tail by the USB task */
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+
+static spin_lock_t *lock;
+
+/* Set by producers when they queued a pump, cleared by the USB task */
+static volatile bool pump_pending = false;
+
+static uint32_t enabled = 0;
+static uint16_t dropped[STREAM_ID_NUM];
+static uint32_t n_sent = 0;
+static uint32_t n_dropped = 0;
+
+void stream_init(void) {
+  lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+static void pump_deferred(void *param) {
+  pump_pending = false;
+  stream_pump();
+}
+
+void stream_enable(uint32_t mask) {
+  uint32_t irq = spin_lock_blocking(lock);
+  enabled = mask;
+  memset(dropped, 0, sizeof(dropped));
+  spin_unlock(lock, irq);
+}
+
+bool stream_enabled(uint8_t stream_id) {
+  return (stream_id < STREAM_ID_NUM) && (enabled & (1UL << stream_id));
+}
+
+int stream_send(uint8_t stream_id, const void *data, size_t len) {
+  if (!stream_enabled(stream_id) || (len > STREAM_MAX_PAYLOAD))
+    return -1;
+
+  uint32_t irq = spin_lock_blocking(lock);
+  if (head - tail >= STREAM_RING_FRAMES) {
+    dropped[stream_id]++;
+    n_dropped++;
+    spin_unlock(lock, irq);
+    return -1;
+  }
+
+  uint8_t *frame = ring[head % STREAM_RING_FRAMES];
+  stream_hdr_t hdr = {.stream_id = stream_id,
+                      .len = len,
+                      .dropped = dropped[stream_id],
+                      .timestamp = time_us_32()};
+  memcpy(frame, &hdr, sizeof(hdr));
+  memcpy(frame + sizeof(hdr), data, len);
+  dropped[stream_id] = 0;
+  head++;
+  spin_unlock(lock, irq);
+
+  if (!pump_pending) {
+    pump_pending = true;
+    usbd_defer_func(pump_deferred, NULL, __get_current_exception() != 0);
+  }
+  return 0;
+}
+
+unsigned int stream_free(void) { return STREAM_RING_FRAMES - (head - tail); }
+
+int stream_wait_free(uint8_t stream_id) {
+  uint32_t t_start = time_us_32();
+
+  /* The task that would disable the stream may be the one waiting */
+  while (stream_free() == 0) {
+    if (!stream_enabled(stream_id) ||
+        (time_us_32() - t_start > STREAM_STALL_MS * 1000))
+      return -1;
+    vTaskDelay(1);
+  }
+  return 0;
+}
+
+int stream_test(uint32_t n_frames) {
+  uint32_t values[STREAM_MAX_PAYLOAD / sizeof(uint32_t)];
+  uint32_t counter = 0;
+
+  for (uint32_t i = 0; i < n_frames; i++) {
+    for (unsigned int j = 0; j < sizeof(values) / sizeof(values[0]); j++)
+      values[j] = counter++;
+
+    if ((stream_wait_free(STREAM_ID_TEST) < 0) ||
+        (stream_send(STREAM_ID_TEST, values, sizeof(values)) != 0))
+      return -1;
+  }
+  return 0;
+}
+
+void stream_pump(void) {
+  if (!tud_vendor_n_mounted(STREAM_ITF)) {
+    /* Nobody is listening, discard queued frames */
+    tail = head;
+    return;
+  }
+
+  bool written = false;
+  while ((tail != head) &&
+         (tud_vendor_n_write_available(STREAM_ITF) >= STREAM_FRAME_SIZE)) {
+    /* Unused payload bytes are sent as well to keep frames aligned to packets */
+    tud_vendor_n_write(STREAM_ITF, ring[tail % STREAM_RING_FRAMES],
+                       STREAM_FRAME_SIZE);
+    tail++;
+    n_sent++;
+    written = true;
+  }
+  if (written)
+    tud_vendor_n_write_flush(STREAM_ITF);
+}
+
+void stream_get_status(stream_status_t *status) {
+  status->enabled = enabled;
+  status->sent = n_sent;
+  status->dropped = n_dropped;
+}
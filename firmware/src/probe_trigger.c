@@ -0,0 +1,426 @@
+/*
+ * Trigger engine. The host arms rules through the vendor command, the UART
+ * receive interrupt and the GPIO interrupt match them. Halting needs the SBW
+ * stack, which belongs to the DAP task, so the interrupt hands that action
+ * over to the task.
+ */
+
+#include <hardware/irq.h>
+#include <hardware/structs/iobank0.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "cdc_uart.h"
+#include "probe_events.h"
+#include "probe_trigger.h"
+#include "probe_vendor.h"
+#include "rioteeprobe_config.h"
+#include "sbw_device.h"
+
+#if (TRIGGER_PATTERN_MAX & (TRIGGER_PATTERN_MAX - 1)) != 0
+#error "TRIGGER_PATTERN_MAX must be a power of two"
+#endif
+
+static struct {
+  trigger_rule_t rule;
+  trigger_status_t status;
+  /* The action waits for the task */
+  bool pending;
+} slots[TRIGGER_N_RULES];
+
+static spin_lock_t *lock;
+static TaskHandle_t run_task;
+
+/* Bitmasks of armed slots with a UART and with a GPIO source */
+static volatile uint32_t uart_mask, gpio_mask;
+
+/* Most recent UART bytes */
+static uint8_t window[TRIGGER_PATTERN_MAX];
+static uint32_t n_rx;
+
+/* Edges of each RP2040 pin that are enabled for rules and the log */
+static uint32_t pin_edges[32];
+
+/* Header GPIOs whose edges are recorded as events, bit per header GPIO */
+static uint32_t log_mask;
+
+/* Core that handles the GPIO interrupt */
+static unsigned int irq_core;
+
+/* Edge of a header GPIO that is reported to a callback */
+static trigger_edge_cb_t watch_cb;
+static unsigned int watch_pin;
+static uint32_t watch_edge;
+
+/* Returns true if the raw handler sees the events of a header GPIO */
+static bool pin_handled(unsigned int pin_no) {
+#ifdef PROBE_PIN_IMAGE_TRIGGER
+  /* Registered by the image store. Raw handlers share the interrupt and run
+   * for the events of all pins. */
+  if (probe_gpio_pin(pin_no) == PROBE_PIN_IMAGE_TRIGGER)
+    return false;
+#endif
+  return probe_gpio_pin(pin_no) >= 0;
+}
+
+/*
+ * The SDK's gpio_set_irq_enabled() and gpio_get_irq_event_mask() act on the
+ * calling core's registers. Rules are armed from the DAP task on one core and
+ * disarmed from interrupts on the other, so the enables and the status of the
+ * core that handles the interrupt are accessed directly.
+ */
+static io_rw_32 *inte_of(unsigned int pin) {
+  return (irq_core == 0) ? &io_bank0_hw->proc0_irq_ctrl.inte[pin / 8]
+                         : &io_bank0_hw->proc1_irq_ctrl.inte[pin / 8];
+}
+
+static void set_edges(unsigned int pin, uint32_t edges, bool enabled) {
+  uint32_t bits = edges << (4 * (pin % 8));
+
+  if (enabled)
+    hw_set_bits(inte_of(pin), bits);
+  else
+    hw_clear_bits(inte_of(pin), bits);
+}
+
+/* Returns the pending edges of a pin that are enabled */
+static uint32_t edges_seen(unsigned int pin) {
+  io_ro_32 *ints = (irq_core == 0) ? io_bank0_hw->proc0_irq_ctrl.ints
+                                   : io_bank0_hw->proc1_irq_ctrl.ints;
+  return (ints[pin / 8] >> (4 * (pin % 8))) & 0xF;
+}
+
+static uint32_t edge_of(const trigger_rule_t *rule) {
+  return (rule->source == TRIGGER_SRC_GPIO_RISE) ? GPIO_IRQ_EDGE_RISE
+                                                 : GPIO_IRQ_EDGE_FALL;
+}
+
+/* Enables the edge interrupts of armed rules and disables the others. Called
+ * with the lock held. */
+static void update_masks(void) {
+  uint32_t edges[32] = {0};
+
+  uart_mask = 0;
+  gpio_mask = 0;
+  for (unsigned int i = 0; i < TRIGGER_N_RULES; i++) {
+    if (!slots[i].status.armed)
+      continue;
+    if (slots[i].rule.source == TRIGGER_SRC_UART) {
+      uart_mask |= (1 << i);
+    } else {
+      gpio_mask |= (1 << i);
+      int pin = probe_gpio_pin(slots[i].rule.src_pin);
+      edges[pin] |= edge_of(&slots[i].rule);
+    }
+  }
+  for (unsigned int i = 0; log_mask >> i; i++) {
+    if (log_mask & (1 << i))
+      edges[probe_gpio_pin(i)] |= GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL;
+  }
+  if (watch_cb != NULL)
+    edges[probe_gpio_pin(watch_pin)] |= watch_edge;
+
+  for (unsigned int pin = 0; pin < 32; pin++) {
+    if (edges[pin] == pin_edges[pin])
+      continue;
+    /* Stale events would fire a new rule right away */
+    gpio_acknowledge_irq(pin, edges[pin] & ~pin_edges[pin]);
+    set_edges(pin, pin_edges[pin] & ~edges[pin], false);
+    set_edges(pin, edges[pin], true);
+    pin_edges[pin] = edges[pin];
+  }
+}
+
+static void complete(unsigned int i, int8_t result) {
+  trigger_status_t *status = &slots[i].status;
+
+  status->result = result;
+  status->action_us = time_us_32();
+  status->max_latency_us =
+      MAX(status->max_latency_us, status->action_us - status->event_us);
+}
+
+static int64_t pulse_end(alarm_id_t id, void *pin_no) {
+  probe_ioset((uintptr_t)pin_no, IOSET_OUT_LOW);
+  return 0;
+}
+
+/* Takes the action of a rule whose event happened at event_us. Only called
+ * from interrupts. */
+static void fire(unsigned int i, uint32_t event_us) {
+  const trigger_rule_t *rule = &slots[i].rule;
+  BaseType_t woken = pdFALSE;
+  uint32_t irq = spin_lock_blocking(lock);
+
+  /* Events while a deferred action waits belong to the same trigger */
+  if (!slots[i].status.armed || slots[i].pending) {
+    spin_unlock(lock, irq);
+    return;
+  }
+  if (!(rule->flags & TRIGGER_FLAG_REPEAT)) {
+    slots[i].status.armed = 0;
+    update_masks();
+  }
+  slots[i].status.n_fired++;
+  slots[i].status.event_us = event_us;
+
+  /* The DAP task may re-arm the slot once the lock is released */
+  uint8_t action = rule->action;
+  uint8_t act_pin = rule->act_pin;
+  uint32_t pulse_us = rule->pulse_us;
+
+  switch (action) {
+  case TRIGGER_ACT_TIMESTAMP:
+    complete(i, 0);
+    break;
+  case TRIGGER_ACT_POWER_OFF:
+  case TRIGGER_ACT_POWER_ON:
+    /* Users of the supply are not counted, the next power command from the
+     * host restores their state */
+    gpio_put(PROBE_PIN_TARGET_POWER, action == TRIGGER_ACT_POWER_ON);
+    complete(i, 0);
+    break;
+  case TRIGGER_ACT_GPIO_PULSE:
+    probe_ioset(act_pin, IOSET_OUT_HIGH);
+    complete(i, 0);
+    break;
+  case TRIGGER_ACT_SBW_HALT:
+    slots[i].pending = true;
+    break;
+  }
+  spin_unlock(lock, irq);
+
+  /* The event stream, the alarm pool and the scheduler take their own locks */
+  switch (action) {
+  case TRIGGER_ACT_POWER_OFF:
+  case TRIGGER_ACT_POWER_ON:
+    event_record(EVENT_POWER, EVENT_CAUSE_TRIGGER,
+                 action == TRIGGER_ACT_POWER_ON);
+    break;
+  case TRIGGER_ACT_GPIO_PULSE:
+    if (add_alarm_in_us(pulse_us, pulse_end, (void *)(uintptr_t)act_pin,
+                        true) < 0) {
+      probe_ioset(act_pin, IOSET_OUT_LOW);
+      irq = spin_lock_blocking(lock);
+      slots[i].status.result = -1;
+      spin_unlock(lock, irq);
+    }
+    break;
+  case TRIGGER_ACT_SBW_HALT:
+    vTaskNotifyGiveFromISR(run_task, &woken);
+    portYIELD_FROM_ISR(woken);
+    break;
+  }
+}
+
+/* Records the edges of a header GPIO in the order in which they happened */
+static void log_edges(unsigned int pin_no, uint32_t edges, uint32_t now) {
+  bool level = gpio_get(probe_gpio_pin(pin_no));
+
+  /* With both edges pending, the current level tells the last one */
+  if (edges == (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL))
+    event_add(EVENT_GPIO, pin_no, !level, now, NULL, 0);
+  event_add(EVENT_GPIO, pin_no, level, now, NULL, 0);
+}
+
+static void gpio_isr(void) {
+  uint32_t now = time_us_32();
+  uint32_t mask = gpio_mask;
+  uint32_t log = log_mask;
+  trigger_edge_cb_t cb = watch_cb;
+  uint32_t seen = 0, watched = 0;
+
+  /* Several rules may wait for the same edge, acknowledge after matching */
+  for (unsigned int i = 0; i < TRIGGER_N_RULES; i++) {
+    if (!(mask & (1 << i)))
+      continue;
+    int pin = probe_gpio_pin(slots[i].rule.src_pin);
+    if (edges_seen(pin) & edge_of(&slots[i].rule))
+      seen |= (1 << i);
+  }
+  if (cb != NULL)
+    watched = edges_seen(probe_gpio_pin(watch_pin)) & watch_edge;
+  for (unsigned int i = 0; log >> i; i++) {
+    if (!(log & (1 << i)))
+      continue;
+    int pin = probe_gpio_pin(i);
+    uint32_t edges =
+        edges_seen(pin) & (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL);
+    if (edges) {
+      log_edges(i, edges, now);
+      gpio_acknowledge_irq(pin, edges);
+    }
+  }
+  for (unsigned int i = 0; i < TRIGGER_N_RULES; i++) {
+    if (seen & (1 << i))
+      gpio_acknowledge_irq(probe_gpio_pin(slots[i].rule.src_pin),
+                           edge_of(&slots[i].rule));
+  }
+  if (watched) {
+    gpio_acknowledge_irq(probe_gpio_pin(watch_pin), watched);
+    cb(now);
+  }
+  for (unsigned int i = 0; i < TRIGGER_N_RULES; i++) {
+    if (seen & (1 << i))
+      fire(i, now);
+  }
+}
+
+void trigger_init(TaskHandle_t task) {
+  run_task = task;
+  if (lock == NULL)
+    lock = spin_lock_instance(spin_lock_claim_unused(true));
+  memset(slots, 0, sizeof(slots));
+  memset(pin_edges, 0, sizeof(pin_edges));
+  uart_mask = 0;
+  gpio_mask = 0;
+  log_mask = 0;
+  watch_cb = NULL;
+  n_rx = 0;
+
+  uint32_t pin_mask = 0;
+  for (unsigned int i = 0; probe_gpio_pin(i) >= 0; i++) {
+    if (pin_handled(i))
+      pin_mask |= (1 << probe_gpio_pin(i));
+  }
+  if (pin_mask == 0)
+    return;
+  /* The interrupt is only enabled in the NVIC of the calling core */
+  irq_core = get_core_num();
+  gpio_add_raw_irq_handler_masked(pin_mask, gpio_isr);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+static bool rule_valid(const trigger_rule_t *rule) {
+  switch (rule->source) {
+  case TRIGGER_SRC_UART:
+    if ((rule->pattern_len == 0) || (rule->pattern_len > TRIGGER_PATTERN_MAX))
+      return false;
+    break;
+  case TRIGGER_SRC_GPIO_RISE:
+  case TRIGGER_SRC_GPIO_FALL:
+    if (!pin_handled(rule->src_pin))
+      return false;
+    break;
+  default:
+    return false;
+  }
+
+  if (rule->action == TRIGGER_ACT_GPIO_PULSE)
+    return probe_gpio_pin(rule->act_pin) >= 0;
+  return rule->action <= TRIGGER_ACT_SBW_HALT;
+}
+
+int trigger_arm(unsigned int slot, const trigger_rule_t *rule) {
+  if ((slot >= TRIGGER_N_RULES) || !rule_valid(rule))
+    return -1;
+
+  uint32_t irq = spin_lock_blocking(lock);
+  memcpy(&slots[slot].rule, rule, sizeof(trigger_rule_t));
+  memset(&slots[slot].status, 0, sizeof(trigger_status_t));
+  slots[slot].pending = false;
+  slots[slot].status.armed = 1;
+  update_masks();
+  spin_unlock(lock, irq);
+
+  cdc_uart_low_latency(uart_mask != 0);
+  return 0;
+}
+
+int trigger_disarm(unsigned int slot) {
+  if (slot >= TRIGGER_N_RULES)
+    return -1;
+
+  uint32_t irq = spin_lock_blocking(lock);
+  slots[slot].status.armed = 0;
+  update_masks();
+  spin_unlock(lock, irq);
+
+  cdc_uart_low_latency(uart_mask != 0);
+  return 0;
+}
+
+int trigger_get_status(trigger_status_t *status, unsigned int slot) {
+  if (slot >= TRIGGER_N_RULES)
+    return -1;
+
+  uint32_t irq = spin_lock_blocking(lock);
+  memcpy(status, &slots[slot].status, sizeof(trigger_status_t));
+  spin_unlock(lock, irq);
+  return 0;
+}
+
+bool trigger_uart_armed(void) { return uart_mask != 0; }
+
+void trigger_uart_byte(uint8_t c, uint32_t rx_us) {
+  uint32_t mask = uart_mask;
+
+  window[n_rx % TRIGGER_PATTERN_MAX] = c;
+  n_rx++;
+
+  while (mask) {
+    unsigned int i = __builtin_ctz(mask);
+    const trigger_rule_t *rule = &slots[i].rule;
+    unsigned int len = rule->pattern_len, k;
+
+    mask &= mask - 1;
+    if ((c != rule->pattern[len - 1]) || (n_rx < len))
+      continue;
+    for (k = 0; k < len - 1; k++) {
+      if (window[(n_rx - len + k) % TRIGGER_PATTERN_MAX] != rule->pattern[k])
+        break;
+    }
+    if (k == len - 1)
+      fire(i, rx_us);
+  }
+}
+
+void trigger_log_gpio(bool enable) {
+  uint32_t mask = 0;
+
+  for (unsigned int i = 0; enable && (probe_gpio_pin(i) >= 0); i++) {
+    if (pin_handled(i))
+      mask |= (1 << i);
+  }
+
+  uint32_t irq = spin_lock_blocking(lock);
+  uint32_t added = mask & ~log_mask;
+  log_mask = mask;
+  update_masks();
+  spin_unlock(lock, irq);
+
+  /* The timeline starts with the current levels */
+  for (unsigned int i = 0; added >> i; i++) {
+    if (added & (1 << i))
+      event_record(EVENT_GPIO, i, gpio_get(probe_gpio_pin(i)));
+  }
+}
+
+int trigger_watch_edge(unsigned int pin_no, bool rising,
+                       trigger_edge_cb_t cb) {
+  if ((cb != NULL) && !pin_handled(pin_no))
+    return -1;
+
+  uint32_t irq = spin_lock_blocking(lock);
+  watch_cb = cb;
+  watch_pin = pin_no;
+  watch_edge = rising ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+  update_masks();
+  spin_unlock(lock, irq);
+  return 0;
+}
+
+void trigger_run_deferred(void) {
+  for (unsigned int i = 0; i < TRIGGER_N_RULES; i++) {
+    if (!slots[i].pending)
+      continue;
+
+    int rc = sbw_dev_halt();
+
+    uint32_t irq = spin_lock_blocking(lock);
+    complete(i, (rc == SBW_ERR_NONE) ? 0 : -1);
+    slots[i].pending = false;
+    spin_unlock(lock, irq);
+  }
+}
@@ -4,13 +4,29 @@
 #include <string.h>
 
 #include "bsp/board.h"
+#include "tusb.h"
 
 #include "DAP.h"
+#include "DAP_config.h"
 #include "cdc_uart.h"
 #include "get_serial.h"
+#include "probe_bench.h"
+#include "probe_boot.h"
+#include "probe_bulk.h"
+#include "probe_events.h"
+#include "probe_image.h"
+#include "probe_logic.h"
+#include "probe_sequence.h"
+#include "probe_stats.h"
+#include "probe_stream.h"
+#include "probe_trigger.h"
+#include "probe_vendor.h"
 #include "rioteeprobe_config.h"
 #include "sbw_device.h"
 #include "sbw_protocol.h"
+#include "sbw_trace.h"
+#include "sbw_transport.h"
+#include "uart_history.h"
 
 /* Used to identify FW version. Updated with bumpversion. */
 const char version_string[] = "1.1.0";
@@ -27,21 +43,54 @@ const char version_string[] = "1.1.0";
 #define ID_DAP_VENDOR_GPIO_SET ID_DAP_Vendor9
 #define ID_DAP_VENDOR_GPIO_GET ID_DAP_Vendor10
 #define ID_DAP_VENDOR_BYPASS ID_DAP_Vendor11
+#define ID_DAP_VENDOR_BATCH ID_DAP_Vendor12
+#define ID_DAP_VENDOR_SEQUENCE ID_DAP_Vendor13
+#define ID_DAP_VENDOR_BULK ID_DAP_Vendor14
+#define ID_DAP_VENDOR_TAGGED ID_DAP_Vendor15
+#define ID_DAP_VENDOR_CAPS ID_DAP_Vendor16
+#define ID_DAP_VENDOR_STREAM ID_DAP_Vendor17
+#define ID_DAP_VENDOR_STATS ID_DAP_Vendor18
+#define ID_DAP_VENDOR_TRACE ID_DAP_Vendor19
+#define ID_DAP_VENDOR_BENCH ID_DAP_Vendor20
+#define ID_DAP_VENDOR_IMAGE ID_DAP_Vendor21
+#define ID_DAP_VENDOR_BOOTLOADER ID_DAP_Vendor22
+#define ID_DAP_VENDOR_TIME ID_DAP_Vendor23
+#define ID_DAP_VENDOR_UART ID_DAP_Vendor24
+#define ID_DAP_VENDOR_TRIGGER ID_DAP_Vendor25
+#define ID_DAP_VENDOR_EVENTS ID_DAP_Vendor26
+#define ID_DAP_VENDOR_BOOT ID_DAP_Vendor27
+#define ID_DAP_VENDOR_LOGIC ID_DAP_Vendor28
+
+/* Maximum number of 16-bit words in the response to a read request */
+#define SBW_READ_MAX_WORDS ((DAP_PACKET_SIZE - 2) / 2)
+
+/* Number of bulk requests that the host may keep in flight */
+#define BULK_WINDOW (CFG_TUD_VENDOR_RX_BUFSIZE / DAP_PACKET_SIZE)
 
 static int power_access_cnt = 0;
 static int prog_access_cnt = 0;
 
+static volatile bool reboot_requested = false;
+
 #ifdef BOARD_RIOTEE_PROBE
 
 unsigned int probe_gpios[PROBE_GPIO_NUM] = {PROBE_PIN_GPIO0, PROBE_PIN_GPIO1,
                                             PROBE_PIN_GPIO2, PROBE_PIN_GPIO3};
 
 int probe_ioget(uint8_t *dst, unsigned int pin_no) {
+  if (pin_no >= PROBE_GPIO_NUM)
+    return SBW_RC_ERR_GENERIC;
   *dst = (uint16_t)gpio_get(probe_gpios[pin_no]);
   return SBW_RC_OK;
 }
 
+int probe_gpio_pin(unsigned int pin_no) {
+  return (pin_no < PROBE_GPIO_NUM) ? probe_gpios[pin_no] : -1;
+}
+
 int probe_ioset(unsigned int pin_no, probe_io_state_t state) {
+  if (pin_no >= PROBE_GPIO_NUM)
+    return SBW_RC_ERR_GENERIC;
   switch (state) {
   case IOSET_IN:
     gpio_set_dir(probe_gpios[pin_no], GPIO_IN);
@@ -65,22 +114,30 @@ int probe_ioget(uint8_t *dst, unsigned int pin_no) {
   return SBW_RC_ERR_UNSUPPORTED;
 }
 
+int probe_gpio_pin(unsigned int pin_no) { return -1; }
+
 int probe_ioset(unsigned int pin_no, probe_io_state_t state) {
   return SBW_RC_ERR_UNSUPPORTED;
 }
 #endif
 
 void target_power_enable(void) {
-  if (power_access_cnt++ == 0)
-    gpio_put(PROBE_PIN_TARGET_POWER, 1);
+  bool was_on = gpio_get(PROBE_PIN_TARGET_POWER);
+
+  power_access_cnt++;
+  gpio_put(PROBE_PIN_TARGET_POWER, 1);
+  if (!was_on)
+    event_record(EVENT_POWER, EVENT_CAUSE_COMMAND, 1);
 }
 
 int target_power_disable(void) {
   /* Only switch off power if we're the last one using it*/
   if (power_access_cnt <= 0)
     return -1;
-  if (--power_access_cnt == 0)
+  if ((--power_access_cnt == 0) && gpio_get(PROBE_PIN_TARGET_POWER)) {
     gpio_put(PROBE_PIN_TARGET_POWER, 0);
+    event_record(EVENT_POWER, EVENT_CAUSE_COMMAND, 0);
+  }
   return 0;
 }
 
@@ -89,6 +146,7 @@ int bypass_enable(void) {
   return -1;
 #else
   gpio_put(PROBE_PIN_BYPASS_ENABLE, true);
+  event_record(EVENT_BYPASS, EVENT_CAUSE_COMMAND, 1);
   return 0;
 #endif
 }
@@ -98,6 +156,7 @@ int bypass_disable(void) {
   return -1;
 #else
   gpio_put(PROBE_PIN_BYPASS_ENABLE, false);
+  event_record(EVENT_BYPASS, EVENT_CAUSE_COMMAND, 0);
   return 0;
 #endif
 }
@@ -120,10 +179,789 @@ int programming_disable(void) {
   return 0;
 }
 
+bool bootloader_requested(void) { return reboot_requested; }
+
+/* Returns true for requests that cannot run inside batch and tagged requests:
+ * these two and the USB echo, which returns a full packet. max_len is the
+ * number of bytes left in the request. */
+static bool not_nestable(const uint8_t *request, uint32_t max_len) {
+  if ((request[0] == ID_DAP_VENDOR_BATCH) ||
+      (request[0] == ID_DAP_VENDOR_TAGGED))
+    return true;
+  return (request[0] == ID_DAP_VENDOR_BENCH) && (max_len > 1) &&
+         (request[1] == BENCH_USB_ECHO);
+}
+
+/* Returns true if a vendor command failed. Tagged responses carry the tag
+ * instead of a return code. */
+static bool vendor_failed(const uint8_t *request, const uint8_t *response) {
+  if (request[0] == ID_DAP_VENDOR_TAGGED)
+    return response[3] == DAP_ERROR;
+  return response[1] == DAP_ERROR;
+}
+
+/**
+ * Determines the length of a vendor request from its header
+ *
+ * @param request pointer to request
+ * @param max_len number of bytes available in the request buffer
+ *
+ * @returns number of bytes in request or 0 if the header is incomplete
+ */
+static uint32_t vendor_request_len(const uint8_t *request, uint32_t max_len) {
+  switch (request[0]) {
+  case ID_DAP_VENDOR_POWER:
+  case ID_DAP_VENDOR_BYPASS:
+  case ID_DAP_VENDOR_GPIO_GET:
+    return 2;
+  case ID_DAP_VENDOR_GPIO_SET:
+    return 3;
+  case ID_DAP_VENDOR_SBW_READ:
+    return 6;
+  case ID_DAP_VENDOR_SBW_WRITE:
+    if (max_len < 6)
+      return 0;
+    return 6 + request[5] * 2;
+  case ID_DAP_VENDOR_SEQUENCE:
+    if (max_len < 2)
+      return 0;
+    if (request[1] == SEQ_CMD_RUN)
+      return 6;
+    if (request[1] != SEQ_CMD_LOAD)
+      return 4;
+    if (max_len < 5)
+      return 0;
+    return 5 + request[4];
+  case ID_DAP_VENDOR_BULK:
+    if (max_len < 2)
+      return 0;
+    if ((request[1] == BULK_CMD_WRITE) || (request[1] == BULK_CMD_READ))
+      return 11;
+    if ((request[1] == BULK_CMD_DATA) && (bulk_state() == BULK_STATE_WRITE))
+      return 2 + 2 * bulk_next_words();
+    return 2;
+  case ID_DAP_VENDOR_STREAM:
+    if (max_len < 2)
+      return 0;
+    return (request[1] == STREAM_CMD_STATUS) ? 2 : 6;
+  case ID_DAP_VENDOR_STATS:
+    if (max_len < 2)
+      return 0;
+    return ((request[1] == STATS_CMD_INFO) || (request[1] == STATS_CMD_RESET) ||
+            (request[1] == STATS_CMD_SYSTEM))
+               ? 2
+               : 3;
+  case ID_DAP_VENDOR_BENCH:
+    return 10;
+  case ID_DAP_VENDOR_IMAGE:
+    if (max_len < 3)
+      return 0;
+    switch (request[1]) {
+    case IMAGE_CMD_BEGIN:
+      return 8 + IMAGE_NAME_LEN;
+    case IMAGE_CMD_DATA:
+      return 3 + request[2];
+    case IMAGE_CMD_COMMIT:
+      return 7;
+    case IMAGE_CMD_AUTORUN:
+      return 4;
+    case IMAGE_CMD_RESULT:
+      return 2;
+    default:
+      return 3;
+    }
+  case ID_DAP_VENDOR_TRACE:
+    if (max_len < 2)
+      return 0;
+    if (request[1] == TRACE_CMD_ENABLE)
+      return 3;
+    return (request[1] == TRACE_CMD_READ) ? 4 : 2;
+  case ID_DAP_VENDOR_UART:
+    if (max_len < 2)
+      return 0;
+    if (request[1] == UART_CMD_HISTORY_READ)
+      return 6;
+    return (request[1] == UART_CMD_FRAMED) ? 3 : 2;
+  case ID_DAP_VENDOR_TRIGGER:
+    if (max_len < 2)
+      return 0;
+    return (request[1] == TRIGGER_CMD_ARM) ? 3 + sizeof(trigger_rule_t) : 3;
+  case ID_DAP_VENDOR_EVENTS:
+    if (max_len < 2)
+      return 0;
+    return (request[1] == EVENT_CMD_ENABLE) ? 6 : 2;
+  case ID_DAP_VENDOR_BOOT:
+    if (max_len < 2)
+      return 0;
+    if (request[1] == BOOT_CMD_START)
+      return 2 + sizeof(boot_config_t);
+    return (request[1] == BOOT_CMD_READ) ? 4 : 2;
+  case ID_DAP_VENDOR_LOGIC:
+    if (max_len < 2)
+      return 0;
+    return (request[1] == LOGIC_CMD_START) ? 2 + sizeof(logic_config_t) : 2;
+  case ID_DAP_VENDOR_BATCH: {
+    if (max_len < 2)
+      return 0;
+    uint32_t len = 2;
+    for (unsigned int i = 0; i < request[1]; i++) {
+      if ((len >= max_len) || not_nestable(&request[len], max_len - len))
+        return 0;
+      uint32_t op_len = vendor_request_len(&request[len], max_len - len);
+      if (op_len == 0)
+        return 0;
+      len += op_len;
+    }
+    return len;
+  }
+  case ID_DAP_VENDOR_TAGGED:
+    if (max_len < 3)
+      return 0;
+    uint32_t inner_len = vendor_request_len(&request[2], max_len - 2);
+    return (inner_len == 0) ? 0 : 2 + inner_len;
+  default:
+    return 1;
+  }
+}
+
+/**
+ * Executes a sequence of vendor commands received in a single request
+ *
+ * Request: [Request (1B) | NOps (1B) | Op 0 | Op 1 | ...]
+ * Response: [Request (1B) | ReturnCode (1B) | NDone (1B) | Rsp 0 | Rsp 1 |...]
+ *
+ * Every operation is encoded like the corresponding standalone vendor request
+ * and every operation response starts with the ID and return code of the
+ * operation. Execution stops at the first operation that fails. Batch and
+ * tagged requests and the USB echo cannot be operations. An operation whose
+ * response does not fit is counted with a response of only its ID and
+ * DAP_ERROR.
+ */
+static uint32_t process_batch(const uint8_t *request, uint8_t *response) {
+  /* Operations start at any offset, but their handlers access operands and
+   * results as halfwords, which the Cortex-M0+ only accesses aligned */
+  static uint8_t op_req[DAP_PACKET_SIZE] __attribute__((aligned(4)));
+  static uint8_t op_rsp[DAP_PACKET_SIZE] __attribute__((aligned(4)));
+  uint32_t req_len = 2;
+  uint32_t rsp_len = 3;
+
+  response[2] = 0;
+
+  for (unsigned int i = 0; i < request[1]; i++) {
+    /* Leaves room for at least the ID and return code of the operation */
+    if ((req_len >= DAP_PACKET_SIZE) || (rsp_len + 2 > DAP_PACKET_SIZE) ||
+        not_nestable(&request[req_len], DAP_PACKET_SIZE - req_len)) {
+      response[1] = DAP_ERROR;
+      break;
+    }
+    memcpy(op_req, &request[req_len], DAP_PACKET_SIZE - req_len);
+
+    uint32_t op_req_len =
+        vendor_request_len(op_req, DAP_PACKET_SIZE - req_len);
+    if ((op_req_len == 0) || (req_len + op_req_len > DAP_PACKET_SIZE)) {
+      response[1] = DAP_ERROR;
+      break;
+    }
+
+    uint32_t op_rsp_len =
+        DAP_ProcessVendorCommand(op_req, op_rsp) & 0xFFFF;
+    req_len += op_req_len;
+
+    response[2]++;
+    if (rsp_len + op_rsp_len > DAP_PACKET_SIZE) {
+      response[rsp_len] = op_req[0];
+      response[rsp_len + 1] = DAP_ERROR;
+      rsp_len += 2;
+      response[1] = DAP_ERROR;
+      break;
+    }
+    memcpy(&response[rsp_len], op_rsp, op_rsp_len);
+    rsp_len += op_rsp_len;
+
+    if (vendor_failed(op_req, op_rsp)) {
+      response[1] = DAP_ERROR;
+      break;
+    }
+  }
+
+  return ((req_len << 16) + rsp_len);
+}
+
+/**
+ * Uploads, runs and reads back results of sequence programs
+ *
+ * Load: [Request (1B) | SEQ_CMD_LOAD | Offset (2B) | Len (1B) | Data (Len)]
+ * Run: [Request (1B) | SEQ_CMD_RUN | Timeout us (4B)]
+ *   -> [Request (1B) | ReturnCode (1B) | Status (1B) | PC (2B) | NCaptures (2B)]
+ * Read: [Request (1B) | SEQ_CMD_READ | Index (2B)]
+ *   -> [Request (1B) | ReturnCode (1B) | N (1B) | Captures (N*4B)]
+ */
+static uint32_t process_sequence(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint16_t offset;
+  uint32_t timeout_us;
+
+  switch (request[1]) {
+  case SEQ_CMD_LOAD:
+    memcpy(&offset, &request[2], sizeof(offset));
+    if ((req_len > DAP_PACKET_SIZE) ||
+        (seq_load(offset, &request[5], request[4]) < 0))
+      response[1] = DAP_ERROR;
+    break;
+  case SEQ_CMD_RUN: {
+    uint16_t pc;
+    uint16_t n = 0;
+
+    memcpy(&timeout_us, &request[2], sizeof(timeout_us));
+    response[2] = seq_run(timeout_us, &pc);
+    if (response[2] != SEQ_RC_OK)
+      response[1] = DAP_ERROR;
+    n = seq_n_captures();
+    memcpy(&response[3], &pc, sizeof(pc));
+    memcpy(&response[5], &n, sizeof(n));
+    rsp_len += 5;
+    break;
+  }
+  case SEQ_CMD_READ:
+    memcpy(&offset, &request[2], sizeof(offset));
+    response[2] = seq_read_captures((uint32_t *)&response[3], offset,
+                                    (DAP_PACKET_SIZE - 3) / sizeof(uint32_t));
+    rsp_len += 1 + response[2] * sizeof(uint32_t);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return ((req_len << 16) + rsp_len);
+}
+
+/**
+ * Handles streaming transfers to and from target memory
+ *
+ * Every request is answered with exactly one response. The host may keep up
+ * to BULK_WINDOW requests in flight, padding each to DAP_PACKET_SIZE. Reads
+ * with BULK_FLAG_RLE answer data requests with a variable number of encoded
+ * words until the state changes to BULK_STATE_DONE.
+ *
+ * Start: [Request (1B) | BULK_CMD_WRITE/READ | Flags (1B) | Address (4B) |
+ *         NWords (4B)] -> [Request (1B) | ReturnCode (1B) | Window (1B)]
+ * Write data: [Request (1B) | BULK_CMD_DATA | Data (BULK_WORDS_PER_PKT*2B)]
+ *   -> [Request (1B) | ReturnCode (1B)]
+ * Read data: [Request (1B) | BULK_CMD_DATA]
+ *   -> [Request (1B) | ReturnCode (1B) | Data (BULK_WORDS_PER_PKT*2B)]
+ * Compressed read data: [Request (1B) | BULK_CMD_DATA]
+ *   -> [Request (1B) | ReturnCode (1B) | Len (1B) | Tokens (Len)]
+ * Status: [Request (1B) | BULK_CMD_STATUS]
+ *   -> [Request (1B) | ReturnCode (1B) | bulk_status_t]
+ */
+static uint32_t process_bulk(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint32_t addr, n_words;
+  int rc;
+
+  switch (request[1]) {
+  case BULK_CMD_WRITE:
+  case BULK_CMD_READ:
+    memcpy(&addr, &request[3], sizeof(addr));
+    memcpy(&n_words, &request[7], sizeof(n_words));
+    if (request[1] == BULK_CMD_WRITE)
+      rc = bulk_start_write(addr, n_words, request[2]);
+    else
+      rc = bulk_start_read(addr, n_words, request[2]);
+    if (rc < 0)
+      response[1] = DAP_ERROR;
+    response[2] = MIN(BULK_WINDOW, UINT8_MAX);
+    rsp_len += 1;
+    break;
+  case BULK_CMD_DATA:
+    if (bulk_state() == BULK_STATE_WRITE) {
+      if (bulk_write_data((uint16_t *)&request[2]) < 0)
+        response[1] = DAP_ERROR;
+    } else if (bulk_flags() & BULK_FLAG_RLE) {
+      if ((rc = bulk_read_rle(&response[3], DAP_PACKET_SIZE - 3)) >= 0) {
+        response[2] = rc;
+        rsp_len += 1 + rc;
+      } else {
+        response[1] = DAP_ERROR;
+      }
+    } else if ((rc = bulk_read_data((uint16_t *)&response[2])) >= 0) {
+      rsp_len += 2 * rc;
+    } else {
+      response[1] = DAP_ERROR;
+    }
+    gpio_put(PROBE_PIN_LED, !gpio_get(PROBE_PIN_LED));
+    break;
+  case BULK_CMD_STATUS:
+    bulk_get_status((bulk_status_t *)&response[2]);
+    rsp_len += sizeof(bulk_status_t);
+    break;
+  case BULK_CMD_ABORT:
+    bulk_abort();
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return ((req_len << 16) + rsp_len);
+}
+
+/**
+ * Executes a vendor command wrapped with a tag that is echoed in the response
+ *
+ * Request: [Request (1B) | Tag (1B) | Vendor request]
+ * Response: [Request (1B) | Tag (1B) | Vendor response]
+ *
+ * Lets a host that keeps several requests in flight check that responses
+ * arrive in the order of its requests. Responses that would exceed the packet
+ * size are replaced with an error, so are batch and tagged requests and the
+ * USB echo.
+ */
+static uint32_t process_tagged(const uint8_t *request, uint8_t *response) {
+  /* Reads store halfwords into the response */
+  static uint8_t inner_rsp[DAP_PACKET_SIZE] __attribute__((aligned(4)));
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len;
+
+  response[1] = request[1];
+  if ((req_len == 0) || (req_len > DAP_PACKET_SIZE) ||
+      not_nestable(&request[2], DAP_PACKET_SIZE - 2)) {
+    response[2] = request[2];
+    response[3] = DAP_ERROR;
+    return ((req_len << 16) + 4);
+  }
+
+  rsp_len = DAP_ProcessVendorCommand(&request[2], inner_rsp) & 0xFFFF;
+  if (rsp_len + 2 > DAP_PACKET_SIZE) {
+    response[2] = inner_rsp[0];
+    response[3] = DAP_ERROR;
+    return ((req_len << 16) + 4);
+  }
+  memcpy(&response[2], inner_rsp, rsp_len);
+  return ((req_len << 16) + rsp_len + 2);
+}
+
+/**
+ * Controls the asynchronous stream interface
+ *
+ * Enable: [Request (1B) | 0 (1B) | Mask (4B)]
+ * Status: [Request (1B) | 1 (1B)]
+ *   -> [Request (1B) | ReturnCode (1B) | stream_status_t]
+ * Test: [Request (1B) | 2 (1B) | NFrames (4B)]
+ */
+static uint32_t process_stream(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint32_t arg;
+
+  switch (request[1]) {
+  case STREAM_CMD_ENABLE:
+    memcpy(&arg, &request[2], sizeof(arg));
+    stream_enable(arg);
+    break;
+  case STREAM_CMD_STATUS:
+    stream_get_status((stream_status_t *)&response[2]);
+    rsp_len += sizeof(stream_status_t);
+    break;
+  case STREAM_CMD_TEST:
+    memcpy(&arg, &request[2], sizeof(arg));
+    if (stream_test(arg) < 0)
+      response[1] = DAP_ERROR;
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Reads and controls command statistics
+ *
+ * Info: [Request (1B) | 0 (1B)] -> [.. | stats_info_t]
+ * Enable: [Request (1B) | 1 (1B) | Enable (1B)]
+ * Reset: [Request (1B) | 2 (1B)]
+ * Read: [Request (1B) | 3 (1B) | Slot (1B)] -> [.. | stats_counters_t]
+ * Histogram: [Request (1B) | 4 (1B) | Slot (1B)] -> [.. | Buckets (15*4B)]
+ * System: [Request (1B) | 5 (1B)] -> [.. | stats_system_t]
+ * Task: [Request (1B) | 6 (1B) | Index (1B)] -> [.. | stats_task_t]
+ */
+static uint32_t process_stats(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+
+  switch (request[1]) {
+  case STATS_CMD_INFO:
+    stats_get_info((stats_info_t *)&response[2]);
+    rsp_len += sizeof(stats_info_t);
+    break;
+  case STATS_CMD_ENABLE:
+    stats_enable(request[2]);
+    break;
+  case STATS_CMD_RESET:
+    stats_reset();
+    break;
+  case STATS_CMD_READ:
+    if (stats_get_counters((stats_counters_t *)&response[2], request[2]) < 0)
+      response[1] = DAP_ERROR;
+    else
+      rsp_len += sizeof(stats_counters_t);
+    break;
+  case STATS_CMD_HIST:
+    if (stats_get_histogram((uint32_t *)&response[2], request[2]) < 0)
+      response[1] = DAP_ERROR;
+    else
+      rsp_len += STATS_N_BUCKETS * sizeof(uint32_t);
+    break;
+  case STATS_CMD_SYSTEM:
+    stats_get_system((stats_system_t *)&response[2]);
+    rsp_len += sizeof(stats_system_t);
+    break;
+  case STATS_CMD_TASK:
+    if (stats_get_task((stats_task_t *)&response[2], request[2]) < 0)
+      response[1] = DAP_ERROR;
+    else
+      rsp_len += sizeof(stats_task_t);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Controls the SBW trace and reads trace entries
+ *
+ * Info: [Request (1B) | 0 (1B)] -> [.. | trace_info_t]
+ * Enable: [Request (1B) | 1 (1B) | Enable (1B)]
+ * Clear: [Request (1B) | 2 (1B)]
+ * Read: [Request (1B) | 3 (1B) | Index (2B)]
+ *   -> [.. | NEntries (1B) | Entries (NEntries * 14B)]
+ */
+static uint32_t process_trace(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint16_t index;
+
+  switch (request[1]) {
+  case TRACE_CMD_INFO:
+    trace_get_info((trace_info_t *)&response[2]);
+    rsp_len += sizeof(trace_info_t);
+    break;
+  case TRACE_CMD_ENABLE:
+    trace_enable(request[2]);
+    break;
+  case TRACE_CMD_CLEAR:
+    trace_clear();
+    break;
+  case TRACE_CMD_READ:
+    memcpy(&index, &request[2], sizeof(index));
+    response[2] = trace_read((trace_entry_t *)&response[3], index,
+                             TRACE_ENTRIES_PER_PKT);
+    rsp_len += 1 + response[2] * sizeof(trace_entry_t);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Benchmarks one of the probe's primitives
+ *
+ * Request: [Request (1B) | Primitive (1B) | NIter (4B) | Arg (4B)]
+ * Response: [Request (1B) | ReturnCode (1B) | bench_result_t]
+ *
+ * The echo primitive returns a full packet with the request instead.
+ */
+static uint32_t process_bench(const uint8_t *request, uint8_t *response) {
+  uint32_t n_iter, arg;
+
+  if (request[1] == BENCH_USB_ECHO) {
+    memcpy(&response[2], &request[2], DAP_PACKET_SIZE - 2);
+    return (10U << 16) | DAP_PACKET_SIZE;
+  }
+
+  memcpy(&n_iter, &request[2], sizeof(n_iter));
+  memcpy(&arg, &request[6], sizeof(arg));
+  if (bench_run((bench_result_t *)&response[2], request[1], n_iter, arg) < 0)
+    response[1] = DAP_ERROR;
+  return (10U << 16) | (2 + sizeof(bench_result_t));
+}
+
+/**
+ * Reports the state of the UART bridge and gives access to its history
+ *
+ * Stats: [Request (1B) | UART_CMD_STATS] -> [.. | uart_stats_t]
+ * History info: [Request (1B) | UART_CMD_HISTORY_INFO]
+ *   -> [.. | uart_history_info_t]
+ * History read: [Request (1B) | UART_CMD_HISTORY_READ | Position (4B)]
+ *   -> [.. | Position (4B) | Lost (4B) | Data]
+ * Replay the history on the serial port: [Request (1B) |
+ *   UART_CMD_HISTORY_REPLAY]
+ * Framed mode: [Request (1B) | UART_CMD_FRAMED | Enable (1B)]
+ *
+ * Reads return the position of their data, which is later than requested if
+ * the requested bytes were overwritten, and the number of bytes lost before.
+ */
+static uint32_t process_uart(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint32_t pos, lost;
+
+  switch (request[1]) {
+  case UART_CMD_STATS:
+    cdc_uart_get_stats((uart_stats_t *)&response[2]);
+    rsp_len += sizeof(uart_stats_t);
+    break;
+  case UART_CMD_HISTORY_INFO:
+    uart_history_get_info((uart_history_info_t *)&response[2]);
+    rsp_len += sizeof(uart_history_info_t);
+    break;
+  case UART_CMD_HISTORY_READ:
+    memcpy(&pos, &request[2], sizeof(pos));
+    rsp_len += 8 + uart_history_read(&pos, &response[10],
+                                     DAP_PACKET_SIZE - 10, &lost);
+    /* The position of the data, not the one after it */
+    pos -= rsp_len - 10;
+    memcpy(&response[2], &pos, sizeof(pos));
+    memcpy(&response[6], &lost, sizeof(lost));
+    break;
+  case UART_CMD_HISTORY_REPLAY:
+    cdc_uart_replay();
+    break;
+  case UART_CMD_FRAMED:
+    cdc_uart_set_framed(request[2] != 0);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Arms rules that react to UART output and GPIO edges on the probe
+ *
+ * Arm: [Request (1B) | TRIGGER_CMD_ARM | Slot (1B) | trigger_rule_t]
+ * Disarm: [Request (1B) | TRIGGER_CMD_DISARM | Slot (1B)]
+ * Status: [Request (1B) | TRIGGER_CMD_STATUS | Slot (1B)]
+ *   -> [Request (1B) | ReturnCode (1B) | trigger_status_t]
+ */
+static uint32_t process_trigger(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  trigger_rule_t rule;
+  int rc;
+
+  switch (request[1]) {
+  case TRIGGER_CMD_ARM:
+    memcpy(&rule, &request[3], sizeof(rule));
+    rc = trigger_arm(request[2], &rule);
+    break;
+  case TRIGGER_CMD_DISARM:
+    rc = trigger_disarm(request[2]);
+    break;
+  case TRIGGER_CMD_STATUS:
+    rc = trigger_get_status((trigger_status_t *)&response[2], request[2]);
+    if (rc == 0)
+      rsp_len += sizeof(trigger_status_t);
+    break;
+  default:
+    rc = -1;
+  }
+  if (rc < 0)
+    response[1] = DAP_ERROR;
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Controls the event timeline, which is sent on STREAM_ID_EVENT
+ *
+ * Enable: [Request (1B) | EVENT_CMD_ENABLE | Mask of EVENT_* (4B)]
+ * Status: [Request (1B) | EVENT_CMD_STATUS]
+ *   -> [Request (1B) | ReturnCode (1B) | event_status_t]
+ */
+static uint32_t process_events(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint32_t mask;
+
+  switch (request[1]) {
+  case EVENT_CMD_ENABLE:
+    memcpy(&mask, &request[2], sizeof(mask));
+    events_enable(mask & ((1UL << EVENT_TYPE_NUM) - 1));
+    break;
+  case EVENT_CMD_STATUS:
+    events_get_status((event_status_t *)&response[2]);
+    rsp_len += sizeof(event_status_t);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/* Most cycles in the response to a read request */
+#define BOOT_READ_MAX ((DAP_PACKET_SIZE - 3) / sizeof(boot_cycle_t))
+
+/**
+ * Measures the boot latency of the target over repeated power cycles
+ *
+ * Start: [Request (1B) | BOOT_CMD_START | boot_config_t]
+ * Stop: [Request (1B) | BOOT_CMD_STOP]
+ * Status: [Request (1B) | BOOT_CMD_STATUS]
+ *   -> [Request (1B) | ReturnCode (1B) | boot_status_t]
+ * Read: [Request (1B) | BOOT_CMD_READ | Index (2B)]
+ *   -> [Request (1B) | ReturnCode (1B) | N (1B) | N x boot_cycle_t]
+ */
+static uint32_t process_boot(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  boot_config_t config;
+  uint16_t index;
+
+  switch (request[1]) {
+  case BOOT_CMD_START:
+    memcpy(&config, &request[2], sizeof(config));
+    if (boot_start(&config) < 0)
+      response[1] = DAP_ERROR;
+    break;
+  case BOOT_CMD_STOP:
+    boot_stop();
+    break;
+  case BOOT_CMD_STATUS:
+    boot_get_status((boot_status_t *)&response[2]);
+    rsp_len += sizeof(boot_status_t);
+    break;
+  case BOOT_CMD_READ:
+    memcpy(&index, &request[2], sizeof(index));
+    response[2] =
+        boot_read((boot_cycle_t *)&response[3], index, BOOT_READ_MAX);
+    rsp_len += 1 + response[2] * sizeof(boot_cycle_t);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Captures the header GPIOs and UART RX, the samples are sent on
+ * STREAM_ID_LOGIC
+ *
+ * Start: [Request (1B) | LOGIC_CMD_START | logic_config_t]
+ * Stop: [Request (1B) | LOGIC_CMD_STOP]
+ * Status: [Request (1B) | LOGIC_CMD_STATUS]
+ *   -> [Request (1B) | ReturnCode (1B) | logic_status_t]
+ */
+static uint32_t process_logic(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  logic_config_t config;
+
+  switch (request[1]) {
+  case LOGIC_CMD_START:
+    memcpy(&config, &request[2], sizeof(config));
+    if (logic_start(&config) < 0)
+      response[1] = DAP_ERROR;
+    break;
+  case LOGIC_CMD_STOP:
+    logic_stop();
+    break;
+  case LOGIC_CMD_STATUS:
+    logic_get_status((logic_status_t *)&response[2]);
+    rsp_len += sizeof(logic_status_t);
+    break;
+  default:
+    response[1] = DAP_ERROR;
+  }
+  return (req_len << 16) | rsp_len;
+}
+
+/**
+ * Manages the image store and programs targets from it
+ *
+ * Info: [Request (1B) | 0 (1B) | Slot (1B)] -> [.. | image_info_t]
+ * Begin: [Request (1B) | 1 (1B) | Slot (1B) | Target (1B) | Size (4B) |
+ *         Name (16B)]
+ * Data: [Request (1B) | 2 (1B) | Len (1B) | Data (Len)]
+ * Commit: [Request (1B) | 3 (1B) | CRC32 (4B) | Autorun (1B)]
+ * Erase: [Request (1B) | 4 (1B) | Slot (1B)]
+ * Autorun: [Request (1B) | 5 (1B) | Slot (1B) | Enable (1B)]
+ * Run: [Request (1B) | 6 (1B) | SlotMask (1B)] -> [.. | image_result_t]
+ * Result: [Request (1B) | 7 (1B)] -> [.. | image_result_t]
+ */
+static uint32_t process_image(const uint8_t *request, uint8_t *response) {
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
+  uint32_t rsp_len = 2;
+  uint32_t value;
+  int rc = 0;
+
+  switch (request[1]) {
+  case IMAGE_CMD_INFO:
+    rc = image_get_info((image_info_t *)&response[2], request[2]);
+    if (rc == 0)
+      rsp_len += sizeof(image_info_t);
+    break;
+  case IMAGE_CMD_BEGIN:
+    memcpy(&value, &request[4], sizeof(value));
+    rc = image_begin(request[2], request[3], value, (const char *)&request[8]);
+    break;
+  case IMAGE_CMD_DATA:
+    if (req_len > DAP_PACKET_SIZE)
+      rc = -1;
+    else
+      rc = image_data(&request[3], request[2]);
+    break;
+  case IMAGE_CMD_COMMIT:
+    memcpy(&value, &request[2], sizeof(value));
+    rc = image_commit(value, request[6]);
+    break;
+  case IMAGE_CMD_ERASE:
+    rc = image_erase(request[2]);
+    break;
+  case IMAGE_CMD_AUTORUN:
+    rc = image_set_autorun(request[2], request[3]);
+    break;
+  case IMAGE_CMD_RUN:
+    /* The result is returned regardless of the outcome */
+    image_run(request[2]);
+    /* fall through */
+  case IMAGE_CMD_RESULT:
+    image_get_result((image_result_t *)&response[2]);
+    rsp_len += sizeof(image_result_t);
+    break;
+  default:
+    rc = -1;
+  }
+  if (rc < 0)
+    response[1] = DAP_ERROR;
+  return (req_len << 16) | rsp_len;
+}
+
+/* Fills in the features and limits of this firmware */
+static void get_capabilities(probe_caps_t *caps) {
+  caps->features = PROBE_FEATURE_BATCH | PROBE_FEATURE_SEQUENCE |
+                   PROBE_FEATURE_BULK | PROBE_FEATURE_BULK_VERIFY |
+                   PROBE_FEATURE_TAGGED | PROBE_FEATURE_STREAM |
+                   PROBE_FEATURE_STATS | PROBE_FEATURE_TRACE |
+                   PROBE_FEATURE_BENCH | PROBE_FEATURE_IMAGE |
+                   PROBE_FEATURE_BOOTLOADER | PROBE_FEATURE_BULK_RLE |
+                   PROBE_FEATURE_TIME | PROBE_FEATURE_UART_STATS |
+                   PROBE_FEATURE_UART_HISTORY | PROBE_FEATURE_UART_FRAMED |
+                   PROBE_FEATURE_TRIGGER | PROBE_FEATURE_EVENTS |
+                   PROBE_FEATURE_BOOT | PROBE_FEATURE_LOGIC;
+  caps->max_payload = DAP_PACKET_SIZE;
+  caps->max_outstanding = BULK_WINDOW;
+  caps->staging_size = CFG_TUD_VENDOR_RX_BUFSIZE;
+  /* The SBW clock is currently not adjustable */
+  caps->sbw_clk_min_hz = sbw_transport_clk_hz();
+  caps->sbw_clk_max_hz = caps->sbw_clk_min_hz;
+}
+
 //   return:   number of bytes in response (lower 16 bits)
 //             number of bytes in request (upper 16 bits)
 // First byte in response is request
-uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
+static uint32_t process_vendor_command(const uint8_t *request,
+                                       uint8_t *response) {
   uint32_t addr;
   /* Reply with same ID as request */
   response[0] = request[0];
@@ -131,7 +969,7 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
   response[1] = DAP_OK;
   uint32_t rsp_len = 2;
 
-  uint32_t req_len = 1;
+  uint32_t req_len = vendor_request_len(request, DAP_PACKET_SIZE);
 
   switch (request[0]) {
   case ID_DAP_VENDOR_VERSION:
@@ -163,25 +1001,25 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
     }
     break;
   case ID_DAP_VENDOR_SBW_RESUME:
-    if (sbw_dev_release() < 0)
+    if (sbw_dev_release() != SBW_ERR_NONE)
       response[1] = DAP_ERROR;
     break;
   case ID_DAP_VENDOR_SBW_RESET:
-    if (sbw_dev_reset() < 0)
+    if (sbw_dev_reset() != SBW_ERR_NONE)
       response[1] = DAP_ERROR;
     break;
   case ID_DAP_VENDOR_SBW_HALT:
-    if (sbw_dev_halt() < 0)
+    if (sbw_dev_halt() != SBW_ERR_NONE)
       response[1] = DAP_ERROR;
     break;
   case ID_DAP_VENDOR_SBW_CONNECT:
     if (programming_enable() < 0)
       response[1] = DAP_ERROR;
-    if (sbw_dev_connect() < 0)
+    if (sbw_dev_connect() != SBW_ERR_NONE)
       response[1] = DAP_ERROR;
     break;
   case ID_DAP_VENDOR_SBW_DISCONNECT:
-    if (sbw_dev_disconnect() < 0)
+    if (sbw_dev_disconnect() != SBW_ERR_NONE)
       response[1] = DAP_ERROR;
     if (programming_disable() < 0)
       response[1] = DAP_ERROR;
@@ -194,7 +1032,10 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
     memcpy(&addr, &request[1], sizeof(addr));
 
     uint8_t n_words_r = request[5];
-    if (sbw_dev_mem_read((uint16_t *)&response[2], addr, n_words_r) == 0) {
+    if (n_words_r > SBW_READ_MAX_WORDS) {
+      response[1] = DAP_ERROR;
+    } else if (sbw_dev_mem_read((uint16_t *)&response[2], addr, n_words_r) ==
+               0) {
       rsp_len += n_words_r * 2;
     } else
       response[1] = DAP_ERROR;
@@ -205,10 +1046,61 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
     memcpy(&addr, &request[1], sizeof(addr));
 
     uint8_t n_words_w = request[5];
-    if (sbw_dev_mem_write(addr, (uint16_t *)&request[6], n_words_w) < 0)
+    if (sbw_dev_mem_write(addr, (uint16_t *)&request[6], n_words_w) !=
+        SBW_ERR_NONE)
       response[1] = DAP_ERROR;
     gpio_put(PROBE_PIN_LED, !gpio_get(PROBE_PIN_LED));
     break;
+  case ID_DAP_VENDOR_BATCH:
+    return process_batch(request, response);
+  case ID_DAP_VENDOR_SEQUENCE:
+    return process_sequence(request, response);
+  case ID_DAP_VENDOR_BULK:
+    return process_bulk(request, response);
+  case ID_DAP_VENDOR_TAGGED:
+    return process_tagged(request, response);
+  case ID_DAP_VENDOR_STREAM:
+    return process_stream(request, response);
+  case ID_DAP_VENDOR_STATS:
+    return process_stats(request, response);
+  case ID_DAP_VENDOR_TRACE:
+    return process_trace(request, response);
+  case ID_DAP_VENDOR_BENCH:
+    return process_bench(request, response);
+  case ID_DAP_VENDOR_IMAGE:
+    return process_image(request, response);
+  case ID_DAP_VENDOR_UART:
+    return process_uart(request, response);
+  case ID_DAP_VENDOR_TRIGGER:
+    return process_trigger(request, response);
+  case ID_DAP_VENDOR_EVENTS:
+    return process_events(request, response);
+  case ID_DAP_VENDOR_BOOT:
+    return process_boot(request, response);
+  case ID_DAP_VENDOR_LOGIC:
+    return process_logic(request, response);
+  case ID_DAP_VENDOR_BOOTLOADER:
+    /* The DAP task reboots once the response is on its way to the host */
+    reboot_requested = true;
+    break;
+  case ID_DAP_VENDOR_TIME: {
+    /*
+     * Response: [Request (1B) | ReturnCode (1B) | Time (8B)]
+     *
+     * Microseconds since boot, the lower 32 bits match the timestamps of
+     * streams and traces. The host brackets the request with its own clock to
+     * estimate offset and drift.
+     */
+    uint64_t now = time_us_64();
+    memcpy(&response[2], &now, sizeof(now));
+    rsp_len += sizeof(now);
+    break;
+  }
+  case ID_DAP_VENDOR_CAPS:
+    /* Response: [Request (1B) | ReturnCode (1B) | Capabilities] */
+    get_capabilities((probe_caps_t *)&response[2]);
+    rsp_len += sizeof(probe_caps_t);
+    break;
   default:
     response[0] = ID_DAP_Invalid;
     response[1] = DAP_ERROR;
@@ -216,3 +1108,17 @@ uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
 
   return ((req_len << 16) + rsp_len);
 }
+
+/* Executes a vendor command and records its statistics. Also called for the
+ * operations of batch and tagged requests. */
+uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *response) {
+  uint32_t t_start = time_us_32();
+
+  /* Marks which command issued the following scans */
+  if (request[0] != ID_DAP_VENDOR_TRACE)
+    trace_record(TRACE_CMD, request[0], 0);
+  uint32_t ret = process_vendor_command(request, response);
+
+  stats_record(request[0], t_start, vendor_failed(request, response));
+  return ret;
+}
@@ -1,3 +1,4 @@
+#include "probe_events.h"
 #include "sbw_device.h"
 #include "sbw_jtag.h"
 
@@ -240,6 +241,7 @@ int sbw_dev_halt(void) {
   tap_ir_shift(IR_CNTRL_SIG_16BIT);
   tap_dr_shift16(0x2409); // set JTAG_HALT bit
   set_tclk_sbw();
+  event_record(EVENT_SBW, EVENT_SBW_HALT, SBW_ERR_NONE);
   return SBW_ERR_NONE;
 }
 
@@ -253,6 +255,7 @@ int sbw_dev_release(void) {
   tap_dr_shift16(0x2401); // Release reset.
   tap_ir_shift(IR_CNTRL_SIG_RELEASE);
   set_tclk_sbw();
+  event_record(EVENT_SBW, EVENT_SBW_RELEASE, SBW_ERR_NONE);
   return SBW_ERR_NONE;
 }
 
@@ -280,7 +283,7 @@ int sbw_dev_setup(sbw_pins_t *sbw_pins) {
   return rc;
 }
 
-int sbw_dev_connect(void) {
+static int dev_connect(void) {
   int rc;
 
   uint16_t core_id;
@@ -298,11 +301,19 @@ int sbw_dev_connect(void) {
   return SBW_ERR_NONE;
 }
 
+int sbw_dev_connect(void) {
+  int rc = dev_connect();
+
+  event_record(EVENT_SBW, EVENT_SBW_CONNECT, rc);
+  return rc;
+}
+
 int sbw_dev_disconnect(void) {
   tap_ir_shift(IR_CNTRL_SIG_16BIT);
   tap_dr_shift16(0x2C01);
   tap_dr_shift16(0x2401);
   tap_ir_shift(IR_CNTRL_SIG_RELEASE);
   int rc = sbw_jtag_disconnect();
+  event_record(EVENT_SBW, EVENT_SBW_DISCONNECT, rc);
   return rc;
 }
@@ -41,6 +41,7 @@
 #include <stdint.h>
 
 #include "sbw_jtag.h"
+#include "sbw_trace.h"
 #include "sbw_transport.h"
 
 #include "FreeRTOS.h"
@@ -57,6 +58,7 @@ void tap_reset(void) {
   }
   /* JTAG FSM is now in Test-Logic-Reset, move to Run/Test Idle */
   tmsl_tdih();
+  trace_record(TRACE_TAP_RESET, 0, 0);
 }
 
 /**
@@ -138,7 +140,9 @@ uint32_t tap_ir_shift(uint8_t instruction) {
   // JTAG FSM state = Capture-IR
   tmsl_tdih();
   // JTAG FSM state = Shift-IR, Shift in TDI (8-bit)
-  return (tap_shift(F_BYTE, instruction));
+  uint32_t tdo = tap_shift(F_BYTE, instruction);
+  trace_record(TRACE_IR_SHIFT, instruction, tdo);
+  return tdo;
   // JTAG FSM state = Run-Test/Idle
 }
 
@@ -155,7 +159,9 @@ uint16_t tap_dr_shift16(uint16_t data) {
   tmsl_tdih();
 
   // JTAG FSM state = Shift-DR, Shift in TDI (16-bit)
-  return (tap_shift(F_WORD, data));
+  uint16_t tdo = tap_shift(F_WORD, data);
+  trace_record(TRACE_DR_SHIFT16, data, tdo);
+  return tdo;
   // JTAG FSM state = Run-Test/Idle
 }
 
@@ -171,8 +177,10 @@ uint32_t tap_dr_shift20(uint32_t address) {
   // JTAG FSM state = Capture-DR
   tmsl_tdih();
 
-  // JTAG FSM state = Shift-DR, Shift in TDI (16-bit)
-  return (tap_shift(F_ADDR, address));
+  // JTAG FSM state = Shift-DR, Shift in TDI (20-bit)
+  uint32_t tdo = tap_shift(F_ADDR, address);
+  trace_record(TRACE_DR_SHIFT20, address, tdo);
+  return tdo;
   // JTAG FSM state = Run-Test/Idle
 }
 
@@ -197,6 +205,15 @@ int sbw_jtag_write_jmb_in16(uint16_t data) {
   return SBW_ERR_NONE;
 }
 
+int sbw_jtag_read_jmb_out16(uint16_t *data) {
+  tap_ir_shift(IR_JMB_EXCHANGE);
+  if (!(tap_dr_shift16(0x0000) & OUT1RDY))
+    return SBW_ERR_GENERIC;
+  tap_dr_shift16(OUTREQ);
+  *data = tap_dr_shift16(0x0000);
+  return SBW_ERR_NONE;
+}
+
 /**
  * Enables JTAG access over SBW
  *
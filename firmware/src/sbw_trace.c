@@ -0,0 +1,56 @@
+/*
+ * Records the JTAG scans and TCLK toggles issued via SBW in a ring buffer. The
+ * oldest entries are overwritten when the buffer is full. Entries are only
+ * recorded from the task that drives SBW, so no locking is required.
+ */
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "sbw_trace.h"
+
+bool trace_active = false;
+
+static trace_entry_t entries[TRACE_N_ENTRIES];
+static uint32_t total = 0;
+static uint8_t instr = 0;
+
+void trace_add(uint8_t type, uint32_t data_in, uint32_t data_out) {
+  trace_entry_t *entry = &entries[total % TRACE_N_ENTRIES];
+
+  if (type == TRACE_IR_SHIFT)
+    instr = data_in;
+
+  entry->timestamp = time_us_32();
+  entry->type = type;
+  entry->instr = instr;
+  entry->data_in = data_in;
+  entry->data_out = data_out;
+  total++;
+}
+
+void trace_enable(bool enable) { trace_active = enable; }
+
+void trace_clear(void) {
+  total = 0;
+  instr = 0;
+}
+
+void trace_get_info(trace_info_t *info) {
+  info->enabled = trace_active;
+  info->total = total;
+  info->available = MIN(total, TRACE_N_ENTRIES);
+}
+
+unsigned int trace_read(trace_entry_t *dst, unsigned int index,
+                        unsigned int n) {
+  unsigned int available = MIN(total, TRACE_N_ENTRIES);
+  uint32_t oldest = total - available;
+
+  if (index >= available)
+    return 0;
+  n = MIN(n, available - index);
+  for (unsigned int i = 0; i < n; i++)
+    dst[i] = entries[(oldest + index + i) % TRACE_N_ENTRIES];
+  return n;
+}
@@ -37,13 +37,13 @@
  * the JTAG TMS, TDO and TDI signals over a two wire interface.
  */
 
+#include "sbw_trace.h"
 #include "sbw_transport.h"
 
 #include "delay.h"
 
-#include "FreeRTOS.h"
-#include "task.h"
-
+#include <hardware/clocks.h>
+#include <hardware/sync.h>
 #include <pico/stdlib.h>
 #include <stdio.h>
 
@@ -52,6 +52,15 @@ static unsigned int clk_delay_cycles;
 
 static sbw_pins_t pins;
 
+/*
+ * The SBW clock must not be held low for longer than the device's SBW timeout
+ * (~7us), so slots must not be interrupted. Only interrupts on this core are
+ * masked; a FreeRTOS critical section would also take the kernel lock and stall
+ * the UART and USB tasks on the other core.
+ */
+#define SLOT_ENTER() uint32_t irq_state = save_and_disable_interrupts()
+#define SLOT_EXIT() restore_interrupts(irq_state)
+
 static inline void tmsh(void) {
   gpio_put(pins.sbw_tdio, true);
   __delay_cycles(clk_delay_cycles);
@@ -135,82 +144,82 @@ void set_sbwtdio(bool state) { gpio_put(pins.sbw_tdio, state); }
 void set_sbwtck(bool state) { gpio_put(pins.sbw_tck, state); }
 
 void tmsl_tdil(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
   tmsl();
   tdil();
   tdo_sbw();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
 }
 
 void tmsh_tdil(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsh();
   tdil();
   tdo_sbw();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
 }
 
 void tmsl_tdih(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsl();
   tdih();
   tdo_sbw();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
 }
 
 void tmsh_tdih(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsh();
   tdih();
   tdo_sbw();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
 }
 
 bool tmsl_tdih_tdo_rd(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsl();
   tdih();
   bool res = tdo_rd();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
   return res;
 }
 
 bool tmsl_tdil_tdo_rd(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsl();
   tdil();
   bool res = tdo_rd();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
   return res;
 }
 
 bool tmsh_tdih_tdo_rd(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsh();
   tdih();
   bool res = tdo_rd();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
   return res;
 }
 
 bool tmsh_tdil_tdo_rd(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   tmsh();
   tdil();
   bool res = tdo_rd();
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
   return res;
 }
 
 void clr_tclk_sbw(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
   if (tclk_state == true) {
     tmsldh();
   } else {
@@ -222,11 +231,12 @@ void clr_tclk_sbw(void) {
   tdil();
   tdo_sbw();
   tclk_state = 0;
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
+  trace_record(TRACE_TCLK_CLR, 0, 0);
 }
 
 void set_tclk_sbw(void) {
-  taskENTER_CRITICAL();
+  SLOT_ENTER();
 
   if (tclk_state == true) {
     tmsldh();
@@ -238,7 +248,8 @@ void set_tclk_sbw(void) {
   tdih();
   tdo_sbw();
   tclk_state = 1;
-  taskEXIT_CRITICAL();
+  SLOT_EXIT();
+  trace_record(TRACE_TCLK_SET, 0, 0);
 }
 
 bool get_tclk(void) { return tclk_state; }
@@ -265,6 +276,11 @@ int sbw_transport_connect(void) {
   return 0;
 }
 
+uint32_t sbw_transport_clk_hz(void) {
+  /* Every SBW clock period consists of two delays */
+  return clock_get_hz(clk_sys) / (2 * clk_delay_cycles);
+}
+
 int sbw_transport_setup(sbw_pins_t *sbw_pins) {
   pins.sbw_tck = sbw_pins->sbw_tck;
   pins.sbw_tdio = sbw_pins->sbw_tdio;
@@ -0,0 +1,150 @@
+/*
+ * Minimal ADIv5 MEM-AP access on top of the CMSIS-DAP SWD transfer routine.
+ * Allows the probe to access memory of an ARM target without the host, for
+ * example to program images from the probe's flash.
+ */
+
+#include <pico/stdlib.h>
+
+#include "DAP.h"
+#include "DAP_config.h"
+
+#include "swd_mem.h"
+
+/* Debug port registers */
+#define DP_IDCODE 0x00
+#define DP_ABORT 0x00
+#define DP_CTRL_STAT 0x04
+#define DP_SELECT 0x08
+#define DP_RDBUFF 0x0C
+
+/* MEM-AP registers in bank 0 */
+#define AP_CSW 0x00
+#define AP_TAR 0x04
+#define AP_DRW 0x0C
+
+#define CTRL_CDBGPWRUPREQ (1UL << 28)
+#define CTRL_CDBGPWRUPACK (1UL << 29)
+#define CTRL_CSYSPWRUPREQ (1UL << 30)
+#define CTRL_CSYSPWRUPACK (1UL << 31)
+
+#define ABORT_CLEAR_ALL 0x1E
+
+/* 32-bit accesses with single address increment */
+#define CSW_WORD_AUTOINC 0x23000012
+
+/* The TAR auto-increment only covers 1 KB blocks */
+#define TAR_INC_BLOCK 1024
+
+#define SWD_RETRIES 100
+#define SWD_POWERUP_RETRIES 100
+
+static int transfer(uint32_t request, uint32_t *data) {
+  for (unsigned int i = 0; i < SWD_RETRIES; i++) {
+    uint8_t ack = SWD_Transfer(request, data);
+    if (ack == DAP_TRANSFER_OK)
+      return 0;
+    if (ack != DAP_TRANSFER_WAIT)
+      return -1;
+  }
+  return -1;
+}
+
+static int dp_write(uint8_t reg, uint32_t value) {
+  return transfer(reg & 0x0C, &value);
+}
+
+static int dp_read(uint8_t reg, uint32_t *value) {
+  return transfer(DAP_TRANSFER_RnW | (reg & 0x0C), value);
+}
+
+static int ap_write(uint8_t reg, uint32_t value) {
+  return transfer(DAP_TRANSFER_APnDP | (reg & 0x0C), &value);
+}
+
+/* AP reads are posted, the value is returned by the next AP or RDBUFF read */
+static int ap_read_posted(uint8_t reg, uint32_t *value) {
+  return transfer(DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | (reg & 0x0C), value);
+}
+
+int swd_mem_connect(void) {
+  /* Line reset, JTAG-to-SWD switch sequence, line reset and idle cycles */
+  static const uint8_t ones[7] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  static const uint8_t jtag_to_swd[2] = {0x9E, 0xE7};
+  static const uint8_t idle[1] = {0x00};
+  uint32_t value;
+
+  SWJ_Sequence(51, ones);
+  SWJ_Sequence(16, jtag_to_swd);
+  SWJ_Sequence(51, ones);
+  SWJ_Sequence(8, idle);
+
+  if (dp_read(DP_IDCODE, &value) < 0)
+    return -1;
+  if (dp_write(DP_ABORT, ABORT_CLEAR_ALL) < 0)
+    return -1;
+  if (dp_write(DP_CTRL_STAT, CTRL_CDBGPWRUPREQ | CTRL_CSYSPWRUPREQ) < 0)
+    return -1;
+
+  for (unsigned int i = 0;; i++) {
+    if (dp_read(DP_CTRL_STAT, &value) < 0)
+      return -1;
+    if ((value & (CTRL_CDBGPWRUPACK | CTRL_CSYSPWRUPACK)) ==
+        (CTRL_CDBGPWRUPACK | CTRL_CSYSPWRUPACK))
+      break;
+    if (i == SWD_POWERUP_RETRIES)
+      return -1;
+    sleep_us(100);
+  }
+
+  /* Select MEM-AP 0, bank 0 */
+  if (dp_write(DP_SELECT, 0) < 0)
+    return -1;
+  return ap_write(AP_CSW, CSW_WORD_AUTOINC);
+}
+
+int swd_mem_read32(uint32_t *dst, uint32_t addr) {
+  return swd_mem_read_block(dst, addr, 1);
+}
+
+int swd_mem_write32(uint32_t addr, uint32_t value) {
+  return swd_mem_write_block(addr, &value, 1);
+}
+
+int swd_mem_write_block(uint32_t addr, const uint32_t *data, size_t n_words) {
+  for (size_t i = 0; i < n_words; i++, addr += 4) {
+    /* TAR needs to be rewritten at the start of every auto-increment block */
+    if ((i == 0) || ((addr % TAR_INC_BLOCK) == 0)) {
+      if (ap_write(AP_TAR, addr) < 0)
+        return -1;
+    }
+    if (ap_write(AP_DRW, data[i]) < 0)
+      return -1;
+  }
+  /* Makes sure the last write has completed */
+  return dp_read(DP_RDBUFF, NULL);
+}
+
+int swd_mem_read_block(uint32_t *dst, uint32_t addr, size_t n_words) {
+  while (n_words > 0) {
+    /* Reads up to the end of the auto-increment block */
+    size_t n = MIN(n_words, (TAR_INC_BLOCK - (addr % TAR_INC_BLOCK)) / 4);
+
+    if (ap_write(AP_TAR, addr) < 0)
+      return -1;
+    /* Every AP read returns the result of the previous one */
+    if (ap_read_posted(AP_DRW, NULL) < 0)
+      return -1;
+    for (size_t i = 1; i < n; i++) {
+      if (ap_read_posted(AP_DRW, &dst[i - 1]) < 0)
+        return -1;
+    }
+    if (dp_read(DP_RDBUFF, &dst[n - 1]) < 0)
+      return -1;
+
+    dst += n;
+    addr += 4 * n;
+    n_words -= n;
+  }
+  return 0;
+}
@@ -43,7 +43,7 @@ extern "C" {
 #define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
 
 #ifndef CFG_TUSB_OS
-#define CFG_TUSB_OS OPT_OS_PICO
+#define CFG_TUSB_OS OPT_OS_FREERTOS
 #endif
 
 #ifndef CFG_TUSB_MEM_SECTION
@@ -67,10 +67,11 @@ extern "C" {
 #define CFG_TUD_CDC 1
 #define CFG_TUD_MSC 0
 #define CFG_TUD_MIDI 0
-#define CFG_TUD_VENDOR 1
+#define CFG_TUD_VENDOR 2
 
-#define CFG_TUD_CDC_RX_BUFSIZE 64
-#define CFG_TUD_CDC_TX_BUFSIZE 64
+/* Absorb bursts of the UART at 1 Mbaud between two reads of the host */
+#define CFG_TUD_CDC_RX_BUFSIZE 1024
+#define CFG_TUD_CDC_TX_BUFSIZE 4096
 
 #define CFG_TUD_VENDOR_RX_BUFSIZE 8192
 #define CFG_TUD_VENDOR_TX_BUFSIZE 8192
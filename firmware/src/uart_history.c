@@ -0,0 +1,193 @@
+/*
+ * Ring buffer of the target's UART output. The UART task writes it, the UART
+ * task and the DAP task read it, so all accesses hold a hardware spin lock.
+ */
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "uart_history.h"
+
+static uint8_t buf[UART_HISTORY_SIZE];
+static uint32_t head;
+/* Number of valid bytes, saturates at the size of the buffer */
+static uint32_t n_held;
+static uint32_t lost_total;
+
+/* Positions of losses and the number of bytes lost there, oldest first */
+static struct {
+  uint32_t pos;
+  uint32_t n_lost;
+} losses[UART_HISTORY_MAX_LOSSES];
+static uint32_t n_losses;
+
+/* Reception times, oldest first */
+static uart_stamp_t stamps[UART_HISTORY_MAX_STAMPS];
+static uint32_t n_stamps;
+
+static spin_lock_t *lock;
+
+void uart_history_init(void) {
+  if (lock == NULL)
+    lock = spin_lock_instance(spin_lock_claim_unused(true));
+  head = 0;
+  n_held = 0;
+  lost_total = 0;
+  n_losses = 0;
+  n_stamps = 0;
+}
+
+static uint32_t oldest(void) { return head - n_held; }
+
+void uart_history_write(const uint8_t *data, unsigned int len) {
+  uint32_t irq = spin_lock_blocking(lock);
+
+  /* Only the last UART_HISTORY_SIZE bytes survive */
+  if (len > UART_HISTORY_SIZE) {
+    head += len - UART_HISTORY_SIZE;
+    data += len - UART_HISTORY_SIZE;
+    len = UART_HISTORY_SIZE;
+  }
+  while (len > 0) {
+    uint32_t offset = head % UART_HISTORY_SIZE;
+    uint32_t n = MIN(len, UART_HISTORY_SIZE - offset);
+    memcpy(&buf[offset], data, n);
+    head += n;
+    n_held = MIN(n_held + n, UART_HISTORY_SIZE);
+    data += n;
+    len -= n;
+  }
+  spin_unlock(lock, irq);
+}
+
+void uart_history_mark_loss(uint32_t n_lost) {
+  uint32_t irq = spin_lock_blocking(lock);
+
+  lost_total += n_lost;
+  if ((n_losses > 0) &&
+      (losses[(n_losses - 1) % UART_HISTORY_MAX_LOSSES].pos == head)) {
+    /* Nothing arrived in between */
+    losses[(n_losses - 1) % UART_HISTORY_MAX_LOSSES].n_lost += n_lost;
+  } else {
+    losses[n_losses % UART_HISTORY_MAX_LOSSES].pos = head;
+    losses[n_losses % UART_HISTORY_MAX_LOSSES].n_lost = n_lost;
+    n_losses++;
+  }
+  spin_unlock(lock, irq);
+}
+
+void uart_history_mark_time(uint32_t time_us) {
+  uint32_t irq = spin_lock_blocking(lock);
+
+  /* A later stamp for the same byte replaces the earlier one */
+  if ((n_stamps == 0) ||
+      (stamps[(n_stamps - 1) % UART_HISTORY_MAX_STAMPS].pos != head))
+    n_stamps++;
+  stamps[(n_stamps - 1) % UART_HISTORY_MAX_STAMPS].pos = head;
+  stamps[(n_stamps - 1) % UART_HISTORY_MAX_STAMPS].time_us = time_us;
+  spin_unlock(lock, irq);
+}
+
+static unsigned int read(uint32_t *pos, uint8_t *dst, unsigned int max_len,
+                         uint32_t *lost, uart_stamp_t *stamp) {
+  uint32_t irq = spin_lock_blocking(lock);
+  uint32_t start = *pos;
+  uint32_t end = head;
+  uint32_t first = (n_losses > UART_HISTORY_MAX_LOSSES)
+                       ? n_losses - UART_HISTORY_MAX_LOSSES
+                       : 0;
+  unsigned int len = 0;
+
+  *lost = 0;
+  if ((int32_t)(start - oldest()) < 0) {
+    *lost = oldest() - start;
+    start = oldest();
+  }
+
+  /* Losses are ordered by position */
+  for (uint32_t i = first; i < n_losses; i++) {
+    uint32_t loss_pos = losses[i % UART_HISTORY_MAX_LOSSES].pos;
+    if (loss_pos == start) {
+      *lost += losses[i % UART_HISTORY_MAX_LOSSES].n_lost;
+    } else if ((int32_t)(loss_pos - start) > 0) {
+      end = loss_pos;
+      break;
+    }
+  }
+
+  if (stamp != NULL) {
+    uint32_t lo = (n_stamps > UART_HISTORY_MAX_STAMPS)
+                      ? n_stamps - UART_HISTORY_MAX_STAMPS
+                      : 0;
+    uint32_t hi = n_stamps;
+
+    /* Binary search for the first stamp after start, the lock is held with
+     * interrupts disabled */
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if ((int32_t)(stamps[mid % UART_HISTORY_MAX_STAMPS].pos - start) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo < n_stamps) {
+      uart_stamp_t *next = &stamps[lo % UART_HISTORY_MAX_STAMPS];
+      if ((int32_t)(next->pos - end) < 0)
+        end = next->pos;
+    }
+    if ((lo > 0) && (n_stamps - lo < UART_HISTORY_MAX_STAMPS))
+      *stamp = stamps[(lo - 1) % UART_HISTORY_MAX_STAMPS];
+    else if (lo < n_stamps)
+      *stamp = stamps[lo % UART_HISTORY_MAX_STAMPS];
+    else {
+      stamp->pos = start;
+      stamp->time_us = 0;
+    }
+  }
+
+  /* Losses are reported with the first byte after them */
+  if (start == head) {
+    *lost = 0;
+    spin_unlock(lock, irq);
+    return 0;
+  }
+
+  while ((start + len != end) && (len < max_len)) {
+    uint32_t offset = (start + len) % UART_HISTORY_SIZE;
+    uint32_t n = MIN(MIN(end - start - len, max_len - len),
+                     UART_HISTORY_SIZE - offset);
+    memcpy(&dst[len], &buf[offset], n);
+    len += n;
+  }
+  *pos = start + len;
+  spin_unlock(lock, irq);
+  return len;
+}
+
+unsigned int uart_history_read(uint32_t *pos, uint8_t *dst,
+                               unsigned int max_len, uint32_t *lost) {
+  return read(pos, dst, max_len, lost, NULL);
+}
+
+unsigned int uart_history_read_stamped(uint32_t *pos, uint8_t *dst,
+                                       unsigned int max_len, uint32_t *lost,
+                                       uart_stamp_t *stamp) {
+  return read(pos, dst, max_len, lost, stamp);
+}
+
+uint32_t uart_history_oldest(void) {
+  uint32_t irq = spin_lock_blocking(lock);
+  uint32_t pos = oldest();
+  spin_unlock(lock, irq);
+  return pos;
+}
+
+void uart_history_get_info(uart_history_info_t *info) {
+  uint32_t irq = spin_lock_blocking(lock);
+  info->size = UART_HISTORY_SIZE;
+  info->head = head;
+  info->oldest = oldest();
+  info->lost = lost_total;
+  spin_unlock(lock, irq);
+}
@@ -61,7 +61,13 @@ uint8_t const *tud_descriptor_device_cb(void) {
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
-enum { ITF_NUM_PROBE, ITF_NUM_CDC_UART, ITF_NUM_CDC_UART_DATA, ITF_NUM_TOTAL };
+enum {
+  ITF_NUM_PROBE,
+  ITF_NUM_CDC_UART,
+  ITF_NUM_CDC_UART_DATA,
+  ITF_NUM_STREAM,
+  ITF_NUM_TOTAL
+};
 
 /* UART notifications on endpoint 1 IN */
 #define CDC_NOTIFICATION_EP_NUM 0x81
@@ -76,8 +82,13 @@ enum { ITF_NUM_PROBE, ITF_NUM_CDC_UART, ITF_NUM_CDC_UART_DATA, ITF_NUM_TOTAL };
 /* DAP commands on endpoint 3 IN */
 #define PROBE_IN_EP_NUM 0x83
 
+/* Unused, but required by the vendor interface descriptor */
+#define STREAM_OUT_EP_NUM 0x04
+/* Asynchronous streams on endpoint 4 IN */
+#define STREAM_IN_EP_NUM 0x84
+
 #define CONFIG_TOTAL_LEN                                                       \
-  (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN)
+  (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + 2 * TUD_VENDOR_DESC_LEN)
 
 uint8_t const desc_configuration[] = {
     TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN,
@@ -86,6 +97,8 @@ uint8_t const desc_configuration[] = {
                           64),
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_UART, 5, CDC_NOTIFICATION_EP_NUM, 64,
                        CDC_DATA_OUT_EP_NUM, CDC_DATA_IN_EP_NUM, 64),
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_STREAM, 6, STREAM_OUT_EP_NUM,
+                          STREAM_IN_EP_NUM, 64),
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -112,6 +125,7 @@ char const *string_desc_arr[] = {
     usb_serial,                 // 3: Serial, uses flash unique ID
     "Rioteeprobe CMSIS-DAP v2", // 4: Interface descriptor for Bulk transport
     "Rioteeprobe CDC-ACM UART", // 5: Interface descriptor for CDC
+    "Rioteeprobe Stream",       // 6: Interface descriptor for streams
 };
 
 static uint16_t _desc_str[32];
@@ -170,7 +184,9 @@ will insert "DeviceInterfaceGUIDs" multistring property.
 https://developers.google.com/web/fundamentals/native-hardware/build-for-webusb/
 (Section Microsoft OS compatibility descriptors)
 */
-#define MS_OS_20_DESC_LEN 0xB2
+/* Length of the function subset for one WinUSB interface */
+#define MS_OS_20_FUNC_DESC_LEN 0xA0
+#define MS_OS_20_DESC_LEN (0x0A + 0x08 + 2 * MS_OS_20_FUNC_DESC_LEN)
 
 #define BOS_TOTAL_LEN (TUD_BOS_DESC_LEN + TUD_BOS_MICROSOFT_OS_DESC_LEN)
 
@@ -181,6 +197,39 @@ uint8_t const desc_bos[] = {
     // Microsoft OS 2.0 descriptor
     TUD_BOS_MS_OS_20_DESCRIPTOR(MS_OS_20_DESC_LEN, 1)};
 
+/* Binds WinUSB to an interface */
+#define MS_OS_20_WINUSB_FUNCTION(itf)                                          \
+  /* Function Subset header: length, type, first interface, reserved, subset   \
+   * length */                                                                 \
+  U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION), itf,  \
+      0, U16_TO_U8S_LE(MS_OS_20_FUNC_DESC_LEN),                                \
+                                                                               \
+      /* MS OS 2.0 Compatible ID descriptor: length, type, compatible ID, sub  \
+       * compatible ID */                                                      \
+      U16_TO_U8S_LE(0x0014), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID),     \
+      'W', 'I', 'N', 'U', 'S', 'B', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  \
+      0x00, 0x00, 0x00, /* sub-compatible */                                   \
+                                                                               \
+      /* MS OS 2.0 Registry property descriptor: length, type */               \
+      U16_TO_U8S_LE(MS_OS_20_FUNC_DESC_LEN - 0x08 - 0x14),                     \
+      U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY), U16_TO_U8S_LE(0x0007),     \
+      /* wPropertyDataType, wPropertyNameLength and PropertyName               \
+       * "DeviceInterfaceGUIDs\0" in UTF-16 */                                 \
+      U16_TO_U8S_LE(0x002A), 'D', 0x00, 'e', 0x00, 'v', 0x00, 'i', 0x00, 'c',  \
+      0x00, 'e', 0x00, 'I', 0x00, 'n', 0x00, 't', 0x00, 'e', 0x00, 'r', 0x00,  \
+      'f', 0x00, 'a', 0x00, 'c', 0x00, 'e', 0x00, 'G', 0x00, 'U', 0x00, 'I',   \
+      0x00, 'D', 0x00, 's', 0x00, 0x00, 0x00,                                  \
+      U16_TO_U8S_LE(0x0050), /* wPropertyDataLength */                         \
+      /* bPropertyData "{CDB3B5AD-293B-4663-AA36-1AAE46463776}" as a UTF-16    \
+       * string (b doesn't mean bytes) */                                      \
+      '{', 0x00, 'C', 0x00, 'D', 0x00, 'B', 0x00, '3', 0x00, 'B', 0x00, '5',   \
+      0x00, 'A', 0x00, 'D', 0x00, '-', 0x00, '2', 0x00, '9', 0x00, '3', 0x00,  \
+      'B', 0x00, '-', 0x00, '4', 0x00, '6', 0x00, '6', 0x00, '3', 0x00, '-',   \
+      0x00, 'A', 0x00, 'A', 0x00, '3', 0x00, '6', 0x00, '-', 0x00, '1', 0x00,  \
+      'A', 0x00, 'A', 0x00, 'E', 0x00, '4', 0x00, '6', 0x00, '4', 0x00, '6',   \
+      0x00, '3', 0x00, '7', 0x00, '7', 0x00, '6', 0x00, '}', 0x00, 0x00, 0x00, \
+      0x00, 0x00
+
 uint8_t const desc_ms_os_20[] = {
     // Set header: length, type, windows version, total length
     U16_TO_U8S_LE(0x000A), U16_TO_U8S_LE(MS_OS_20_SET_HEADER_DESCRIPTOR),
@@ -191,35 +240,8 @@ uint8_t const desc_ms_os_20[] = {
     U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_CONFIGURATION),
     0, 0, U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A),
 
-    // Function Subset header: length, type, first interface, reserved, subset
-    // length
-    U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION),
-    ITF_NUM_PROBE, 0, U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A - 0x08),
-
-    // MS OS 2.0 Compatible ID descriptor: length, type, compatible ID, sub
-    // compatible ID
-    U16_TO_U8S_LE(0x0014), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID), 'W',
-    'I', 'N', 'U', 'S', 'B', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, // sub-compatible
-
-    // MS OS 2.0 Registry property descriptor: length, type
-    U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A - 0x08 - 0x08 - 0x14),
-    U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY), U16_TO_U8S_LE(0x0007),
-    U16_TO_U8S_LE(0x002A), // wPropertyDataType, wPropertyNameLength and
-                           // PropertyName "DeviceInterfaceGUIDs\0" in UTF-16
-    'D', 0x00, 'e', 0x00, 'v', 0x00, 'i', 0x00, 'c', 0x00, 'e', 0x00, 'I', 0x00,
-    'n', 0x00, 't', 0x00, 'e', 0x00, 'r', 0x00, 'f', 0x00, 'a', 0x00, 'c', 0x00,
-    'e', 0x00, 'G', 0x00, 'U', 0x00, 'I', 0x00, 'D', 0x00, 's', 0x00, 0x00,
-    0x00,
-    U16_TO_U8S_LE(0x0050), // wPropertyDataLength
-    // bPropertyData "{CDB3B5AD-293B-4663-AA36-1AAE46463776}" as a
-    // UTF-16 string (b doesn't mean bytes)
-    '{', 0x00, 'C', 0x00, 'D', 0x00, 'B', 0x00, '3', 0x00, 'B', 0x00, '5', 0x00,
-    'A', 0x00, 'D', 0x00, '-', 0x00, '2', 0x00, '9', 0x00, '3', 0x00, 'B', 0x00,
-    '-', 0x00, '4', 0x00, '6', 0x00, '6', 0x00, '3', 0x00, '-', 0x00, 'A', 0x00,
-    'A', 0x00, '3', 0x00, '6', 0x00, '-', 0x00, '1', 0x00, 'A', 0x00, 'A', 0x00,
-    'E', 0x00, '4', 0x00, '6', 0x00, '4', 0x00, '6', 0x00, '3', 0x00, '7', 0x00,
-    '7', 0x00, '6', 0x00, '}', 0x00, 0x00, 0x00, 0x00, 0x00};
+    MS_OS_20_WINUSB_FUNCTION(ITF_NUM_PROBE),
+    MS_OS_20_WINUSB_FUNCTION(ITF_NUM_STREAM)};
 
 TU_VERIFY_STATIC(sizeof(desc_ms_os_20) == MS_OS_20_DESC_LEN, "Incorrect size");
 
@@ -5,6 +5,7 @@ from .probe import RioteeProbeBoard
 from .target import TargetNRF52
 from .target import TargetMSP430
 from .probe import GpioDir
+from .sequence import Sequence
 from .session import get_connected_probe
 
 __version__ = "1.1.0"
@@ -16,5 +17,6 @@ __all__ = [
     "TargetNRF52",
     "TargetMSP430",
     "GpioDir",
+    "Sequence",
     "get_connected_probe",
 ]
@@ -0,0 +1,122 @@
+import struct
+from typing import Any, Callable, List, Optional, Sequence, Union
+
+import numpy as np
+from typing_extensions import Self
+
+from .protocol import DAP_VENDOR_MAX_PKT_SIZE, DapRetCode, IOSetState, ReqType, TargetPowerState
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+class BatchError(Exception):
+    pass
+
+
+class VendorBatch:
+    """Collects vendor operations and executes them on the probe in a single USB transaction.
+
+    The probe executes the operations in order and stops at the first operation that fails.
+    The operations return their results in the order they were added, e.g.:
+
+        halted, data, _ = session.batch().sbw_halt().sbw_read(0x4400, 8).sbw_resume().execute()
+    """
+
+    # Request: 1B batch ID, 1B number of operations
+    REQ_OVERHEAD = 2
+    # Response: 1B batch ID, 1B return code, 1B number of executed operations
+    RSP_OVERHEAD = 3
+
+    def __init__(self, session: "RioteeProbeSession") -> None:
+        self._session = session
+        self._ops = []
+        self._req_len = self.REQ_OVERHEAD
+        self._rsp_len = self.RSP_OVERHEAD
+
+    def __len__(self) -> int:
+        return len(self._ops)
+
+    def _append(
+        self, cmd_id: ReqType, data: bytes = b"", rsp_len: int = 0, decode: Optional[Callable[[bytes], Any]] = None
+    ) -> Self:
+        # Every operation request carries its ID, every response its ID and return code
+        req_len = self._req_len + 1 + len(data)
+        rsp_len = self._rsp_len + 2 + rsp_len
+        if req_len > DAP_VENDOR_MAX_PKT_SIZE or rsp_len > DAP_VENDOR_MAX_PKT_SIZE:
+            raise ValueError("Batch exceeds maximum packet size")
+
+        self._ops.append((cmd_id, data, rsp_len - self._rsp_len - 2, decode))
+        self._req_len = req_len
+        self._rsp_len = rsp_len
+        return self
+
+    def target_power(self, state: bool) -> Self:
+        return self._append(ReqType.ID_DAP_VENDOR_POWER, struct.pack("=B", TargetPowerState(state)))
+
+    def gpio_set(self, pin: int, state: bool) -> Self:
+        io_state = IOSetState.IOSET_OUT_HIGH if state else IOSetState.IOSET_OUT_LOW
+        return self._append(ReqType.ID_DAP_VENDOR_GPIO_SET, struct.pack("=BB", pin, io_state))
+
+    def gpio_input(self, pin: int) -> Self:
+        return self._append(ReqType.ID_DAP_VENDOR_GPIO_SET, struct.pack("=BB", pin, IOSetState.IOSET_IN))
+
+    def gpio_get(self, pin: int) -> Self:
+        return self._append(ReqType.ID_DAP_VENDOR_GPIO_GET, struct.pack("=B", pin), 1, lambda rsp: bool(rsp[0]))
+
+    def sbw_halt(self) -> Self:
+        return self._append(ReqType.ID_DAP_VENDOR_SBW_HALT)
+
+    def sbw_resume(self) -> Self:
+        return self._append(ReqType.ID_DAP_VENDOR_SBW_RESUME)
+
+    def sbw_reset(self) -> Self:
+        return self._append(ReqType.ID_DAP_VENDOR_SBW_RESET)
+
+    def sbw_read(self, addr: int, n_words: int = 1) -> Self:
+        def decode(rsp: bytes) -> Union[np.ndarray, np.uint16]:
+            rsp_arr = np.frombuffer(rsp, dtype=np.uint16)
+            if n_words == 1:
+                return rsp_arr[0]
+            return rsp_arr
+
+        return self._append(ReqType.ID_DAP_VENDOR_SBW_READ, struct.pack("=IB", addr, n_words), 2 * n_words, decode)
+
+    def sbw_write(self, addr: int, data: Union[Sequence[np.uint16], np.uint16]) -> Self:
+        if hasattr(data, "__len__"):
+            pkt = struct.pack(f"=IB{len(data)}H", addr, len(data), *data)
+        else:
+            pkt = struct.pack("=IBH", addr, 1, data)
+        return self._append(ReqType.ID_DAP_VENDOR_SBW_WRITE, pkt)
+
+    def execute(self) -> List[Any]:
+        """Executes all operations and returns their results.
+
+        Operations without a result return None. Raises BatchError if any operation fails.
+        """
+        req = struct.pack("=B", len(self._ops))
+        for cmd_id, data, _, _ in self._ops:
+            req += struct.pack("=B", cmd_id) + data
+
+        rsp = self._session.vendor_cmd_raw(ReqType.ID_DAP_VENDOR_BATCH, req)
+        if len(rsp) < 2:
+            raise Exception("Probe is unsupported -> try updating firmware")
+        n_done = rsp[1]
+
+        results = []
+        offset = 2
+        for i, (cmd_id, _, rsp_len, decode) in enumerate(self._ops[:n_done]):
+            op_id, op_rc = rsp[offset], rsp[offset + 1]
+            if op_id != cmd_id or op_rc != DapRetCode.DAP_OK:
+                raise BatchError(f"Batch operation {i} ({ReqType(cmd_id).name}) failed with error code {op_rc}")
+            op_rsp = rsp[offset + 2 : offset + 2 + rsp_len]
+            results.append(decode(op_rsp) if decode else None)
+            offset += 2 + rsp_len
+
+        if rsp[0] != DapRetCode.DAP_OK or n_done != len(self._ops):
+            raise BatchError(f"Batch aborted after {n_done} of {len(self._ops)} operations")
+
+        return results
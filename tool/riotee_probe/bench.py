@@ -0,0 +1,56 @@
+import struct
+import time
+from dataclasses import dataclass
+
+import numpy as np
+
+from .protocol import DAP_VENDOR_MAX_PKT_SIZE, BenchPrimitive, ReqType
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+@dataclass
+class BenchResult:
+    primitive: BenchPrimitive
+    n_iter: int
+    total_cycles: int
+    min_cycles: int
+    max_cycles: int
+    clk_hz: int
+
+    FORMAT = "<IQIII"
+
+    @classmethod
+    def from_bytes(cls, primitive: BenchPrimitive, data: bytes) -> "BenchResult":
+        return cls(primitive, *struct.unpack_from(cls.FORMAT, data))
+
+    @property
+    def mean_cycles(self) -> float:
+        return self.total_cycles / self.n_iter
+
+    def cycles_to_ns(self, cycles: float) -> float:
+        return cycles * 1e9 / self.clk_hz
+
+
+def run_bench(session: "RioteeProbeSession", primitive: BenchPrimitive, n_iter: int, arg: int = 0) -> BenchResult:
+    """Executes a primitive n_iter times on the probe and returns the measured cycles."""
+    if primitive == BenchPrimitive.BENCH_USB_ECHO:
+        raise ValueError("USB echo is timed by the host, use usb_echo_bench instead")
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_BENCH, struct.pack("<BII", primitive, n_iter, arg))
+    return BenchResult.from_bytes(primitive, rsp)
+
+
+def usb_echo_bench(session: "RioteeProbeSession", n_iter: int) -> np.ndarray:
+    """Returns the round trip times in nanoseconds of n_iter full-size vendor packets."""
+    pkt = struct.pack("<BII", BenchPrimitive.BENCH_USB_ECHO, 0, 0)
+    pkt += bytes(DAP_VENDOR_MAX_PKT_SIZE - 1 - len(pkt))
+    rtt = np.empty(n_iter, dtype=np.int64)
+    for i in range(n_iter):
+        t_start = time.perf_counter_ns()
+        session.vendor_cmd(ReqType.ID_DAP_VENDOR_BENCH, pkt)
+        rtt[i] = time.perf_counter_ns() - t_start
+    return rtt
@@ -0,0 +1,174 @@
+import struct
+import time
+from dataclasses import dataclass
+from typing import Dict, List, Optional
+
+import numpy as np
+
+from .protocol import BOOT_MAX_CYCLES, BOOT_NOT_SEEN, BootCmd, BootWait, ProbeFeature, ReqType
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+# Milestones in the order of their fields in BootCycle
+MILESTONES = ("uart", "gpio", "mailbox")
+
+
+@dataclass
+class BootConfig:
+    """Power cycles of a boot latency measurement and the milestones each one waits for."""
+
+    n_cycles: int
+    wait: BootWait
+    # Header GPIO number and edge
+    gpio_pin: int = 1
+    gpio_rising: bool = True
+    # Time without power before each cycle
+    off_us: int = 100000
+    # Time after power-on after which a cycle ends without its milestones
+    timeout_us: int = 1000000
+
+    FORMAT = "<HBBBII"
+
+    def to_bytes(self) -> bytes:
+        if not 1 <= self.n_cycles <= BOOT_MAX_CYCLES:
+            raise ValueError(f"Number of cycles must be in range 1..{BOOT_MAX_CYCLES}")
+        return struct.pack(
+            self.FORMAT,
+            self.n_cycles,
+            self.wait,
+            self.gpio_pin,
+            int(self.gpio_rising),
+            self.off_us,
+            self.timeout_us,
+        )
+
+
+@dataclass
+class BootCycle:
+    """Times in microseconds from switching power on to the milestones of one cycle, None if not reached."""
+
+    uart_us: Optional[int]
+    gpio_us: Optional[int]
+    mailbox_us: Optional[int]
+    # First word the target wrote to the JTAG mailbox
+    mailbox_word: int
+
+    FORMAT = "<IIIH"
+    SIZE = struct.calcsize(FORMAT)
+
+    @classmethod
+    def from_bytes(cls, data: bytes, offset: int = 0) -> "BootCycle":
+        *times, word = struct.unpack_from(cls.FORMAT, data, offset)
+        return cls(*(None if t == BOOT_NOT_SEEN else t for t in times), word)
+
+
+@dataclass
+class BootStatus:
+    running: bool
+    n_cycles: int
+    # Number of completed cycles
+    n_done: int
+
+    FORMAT = "<BHH"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "BootStatus":
+        running, *fields = struct.unpack_from(cls.FORMAT, data)
+        return cls(bool(running), *fields)
+
+
+@dataclass
+class MilestoneStats:
+    """Distribution of the latency of one milestone over the cycles that reached it, in microseconds."""
+
+    n_seen: int
+    n_missed: int
+    min: float
+    median: float
+    mean: float
+    p90: float
+    max: float
+    std: float
+
+    @classmethod
+    def from_times(cls, times: List[Optional[int]]) -> "MilestoneStats":
+        seen = np.array([t for t in times if t is not None], dtype=np.float64)
+        n_missed = len(times) - len(seen)
+        if len(seen) == 0:
+            return cls(0, n_missed, *([np.nan] * 6))
+        return cls(
+            len(seen),
+            n_missed,
+            float(seen.min()),
+            float(np.median(seen)),
+            float(seen.mean()),
+            float(np.percentile(seen, 90)),
+            float(seen.max()),
+            float(seen.std()),
+        )
+
+
+@dataclass
+class BootResult:
+    config: BootConfig
+    cycles: List[BootCycle]
+
+    def stats(self) -> Dict[str, MilestoneStats]:
+        """Returns the statistics of each milestone the measurement waited for."""
+        result = {}
+        for bit, name in zip(BootWait, MILESTONES):
+            if self.config.wait & bit:
+                result[name] = MilestoneStats.from_times([getattr(c, f"{name}_us") for c in self.cycles])
+        return result
+
+
+def _check_boot(session: "RioteeProbeSession") -> None:
+    if not session.supports(ProbeFeature.FEATURE_BOOT):
+        raise Exception("Probe firmware does not support boot latency measurements -> try updating firmware")
+
+
+def start_boot(session: "RioteeProbeSession", config: BootConfig) -> None:
+    _check_boot(session)
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_BOOT, struct.pack("<B", BootCmd.BOOT_CMD_START) + config.to_bytes())
+
+
+def stop_boot(session: "RioteeProbeSession") -> None:
+    """Aborts a measurement. The probe restores the power state from before the measurement."""
+    _check_boot(session)
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_BOOT, struct.pack("<B", BootCmd.BOOT_CMD_STOP))
+
+
+def read_boot_status(session: "RioteeProbeSession") -> BootStatus:
+    _check_boot(session)
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_BOOT, struct.pack("<B", BootCmd.BOOT_CMD_STATUS))
+    return BootStatus.from_bytes(rsp)
+
+
+def read_boot_cycles(session: "RioteeProbeSession", n_cycles: int) -> List[BootCycle]:
+    """Reads the results of the first n_cycles completed cycles."""
+    _check_boot(session)
+    cycles: List[BootCycle] = []
+    while len(cycles) < n_cycles:
+        rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_BOOT, struct.pack("<BH", BootCmd.BOOT_CMD_READ, len(cycles)))
+        if rsp[0] == 0:
+            break
+        cycles += [BootCycle.from_bytes(rsp, 1 + i * BootCycle.SIZE) for i in range(rsp[0])]
+    return cycles[:n_cycles]
+
+
+def run_boot_latency(session: "RioteeProbeSession", config: BootConfig, poll_interval: float = 0.1) -> BootResult:
+    """Runs a measurement on the probe and waits for it to complete. Stops it when interrupted."""
+    start_boot(session, config)
+    try:
+        while read_boot_status(session).running:
+            time.sleep(poll_interval)
+    except BaseException:
+        stop_boot(session)
+        raise
+    status = read_boot_status(session)
+    return BootResult(config, read_boot_cycles(session, status.n_done))
@@ -1,9 +1,11 @@
 import platform
+import time
 from contextlib import contextmanager
 from pathlib import Path
 from typing import Generator
 
 import click
+import numpy as np
 from progress.bar import Bar
 
 from . import __version__
@@ -11,6 +13,28 @@ from .probe import GpioDir
 from .session import get_connected_probe
 from .target import Target
 from .session import get_all_probe_sessions
+from .fw_update import update_all
+from .dump import dump_rle
+from .boot import BootConfig
+from .events import describe_event, write_events_csv
+from .image import ImageResult
+from .logic import LogicConfig
+from .protocol import (
+    LOGIC_N_CHANNELS,
+    TRIGGER_N_RULES,
+    BenchPrimitive,
+    BootWait,
+    ImageTarget,
+    LogicEncoding,
+    LogicTrigger,
+    StreamId,
+    TriggerAction,
+    TriggerSource,
+)
+from .stream import FRAME_DTYPE, StreamRecorder
+from .trace import format_trace, write_trace_csv
+from .trigger import TriggerRule
+from .uart import uart_records
 
 device_option = click.option("-d", "--device", type=click.Choice(["msp430", "nrf52"]), default="nrf52")
 
@@ -138,6 +162,481 @@ def get_pin_state(pin_no: int) -> None:
         click.echo(state)
 
 
+@cli.command(short_help="Measure MSP430 upload throughput for different pipeline windows")
+@click.option("--window", "-w", type=int, multiple=True, default=[1, 2, 4, 8, 16], help="Commands in flight")
+@click.option("--n-bytes", "-n", type=int, default=2048, help="Number of bytes per upload")
+@click.option("--address", "-a", type=str, default="0x1C00", help="Start address in target RAM")
+def upload_benchmark(window: tuple, n_bytes: int, address: str) -> None:
+    data = np.arange(n_bytes // 2, dtype=np.uint16)
+    with get_target("msp430") as target:
+        target.halt()
+        for w in window:
+            t_start = time.perf_counter()
+            target.write_pipelined(int(address, 0), data, window=w)
+            duration = time.perf_counter() - t_start
+            click.echo(f"window={w:<3d} {n_bytes / duration / 1024:8.1f} kB/s")
+
+
+@cli.command(short_help="Read target memory into a binary file")
+@device_option
+@click.option("--address", "-a", type=str, required=True, help="Start address")
+@click.option("--n-bytes", "-n", type=str, required=True, help="Number of bytes to read")
+@click.option("--output", "-o", type=click.Path(), required=True, help="Binary output file")
+def dump(device: str, address: str, n_bytes: str, output: str) -> None:
+    addr = int(address, 0)
+    if device == "msp430":
+        with get_target("msp430") as target:
+            target.halt()
+            data, stats = dump_rle(target._session, addr, int(n_bytes, 0) // 2)
+    else:
+        # The probe accesses the nRF52 on its own, without pyOCD
+        with get_connected_probe() as probe:
+            data, stats = probe.dump_nrf52(addr, int(n_bytes, 0) // 4)
+
+    data.tofile(output)
+    click.echo(
+        f"{data.nbytes}B in {stats.n_pkts} packets ({stats.n_bytes}B encoded, ratio {stats.ratio:.1f}) "
+        f"in {stats.duration * 1e3:.1f}ms, {data.nbytes / stats.duration / 1024:.1f} kB/s"
+    )
+
+
+@cli.command(short_help="Estimate offset and drift of the probe clock against the host clock")
+@click.option("--n-pings", "-n", type=int, default=200, help="Ping exchanges per measurement")
+@click.option("--duration", "-t", type=float, default=5.0, help="Seconds between the two measurements")
+def clock_sync(n_pings: int, duration: float) -> None:
+    with get_connected_probe() as probe:
+        sync = probe.clock_sync(n_pings)
+        time.sleep(duration)
+        sync.sample(n_pings)
+        fit = sync.fit()
+
+    rtt_us = (sync.samples["host_rx_ns"] - sync.samples["host_tx_ns"]) / 1e3
+    click.echo(f"Round trip [us]: min {rtt_us.min():.1f}, median {np.median(rtt_us):.1f}, max {rtt_us.max():.1f}")
+    click.echo(f"Drift {fit.drift_ppm:+.2f}ppm, error bound +-{fit.error_ns / 1e3:.1f}us")
+    click.echo(f"Probe booted at host time {fit.probe_to_host_ns(0) / 1e9:.6f}s (time.perf_counter)")
+
+
+@cli.command(short_help="Measure throughput of the stream interface")
+@click.option("--n-frames", "-n", type=int, default=10000, help="Number of test frames")
+def stream_benchmark(n_frames: int) -> None:
+    with get_connected_probe() as probe:
+        recorder = StreamRecorder()
+        with probe.stream_reader() as reader:
+            reader.subscribe(StreamId.STREAM_ID_TEST, recorder)
+            reader.enable([StreamId.STREAM_ID_TEST])
+            t_start = time.perf_counter()
+            probe.stream_test(n_frames)
+            while len(recorder.frames()) < n_frames and time.perf_counter() - t_start < 10.0:
+                reader.check()
+                time.sleep(0.01)
+            duration = time.perf_counter() - t_start
+
+        payload = recorder.payload().view(np.uint32)
+        n_bytes = len(payload) * 4
+        n_dropped = reader.dropped[StreamId.STREAM_ID_TEST]
+        click.echo(f"Received {len(recorder.frames())}/{n_frames} frames, {n_dropped} dropped")
+        click.echo(f"{n_bytes / duration / 1024:.1f} kB/s payload")
+        if not np.array_equal(payload, np.arange(len(payload), dtype=np.uint32)):
+            click.echo("Payload mismatch", err=True)
+
+
+@cli.command(short_help="Measure the execution time of probe primitives")
+@click.option("--n-iter", "-n", type=int, default=1000, help="Iterations per primitive")
+@click.option("--address", "-a", type=str, default="0x1C00", help="Address for MSP430 memory accesses")
+@click.option("--msp430", is_flag=True, help="Connect MSP430 target and include SBW primitives")
+@click.option("--swd", is_flag=True, help="Include SWD transfer (requires nRF52 target)")
+def benchmark(n_iter: int, address: str, msp430: bool, swd: bool) -> None:
+    primitives = [BenchPrimitive.BENCH_NOP]
+    if msp430:
+        primitives += [
+            BenchPrimitive.BENCH_SBW_SLOT,
+            BenchPrimitive.BENCH_TAP_DR_SHIFT16,
+            BenchPrimitive.BENCH_MEM_READ_WORD,
+            BenchPrimitive.BENCH_MEM_WRITE_WORD,
+        ]
+    if swd:
+        primitives.append(BenchPrimitive.BENCH_SWD_TRANSFER)
+
+    with get_connected_probe() as probe:
+        click.echo(f"{probe._session.product_name}, firmware {probe.fw_version()}")
+        click.echo(f"{'Primitive':<24} {'Iterations':>10} {'mean[ns]':>10} {'min[ns]':>10} {'max[ns]':>10}")
+
+        def run_all() -> None:
+            for primitive in primitives:
+                r = probe.bench(primitive, n_iter, int(address, 0))
+                click.echo(
+                    f"{primitive.name:<24} {r.n_iter:>10} {r.cycles_to_ns(r.mean_cycles):>10.0f} "
+                    f"{r.cycles_to_ns(r.min_cycles):>10.0f} {r.cycles_to_ns(r.max_cycles):>10.0f}"
+                )
+
+        if msp430:
+            with probe.msp430() as target:
+                target.halt()
+                run_all()
+        else:
+            run_all()
+
+        rtt = probe.usb_echo_bench(n_iter)
+        click.echo(
+            f"{BenchPrimitive.BENCH_USB_ECHO.name:<24} {n_iter:>10} {np.mean(rtt):>10.0f} "
+            f"{np.min(rtt):>10.0f} {np.max(rtt):>10.0f}"
+        )
+
+
+@cli.command(short_help="Show byte and loss counters of the UART bridge")
+def uart_stats() -> None:
+    with get_connected_probe() as probe:
+        s = probe.uart_stats()
+    click.echo(f"Baudrate {s.baudrate}, received {s.rx_bytes}B, sent {s.tx_bytes}B")
+    click.echo(f"Lost: {s.rx_overrun} FIFO overruns, {s.rx_dropped}B not buffered, {s.host_lost}B skipped by the host")
+    click.echo(f"Errors: {s.rx_framing} framing, {s.rx_parity} parity, {s.rx_break} breaks")
+    click.echo(f"Peak buffer level {s.rx_peak}B")
+
+
+@cli.command(short_help="Print the recent UART output held by the probe")
+@click.option("--replay", is_flag=True, help="Send the output to the serial port again instead")
+@click.option("--outfile", "-o", type=click.Path(dir_okay=False, writable=True), help="Write raw output to file")
+def uart_history(replay: bool, outfile: str) -> None:
+    with get_connected_probe() as probe:
+        if replay:
+            probe.uart_replay()
+            return
+        data, losses = probe.uart_history()
+
+    if outfile is not None:
+        with open(outfile, "wb") as f:
+            f.write(data)
+        click.echo(f"Wrote {len(data)}B, {sum(n for _, n in losses)}B lost in {len(losses)} gaps")
+        return
+
+    start = 0
+    for offset, n_lost in losses + [(len(data), 0)]:
+        click.echo(data[start:offset].decode(errors="replace"), nl=False)
+        if n_lost:
+            click.echo(f"\n[{n_lost} bytes lost]\n", nl=False)
+        start = offset
+
+
+@cli.command(short_help="Print the UART output with the probe time of its reception")
+@click.option("--duration", "-t", type=float, default=None, help="Stop after this many seconds")
+@click.option("--outfile", "-o", type=click.Path(dir_okay=False, writable=True), help="Save frames as .npy file")
+def uart_log(duration: float, outfile: str) -> None:
+    t_end = None if duration is None else time.monotonic() + duration
+    chunks = []
+    with get_connected_probe() as probe:
+        with probe.uart_frames() as reader:
+            try:
+                while t_end is None or time.monotonic() < t_end:
+                    frames = reader.read()
+                    if outfile is not None:
+                        chunks.append(frames)
+                        continue
+                    for timestamp, data in uart_records(frames):
+                        click.echo(f"{timestamp:>10} {data.decode(errors='replace')!r}")
+            except KeyboardInterrupt:
+                pass
+    if outfile is not None:
+        frames = np.concatenate(chunks) if chunks else np.empty(0, dtype=FRAME_DTYPE)
+        np.save(outfile, frames)
+        click.echo(f"Saved {len(frames)} frames, {int(frames['dropped'].sum())}B lost")
+
+
+@cli.command(short_help="Record UART output, GPIO edges, power switching and SBW operations on one timeline")
+@click.option("--duration", "-t", type=float, default=None, help="Stop after this many seconds")
+@click.option("--outfile", "-o", type=click.Path(dir_okay=False, writable=True), help="Save records as .csv file")
+def events(duration: float, outfile: str) -> None:
+    t_end = None if duration is None else time.monotonic() + duration
+    with get_connected_probe() as probe:
+        with probe.events() as recorder:
+            try:
+                while t_end is None or time.monotonic() < t_end:
+                    time.sleep(0.1)
+            except KeyboardInterrupt:
+                pass
+    log = recorder.log
+
+    if outfile is not None:
+        write_events_csv(log, outfile)
+    else:
+        data = log.data
+        for r in log.records:
+            click.echo(f"{r['time_us']:>12} {describe_event(r, data[r['offset'] : r['offset'] + r['len']])}")
+    click.echo(f"{len(log.records)} records, {log.dropped_frames} frames lost")
+
+
+@cli.command(name="boot-latency", short_help="Measure the time from power-on to boot milestones of the target")
+@click.option("--cycles", "-n", type=click.IntRange(1, 256), default=20, help="Number of power cycles")
+@click.option("--off-ms", type=float, default=100, help="Time without power before each cycle")
+@click.option("--timeout-ms", type=float, default=1000, help="Give up on a cycle after this time")
+@click.option("--uart", is_flag=True, help="Wait for the first UART byte")
+@click.option("--gpio", type=click.IntRange(1, 3), help="Wait for an edge on this header GPIO")
+@click.option("--falling", is_flag=True, help="Wait for a falling instead of a rising edge")
+@click.option("--mailbox", is_flag=True, help="Wait for the MSP430 to write its JTAG mailbox")
+def boot_latency(
+    cycles: int, off_ms: float, timeout_ms: float, uart: bool, gpio: int, falling: bool, mailbox: bool
+) -> None:
+    wait = BootWait(0)
+    if uart:
+        wait |= BootWait.BOOT_WAIT_UART
+    if gpio is not None:
+        wait |= BootWait.BOOT_WAIT_GPIO
+    if mailbox:
+        wait |= BootWait.BOOT_WAIT_MAILBOX
+    if not wait:
+        raise click.UsageError("At least one of --uart, --gpio and --mailbox is required")
+
+    config = BootConfig(cycles, wait, gpio or 0, not falling, int(off_ms * 1000), int(timeout_ms * 1000))
+    with get_connected_probe() as probe:
+        result = probe.boot_latency(config)
+
+    columns = ("Min", "Median", "Mean", "P90", "Max")
+    click.echo(f"{'Milestone':<10} {'Seen':>5} {'Missed':>6} " + " ".join(f"{c:>9}" for c in columns))
+    for name, s in result.stats().items():
+        click.echo(
+            f"{name:<10} {s.n_seen:>5} {s.n_missed:>6} {s.min / 1e3:>9.3f} {s.median / 1e3:>9.3f} "
+            f"{s.mean / 1e3:>9.3f} {s.p90 / 1e3:>9.3f} {s.max / 1e3:>9.3f}"
+        )
+    click.echo(f"Times in ms after power-on over {len(result.cycles)} cycles")
+
+
+@cli.command(short_help="Capture the header GPIOs and UART RX with the probe's logic analyzer")
+@click.option("--rate", "-r", type=float, default=1e6, help="Samples per second")
+@click.option("--samples", "-n", type=click.IntRange(1), default=4000, help="Samples after the trigger")
+@click.option("--pre", type=click.IntRange(0), default=0, help="Samples before the trigger")
+@click.option("--trigger", "-t", type=click.Choice(["none", "rise", "fall"]), default="none", help="Edge to wait for")
+@click.option(
+    "--channel", "-c", type=click.IntRange(0, LOGIC_N_CHANNELS - 1), default=0, help="Trigger channel, 4 is UART RX"
+)
+@click.option("--timeout", type=float, default=10, help="Give up waiting for the trigger after this many seconds")
+@click.option("--raw", is_flag=True, help="Transfer every sample instead of run lengths")
+@click.option(
+    "--outfile",
+    "-o",
+    type=click.Path(dir_okay=False, writable=True),
+    required=True,
+    help="Save as .vcd or sigrok .sr file",
+)
+def logic(
+    rate: float, samples: int, pre: int, trigger: str, channel: int, timeout: float, raw: bool, outfile: str
+) -> None:
+    config = LogicConfig(
+        int(rate),
+        samples,
+        pre,
+        LogicTrigger[f"LOGIC_TRIG_{trigger.upper()}"],
+        channel,
+        LogicEncoding.LOGIC_ENC_RAW if raw else LogicEncoding.LOGIC_ENC_RLE,
+    )
+    with get_connected_probe() as probe:
+        capture = probe.logic_capture(config, timeout)
+
+    if Path(outfile).suffix == ".sr":
+        capture.write_sigrok(outfile)
+    else:
+        capture.write_vcd(outfile)
+    click.echo(f"{len(capture.samples)} samples at {capture.rate_hz}Hz")
+
+
+@cli.command(short_help="Show command statistics of the probe")
+@click.option("--reset", is_flag=True, help="Clear statistics after printing")
+@click.option("--enable/--disable", default=None, help="Start or stop recording")
+@click.option("--tasks", is_flag=True, help="Show CPU, stack and heap usage instead")
+def stats(reset: bool, enable: bool, tasks: bool) -> None:
+    with get_connected_probe() as probe:
+        if tasks:
+            system, task_list = probe.task_stats()
+            click.echo(f"{'Task':<12} {'Prio':>4} {'State':<10} {'Cores':>5} {'CPU[%]':>7} {'Stack free[words]':>18}")
+            for t in task_list:
+                click.echo(
+                    f"{t.name:<12} {t.priority:>4} {t.state_name:<10} {t.core_mask:>5b} "
+                    f"{100 * t.cpu_share(system):>7.2f} {t.stack_free_min:>18}"
+                )
+            click.echo(f"Uptime: {system.uptime_us / 1e6:.1f}s on {system.n_cores} cores")
+            click.echo(f"Heap: {system.heap_used}/{system.heap_size} bytes used")
+            return
+
+        if enable is not None:
+            probe.enable_stats(enable)
+
+        click.echo(f"{'Command':<30} {'Count':>10} {'Errors':>8} {'p50[us]':>8} {'p99[us]':>8} {'max[us]':>8}")
+        for s in probe.command_stats():
+            click.echo(
+                f"{s.name:<30} {s.count:>10} {s.errors:>8} {s.percentile(50):>8} {s.percentile(99):>8} {s.max_us:>8}"
+            )
+        click.echo(f"Recording overhead: {probe.stats_overhead_ns()}ns per command")
+
+        if reset:
+            probe.reset_stats()
+
+
+@cli.group(short_help="Record SBW/JTAG transactions (MSP430 only)")
+def trace() -> None:
+    pass
+
+
+@trace.command(name="start", short_help="Clear trace buffer and start recording")
+def trace_start() -> None:
+    with get_connected_probe() as probe:
+        probe.trace_clear()
+        probe.trace_enable(True)
+
+
+@trace.command(name="stop", short_help="Stop recording")
+def trace_stop() -> None:
+    with get_connected_probe() as probe:
+        probe.trace_enable(False)
+
+
+@trace.command(name="dump", short_help="Stop recording and print the recorded transactions")
+@click.option("--csv", "csv_path", type=click.Path(dir_okay=False), help="Write to CSV file instead")
+def trace_dump(csv_path: str) -> None:
+    with get_connected_probe() as probe:
+        probe.trace_enable(False)
+        entries = probe.trace_download()
+
+    if csv_path:
+        write_trace_csv(entries, csv_path)
+    else:
+        for line in format_trace(entries):
+            click.echo(line)
+
+
+@cli.group(short_help="Manage images for standalone programming")
+def image() -> None:
+    pass
+
+
+def print_image_result(result: ImageResult) -> None:
+    if result.passed:
+        click.echo(f"PASS in {result.cycle_us / 1e3:.1f}ms")
+    else:
+        click.echo(
+            f"FAIL in slot {result.slot} during {result.step.name} at 0x{result.err_addr:08X} "
+            f"after {result.cycle_us / 1e3:.1f}ms"
+        )
+    click.echo(f"{result.n_pass} passed, {result.n_fail} failed since power-up")
+
+
+@image.command(name="list", short_help="Show the contents of the image store")
+def image_list() -> None:
+    with get_connected_probe() as probe:
+        for slot, info in enumerate(probe.image_slots()):
+            if not info.valid:
+                click.echo(f"{slot}: empty")
+                continue
+            target = "msp430" if info.target == ImageTarget.IMAGE_TARGET_MSP430 else "nrf52"
+            autorun = " autorun" if info.autorun else ""
+            click.echo(f"{slot}: {info.name:<16} {target:<6} {info.size:>8}B crc=0x{info.crc32:08X}{autorun}")
+
+
+@image.command(name="upload", short_help="Store a firmware image in the probe's flash")
+@click.option("--slot", "-s", type=int, required=True)
+@device_option
+@click.option("-f", "--firmware", type=click.Path(exists=True), required=True)
+@click.option("--autorun", is_flag=True, help="Program this image when the trigger GPIO fires")
+def image_upload(slot: int, device: str, firmware: Path, autorun: bool) -> None:
+    target = ImageTarget.IMAGE_TARGET_MSP430 if device == "msp430" else ImageTarget.IMAGE_TARGET_NRF52
+    with get_connected_probe() as probe:
+        probe.upload_image(slot, firmware, target, autorun)
+
+
+@image.command(name="erase", short_help="Delete the image in a slot")
+@click.option("--slot", "-s", type=int, required=True)
+def image_erase(slot: int) -> None:
+    with get_connected_probe() as probe:
+        probe.erase_image(slot)
+
+
+@image.command(name="autorun", short_help="Select slots that are programmed when the trigger GPIO fires")
+@click.option("--slot", "-s", type=int, required=True)
+@click.option("--on/--off", required=True)
+def image_autorun(slot: int, on: bool) -> None:
+    with get_connected_probe() as probe:
+        probe.image_autorun(slot, on)
+
+
+@image.command(name="run", short_help="Program targets from the image store")
+@click.option("--slot", "-s", type=int, multiple=True, help="Slots to program, defaults to autorun slots")
+def image_run(slot: tuple) -> None:
+    with get_connected_probe() as probe:
+        print_image_result(probe.run_images(slot))
+
+
+@image.command(name="result", short_help="Show the result of the last programming run")
+def image_result() -> None:
+    with get_connected_probe() as probe:
+        print_image_result(probe.image_result())
+
+
+@cli.group(short_help="React to UART output or GPIO edges on the probe")
+def trigger() -> None:
+    pass
+
+
+slot_option = click.option("--slot", "-s", type=click.IntRange(0, TRIGGER_N_RULES - 1), default=0)
+TRIGGER_ACTIONS = {
+    "timestamp": TriggerAction.TRIGGER_ACT_TIMESTAMP,
+    "power-off": TriggerAction.TRIGGER_ACT_POWER_OFF,
+    "power-on": TriggerAction.TRIGGER_ACT_POWER_ON,
+    "pulse": TriggerAction.TRIGGER_ACT_GPIO_PULSE,
+    "halt": TriggerAction.TRIGGER_ACT_SBW_HALT,
+}
+
+
+@trigger.command(name="arm", short_help="Arm a rule, exactly one source option is required")
+@slot_option
+@click.option("--uart", type=str, help="Fire on this string in the UART output (escapes like \\n allowed)")
+@click.option("--gpio-rise", type=int, help="Fire on a rising edge of this header GPIO")
+@click.option("--gpio-fall", type=int, help="Fire on a falling edge of this header GPIO")
+@click.option("--action", "-a", type=click.Choice(list(TRIGGER_ACTIONS)), default="timestamp")
+@click.option("--pulse-pin", type=int, default=0, help="Header GPIO driven high by the pulse action")
+@click.option("--pulse-us", type=int, default=1000, help="Duration of the pulse")
+@click.option("--repeat", is_flag=True, help="Stay armed after firing")
+def trigger_arm(
+    slot: int, uart: str, gpio_rise: int, gpio_fall: int, action: str, pulse_pin: int, pulse_us: int, repeat: bool
+) -> None:
+    sources = [
+        (TriggerSource.TRIGGER_SRC_UART, uart),
+        (TriggerSource.TRIGGER_SRC_GPIO_RISE, gpio_rise),
+        (TriggerSource.TRIGGER_SRC_GPIO_FALL, gpio_fall),
+    ]
+    given = [(source, value) for source, value in sources if value is not None]
+    if len(given) != 1:
+        raise click.UsageError("Specify exactly one of --uart, --gpio-rise and --gpio-fall")
+    source, value = given[0]
+
+    rule = TriggerRule(source, TRIGGER_ACTIONS[action], act_pin=pulse_pin, pulse_us=pulse_us, repeat=repeat)
+    if source == TriggerSource.TRIGGER_SRC_UART:
+        rule.pattern = value.encode().decode("unicode_escape").encode("latin-1")
+    else:
+        rule.src_pin = value
+    with get_connected_probe() as probe:
+        probe.trigger_arm(rule, slot)
+
+
+@trigger.command(name="disarm", short_help="Disarm a rule")
+@slot_option
+def trigger_disarm(slot: int) -> None:
+    with get_connected_probe() as probe:
+        probe.trigger_disarm(slot)
+
+
+@trigger.command(name="status", short_help="Show how often rules fired and their latency")
+def trigger_status() -> None:
+    with get_connected_probe() as probe:
+        for slot in range(TRIGGER_N_RULES):
+            s = probe.trigger_status(slot)
+            state = "armed" if s.armed else "idle"
+            if s.n_fired == 0:
+                click.echo(f"{slot}: {state}, never fired")
+                continue
+            result = "ok" if s.result == 0 else f"failed ({s.result})"
+            click.echo(
+                f"{slot}: {state}, fired {s.n_fired}x, last at {s.event_us}us {result}, "
+                f"latency {s.latency_us}us (max {s.max_latency_us}us)"
+            )
+
+
 @cli.command(name="list")
 def list_probes() -> None:
     """Show any connected device and its firmware version"""
@@ -152,5 +651,25 @@ def list_probes() -> None:
         click.echo("Currently no probes connected", err=True)
 
 
+@cli.command(name="bootloader", short_help="Reboot the probe into the USB mass storage bootloader")
+def bootloader() -> None:
+    with get_connected_probe() as probe:
+        probe.reboot_to_bootloader()
+
+
+@cli.command(name="fw-update", short_help="Update the firmware of connected probes")
+@click.option("-f", "--firmware", type=click.Path(exists=True), required=True, help="UF2 image")
+@click.option("--expect-version", type=str, help="Version that the probes must report after the update")
+@click.option("--timeout", type=float, default=30.0, show_default=True, help="Seconds to wait for drives and probes")
+@click.option("--search-dir", type=click.Path(), multiple=True, help="Where bootloader drives are mounted")
+def fw_update(firmware: Path, expect_version: str, timeout: float, search_dir: tuple) -> None:
+    results = update_all(Path(firmware), expect_version, timeout, [Path(d) for d in search_dir] or None)
+    for result in results:
+        status = "ok" if result.ok else f"FAIL: {result.error}"
+        click.echo(f"{result.unique_id:<20} {result.old_version:>8} -> {result.new_version or '?':<8} {status}")
+    if not all(result.ok for result in results):
+        raise click.ClickException("Update failed on some probes")
+
+
 if __name__ == "__main__":
     cli()
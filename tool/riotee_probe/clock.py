@@ -0,0 +1,112 @@
+import struct
+import time
+from dataclasses import dataclass
+from typing import Optional, Union
+
+import numpy as np
+
+from .protocol import ProbeFeature, ReqType
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+# Layout of one ping exchange. Host times in nanoseconds of time.perf_counter_ns(), probe time in microseconds.
+SYNC_DTYPE = np.dtype([("host_tx_ns", "<i8"), ("host_rx_ns", "<i8"), ("probe_us", "<u8")])
+
+
+@dataclass
+class ClockFit:
+    """Linear mapping from probe time to host time."""
+
+    # Host time in nanoseconds at probe time ref_us
+    host_ref_ns: float
+    ref_us: int
+    # Host nanoseconds per probe microsecond, 1000 for a perfect probe clock
+    ns_per_us: float
+    # Maximum deviation of the mapping from the bracketing host times of the samples used for the fit
+    error_ns: float
+
+    @property
+    def drift_ppm(self) -> float:
+        """Rate of the probe clock relative to the host clock, positive if the probe runs fast."""
+        return (1000.0 / self.ns_per_us - 1.0) * 1e6
+
+    def probe_to_host_ns(self, probe_us: Union[int, np.ndarray]) -> np.ndarray:
+        """Maps 64-bit probe timestamps to host time in nanoseconds."""
+        delta = np.asarray(probe_us, dtype=np.int64) - np.int64(self.ref_us)
+        return self.host_ref_ns + delta * self.ns_per_us
+
+    def unwrap_us32(self, probe_us32: Union[int, np.ndarray]) -> np.ndarray:
+        """Extends 32-bit probe timestamps to 64 bit.
+
+        Timestamps of streams and traces wrap after ~71 minutes. They are placed closest to the reference point of
+        the fit, so they must lie within ~35 minutes of the synchronization.
+        """
+        ts = np.asarray(probe_us32, dtype=np.uint32)
+        delta = (ts - np.uint32(self.ref_us & 0xFFFFFFFF)).astype(np.int32)
+        return np.int64(self.ref_us) + delta.astype(np.int64)
+
+    def probe32_to_host_ns(self, probe_us32: Union[int, np.ndarray]) -> np.ndarray:
+        """Maps 32-bit probe timestamps, e.g., of stream frames, to host time in nanoseconds."""
+        return self.probe_to_host_ns(self.unwrap_us32(probe_us32))
+
+
+def ping(session: "RioteeProbeSession") -> np.ndarray:
+    """Reads the probe clock once and brackets the exchange with the host clock."""
+    t_tx = time.perf_counter_ns()
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_TIME)
+    t_rx = time.perf_counter_ns()
+    (probe_us,) = struct.unpack("<Q", rsp[:8])
+    return np.array([(t_tx, t_rx, probe_us)], dtype=SYNC_DTYPE)
+
+
+class ClockSync:
+    """Estimates offset and drift of a probe's clock from ping exchanges.
+
+    The probe reads its clock at some point between the host's send and receive times. Exchanges with the
+    shortest round trips bracket that point most tightly, so only those are used for the fit. Calling sample()
+    again after some time refines the drift estimate.
+    """
+
+    # Fraction of exchanges with the shortest round trip that are used for the fit
+    FIT_QUANTILE = 0.25
+
+    def __init__(self, session: "RioteeProbeSession") -> None:
+        if not session.supports(ProbeFeature.FEATURE_TIME):
+            raise Exception("Probe firmware does not support clock synchronization -> try updating firmware")
+        self._session = session
+        self.samples = np.empty(0, dtype=SYNC_DTYPE)
+
+    def sample(self, n_pings: int = 64) -> None:
+        self.samples = np.concatenate([self.samples] + [ping(self._session) for _ in range(n_pings)])
+
+    def fit(self, samples: Optional[np.ndarray] = None) -> ClockFit:
+        return fit_clock(self.samples if samples is None else samples, self.FIT_QUANTILE)
+
+
+def fit_clock(samples: np.ndarray, quantile: float = ClockSync.FIT_QUANTILE) -> ClockFit:
+    """Fits a linear mapping from probe time to host time through the tightest bracketed exchanges."""
+    if len(samples) == 0:
+        raise ValueError("No samples")
+    rtt = samples["host_rx_ns"] - samples["host_tx_ns"]
+    best = samples[rtt <= np.quantile(rtt, quantile)]
+    ref_us = int(best["probe_us"][0])
+    x = (best["probe_us"].astype(np.int64) - ref_us).astype(np.float64)
+    mid = (best["host_tx_ns"] + best["host_rx_ns"]) / 2.0
+    host_ref = float(mid[0])
+    y = mid - host_ref
+
+    if len(best) >= 2 and np.ptp(x) > 0:
+        ns_per_us, intercept = np.polyfit(x, y, 1)
+    else:
+        # A single point in time cannot tell the drift
+        ns_per_us, intercept = 1000.0, float(np.mean(y - 1000.0 * x))
+
+    # The true host time of every exchange lies within its bracket
+    mapped = host_ref + intercept + x * ns_per_us
+    error = np.maximum(mapped - best["host_tx_ns"], best["host_rx_ns"] - mapped)
+    return ClockFit(host_ref + intercept, ref_us, float(ns_per_us), float(np.max(error)))
@@ -0,0 +1,88 @@
+import struct
+import time
+from dataclasses import dataclass
+from typing import Generator, List, Tuple
+
+import numpy as np
+
+from .protocol import BULK_RLE_RUN, BulkCmd, BulkFlag, DapRetCode, ProbeFeature, ReqType
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+@dataclass
+class DumpStats:
+    n_words: int
+    # Number of data packets and encoded bytes received
+    n_pkts: int
+    n_bytes: int
+    duration: float
+
+    @property
+    def ratio(self) -> float:
+        """Size of the memory divided by the number of bytes on the wire."""
+        return 2 * self.n_words / max(self.n_bytes, 1)
+
+
+def decode_rle(data: bytes) -> np.ndarray:
+    """Expands the tokens of a compressed bulk read into 16-bit words."""
+    parts: List[np.ndarray] = []
+    i = 0
+    while i < len(data):
+        hdr = data[i]
+        if hdr & BULK_RLE_RUN:
+            n_run = (((hdr & 0x7F) << 8) | data[i + 1]) + 1
+            value = int.from_bytes(data[i + 2 : i + 4], "little")
+            parts.append(np.full(n_run, value, dtype=np.uint16))
+            i += 4
+        else:
+            n_words = hdr + 1
+            parts.append(np.frombuffer(data, dtype="<u2", count=n_words, offset=i + 1))
+            i += 1 + 2 * n_words
+    if not parts:
+        return np.empty(0, dtype=np.uint16)
+    return np.concatenate(parts).astype(np.uint16)
+
+
+def dump_rle(
+    session: "RioteeProbeSession", addr: int, n_words: int, nrf52: bool = False
+) -> Tuple[np.ndarray, DumpStats]:
+    """Reads n_words 16-bit words with run-length encoding on the probe.
+
+    MSP430 reads require an SBW connection. nRF52 reads connect through the probe's own MEM-AP access and must
+    not be mixed with pyOCD accesses, as pyOCD caches the state of the debug port.
+    """
+    if not session.supports(ProbeFeature.FEATURE_BULK_RLE):
+        raise Exception("Probe firmware does not support compressed reads -> try updating firmware")
+
+    t_start = time.perf_counter()
+    flags = BulkFlag.BULK_FLAG_RLE | (BulkFlag.BULK_FLAG_NRF52 if nrf52 else 0)
+    pkt = struct.pack("=BBII", BulkCmd.BULK_CMD_READ, flags, addr, n_words)
+    window = min(session.vendor_cmd(ReqType.ID_DAP_VENDOR_BULK, pkt)[0], session.window)
+
+    def payloads() -> Generator[bytes, None, None]:
+        # The number of packets depends on the data, requests beyond the end are rejected
+        while True:
+            yield struct.pack("=B", BulkCmd.BULK_CMD_DATA)
+
+    parts = []
+    n_rx = n_pkts = n_bytes = 0
+    for rsp in session.vendor_cmd_pipelined(ReqType.ID_DAP_VENDOR_BULK, payloads(), window):
+        if rsp[0] != DapRetCode.DAP_OK:
+            rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_BULK, struct.pack("=B", BulkCmd.BULK_CMD_STATUS))
+            _, _, err_addr = struct.unpack("=BII", rsp[:9])
+            raise Exception(f"Read failed at 0x{err_addr:08X}!")
+        words = decode_rle(rsp[2 : 2 + rsp[1]])
+        parts.append(words)
+        n_rx += len(words)
+        n_pkts += 1
+        n_bytes += rsp[1]
+        if n_rx >= n_words:
+            break
+
+    stats = DumpStats(n_words, n_pkts, n_bytes, time.perf_counter() - t_start)
+    return np.concatenate(parts)[:n_words], stats
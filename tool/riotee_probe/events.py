@@ -0,0 +1,218 @@
+import csv
+import struct
+import threading
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Iterable, List, Optional, Union
+
+import numpy as np
+from typing_extensions import Self
+
+from .protocol import EventCause, EventCmd, EventSbw, EventType, ProbeFeature, ReqType, StreamId
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+    from .stream import StreamReader
+
+
+# Header of a record in the frames of STREAM_ID_EVENT. UART records are followed by arg data bytes.
+WIRE_DTYPE = np.dtype([("time_us", "<u4"), ("type", "u1"), ("arg", "u1"), ("value", "<u2")])
+
+# Decoded record. Times are probe microseconds extended to 64 bit, UART data is at offset in EventLog.data.
+EVENT_DTYPE = np.dtype(
+    [("time_us", "<i8"), ("type", "u1"), ("arg", "u1"), ("value", "<u2"), ("offset", "<u4"), ("len", "u1")]
+)
+
+
+@dataclass
+class EventStatus:
+    """Counters of the probe's event timeline since power-up."""
+
+    # Bitmask of enabled EventType values
+    enabled: int
+    recorded: int
+    # Records lost because the stream interface was busy
+    dropped: int
+
+    FORMAT = "<3I"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "EventStatus":
+        return cls(*struct.unpack_from(cls.FORMAT, data))
+
+
+def _check_events(session: "RioteeProbeSession") -> None:
+    if not session.supports(ProbeFeature.FEATURE_EVENTS):
+        raise Exception("Probe firmware does not support the event timeline -> try updating firmware")
+
+
+def enable_events(session: "RioteeProbeSession", types: Iterable[EventType]) -> None:
+    """Records the given types of events and stops recording all others."""
+    _check_events(session)
+    mask = 0
+    for t in types:
+        mask |= 1 << t
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_EVENTS, struct.pack("<BI", EventCmd.EVENT_CMD_ENABLE, mask))
+
+
+def read_event_status(session: "RioteeProbeSession") -> EventStatus:
+    _check_events(session)
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_EVENTS, struct.pack("<B", EventCmd.EVENT_CMD_STATUS))
+    return EventStatus.from_bytes(rsp)
+
+
+class EventLog:
+    """Collects the records of the event timeline from frames of STREAM_ID_EVENT.
+
+    The probe sends records roughly in the order in which they happened. Records are stored in that order and
+    sorted by time on access, with timestamps extended to 64 bit, so that gaps up to ~35 minutes are handled.
+    """
+
+    def __init__(self) -> None:
+        self._chunks: List[np.ndarray] = []
+        self._data = bytearray()
+        self._last_us32: Optional[int] = None
+        self._base_us = 0
+        self._lock = threading.Lock()
+        # Number of frames the probe reported as dropped
+        self.dropped_frames = 0
+
+    def _unwrap(self, us32: np.ndarray) -> np.ndarray:
+        if len(us32) == 0:
+            return us32.astype(np.int64)
+        prev = us32[0] if self._last_us32 is None else self._last_us32
+        # Consecutive records are close in time, so differences fit in 32 bit
+        delta = np.diff(us32, prepend=np.uint32(prev)).astype(np.int32).astype(np.int64)
+        times = self._base_us + int(prev) + np.cumsum(delta)
+        self._base_us = int(times[-1]) - int(us32[-1])
+        self._last_us32 = int(us32[-1])
+        return times
+
+    def feed(self, frames: np.ndarray) -> np.ndarray:
+        """Decodes frames (FRAME_DTYPE) of STREAM_ID_EVENT and returns their records (EVENT_DTYPE)."""
+        headers = []
+        offsets = []
+        with self._lock:
+            for frame in frames[frames["stream_id"] == StreamId.STREAM_ID_EVENT]:
+                self.dropped_frames += int(frame["dropped"])
+                payload = frame["payload"][: frame["len"]].tobytes()
+                pos = 0
+                while pos + WIRE_DTYPE.itemsize <= len(payload):
+                    hdr = np.frombuffer(payload, dtype=WIRE_DTYPE, count=1, offset=pos)[0]
+                    pos += WIRE_DTYPE.itemsize
+                    n_data = int(hdr["arg"]) if hdr["type"] == EventType.EVENT_UART else 0
+                    headers.append(hdr)
+                    offsets.append((len(self._data), n_data))
+                    self._data += payload[pos : pos + n_data]
+                    pos += n_data
+
+            records = np.zeros(len(headers), dtype=EVENT_DTYPE)
+            if headers:
+                wire = np.array(headers, dtype=WIRE_DTYPE)
+                records["time_us"] = self._unwrap(wire["time_us"])
+                for field in ("type", "arg", "value"):
+                    records[field] = wire[field]
+                records["offset"], records["len"] = np.array(offsets, dtype=np.uint32).T
+            self._chunks.append(records)
+        return records
+
+    @property
+    def data(self) -> bytes:
+        """UART output of all records, referenced by their offset and len fields."""
+        with self._lock:
+            return bytes(self._data)
+
+    @property
+    def records(self) -> np.ndarray:
+        """All records (EVENT_DTYPE) ordered by time."""
+        with self._lock:
+            records = np.concatenate(self._chunks) if self._chunks else np.empty(0, dtype=EVENT_DTYPE)
+        return records[np.argsort(records["time_us"], kind="stable")]
+
+    def uart_data(self, record: np.void) -> bytes:
+        return self.data[record["offset"] : record["offset"] + record["len"]]
+
+    def to_dataframe(self):
+        """Returns the records as pandas DataFrame with type names and the UART data as bytes."""
+        import pandas as pd
+
+        records = self.records
+        data = self.data
+        df = pd.DataFrame(
+            {
+                "time_us": records["time_us"],
+                "type": [_name(EventType, t, "EVENT_") for t in records["type"]],
+                "arg": records["arg"],
+                "value": records["value"],
+            }
+        )
+        df["data"] = [data[r["offset"] : r["offset"] + r["len"]] if r["len"] else None for r in records]
+        return df
+
+
+def _name(enum, value: int, prefix: str) -> str:
+    try:
+        return enum(value).name[len(prefix) :].lower()
+    except ValueError:
+        return str(value)
+
+
+def describe_event(record: np.void, data: bytes = b"") -> str:
+    """Formats a record for humans."""
+    t = EventType(record["type"])
+    arg, value = int(record["arg"]), int(record["value"])
+    if t == EventType.EVENT_UART:
+        lost = f" ({value}B lost before)" if value else ""
+        return f"uart   {data!r}{lost}"
+    if t == EventType.EVENT_GPIO:
+        return f"gpio   {arg} {'high' if value else 'low'}"
+    if t in (EventType.EVENT_POWER, EventType.EVENT_BYPASS):
+        name = "power " if t == EventType.EVENT_POWER else "bypass"
+        return f"{name} {'on' if value else 'off'} ({_name(EventCause, arg, 'EVENT_CAUSE_')})"
+    # Return codes are negative
+    rc = value - 0x10000 if value & 0x8000 else value
+    return f"sbw    {_name(EventSbw, arg, 'EVENT_SBW_')}{'' if rc == 0 else f' failed ({rc})'}"
+
+
+def write_events_csv(log: EventLog, path: Union[Path, str]) -> None:
+    data = log.data
+    with open(path, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["time_us", "type", "arg", "value", "data"])
+        for r in log.records:
+            chunk = data[r["offset"] : r["offset"] + r["len"]]
+            writer.writerow([r["time_us"], _name(EventType, r["type"], "EVENT_"), r["arg"], r["value"], chunk.hex()])
+
+
+class EventRecorder:
+    """Records the probe's event timeline while in the context.
+
+    Enables STREAM_ID_EVENT and the given event types when entering the context and disables both again when
+    leaving it. The records are collected in an EventLog.
+    """
+
+    def __init__(self, session: "RioteeProbeSession", types: Optional[Iterable[EventType]] = None) -> None:
+        _check_events(session)
+        self._session = session
+        self._types = list(EventType) if types is None else list(types)
+        self._reader: Optional["StreamReader"] = None
+        self.log = EventLog()
+
+    def __enter__(self) -> Self:
+        self._reader = self._session.stream_reader()
+        self._reader.subscribe(StreamId.STREAM_ID_EVENT, self.log.feed)
+        self._reader.start()
+        self._reader.enable([StreamId.STREAM_ID_EVENT])
+        enable_events(self._session, self._types)
+        return self
+
+    def __exit__(self, *exc) -> None:
+        enable_events(self._session, [])
+        self._reader.stop()
+        self._reader = None
+
+    def status(self) -> EventStatus:
+        return read_event_status(self._session)
@@ -0,0 +1,177 @@
+import os
+import platform
+import shutil
+import string
+import time
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Dict, Iterable, List, Optional
+
+from .protocol import ProbeFeature, ReqType
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+# The RP2040 ROM bootloader identifies its mass storage drive with this file
+UF2_INFO_FILE = "INFO_UF2.TXT"
+UF2_BOARD_ID = "RPI-RP2"
+
+
+@dataclass
+class UpdateResult:
+    unique_id: str
+    old_version: str
+    new_version: Optional[str] = None
+    error: Optional[str] = None
+
+    @property
+    def ok(self) -> bool:
+        return self.error is None
+
+
+def reboot_to_bootloader(session: "RioteeProbeSession") -> None:
+    """Makes the probe reboot into the USB mass storage bootloader of the RP2040 ROM."""
+    if not session.supports(ProbeFeature.FEATURE_BOOTLOADER):
+        raise Exception("Probe firmware does not support rebooting -> update the firmware manually")
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_BOOTLOADER)
+
+
+def default_search_dirs() -> List[Path]:
+    """Returns the directories under which the operating system mounts USB drives."""
+    system = platform.system()
+    if system == "Windows":
+        return [Path(f"{letter}:\\") for letter in string.ascii_uppercase]
+    if system == "Darwin":
+        return [Path("/Volumes")]
+    user = os.environ.get("USER", "")
+    return [Path("/media") / user, Path("/run/media") / user, Path("/media"), Path("/mnt")]
+
+
+def is_bootloader_drive(path: Path) -> bool:
+    try:
+        return UF2_BOARD_ID in (path / UF2_INFO_FILE).read_text(errors="ignore")
+    except OSError:
+        return False
+
+
+def find_bootloader_drives(search_dirs: Optional[Iterable[Path]] = None) -> List[Path]:
+    """Returns the mount points of all RP2040s that are in the USB bootloader."""
+    drives = set()
+    for root in search_dirs or default_search_dirs():
+        root = Path(root)
+        if is_bootloader_drive(root):
+            drives.add(root)
+            continue
+        try:
+            candidates = [p for p in root.iterdir() if p.is_dir()]
+        except OSError:
+            continue
+        drives.update(p for p in candidates if is_bootloader_drive(p))
+    return sorted(drives)
+
+
+def wait_for_drives(n_drives: int, timeout: float, search_dirs: Optional[Iterable[Path]] = None) -> List[Path]:
+    """Waits until n_drives bootloader drives are mounted and returns those found after timeout seconds."""
+    t_end = time.monotonic() + timeout
+    while True:
+        drives = find_bootloader_drives(search_dirs)
+        if len(drives) >= n_drives or time.monotonic() > t_end:
+            return drives
+        time.sleep(0.5)
+
+
+def copy_uf2(uf2_path: Path, drives: Iterable[Path]) -> Dict[Path, Optional[str]]:
+    """Writes the UF2 image to all drives in parallel and returns an error message per drive or None."""
+
+    def copy(drive: Path) -> Optional[str]:
+        try:
+            # The bootloader reboots into the new firmware as soon as the last block is written
+            shutil.copyfile(uf2_path, drive / Path(uf2_path).name)
+        except OSError as e:
+            return str(e)
+        return None
+
+    drives = list(drives)
+    if not drives:
+        return {}
+    with ThreadPoolExecutor(max_workers=len(drives)) as pool:
+        return dict(zip(drives, pool.map(copy, drives)))
+
+
+def wait_for_probes(unique_ids: Iterable[str], timeout: float) -> Dict[str, str]:
+    """Waits for the probes to enumerate and returns the firmware version of each probe that showed up."""
+    # Avoid circular import
+    from .session import get_all_probe_sessions
+
+    pending = set(unique_ids)
+    versions = {}
+    t_end = time.monotonic() + timeout
+    while pending and time.monotonic() < t_end:
+        try:
+            for details in get_all_probe_sessions():
+                if details["Unique ID"] in pending:
+                    versions[details["Unique ID"]] = details["Firmware version"]
+                    pending.discard(details["Unique ID"])
+        except Exception:
+            # Probes that are still booting may fail to open
+            pass
+        if pending:
+            time.sleep(0.5)
+    return versions
+
+
+def update_all(
+    uf2_path: Path,
+    expect_version: Optional[str] = None,
+    timeout: float = 30.0,
+    search_dirs: Optional[Iterable[Path]] = None,
+) -> List[UpdateResult]:
+    """Updates the firmware of all connected probes at once.
+
+    Reboots every probe into the bootloader, writes the UF2 image to all bootloader drives concurrently and
+    reads back the firmware version once the probes are back. Drives that were already mounted before the
+    reboot are updated as well.
+    """
+    # Avoid circular import
+    from .session import RioteeProbeSession, get_all_probe_sessions
+
+    results = {d["Unique ID"]: UpdateResult(d["Unique ID"], d["Firmware version"]) for d in get_all_probe_sessions()}
+    if not results:
+        raise Exception("No probes connected")
+
+    n_rebooted = 0
+    for result in results.values():
+        rebooted = False
+        try:
+            with RioteeProbeSession(unique_id=result.unique_id) as session:
+                reboot_to_bootloader(session)
+                rebooted = True
+        except Exception as e:
+            # Closing fails if the probe has already left the bus
+            if not rebooted:
+                result.error = str(e)
+        n_rebooted += rebooted
+
+    drives = wait_for_drives(n_rebooted, timeout, search_dirs)
+    if len(drives) < n_rebooted:
+        raise Exception(f"Found {len(drives)} bootloader drives, expected {n_rebooted}")
+
+    errors = [f"{drive}: {err}" for drive, err in copy_uf2(uf2_path, drives).items() if err is not None]
+    if errors:
+        raise Exception("Writing the firmware failed on " + ", ".join(errors))
+
+    pending = [r.unique_id for r in results.values() if r.ok]
+    versions = wait_for_probes(pending, timeout)
+    for uid in pending:
+        result = results[uid]
+        result.new_version = versions.get(uid)
+        if result.new_version is None:
+            result.error = "Probe did not come back after the update"
+        elif expect_version is not None and result.new_version != expect_version:
+            result.error = f"Expected version {expect_version}, got {result.new_version}"
+    return list(results.values())
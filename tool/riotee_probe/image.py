@@ -0,0 +1,143 @@
+import struct
+import zlib
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Iterable, Optional, Tuple
+
+from intelhex import IntelHex
+
+from .protocol import (
+    DAP_VENDOR_MAX_PKT_SIZE,
+    IMAGE_NAME_LEN,
+    DapRetCode,
+    ImageCmd,
+    ImageResultCode,
+    ImageStep,
+    ImageTarget,
+    ReqType,
+)
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+# Overhead: 1B request, 1B sub-command, 1B len
+IMAGE_DATA_PER_PKT = DAP_VENDOR_MAX_PKT_SIZE - 3
+
+# Width of a memory word of the target in bytes
+TARGET_ALIGNMENT = {ImageTarget.IMAGE_TARGET_MSP430: 2, ImageTarget.IMAGE_TARGET_NRF52: 4}
+
+
+@dataclass
+class ImageInfo:
+    valid: bool
+    target: ImageTarget
+    autorun: bool
+    name: str
+    size: int
+    crc32: int
+
+    FORMAT = f"<BBB{IMAGE_NAME_LEN}sII"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "ImageInfo":
+        valid, target, autorun, name, size, crc32 = struct.unpack_from(cls.FORMAT, data)
+        return cls(bool(valid), ImageTarget(target), bool(autorun), name.rstrip(b"\0").decode(), size, crc32)
+
+
+@dataclass
+class ImageResult:
+    result: ImageResultCode
+    # Slot, step and address at which programming failed
+    slot: int
+    step: ImageStep
+    err_addr: int
+    cycle_us: int
+    n_pass: int
+    n_fail: int
+
+    FORMAT = "<BBBIIII"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "ImageResult":
+        result, slot, step, *fields = struct.unpack_from(cls.FORMAT, data)
+        return cls(ImageResultCode(result), slot, ImageStep(step), *fields)
+
+    @property
+    def passed(self) -> bool:
+        return self.result == ImageResultCode.IMAGE_RESULT_PASS
+
+
+def build_image(segments: Iterable[Tuple[int, bytes]], target: ImageTarget) -> bytes:
+    """Packs segments of (address, data) into the record list stored on the probe."""
+    align = TARGET_ALIGNMENT[target]
+    image = bytearray()
+    for addr, data in segments:
+        if addr % align:
+            raise ValueError(f"Segment at 0x{addr:08X} is not aligned to {align} bytes")
+        data = bytes(data) + b"\xff" * (-len(data) % align)
+        image += struct.pack("<II", addr, len(data)) + data + b"\xff" * (-len(data) % 4)
+    return bytes(image)
+
+
+def image_from_hex(fw_path: Path, target: ImageTarget) -> bytes:
+    ih = IntelHex(str(fw_path))
+    return build_image(((start, ih.tobinstr(start=start, end=stop - 1)) for start, stop in ih.segments()), target)
+
+
+def _image_cmd(session: "RioteeProbeSession", fmt: str, *args) -> bytes:
+    return session.vendor_cmd(ReqType.ID_DAP_VENDOR_IMAGE, struct.pack(f"<{fmt}", *args))
+
+
+def image_info(session: "RioteeProbeSession", slot: int) -> ImageInfo:
+    return ImageInfo.from_bytes(_image_cmd(session, "BB", ImageCmd.IMAGE_CMD_INFO, slot))
+
+
+def upload_image(
+    session: "RioteeProbeSession",
+    slot: int,
+    target: ImageTarget,
+    name: str,
+    image: bytes,
+    autorun: bool = False,
+    window: Optional[int] = None,
+) -> None:
+    """Stores an image built with build_image() in a slot of the probe's flash."""
+    name_bytes = name.encode()[:IMAGE_NAME_LEN]
+    _image_cmd(session, f"BBBI{IMAGE_NAME_LEN}s", ImageCmd.IMAGE_CMD_BEGIN, slot, target, len(image), name_bytes)
+
+    payloads = (
+        struct.pack("<BB", ImageCmd.IMAGE_CMD_DATA, len(image[i : i + IMAGE_DATA_PER_PKT]))
+        + image[i : i + IMAGE_DATA_PER_PKT]
+        for i in range(0, len(image), IMAGE_DATA_PER_PKT)
+    )
+    for rsp in session.vendor_cmd_pipelined(ReqType.ID_DAP_VENDOR_IMAGE, payloads, window):
+        if rsp[0] != DapRetCode.DAP_OK:
+            raise Exception(f"Upload to slot {slot} failed")
+
+    pkt = struct.pack("<BIB", ImageCmd.IMAGE_CMD_COMMIT, zlib.crc32(image), autorun)
+    rsp = session.vendor_cmd_raw(ReqType.ID_DAP_VENDOR_IMAGE, pkt)
+    if rsp[0] != DapRetCode.DAP_OK:
+        raise Exception(f"Image in slot {slot} does not match the uploaded data")
+
+
+def erase_image(session: "RioteeProbeSession", slot: int) -> None:
+    _image_cmd(session, "BB", ImageCmd.IMAGE_CMD_ERASE, slot)
+
+
+def set_autorun(session: "RioteeProbeSession", slot: int, autorun: bool) -> None:
+    _image_cmd(session, "BBB", ImageCmd.IMAGE_CMD_AUTORUN, slot, autorun)
+
+
+def run_images(session: "RioteeProbeSession", slots: Iterable[int] = ()) -> ImageResult:
+    """Programs the images in the given slots, or all autorun slots if none are given."""
+    mask = sum(1 << slot for slot in set(slots))
+    return ImageResult.from_bytes(_image_cmd(session, "BB", ImageCmd.IMAGE_CMD_RUN, mask))
+
+
+def read_image_result(session: "RioteeProbeSession") -> ImageResult:
+    """Returns the result of the last programming run, including runs triggered by GPIO."""
+    return ImageResult.from_bytes(_image_cmd(session, "B", ImageCmd.IMAGE_CMD_RESULT))
@@ -0,0 +1,199 @@
+import struct
+import time
+import zipfile
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Optional, Sequence, Union
+
+import numpy as np
+
+from .protocol import (
+    LOGIC_N_CHANNELS,
+    LogicCmd,
+    LogicEncoding,
+    LogicState,
+    LogicTrigger,
+    ProbeFeature,
+    ReqType,
+    StreamId,
+)
+from .stream import StreamRecorder
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+CHANNEL_NAMES = ("GPIO0", "GPIO1", "GPIO2", "GPIO3", "UART_RX")
+
+
+@dataclass
+class LogicConfig:
+    """Capture of the logic analyzer. Pre- and post-trigger samples together must fit the probe's buffer."""
+
+    rate_hz: int
+    # Samples after the trigger, or all samples without trigger
+    n_post: int
+    # Samples before the trigger
+    n_pre: int = 0
+    trigger: LogicTrigger = LogicTrigger.LOGIC_TRIG_NONE
+    trig_channel: int = 0
+    encoding: LogicEncoding = LogicEncoding.LOGIC_ENC_RLE
+
+    FORMAT = "<IIIBBB"
+
+    def to_bytes(self) -> bytes:
+        if self.n_post < 1:
+            raise ValueError("At least one sample after the trigger is required")
+        if not 0 <= self.trig_channel < LOGIC_N_CHANNELS:
+            raise ValueError(f"Trigger channel must be in range 0..{LOGIC_N_CHANNELS - 1}")
+        return struct.pack(
+            self.FORMAT, self.rate_hz, self.n_pre, self.n_post, self.trigger, self.trig_channel, self.encoding
+        )
+
+
+@dataclass
+class LogicStatus:
+    state: LogicState
+    # Rate used by the probe, the closest one to the requested rate it can do
+    rate_hz: int
+    # Probe time in microseconds at which the trigger was seen
+    trigger_us: int
+    # Samples before the one at which the trigger was seen
+    n_pre: int
+    n_samples: int
+    # Frames queued on STREAM_ID_LOGIC
+    n_frames: int
+
+    FORMAT = "<BIIIII"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "LogicStatus":
+        state, *fields = struct.unpack_from(cls.FORMAT, data)
+        return cls(LogicState(state), *fields)
+
+
+def decode_logic_rle(data: bytes) -> np.ndarray:
+    """Expands RLE records of STREAM_ID_LOGIC into one byte per sample."""
+    records = np.frombuffer(data, dtype="<u2")
+    levels = (records & ((1 << LOGIC_N_CHANNELS) - 1)).astype(np.uint8)
+    return np.repeat(levels, (records >> LOGIC_N_CHANNELS).astype(np.int64) + 1)
+
+
+@dataclass
+class LogicCapture:
+    """Samples of the logic analyzer, bit i of each sample is the level of channel i."""
+
+    samples: np.ndarray
+    rate_hz: int
+    # Index of the sample at which the trigger was seen, None without trigger
+    trigger_index: Optional[int] = None
+    trigger_us: int = 0
+
+    def channel(self, index: int) -> np.ndarray:
+        return (self.samples >> index) & 1 == 1
+
+    @property
+    def times(self) -> np.ndarray:
+        """Time of each sample in seconds relative to the trigger."""
+        return (np.arange(len(self.samples)) - (self.trigger_index or 0)) / self.rate_hz
+
+    def write_vcd(self, path: Union[Path, str], names: Sequence[str] = CHANNEL_NAMES) -> None:
+        """Saves the capture as Value Change Dump with a resolution of 1ns. The trigger is at time 0."""
+        ids = [chr(ord("!") + i) for i in range(LOGIC_N_CHANNELS)]
+        offset = self.trigger_index or 0
+        with open(path, "w") as f:
+            f.write("$version riotee-probe $end\n$timescale 1 ns $end\n$scope module probe $end\n")
+            for i, name in zip(ids, names):
+                f.write(f"$var wire 1 {i} {name} $end\n")
+            f.write("$upscope $end\n$enddefinitions $end\n")
+            if len(self.samples) == 0:
+                return
+
+            f.write(f"#{round(-offset * 1e9 / self.rate_hz)}\n$dumpvars\n")
+            for ch, i in enumerate(ids):
+                f.write(f"{(self.samples[0] >> ch) & 1}{i}\n")
+            f.write("$end\n")
+            changes = np.flatnonzero(np.diff(self.samples)) + 1
+            for idx in changes:
+                changed = self.samples[idx] ^ self.samples[idx - 1]
+                f.write(f"#{round((idx - offset) * 1e9 / self.rate_hz)}\n")
+                for ch, i in enumerate(ids):
+                    if changed & (1 << ch):
+                        f.write(f"{(self.samples[idx] >> ch) & 1}{i}\n")
+
+    def write_sigrok(self, path: Union[Path, str], names: Sequence[str] = CHANNEL_NAMES) -> None:
+        """Saves the capture as sigrok session file (.sr) for PulseView."""
+        metadata = "[global]\nsigrok version=0.5.2\n\n[device 1]\ncapturefile=logic-1\n"
+        metadata += f"total probes={LOGIC_N_CHANNELS}\nsamplerate={self.rate_hz} Hz\ntotal analog=0\n"
+        metadata += "".join(f"probe{i + 1}={name}\n" for i, name in enumerate(names))
+        metadata += "unitsize=1\n"
+        with zipfile.ZipFile(path, "w", compression=zipfile.ZIP_DEFLATED) as zf:
+            zf.writestr("version", "2")
+            zf.writestr("metadata", metadata)
+            zf.writestr("logic-1-1", self.samples.astype(np.uint8).tobytes())
+
+
+def _check_logic(session: "RioteeProbeSession") -> None:
+    if not session.supports(ProbeFeature.FEATURE_LOGIC):
+        raise Exception("Probe firmware does not support the logic analyzer -> try updating firmware")
+
+
+def start_logic(session: "RioteeProbeSession", config: LogicConfig) -> None:
+    _check_logic(session)
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_LOGIC, struct.pack("<B", LogicCmd.LOGIC_CMD_START) + config.to_bytes())
+
+
+def stop_logic(session: "RioteeProbeSession") -> None:
+    _check_logic(session)
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_LOGIC, struct.pack("<B", LogicCmd.LOGIC_CMD_STOP))
+
+
+def read_logic_status(session: "RioteeProbeSession") -> LogicStatus:
+    _check_logic(session)
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_LOGIC, struct.pack("<B", LogicCmd.LOGIC_CMD_STATUS))
+    return LogicStatus.from_bytes(rsp)
+
+
+def capture_logic(session: "RioteeProbeSession", config: LogicConfig, timeout: float = 10.0) -> LogicCapture:
+    """Runs a capture and receives its samples. Stops the capture if the trigger does not come within timeout
+    seconds or when interrupted."""
+    _check_logic(session)
+    recorder = StreamRecorder()
+    reader = session.stream_reader()
+    reader.subscribe(StreamId.STREAM_ID_LOGIC, recorder)
+    reader.start()
+    t_end = time.monotonic() + timeout
+    try:
+        reader.enable([StreamId.STREAM_ID_LOGIC])
+        start_logic(session, config)
+        try:
+            status = read_logic_status(session)
+            while status.state not in (LogicState.LOGIC_STATE_DONE, LogicState.LOGIC_STATE_FAILED):
+                if time.monotonic() > t_end:
+                    raise TimeoutError("Logic analyzer did not trigger")
+                time.sleep(0.01)
+                status = read_logic_status(session)
+        except BaseException:
+            stop_logic(session)
+            raise
+        # The last frames may still be on their way
+        while len(recorder.frames()) < status.n_frames and time.monotonic() < t_end + 1.0:
+            reader.check()
+            time.sleep(0.01)
+    finally:
+        reader.stop()
+
+    if status.state == LogicState.LOGIC_STATE_FAILED:
+        raise Exception("Probe could not send the capture, the stream was disabled or not read")
+    payload = recorder.payload().tobytes()
+    if config.encoding == LogicEncoding.LOGIC_ENC_RLE:
+        samples = decode_logic_rle(payload)
+    else:
+        samples = np.frombuffer(payload, dtype=np.uint8).copy()
+    if len(samples) != status.n_samples:
+        raise Exception(f"Received {len(samples)} of {status.n_samples} samples")
+    trigger_index = None if config.trigger == LogicTrigger.LOGIC_TRIG_NONE else status.n_pre
+    return LogicCapture(samples, status.rate_hz, trigger_index, status.trigger_us)
@@ -1,9 +1,53 @@
 import struct
 from contextlib import contextmanager
 from enum import Enum
-from typing import Generator
+from pathlib import Path
+from typing import Generator, Iterable, List, Optional, Tuple
 
-from .protocol import IOSetState, ReqType
+import numpy as np
+
+from .bench import BenchResult, run_bench, usb_echo_bench
+from .boot import BootConfig, BootResult, run_boot_latency
+from .clock import ClockSync
+from .dump import DumpStats, dump_rle
+from .events import EventRecorder
+from .fw_update import reboot_to_bootloader
+from .image import (
+    ImageInfo,
+    ImageResult,
+    erase_image,
+    image_from_hex,
+    image_info,
+    read_image_result,
+    run_images,
+    set_autorun,
+    upload_image,
+)
+from .logic import LogicCapture, LogicConfig, capture_logic
+from .protocol import IMAGE_N_SLOTS, BenchPrimitive, EventType, ImageTarget, IOSetState, ReqType, StreamCmd
+from .sequence import Sequence, run_sequence
+from .stats import (
+    CommandStats,
+    SystemStats,
+    TaskStats,
+    enable_stats,
+    read_command_stats,
+    read_task_stats,
+    reset_stats,
+    stats_overhead_ns,
+)
+from .stream import StreamReader
+from .trace import download_trace, trace_clear, trace_enable
+from .trigger import TriggerRule, TriggerStatus, arm_trigger, disarm_trigger, read_trigger_status
+from .uart import (
+    UartFrameReader,
+    UartHistoryInfo,
+    UartStats,
+    read_uart_history,
+    read_uart_history_info,
+    read_uart_stats,
+    replay_uart_history,
+)
 
 from .target import TargetMSP430, TargetNRF52
 
@@ -49,6 +93,144 @@ class RioteeProbe:
     def bypass(self, state: bool) -> None:
         raise NotImplementedError
 
+    def run_sequence(self, seq: Sequence, timeout: float = 1.0) -> np.ndarray:
+        """Executes a sequence on the probe and returns the captured values.
+
+        The sequence is aborted if it runs longer than timeout seconds.
+        """
+        return run_sequence(self._session, seq, timeout)
+
+    def stream_reader(self, **kwargs) -> StreamReader:
+        """Returns a reader for the asynchronous streams of the probe."""
+        return self._session.stream_reader(**kwargs)
+
+    def stream_test(self, n_frames: int) -> None:
+        """Makes the probe send n_frames frames with consecutive uint32 counter values on the test stream."""
+        pkt = struct.pack("<BI", StreamCmd.STREAM_CMD_TEST, n_frames)
+        self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_STREAM, pkt)
+
+    def command_stats(self) -> List[CommandStats]:
+        """Returns call counts, error counts and latency histograms of the commands executed by the probe."""
+        return read_command_stats(self._session)
+
+    def stats_overhead_ns(self) -> int:
+        return stats_overhead_ns(self._session)
+
+    def enable_stats(self, enable: bool) -> None:
+        enable_stats(self._session, enable)
+
+    def reset_stats(self) -> None:
+        reset_stats(self._session)
+
+    def task_stats(self) -> Tuple[SystemStats, List[TaskStats]]:
+        """Returns uptime and heap usage as well as run time and stack usage per task."""
+        return read_task_stats(self._session)
+
+    def trace_enable(self, enable: bool) -> None:
+        """Starts or stops recording SBW/JTAG transactions on the probe."""
+        trace_enable(self._session, enable)
+
+    def trace_clear(self) -> None:
+        trace_clear(self._session)
+
+    def trace_download(self) -> np.ndarray:
+        """Returns the recorded SBW/JTAG transactions, oldest first."""
+        return download_trace(self._session)
+
+    def bench(self, primitive: BenchPrimitive, n_iter: int, arg: int = 0) -> BenchResult:
+        """Measures the execution time of one of the probe's primitives."""
+        return run_bench(self._session, primitive, n_iter, arg)
+
+    def usb_echo_bench(self, n_iter: int) -> np.ndarray:
+        """Returns the round trip times of n_iter vendor packets in nanoseconds."""
+        return usb_echo_bench(self._session, n_iter)
+
+    def image_slots(self) -> List[ImageInfo]:
+        """Returns information about all slots of the image store."""
+        return [image_info(self._session, slot) for slot in range(IMAGE_N_SLOTS)]
+
+    def upload_image(self, slot: int, fw_path: Path, target: ImageTarget, autorun: bool = False) -> None:
+        """Stores a firmware image in the probe's flash for standalone programming."""
+        image = image_from_hex(fw_path, target)
+        upload_image(self._session, slot, target, Path(fw_path).stem, image, autorun)
+
+    def erase_image(self, slot: int) -> None:
+        erase_image(self._session, slot)
+
+    def image_autorun(self, slot: int, autorun: bool) -> None:
+        """Includes or excludes a slot from programming triggered by the GPIO."""
+        set_autorun(self._session, slot, autorun)
+
+    def run_images(self, slots: Iterable[int] = ()) -> ImageResult:
+        """Programs targets from the image store, by default all autorun slots."""
+        return run_images(self._session, slots)
+
+    def image_result(self) -> ImageResult:
+        return read_image_result(self._session)
+
+    def dump_nrf52(self, addr: int, n_words: int) -> Tuple[np.ndarray, DumpStats]:
+        """Reads n_words 32-bit words from the nRF52 with compression on the probe.
+
+        Must not be called inside the nrf52() context, which leaves the debug port to pyOCD.
+        """
+        data, stats = dump_rle(self._session, addr, 2 * n_words, nrf52=True)
+        return data.view(np.uint32), stats
+
+    def uart_stats(self) -> UartStats:
+        """Returns byte and loss counters of the UART bridge."""
+        return read_uart_stats(self._session)
+
+    def uart_history_info(self) -> UartHistoryInfo:
+        return read_uart_history_info(self._session)
+
+    def uart_history(self) -> Tuple[bytes, List[Tuple[int, int]]]:
+        """Returns the UART output held by the probe and (offset, number of bytes lost) for every gap in it."""
+        return read_uart_history(self._session)
+
+    def uart_replay(self) -> None:
+        """Sends the UART output held by the probe to the serial port again."""
+        replay_uart_history(self._session)
+
+    def uart_frames(self, port: Optional[str] = None) -> UartFrameReader:
+        """Returns a context that reads the UART output with the probe time of its reception."""
+        return UartFrameReader(self._session, port)
+
+    def events(self, types: Optional[Iterable[EventType]] = None) -> EventRecorder:
+        """Returns a context that records UART output, GPIO edges, power switching and SBW operations on one
+        timeline, by default all of them. The records are collected in the log attribute of the context."""
+        return EventRecorder(self._session, types)
+
+    def trigger_arm(self, rule: TriggerRule, slot: int = 0) -> None:
+        """Arms a rule on the probe. The probe takes its action when the event occurs, without the host."""
+        arm_trigger(self._session, rule, slot)
+
+    def trigger_disarm(self, slot: int = 0) -> None:
+        disarm_trigger(self._session, slot)
+
+    def trigger_status(self, slot: int = 0) -> TriggerStatus:
+        """Returns how often a rule fired and the probe times of its last event and action."""
+        return read_trigger_status(self._session, slot)
+
+    def boot_latency(self, config: BootConfig) -> BootResult:
+        """Power cycles the target repeatedly and measures the time from power-on to its first UART byte, a GPIO
+        edge or its first write to the JTAG mailbox. Blocks until all cycles are done."""
+        return run_boot_latency(self._session, config)
+
+    def logic_capture(self, config: LogicConfig, timeout: float = 10.0) -> LogicCapture:
+        """Samples the header GPIOs and UART RX with the probe's logic analyzer. Blocks until the capture was
+        triggered and received."""
+        return capture_logic(self._session, config, timeout)
+
+    def clock_sync(self, n_pings: int = 64) -> ClockSync:
+        """Samples the probe clock against the host clock. Call fit() on the result to map probe timestamps."""
+        sync = ClockSync(self._session)
+        sync.sample(n_pings)
+        return sync
+
+    def reboot_to_bootloader(self) -> None:
+        """Reboots the probe into the USB mass storage bootloader for a firmware update."""
+        reboot_to_bootloader(self._session)
+
     def fw_version(self) -> str:
         ret = self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_VERSION)
         # Firmware versions before 1.1.0 send a trailing nul over the wire
@@ -1,4 +1,6 @@
-from enum import IntEnum
+import struct
+from dataclasses import dataclass
+from enum import IntEnum, IntFlag
 
 
 class DapRetCode(IntEnum):
@@ -8,6 +10,9 @@ class DapRetCode(IntEnum):
 
 ID_DAP_VENDOR0: int = 0x80
 
+# First byte of the response to a command that the firmware does not know
+ID_DAP_INVALID: int = 0xFF
+
 DAP_VENDOR_MAX_PKT_SIZE: int = 64
 
 
@@ -24,6 +29,47 @@ class ReqType(IntEnum):
     ID_DAP_VENDOR_GPIO_SET = 0x89
     ID_DAP_VENDOR_GPIO_GET = 0x8A
     ID_DAP_VENDOR_BYPASS = 0x8B
+    ID_DAP_VENDOR_BATCH = 0x8C
+    ID_DAP_VENDOR_SEQUENCE = 0x8D
+    ID_DAP_VENDOR_BULK = 0x8E
+    ID_DAP_VENDOR_TAGGED = 0x8F
+    ID_DAP_VENDOR_CAPS = 0x90
+    ID_DAP_VENDOR_STREAM = 0x91
+    ID_DAP_VENDOR_STATS = 0x92
+    ID_DAP_VENDOR_TRACE = 0x93
+    ID_DAP_VENDOR_BENCH = 0x94
+    ID_DAP_VENDOR_IMAGE = 0x95
+    ID_DAP_VENDOR_BOOTLOADER = 0x96
+    ID_DAP_VENDOR_TIME = 0x97
+    ID_DAP_VENDOR_UART = 0x98
+    ID_DAP_VENDOR_TRIGGER = 0x99
+    ID_DAP_VENDOR_EVENTS = 0x9A
+    ID_DAP_VENDOR_BOOT = 0x9B
+    ID_DAP_VENDOR_LOGIC = 0x9C
+
+
+class DapCmd(IntEnum):
+    """Standard CMSIS-DAP commands"""
+
+    ID_DAP_INFO = 0x00
+    ID_DAP_HOST_STATUS = 0x01
+    ID_DAP_CONNECT = 0x02
+    ID_DAP_DISCONNECT = 0x03
+    ID_DAP_TRANSFER_CONFIGURE = 0x04
+    ID_DAP_TRANSFER = 0x05
+    ID_DAP_TRANSFER_BLOCK = 0x06
+    ID_DAP_TRANSFER_ABORT = 0x07
+    ID_DAP_WRITE_ABORT = 0x08
+    ID_DAP_DELAY = 0x09
+    ID_DAP_RESET_TARGET = 0x0A
+    ID_DAP_SWJ_PINS = 0x10
+    ID_DAP_SWJ_CLOCK = 0x11
+    ID_DAP_SWJ_SEQUENCE = 0x12
+    ID_DAP_SWD_CONFIGURE = 0x13
+    ID_DAP_JTAG_SEQUENCE = 0x14
+    ID_DAP_JTAG_CONFIGURE = 0x15
+    ID_DAP_JTAG_IDCODE = 0x16
+    ID_DAP_SWD_SEQUENCE = 0x1D
 
 
 class BypassState(IntEnum):
@@ -45,3 +91,359 @@ class IOSetState(IntEnum):
 class IOGetState(IntEnum):
     IOGET_LOW = 0
     IOGET_HIGH = 1
+
+
+class BulkCmd(IntEnum):
+    BULK_CMD_WRITE = 0
+    BULK_CMD_READ = 1
+    BULK_CMD_DATA = 2
+    BULK_CMD_STATUS = 3
+    BULK_CMD_ABORT = 4
+
+
+class BulkFlag(IntEnum):
+    BULK_FLAG_VERIFY = 0x01
+    BULK_FLAG_RLE = 0x02
+    BULK_FLAG_NRF52 = 0x04
+
+
+class BulkState(IntEnum):
+    BULK_STATE_IDLE = 0
+    BULK_STATE_WRITE = 1
+    BULK_STATE_READ = 2
+    BULK_STATE_DONE = 3
+    BULK_STATE_ERROR = 4
+
+
+# Number of 16-bit words carried by one bulk data packet
+BULK_WORDS_PER_PKT: int = 31
+
+# Header bit of run tokens in compressed bulk reads, literal tokens have it cleared
+BULK_RLE_RUN: int = 0x80
+
+
+class SeqCmd(IntEnum):
+    SEQ_CMD_LOAD = 0
+    SEQ_CMD_RUN = 1
+    SEQ_CMD_READ = 2
+
+
+class SeqOp(IntEnum):
+    SEQ_OP_END = 0x00
+    SEQ_OP_POWER = 0x01
+    SEQ_OP_GPIO_SET = 0x02
+    SEQ_OP_GPIO_GET = 0x03
+    SEQ_OP_SBW_HALT = 0x04
+    SEQ_OP_SBW_RESUME = 0x05
+    SEQ_OP_SBW_RESET = 0x06
+    SEQ_OP_SBW_READ = 0x07
+    SEQ_OP_SBW_WRITE = 0x08
+    SEQ_OP_DELAY_US = 0x09
+    SEQ_OP_LOOP = 0x0A
+    SEQ_OP_END_LOOP = 0x0B
+    SEQ_OP_JUMP = 0x0C
+    SEQ_OP_BRANCH_EQ = 0x0D
+    SEQ_OP_BRANCH_NE = 0x0E
+    SEQ_OP_CAPTURE = 0x0F
+    SEQ_OP_CAPTURE_TIME = 0x10
+
+
+class SeqStatus(IntEnum):
+    SEQ_RC_OK = 0
+    SEQ_RC_ERR_OPCODE = 1
+    SEQ_RC_ERR_OPERAND = 2
+    SEQ_RC_ERR_TARGET = 3
+    SEQ_RC_ERR_TIMEOUT = 4
+    SEQ_RC_ERR_OVERFLOW = 5
+
+
+SEQ_MAX_PROG_SIZE: int = 1024
+
+
+PROBE_USB_VID: int = 0x1209
+
+# USB interface and endpoint of the asynchronous stream interface
+STREAM_ITF_NUM: int = 3
+STREAM_EP_IN: int = 0x84
+
+# Every stream frame occupies one USB packet: 8B header followed by the payload
+STREAM_FRAME_SIZE: int = 64
+STREAM_MAX_PAYLOAD: int = 56
+
+
+class StreamCmd(IntEnum):
+    STREAM_CMD_ENABLE = 0
+    STREAM_CMD_STATUS = 1
+    STREAM_CMD_TEST = 2
+
+
+class StreamId(IntEnum):
+    STREAM_ID_TEST = 0
+    STREAM_ID_UART = 1
+    STREAM_ID_EVENT = 2
+    STREAM_ID_LOGIC = 3
+
+
+class StatsCmd(IntEnum):
+    STATS_CMD_INFO = 0
+    STATS_CMD_ENABLE = 1
+    STATS_CMD_RESET = 2
+    STATS_CMD_READ = 3
+    STATS_CMD_HIST = 4
+    STATS_CMD_SYSTEM = 5
+    STATS_CMD_TASK = 6
+
+
+# Bucket k of a latency histogram counts latencies in [2^k, 2^(k+1)) us, the last bucket all above
+STATS_N_BUCKETS: int = 15
+
+
+class TraceCmd(IntEnum):
+    TRACE_CMD_INFO = 0
+    TRACE_CMD_ENABLE = 1
+    TRACE_CMD_CLEAR = 2
+    TRACE_CMD_READ = 3
+
+
+class TraceType(IntEnum):
+    TRACE_IR_SHIFT = 0
+    TRACE_DR_SHIFT16 = 1
+    TRACE_DR_SHIFT20 = 2
+    TRACE_TCLK_SET = 3
+    TRACE_TCLK_CLR = 4
+    TRACE_TAP_RESET = 5
+    TRACE_CMD = 6
+
+
+TRACE_ENTRIES_PER_PKT: int = 4
+
+
+class JtagInstr(IntEnum):
+    """MSP430 JTAG instructions as shifted into the IR by the probe"""
+
+    IR_CNTRL_SIG_16BIT = 0xC8
+    IR_CNTRL_SIG_CAPTURE = 0x28
+    IR_CNTRL_SIG_RELEASE = 0xA8
+    IR_PREPARE_BLOW = 0x44
+    IR_EX_BLOW = 0x24
+    IR_DATA_16BIT = 0x82
+    IR_DATA_QUICK = 0xC2
+    IR_ADDR_16BIT = 0xC1
+    IR_ADDR_CAPTURE = 0x21
+    IR_DATA_TO_ADDR = 0xA1
+    IR_BYPASS = 0xFF
+    IR_DATA_CAPTURE = 0x42
+    IR_COREIP_ID = 0xE8
+    IR_DEVICE_ID = 0xE1
+    IR_JMB_EXCHANGE = 0x86
+    IR_TEST_REG = 0x54
+    IR_TEST_3V_REG = 0xF4
+
+
+class BenchPrimitive(IntEnum):
+    BENCH_NOP = 0
+    BENCH_SBW_SLOT = 1
+    BENCH_TAP_DR_SHIFT16 = 2
+    BENCH_MEM_READ_WORD = 3
+    BENCH_MEM_WRITE_WORD = 4
+    BENCH_SWD_TRANSFER = 5
+    BENCH_USB_ECHO = 6
+
+
+IMAGE_N_SLOTS: int = 4
+IMAGE_NAME_LEN: int = 16
+
+
+class ImageCmd(IntEnum):
+    IMAGE_CMD_INFO = 0
+    IMAGE_CMD_BEGIN = 1
+    IMAGE_CMD_DATA = 2
+    IMAGE_CMD_COMMIT = 3
+    IMAGE_CMD_ERASE = 4
+    IMAGE_CMD_AUTORUN = 5
+    IMAGE_CMD_RUN = 6
+    IMAGE_CMD_RESULT = 7
+
+
+class ImageTarget(IntEnum):
+    IMAGE_TARGET_MSP430 = 0
+    IMAGE_TARGET_NRF52 = 1
+
+
+class ImageStep(IntEnum):
+    IMAGE_STEP_NONE = 0
+    IMAGE_STEP_CHECK = 1
+    IMAGE_STEP_CONNECT = 2
+    IMAGE_STEP_ERASE = 3
+    IMAGE_STEP_WRITE = 4
+    IMAGE_STEP_VERIFY = 5
+
+
+class ImageResultCode(IntEnum):
+    IMAGE_RESULT_NONE = 0
+    IMAGE_RESULT_PASS = 1
+    IMAGE_RESULT_FAIL = 2
+
+
+class UartCmd(IntEnum):
+    UART_CMD_STATS = 0
+    UART_CMD_HISTORY_INFO = 1
+    UART_CMD_HISTORY_READ = 2
+    UART_CMD_HISTORY_REPLAY = 3
+    UART_CMD_FRAMED = 4
+
+
+# Number of rules the probe can hold at once and maximum length of a UART pattern
+TRIGGER_N_RULES: int = 4
+TRIGGER_PATTERN_MAX: int = 16
+
+
+class TriggerCmd(IntEnum):
+    TRIGGER_CMD_ARM = 0
+    TRIGGER_CMD_DISARM = 1
+    TRIGGER_CMD_STATUS = 2
+
+
+class TriggerSource(IntEnum):
+    TRIGGER_SRC_UART = 0
+    TRIGGER_SRC_GPIO_RISE = 1
+    TRIGGER_SRC_GPIO_FALL = 2
+
+
+class TriggerAction(IntEnum):
+    TRIGGER_ACT_TIMESTAMP = 0
+    TRIGGER_ACT_POWER_OFF = 1
+    TRIGGER_ACT_POWER_ON = 2
+    TRIGGER_ACT_GPIO_PULSE = 3
+    TRIGGER_ACT_SBW_HALT = 4
+
+
+# The rule stays armed after firing
+TRIGGER_FLAG_REPEAT: int = 0x01
+
+
+class EventCmd(IntEnum):
+    EVENT_CMD_ENABLE = 0
+    EVENT_CMD_STATUS = 1
+
+
+class EventType(IntEnum):
+    EVENT_UART = 0
+    EVENT_GPIO = 1
+    EVENT_POWER = 2
+    EVENT_BYPASS = 3
+    EVENT_SBW = 4
+
+
+class EventSbw(IntEnum):
+    EVENT_SBW_CONNECT = 0
+    EVENT_SBW_DISCONNECT = 1
+    EVENT_SBW_HALT = 2
+    EVENT_SBW_RELEASE = 3
+
+
+class EventCause(IntEnum):
+    EVENT_CAUSE_STATE = 0
+    EVENT_CAUSE_COMMAND = 1
+    EVENT_CAUSE_TRIGGER = 2
+    EVENT_CAUSE_BOOT = 3
+
+
+BOOT_MAX_CYCLES: int = 256
+
+# Time of a milestone that was not reached before the timeout
+BOOT_NOT_SEEN: int = 0xFFFFFFFF
+
+
+class BootCmd(IntEnum):
+    BOOT_CMD_START = 0
+    BOOT_CMD_STOP = 1
+    BOOT_CMD_STATUS = 2
+    BOOT_CMD_READ = 3
+
+
+class BootWait(IntFlag):
+    BOOT_WAIT_UART = 0x01
+    BOOT_WAIT_GPIO = 0x02
+    BOOT_WAIT_MAILBOX = 0x04
+
+
+# Channels 0 to 3 are the header GPIOs, channel 4 is the UART RX pin
+LOGIC_N_CHANNELS: int = 5
+
+# Samples per RLE record are stored minus one in the bits above the channels
+LOGIC_RLE_RUN_MAX: int = 1 << (16 - LOGIC_N_CHANNELS)
+
+
+class LogicCmd(IntEnum):
+    LOGIC_CMD_START = 0
+    LOGIC_CMD_STOP = 1
+    LOGIC_CMD_STATUS = 2
+
+
+class LogicTrigger(IntEnum):
+    LOGIC_TRIG_NONE = 0
+    LOGIC_TRIG_RISE = 1
+    LOGIC_TRIG_FALL = 2
+
+
+class LogicEncoding(IntEnum):
+    LOGIC_ENC_RAW = 0
+    LOGIC_ENC_RLE = 1
+
+
+class LogicState(IntEnum):
+    LOGIC_STATE_IDLE = 0
+    LOGIC_STATE_ARMED = 1
+    LOGIC_STATE_TRIGGERED = 2
+    LOGIC_STATE_CAPTURED = 3
+    LOGIC_STATE_SENDING = 4
+    LOGIC_STATE_DONE = 5
+    LOGIC_STATE_FAILED = 6
+
+
+class ProbeFeature(IntFlag):
+    FEATURE_BATCH = 1 << 0
+    FEATURE_SEQUENCE = 1 << 1
+    FEATURE_BULK = 1 << 2
+    FEATURE_BULK_VERIFY = 1 << 3
+    FEATURE_TAGGED = 1 << 4
+    FEATURE_STREAM = 1 << 5
+    FEATURE_STATS = 1 << 6
+    FEATURE_TRACE = 1 << 7
+    FEATURE_BENCH = 1 << 8
+    FEATURE_IMAGE = 1 << 9
+    FEATURE_BOOTLOADER = 1 << 10
+    FEATURE_BULK_RLE = 1 << 11
+    FEATURE_TIME = 1 << 12
+    FEATURE_UART_STATS = 1 << 13
+    FEATURE_UART_HISTORY = 1 << 14
+    FEATURE_UART_FRAMED = 1 << 15
+    FEATURE_TRIGGER = 1 << 16
+    FEATURE_EVENTS = 1 << 17
+    FEATURE_BOOT = 1 << 18
+    FEATURE_LOGIC = 1 << 19
+
+
+@dataclass(frozen=True)
+class ProbeCapabilities:
+    features: ProbeFeature
+    # Maximum size of a vendor request or response in bytes
+    max_payload: int
+    # Number of requests that may be kept in flight
+    max_outstanding: int
+    # Number of request bytes the probe can buffer
+    staging_size: int
+    sbw_clk_min_hz: int
+    sbw_clk_max_hz: int
+
+    FORMAT = "<IHHHII"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "ProbeCapabilities":
+        features, *limits = struct.unpack_from(cls.FORMAT, data)
+        return cls(ProbeFeature(features), *limits)
+
+
+# Assumed for firmware that does not support the capability command
+LEGACY_CAPABILITIES = ProbeCapabilities(ProbeFeature(0), DAP_VENDOR_MAX_PKT_SIZE, 1, DAP_VENDOR_MAX_PKT_SIZE, 0, 0)
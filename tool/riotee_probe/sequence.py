@@ -0,0 +1,170 @@
+import struct
+from contextlib import contextmanager
+from typing import Dict, Generator, List, Tuple
+
+import numpy as np
+from typing_extensions import Self
+
+from .protocol import (
+    DAP_VENDOR_MAX_PKT_SIZE,
+    SEQ_MAX_PROG_SIZE,
+    DapRetCode,
+    IOSetState,
+    ReqType,
+    SeqCmd,
+    SeqOp,
+    SeqStatus,
+    TargetPowerState,
+)
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+class SequenceError(Exception):
+    pass
+
+
+class Sequence:
+    """Builder for programs that are executed by the sequence engine on the probe.
+
+    Instructions that produce a value (gpio_get, sbw_read) load it into an accumulator that can be
+    compared with branch_eq/branch_ne and stored with capture. Example that powers the target,
+    polls a memory location until bit 0 is set and records when that happened:
+
+        seq = Sequence()
+        seq.power(True)
+        seq.label("poll")
+        seq.sbw_read(0x1C00)
+        seq.branch_eq("poll", mask=0x1, value=0x0)
+        seq.capture_time()
+        captures = probe.run_sequence(seq)
+    """
+
+    def __init__(self) -> None:
+        self._code = bytearray()
+        self._labels: Dict[str, int] = {}
+        # Offsets of jump targets that are resolved when compiling
+        self._fixups: List[Tuple[int, str]] = []
+        self._loop_depth = 0
+
+    def _emit(self, opcode: SeqOp, fmt: str = "", *operands) -> Self:
+        self._code += struct.pack(f"<B{fmt}", opcode, *operands)
+        return self
+
+    def _emit_jump(self, opcode: SeqOp, label: str, fmt: str = "", *operands) -> Self:
+        self._emit(opcode, fmt + "H", *operands, 0)
+        self._fixups.append((len(self._code) - 2, label))
+        return self
+
+    def label(self, name: str) -> Self:
+        if name in self._labels:
+            raise ValueError(f"Duplicate label {name}")
+        self._labels[name] = len(self._code)
+        return self
+
+    def power(self, state: bool) -> Self:
+        return self._emit(SeqOp.SEQ_OP_POWER, "B", TargetPowerState(state))
+
+    def gpio_set(self, pin: int, state: bool) -> Self:
+        io_state = IOSetState.IOSET_OUT_HIGH if state else IOSetState.IOSET_OUT_LOW
+        return self._emit(SeqOp.SEQ_OP_GPIO_SET, "BB", pin, io_state)
+
+    def gpio_input(self, pin: int) -> Self:
+        return self._emit(SeqOp.SEQ_OP_GPIO_SET, "BB", pin, IOSetState.IOSET_IN)
+
+    def gpio_get(self, pin: int) -> Self:
+        return self._emit(SeqOp.SEQ_OP_GPIO_GET, "B", pin)
+
+    def sbw_halt(self) -> Self:
+        return self._emit(SeqOp.SEQ_OP_SBW_HALT)
+
+    def sbw_resume(self) -> Self:
+        return self._emit(SeqOp.SEQ_OP_SBW_RESUME)
+
+    def sbw_reset(self) -> Self:
+        return self._emit(SeqOp.SEQ_OP_SBW_RESET)
+
+    def sbw_read(self, addr: int) -> Self:
+        return self._emit(SeqOp.SEQ_OP_SBW_READ, "I", addr)
+
+    def sbw_write(self, addr: int, value: int) -> Self:
+        return self._emit(SeqOp.SEQ_OP_SBW_WRITE, "IH", addr, value)
+
+    def delay_us(self, us: int) -> Self:
+        return self._emit(SeqOp.SEQ_OP_DELAY_US, "I", us)
+
+    @contextmanager
+    def loop(self, count: int) -> Generator[Self, None, None]:
+        """Repeats the instructions added inside the with-block count times."""
+        if not 0 < count < 2**16:
+            raise ValueError("Loop count must be in range 1..65535")
+        self._emit(SeqOp.SEQ_OP_LOOP, "H", count)
+        self._loop_depth += 1
+        yield self
+        self._loop_depth -= 1
+        self._emit(SeqOp.SEQ_OP_END_LOOP)
+
+    def jump(self, label: str) -> Self:
+        return self._emit_jump(SeqOp.SEQ_OP_JUMP, label)
+
+    def branch_eq(self, label: str, value: int, mask: int = 0xFFFF) -> Self:
+        """Jumps to label if (accumulator & mask) == value."""
+        return self._emit_jump(SeqOp.SEQ_OP_BRANCH_EQ, label, "HH", mask, value)
+
+    def branch_ne(self, label: str, value: int, mask: int = 0xFFFF) -> Self:
+        """Jumps to label if (accumulator & mask) != value."""
+        return self._emit_jump(SeqOp.SEQ_OP_BRANCH_NE, label, "HH", mask, value)
+
+    def capture(self) -> Self:
+        return self._emit(SeqOp.SEQ_OP_CAPTURE)
+
+    def capture_time(self) -> Self:
+        """Captures the microseconds elapsed since the start of the sequence."""
+        return self._emit(SeqOp.SEQ_OP_CAPTURE_TIME)
+
+    def compile(self) -> bytes:
+        """Resolves labels and returns the program as bytes."""
+        if self._loop_depth:
+            raise ValueError("Unterminated loop")
+        code = bytearray(self._code) + struct.pack("<B", SeqOp.SEQ_OP_END)
+        if len(code) > SEQ_MAX_PROG_SIZE:
+            raise ValueError(f"Sequence exceeds maximum program size of {SEQ_MAX_PROG_SIZE}B")
+        for offset, label in self._fixups:
+            if label not in self._labels:
+                raise ValueError(f"Undefined label {label}")
+            struct.pack_into("<H", code, offset, self._labels[label])
+        return bytes(code)
+
+
+def run_sequence(session: "RioteeProbeSession", seq: Sequence, timeout: float = 1.0) -> np.ndarray:
+    """Uploads and runs a sequence on the probe and returns the captured values."""
+    # The probe takes the timeout as a 32-bit number of microseconds
+    timeout_us = int(timeout * 1e6)
+    if not 0 <= timeout_us <= 0xFFFFFFFF:
+        raise ValueError(f"Timeout must be in range 0..{0xFFFFFFFF // 1_000_000}s, got {timeout}s")
+    code = seq.compile()
+    # Overhead: 1B request, 1B sub-command, 2B offset, 1B len
+    chunk_size = DAP_VENDOR_MAX_PKT_SIZE - 5
+    for offset in range(0, len(code), chunk_size):
+        chunk = code[offset : offset + chunk_size]
+        pkt = struct.pack("<BHB", SeqCmd.SEQ_CMD_LOAD, offset, len(chunk)) + chunk
+        session.vendor_cmd(ReqType.ID_DAP_VENDOR_SEQUENCE, pkt)
+
+    pkt = struct.pack("<BI", SeqCmd.SEQ_CMD_RUN, timeout_us)
+    rsp = session.vendor_cmd_raw(ReqType.ID_DAP_VENDOR_SEQUENCE, pkt)
+    status, pc, n_captures = struct.unpack("<BHH", rsp[1:6])
+    if rsp[0] != DapRetCode.DAP_OK:
+        raise SequenceError(f"Sequence failed with {SeqStatus(status).name} at offset {pc}")
+
+    captures = bytearray()
+    while len(captures) < 4 * n_captures:
+        pkt = struct.pack("<BH", SeqCmd.SEQ_CMD_READ, len(captures) // 4)
+        rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_SEQUENCE, pkt)
+        if rsp[0] == 0:
+            raise SequenceError("Probe returned fewer captures than announced")
+        captures += rsp[1 : 1 + 4 * rsp[0]]
+    return np.frombuffer(bytes(captures), dtype=np.uint32)
@@ -1,17 +1,29 @@
 from contextlib import contextmanager
-from typing import Generator, Optional
+from collections import deque
+from typing import Callable, Generator, Iterable, Optional, Tuple
 
 from pyocd.core.helpers import ConnectHelper
 from pyocd.core.session import Session
 from typing_extensions import Self
 
-from .protocol import ID_DAP_VENDOR0, DapRetCode
+from .batch import VendorBatch
+from .protocol import (
+    DAP_VENDOR_MAX_PKT_SIZE,
+    ID_DAP_INVALID,
+    ID_DAP_VENDOR0,
+    LEGACY_CAPABILITIES,
+    DapRetCode,
+    ProbeCapabilities,
+    ProbeFeature,
+    ReqType,
+)
 from .probe import RioteeProbe, RioteeProbeBoard, RioteeProbeProbe
+from .stream import StreamReader
 
 
 @contextmanager
-def get_connected_probe() -> Generator[RioteeProbe, None, None]:
-    with RioteeProbeSession() as session:
+def get_connected_probe(unique_id: Optional[str] = None) -> Generator[RioteeProbe, None, None]:
+    with RioteeProbeSession(unique_id=unique_id) as session:
         if session.product_name == "Riotee Board":
             yield RioteeProbeBoard(session)
         elif session.product_name == "Riotee Probe":
@@ -44,11 +56,19 @@ def get_all_probe_sessions() -> Generator[dict, None, None]:
 
 
 class RioteeProbeSession(Session):
-    def __init__(self) -> None:
+    # Default number of vendor commands kept in flight by the pipelined methods
+    DEFAULT_WINDOW = 8
+
+    def __init__(self, window: int = DEFAULT_WINDOW, unique_id: Optional[str] = None) -> None:
         self.product_name = None
+        self.window = window
+        # Selects one of several connected probes, the user is asked if None
+        self.unique_id = unique_id
+        self._tag = 0
+        self._capabilities: Optional[ProbeCapabilities] = None
 
     def __enter__(self) -> Self:
-        probe = ConnectHelper.choose_probe()
+        probe = ConnectHelper.choose_probe(unique_id=self.unique_id)
         super().__init__(probe, target_override="nrf52")
         self.open(init_board=False)
         self.product_name = probe.product_name
@@ -57,12 +77,118 @@ class RioteeProbeSession(Session):
     def __exit__(self, *exc) -> None:
         self.close()
 
-    def vendor_cmd(self, cmd_id: int, data: Optional[bytes] = None) -> bytes:
+    def vendor_cmd_raw(self, cmd_id: int, data: Optional[bytes] = None) -> bytes:
+        """Sends a vendor command and returns the response including the return code."""
         # Subtract command offset here, will be added again later
         cmd_id = cmd_id - ID_DAP_VENDOR0
         rsp = self.probe._link.vendor(cmd_id, data)
         if not isinstance(rsp, bytes) or len(rsp) < 1:
             raise Exception("Probe is unsupported -> try updating firmware")
+        return bytes(rsp)
+
+    def vendor_cmd(self, cmd_id: int, data: Optional[bytes] = None) -> bytes:
+        rsp = self.vendor_cmd_raw(cmd_id, data)
         if rsp[0] != DapRetCode.DAP_OK:
             raise Exception(f"Probe returned error code {rsp[0]}")
-        return bytes(rsp[1:])
+        return rsp[1:]
+
+    @property
+    def capabilities(self) -> ProbeCapabilities:
+        """Features and limits of the probe firmware, queried once per session."""
+        if self._capabilities is None:
+            # Reads the raw response, so that only the answer to an unknown command selects the legacy
+            # capabilities, while transport errors propagate
+            link = self.probe._link
+            link.flush()
+            link._interface.write([ReqType.ID_DAP_VENDOR_CAPS])
+            rsp = bytes(link._interface.read())
+            if rsp[:1] == bytes([ID_DAP_INVALID]):
+                # Firmware before the capability command rejects the request
+                self._capabilities = LEGACY_CAPABILITIES
+            elif len(rsp) < 2 or rsp[0] != ReqType.ID_DAP_VENDOR_CAPS:
+                raise Exception(f"Unexpected response to vendor command 0x{ReqType.ID_DAP_VENDOR_CAPS:02X}")
+            elif rsp[1] != DapRetCode.DAP_OK:
+                raise Exception(f"Probe returned error code {rsp[1]}")
+            else:
+                self._capabilities = ProbeCapabilities.from_bytes(rsp[2:])
+        return self._capabilities
+
+    def supports(self, feature: ProbeFeature) -> bool:
+        return feature in self.capabilities.features
+
+    def _window(self, window: Optional[int]) -> int:
+        return max(1, min(window or self.window, self.capabilities.max_outstanding))
+
+    def _pipeline(
+        self, pkts: Iterable[bytes], window: int, read_rsp: Callable[[], bytes]
+    ) -> Generator[bytes, None, None]:
+        link = self.probe._link
+        link.flush()
+        outstanding = 0
+        try:
+            for pkt in pkts:
+                if outstanding >= window:
+                    outstanding -= 1
+                    yield read_rsp()
+                # Padding lets the probe separate requests that queue up in its USB FIFO
+                link._interface.write(list(pkt.ljust(DAP_VENDOR_MAX_PKT_SIZE, b"\0")))
+                outstanding += 1
+            while outstanding > 0:
+                outstanding -= 1
+                yield read_rsp()
+        finally:
+            # Collect responses of requests in flight if the consumer stopped early
+            while outstanding > 0:
+                outstanding -= 1
+                link._interface.read()
+
+    def _read_vendor_rsp(self, cmd_id: int) -> bytes:
+        rsp = bytes(self.probe._link._interface.read())
+        if len(rsp) < 2 or rsp[0] != cmd_id:
+            raise Exception(f"Unexpected response to vendor command 0x{cmd_id:02X}")
+        return rsp[1:]
+
+    def vendor_cmd_pipelined(
+        self, cmd_id: int, payloads: Iterable[bytes], window: Optional[int] = None
+    ) -> Generator[bytes, None, None]:
+        """Sends a vendor command repeatedly while keeping up to window commands in flight.
+
+        Yields the responses including the return code in the order of the requests.
+        """
+        pkts = (bytes([cmd_id]) + data for data in payloads)
+        return self._pipeline(pkts, self._window(window), lambda: self._read_vendor_rsp(cmd_id))
+
+    def vendor_cmds_tagged(
+        self, cmds: Iterable[Tuple[int, Optional[bytes]]], window: Optional[int] = None
+    ) -> Generator[bytes, None, None]:
+        """Sends arbitrary vendor commands while keeping up to window commands in flight.
+
+        Every command is tagged with a sequence number that the probe echoes, so that responses
+        can be matched to their requests. Yields the responses including the return code.
+        """
+        expected = deque()
+
+        def pkts() -> Generator[bytes, None, None]:
+            for cmd_id, data in cmds:
+                self._tag = (self._tag + 1) % 256
+                expected.append((self._tag, cmd_id))
+                yield bytes([ReqType.ID_DAP_VENDOR_TAGGED, self._tag, cmd_id]) + (data or b"")
+
+        def read_rsp() -> bytes:
+            tag, cmd_id = expected.popleft()
+            rsp = self._read_vendor_rsp(ReqType.ID_DAP_VENDOR_TAGGED)
+            if rsp[0] != tag or rsp[1] != cmd_id:
+                raise Exception(f"Response out of sequence: expected tag {tag}, got {rsp[0]}")
+            return rsp[2:]
+
+        return self._pipeline(pkts(), self._window(window), read_rsp)
+
+    def stream_reader(self, **kwargs) -> StreamReader:
+        """Creates a reader for the asynchronous stream interface of the probe."""
+        if not self.supports(ProbeFeature.FEATURE_STREAM):
+            raise Exception("Probe firmware does not support streams -> try updating firmware")
+        return StreamReader(self, **kwargs)
+
+    def batch(self) -> VendorBatch:
+        """Returns a builder that executes several vendor commands in one USB transaction."""
+        return VendorBatch(self)
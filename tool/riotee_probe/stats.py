@@ -0,0 +1,126 @@
+import struct
+from dataclasses import dataclass
+from typing import List, Tuple
+
+import numpy as np
+
+from .protocol import STATS_N_BUCKETS, DapCmd, ReqType, StatsCmd
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+@dataclass
+class CommandStats:
+    cmd_id: int
+    count: int
+    errors: int
+    max_us: int
+    # Number of commands per log2 latency bucket
+    histogram: np.ndarray
+
+    @property
+    def name(self) -> str:
+        for enum in (ReqType, DapCmd):
+            try:
+                return enum(self.cmd_id).name
+            except ValueError:
+                pass
+        return f"0x{self.cmd_id:02X}"
+
+    def percentile(self, q: float) -> int:
+        """Returns an upper bound in microseconds for the q-th percentile of the latency."""
+        idx = int(np.searchsorted(np.cumsum(self.histogram), q / 100 * self.count))
+        if idx >= STATS_N_BUCKETS - 1:
+            return self.max_us
+        return min(2 ** (idx + 1), self.max_us)
+
+
+# Names of FreeRTOS' eTaskState
+TASK_STATES = ("Running", "Ready", "Blocked", "Suspended", "Deleted", "Invalid")
+
+
+@dataclass
+class SystemStats:
+    n_cores: int
+    uptime_us: int
+    heap_size: int
+    heap_free: int
+
+    FORMAT = "<BBQII"
+
+    @property
+    def heap_used(self) -> int:
+        return self.heap_size - self.heap_free
+
+
+@dataclass
+class TaskStats:
+    name: str
+    priority: int
+    state: int
+    core_mask: int
+    # Smallest amount of free stack since the task was started, in words
+    stack_free_min: int
+    run_time_us: int
+
+    FORMAT = "<12sBBBHQ"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "TaskStats":
+        name, *fields = struct.unpack_from(cls.FORMAT, data)
+        return cls(name.rstrip(b"\0").decode(), *fields)
+
+    @property
+    def state_name(self) -> str:
+        return TASK_STATES[min(self.state, len(TASK_STATES) - 1)]
+
+    def cpu_share(self, system: SystemStats) -> float:
+        """Returns the fraction of one core's time that the task spent running."""
+        return self.run_time_us / system.uptime_us
+
+
+def _stats_cmd(session: "RioteeProbeSession", fmt: str, *args) -> bytes:
+    return session.vendor_cmd(ReqType.ID_DAP_VENDOR_STATS, struct.pack(f"<{fmt}", *args))
+
+
+def stats_overhead_ns(session: "RioteeProbeSession") -> int:
+    """Returns the cost of recording one command as measured by the probe."""
+    _, overhead_ns, _ = struct.unpack_from("<BHB", _stats_cmd(session, "B", StatsCmd.STATS_CMD_INFO))
+    return overhead_ns
+
+
+def read_command_stats(session: "RioteeProbeSession") -> List[CommandStats]:
+    """Reads the statistics of all commands that were executed at least once."""
+    rsp = _stats_cmd(session, "B", StatsCmd.STATS_CMD_INFO)
+    _, _, n_slots = struct.unpack_from("<BHB", rsp)
+    active = np.unpackbits(np.frombuffer(rsp[4 : 4 + n_slots // 8], dtype=np.uint8), bitorder="little")
+
+    stats = []
+    for slot in np.flatnonzero(active):
+        rsp = _stats_cmd(session, "BB", StatsCmd.STATS_CMD_READ, slot)
+        cmd_id, count, errors, max_us = struct.unpack_from("<BIII", rsp)
+        rsp = _stats_cmd(session, "BB", StatsCmd.STATS_CMD_HIST, slot)
+        histogram = np.frombuffer(rsp[: 4 * STATS_N_BUCKETS], dtype=np.uint32)
+        stats.append(CommandStats(cmd_id, count, errors, max_us, histogram))
+    return stats
+
+
+def enable_stats(session: "RioteeProbeSession", enable: bool) -> None:
+    _stats_cmd(session, "BB", StatsCmd.STATS_CMD_ENABLE, enable)
+
+
+def reset_stats(session: "RioteeProbeSession") -> None:
+    _stats_cmd(session, "B", StatsCmd.STATS_CMD_RESET)
+
+
+def read_task_stats(session: "RioteeProbeSession") -> Tuple[SystemStats, List[TaskStats]]:
+    """Reads uptime and heap usage as well as run time and stack usage of all tasks."""
+    rsp = _stats_cmd(session, "B", StatsCmd.STATS_CMD_SYSTEM)
+    n_cores, n_tasks, uptime_us, heap_size, heap_free = struct.unpack_from(SystemStats.FORMAT, rsp)
+    system = SystemStats(n_cores, uptime_us, heap_size, heap_free)
+    tasks = [TaskStats.from_bytes(_stats_cmd(session, "BB", StatsCmd.STATS_CMD_TASK, i)) for i in range(n_tasks)]
+    return system, tasks
@@ -0,0 +1,162 @@
+import struct
+import threading
+from collections import defaultdict
+from typing import Callable, Dict, Iterable, List, Optional, Tuple
+
+import numpy as np
+import usb.core
+import usb.util
+from typing_extensions import Self
+
+from .protocol import (
+    PROBE_USB_VID,
+    STREAM_EP_IN,
+    STREAM_FRAME_SIZE,
+    STREAM_ITF_NUM,
+    STREAM_MAX_PAYLOAD,
+    ReqType,
+    StreamCmd,
+)
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+# Layout of a frame on the stream interface. Timestamps are probe time in microseconds and wrap after ~71 minutes.
+FRAME_DTYPE = np.dtype(
+    [
+        ("stream_id", "u1"),
+        ("len", "u1"),
+        ("dropped", "<u2"),
+        ("timestamp", "<u4"),
+        ("payload", "u1", STREAM_MAX_PAYLOAD),
+    ]
+)
+assert FRAME_DTYPE.itemsize == STREAM_FRAME_SIZE
+
+
+def frame_payload(frames: np.ndarray) -> np.ndarray:
+    """Concatenates the valid payload bytes of frames into a single uint8 array."""
+    valid = np.arange(STREAM_MAX_PAYLOAD) < frames["len"][:, None]
+    return frames["payload"][valid]
+
+
+class StreamRecorder:
+    """Stream consumer that collects all received frames."""
+
+    def __init__(self) -> None:
+        self._chunks: List[np.ndarray] = []
+        self._lock = threading.Lock()
+
+    def __call__(self, frames: np.ndarray) -> None:
+        with self._lock:
+            self._chunks.append(frames)
+
+    def frames(self) -> np.ndarray:
+        with self._lock:
+            if not self._chunks:
+                return np.empty(0, dtype=FRAME_DTYPE)
+            return np.concatenate(self._chunks)
+
+    def payload(self) -> np.ndarray:
+        return frame_payload(self.frames())
+
+
+class StreamReader:
+    """Receives frames from the probe's stream interface on a background thread.
+
+    Every USB transfer carries many frames that are decoded at once. Consumers are called on the reader thread
+    with a structured array (FRAME_DTYPE) of the frames of their stream from one transfer.
+    """
+
+    def __init__(self, session: "RioteeProbeSession", frames_per_read: int = 128, timeout_ms: int = 50) -> None:
+        self._session = session
+        self._read_size = frames_per_read * STREAM_FRAME_SIZE
+        self._timeout_ms = timeout_ms
+        self._consumers: Dict[int, List[Callable[[np.ndarray], None]]] = defaultdict(list)
+        self._dev = None
+        self._thread: Optional[threading.Thread] = None
+        self._stop = threading.Event()
+        # Error that ended the reader thread
+        self._error: Optional[usb.core.USBError] = None
+        # Number of frames per stream that the probe reported as dropped
+        self.dropped: Dict[int, int] = defaultdict(int)
+
+    def __enter__(self) -> Self:
+        self.start()
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.stop()
+
+    def subscribe(self, stream_id: int, consumer: Callable[[np.ndarray], None]) -> None:
+        self._consumers[stream_id].append(consumer)
+
+    def enable(self, stream_ids: Iterable[int]) -> None:
+        """Enables the given streams on the probe and disables all others."""
+        mask = 0
+        for stream_id in stream_ids:
+            mask |= 1 << stream_id
+        pkt = struct.pack("<BI", StreamCmd.STREAM_CMD_ENABLE, mask)
+        self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_STREAM, pkt)
+
+    def status(self) -> Tuple[int, int, int]:
+        """Returns bitmask of enabled streams and the total number of frames sent and dropped by the probe."""
+        rsp = self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_STREAM, struct.pack("<B", StreamCmd.STREAM_CMD_STATUS))
+        return struct.unpack("<III", rsp[:12])
+
+    def start(self) -> None:
+        serial = self._session.probe.unique_id
+        self._dev = usb.core.find(idVendor=PROBE_USB_VID, custom_match=lambda dev: dev.serial_number == serial)
+        if self._dev is None:
+            raise Exception("Stream interface of probe not found")
+        usb.util.claim_interface(self._dev, STREAM_ITF_NUM)
+
+        self._stop.clear()
+        self._error = None
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def stop(self) -> None:
+        """Stops the reader. Raises the error that ended the reader thread early, if any."""
+        if self._thread is None:
+            return
+        self.enable([])
+        self._stop.set()
+        self._thread.join()
+        self._thread = None
+        usb.util.release_interface(self._dev, STREAM_ITF_NUM)
+        usb.util.dispose_resources(self._dev)
+        self.check()
+
+    def check(self) -> None:
+        """Raises the error that ended the reader thread, if any. No more frames arrive after such an error."""
+        if self._error is not None:
+            raise self._error
+
+    def _run(self) -> None:
+        buf = usb.util.create_buffer(self._read_size)
+        while not self._stop.is_set():
+            try:
+                n_bytes = self._dev.read(STREAM_EP_IN, buf, self._timeout_ms)
+            except usb.core.USBTimeoutError:
+                continue
+            except usb.core.USBError as e:
+                self._error = e
+                return
+            frames = np.frombuffer(buf, dtype=FRAME_DTYPE, count=n_bytes // STREAM_FRAME_SIZE)
+            # The buffer is reused for the next transfer
+            self.dispatch(frames.copy())
+
+    def dispatch(self, frames: np.ndarray) -> None:
+        """Hands frames to the consumers of their streams."""
+        for stream_id, consumers in self._consumers.items():
+            selected = frames[frames["stream_id"] == stream_id]
+            if len(selected) == 0:
+                continue
+            self.dropped[stream_id] += int(selected["dropped"].sum())
+            for consumer in consumers:
+                consumer(selected)
@@ -1,13 +1,23 @@
 import struct
 from pathlib import Path
-from typing import Callable, Optional, Sequence, Union
+from typing import Callable, Optional, Sequence, Tuple, Union
 
 import numpy as np
 from pyocd.flash.file_programmer import FileProgrammer
 from typing_extensions import Self
 
+from .dump import dump_rle
 from .intelhex import IntelHex16bitReader
-from .protocol import DAP_VENDOR_MAX_PKT_SIZE, ReqType
+from .protocol import (
+    DAP_VENDOR_MAX_PKT_SIZE,
+    BULK_WORDS_PER_PKT,
+    BulkCmd,
+    BulkFlag,
+    BulkState,
+    DapRetCode,
+    ProbeFeature,
+    ReqType,
+)
 
 from typing import TYPE_CHECKING
 
@@ -46,6 +56,9 @@ class Target:
 
 
 class TargetMSP430(Target):
+    # Number of words programmed per block, determines granularity of progress updates
+    PROGRAM_CHUNK_WORDS = 1024
+
     def __enter__(self) -> Self:
         self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_SBW_CONNECT)
         return self
@@ -74,7 +87,27 @@ class TargetMSP430(Target):
 
         _ = self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_SBW_WRITE, pkt)
 
+    def write_pipelined(self, addr: int, data: Sequence[np.uint16], window: Optional[int] = None) -> None:
+        """Writes data with individual write commands, keeping several of them in flight."""
+        data = np.asarray(data, dtype=np.uint16)
+        # Overhead: 2B tag envelope, 1B request, 4B address, 1B len
+        n_max = (DAP_VENDOR_MAX_PKT_SIZE - 8) // 2
+        cmds = (
+            (
+                ReqType.ID_DAP_VENDOR_SBW_WRITE,
+                struct.pack("=IB", addr + 2 * i, len(data[i : i + n_max])) + data[i : i + n_max].tobytes(),
+            )
+            for i in range(0, len(data), n_max)
+        )
+        for rsp in self._session.vendor_cmds_tagged(cmds, window):
+            if rsp[0] != DapRetCode.DAP_OK:
+                raise Exception(f"Probe returned error code {rsp[0]}")
+
     def read(self, addr, n_words: int = 1) -> np.ndarray:
+        # Two Bytes are required for request type and return code
+        if 2 * n_words > DAP_VENDOR_MAX_PKT_SIZE - 2:
+            raise ValueError("Data length exceeds maximum packet size")
+
         pkt = struct.pack("=IB", addr, n_words)
         rsp = self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_SBW_READ, pkt)
         rsp_arr = np.frombuffer(rsp, dtype=np.uint16)
@@ -82,22 +115,105 @@ class TargetMSP430(Target):
             return rsp_arr[0]
         return rsp_arr
 
+    def _bulk_start(self, cmd: BulkCmd, addr: int, n_words: int, flags: int = 0) -> int:
+        pkt = struct.pack("=BBII", cmd, flags, addr, n_words)
+        rsp = self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_BULK, pkt)
+        return min(rsp[0], self._session.window)
+
+    def _bulk_status(self) -> Tuple[BulkState, int, int]:
+        rsp = self._session.vendor_cmd(ReqType.ID_DAP_VENDOR_BULK, struct.pack("=B", BulkCmd.BULK_CMD_STATUS))
+        state, remaining, err_addr = struct.unpack("=BII", rsp[:9])
+        return BulkState(state), remaining, err_addr
+
+    def write_bulk(self, addr: int, data: Sequence[np.uint16], verify: bool = True) -> None:
+        """Streams data to memory, optionally verifying it on the probe."""
+        data = np.asarray(data, dtype=np.uint16)
+        flags = BulkFlag.BULK_FLAG_VERIFY if verify else 0
+        window = self._bulk_start(BulkCmd.BULK_CMD_WRITE, addr, len(data), flags)
+
+        payloads = (
+            struct.pack("=B", BulkCmd.BULK_CMD_DATA) + data[i : i + BULK_WORDS_PER_PKT].tobytes()
+            for i in range(0, len(data), BULK_WORDS_PER_PKT)
+        )
+        for rsp in self._session.vendor_cmd_pipelined(ReqType.ID_DAP_VENDOR_BULK, payloads, window):
+            if rsp[0] != DapRetCode.DAP_OK:
+                break
+
+        state, _, err_addr = self._bulk_status()
+        if state != BulkState.BULK_STATE_DONE:
+            if verify:
+                raise Exception(f"Verification failed at 0x{err_addr:08X}!")
+            raise Exception(f"Write failed at 0x{err_addr:08X}!")
+
+    def _dump_bulk(self, addr: int, n_words: int) -> np.ndarray:
+        window = self._bulk_start(BulkCmd.BULK_CMD_READ, addr, n_words)
+
+        n_pkts = (n_words + BULK_WORDS_PER_PKT - 1) // BULK_WORDS_PER_PKT
+        payloads = (struct.pack("=B", BulkCmd.BULK_CMD_DATA) for _ in range(n_pkts))
+        buf = bytearray()
+        for rsp in self._session.vendor_cmd_pipelined(ReqType.ID_DAP_VENDOR_BULK, payloads, window):
+            if rsp[0] != DapRetCode.DAP_OK:
+                _, _, err_addr = self._bulk_status()
+                raise Exception(f"Read failed at 0x{err_addr:08X}!")
+            buf += rsp[1:]
+        return np.frombuffer(bytes(buf), dtype=np.uint16)
+
+    def dump(self, addr: int, n_words: int) -> np.ndarray:
+        """Reads a range of memory with the fastest method supported by the probe."""
+        if self._session.supports(ProbeFeature.FEATURE_BULK_RLE):
+            return dump_rle(self._session, addr, n_words)[0]
+        if self._session.supports(ProbeFeature.FEATURE_BULK):
+            return self._dump_bulk(addr, n_words)
+
+        # Two Bytes are required for request type and return code
+        n_max = (DAP_VENDOR_MAX_PKT_SIZE - 2) // 2
+        chunks = [np.atleast_1d(self.read(addr + 2 * i, min(n_max, n_words - i))) for i in range(0, n_words, n_max)]
+        return np.concatenate(chunks)
+
+    def verify(self, addr: int, data: Sequence[np.uint16]) -> None:
+        """Reads back a range of memory and compares it with data."""
+        data = np.asarray(data, dtype=np.uint16)
+        mismatch = np.flatnonzero(self.dump(addr, len(data)) != data)
+        if len(mismatch):
+            raise Exception(f"Verification failed at 0x{addr + 2 * mismatch[0]:08X}!")
+
+    def write_block(self, addr: int, data: Sequence[np.uint16], verify: bool = True) -> None:
+        """Writes a range of memory with the fastest method supported by the probe."""
+        data = np.asarray(data, dtype=np.uint16)
+        if self._session.supports(ProbeFeature.FEATURE_BULK) and (
+            self._session.supports(ProbeFeature.FEATURE_BULK_VERIFY) or not verify
+        ):
+            self.write_bulk(addr, data, verify)
+            return
+
+        if self._session.supports(ProbeFeature.FEATURE_TAGGED):
+            self.write_pipelined(addr, data)
+        else:
+            # Overhead: 1B request, 4B address, 1B len
+            n_max = (DAP_VENDOR_MAX_PKT_SIZE - 6) // 2
+            for i in range(0, len(data), n_max):
+                self.write(addr + 2 * i, data[i : i + n_max])
+        if verify:
+            self.verify(addr, data)
+
+    def erase(self, addr: int, n_words: int) -> None:
+        """Sets a range of FRAM to the erased state (0xFFFF)."""
+        self.write_block(addr, np.full(n_words, 0xFFFF, dtype=np.uint16))
+
     def program(self, fw_path: Path, progress: Optional[Callable] = None, verify: bool = True) -> None:
         ih = IntelHex16bitReader()
         ih.loadhex(fw_path)
 
         self.halt()
-        # Overhead: 1B request, 4B address, 1B len -> 6B
-        pkts = list(ih.iter_packets((DAP_VENDOR_MAX_PKT_SIZE - 6) // 2))
+        pkts = list(ih.iter_packets(self.PROGRAM_CHUNK_WORDS))
+        n_total = sum(len(pkt) for pkt in pkts)
+        n_done = 0
 
-        for i, pkt in enumerate(pkts):
-            self.write(pkt.address, pkt.values)
-            if verify:
-                rb = self.read(pkt.address, len(pkt))
-                if (rb != pkt.values).any():
-                    raise Exception(f"Verification failed at 0x{pkt.address:08X}!")
+        for pkt in pkts:
+            self.write_block(pkt.address, pkt.values, verify)
+            n_done += len(pkt)
             if progress:
-                progress((i + 1) / len(pkts))
+                progress(n_done / n_total)
 
         self.resume()
 
@@ -0,0 +1,104 @@
+import csv
+import struct
+from pathlib import Path
+from typing import Iterator, Union
+
+import numpy as np
+
+from .protocol import TRACE_ENTRIES_PER_PKT, JtagInstr, ReqType, TraceCmd, TraceType
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+TRACE_DTYPE = np.dtype(
+    [
+        ("timestamp", "<u4"),
+        ("type", "u1"),
+        ("instr", "u1"),
+        ("data_in", "<u4"),
+        ("data_out", "<u4"),
+    ]
+)
+
+
+def _trace_cmd(session: "RioteeProbeSession", fmt: str, *args) -> bytes:
+    return session.vendor_cmd(ReqType.ID_DAP_VENDOR_TRACE, struct.pack(f"<{fmt}", *args))
+
+
+def trace_enable(session: "RioteeProbeSession", enable: bool) -> None:
+    _trace_cmd(session, "BB", TraceCmd.TRACE_CMD_ENABLE, enable)
+
+
+def trace_clear(session: "RioteeProbeSession") -> None:
+    _trace_cmd(session, "B", TraceCmd.TRACE_CMD_CLEAR)
+
+
+def download_trace(session: "RioteeProbeSession") -> np.ndarray:
+    """Reads all entries from the probe's trace buffer, oldest first.
+
+    Tracing should be disabled while downloading, otherwise new entries overwrite the ones being read.
+    """
+    rsp = _trace_cmd(session, "B", TraceCmd.TRACE_CMD_INFO)
+    _, _, available = struct.unpack_from("<BIH", rsp)
+
+    payloads = (
+        struct.pack("<BH", TraceCmd.TRACE_CMD_READ, index) for index in range(0, available, TRACE_ENTRIES_PER_PKT)
+    )
+    buf = bytearray()
+    for rsp in session.vendor_cmd_pipelined(ReqType.ID_DAP_VENDOR_TRACE, payloads):
+        buf += rsp[2 : 2 + rsp[1] * TRACE_DTYPE.itemsize]
+    return np.frombuffer(bytes(buf), dtype=TRACE_DTYPE)
+
+
+def _describe(entry: np.void) -> str:
+    entry_type = TraceType(entry["type"])
+    if entry_type == TraceType.TRACE_CMD:
+        try:
+            return f"-- {ReqType(entry['data_in']).name}"
+        except ValueError:
+            return f"-- command 0x{entry['data_in']:02X}"
+    if entry_type == TraceType.TRACE_IR_SHIFT:
+        try:
+            name = JtagInstr(entry["data_in"]).name
+        except ValueError:
+            name = f"0x{entry['data_in']:02X}"
+        return f"IR   {name:<22} out=0x{entry['data_out']:02X}"
+    if entry_type == TraceType.TRACE_DR_SHIFT16:
+        return f"DR16 in=0x{entry['data_in']:04X} out=0x{entry['data_out']:04X}"
+    if entry_type == TraceType.TRACE_DR_SHIFT20:
+        return f"DR20 in=0x{entry['data_in']:05X} out=0x{entry['data_out']:05X}"
+    return {
+        TraceType.TRACE_TCLK_SET: "TCLK 1",
+        TraceType.TRACE_TCLK_CLR: "TCLK 0",
+        TraceType.TRACE_TAP_RESET: "TAP reset",
+    }[entry_type]
+
+
+def format_trace(entries: np.ndarray) -> Iterator[str]:
+    """Yields one line per entry with the time relative to the first entry and to the previous entry."""
+    if len(entries) == 0:
+        return
+    # Differences in uint32 handle a wrap-around of the probe timer
+    deltas = np.diff(entries["timestamp"], prepend=entries["timestamp"][0])
+    times = np.cumsum(deltas.astype(np.uint64))
+    for entry, t, dt in zip(entries, times, deltas):
+        yield f"{t:>10}us {'+' + str(dt):>8}  {_describe(entry)}"
+
+
+def write_trace_csv(entries: np.ndarray, path: Union[Path, str]) -> None:
+    with open(path, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["timestamp_us", "type", "instruction", "data_in", "data_out"])
+        for entry in entries:
+            try:
+                instr = JtagInstr(entry["instr"]).name
+            except ValueError:
+                instr = f"0x{entry['instr']:02X}"
+            row_type = TraceType(entry["type"]).name
+            data_in = f"0x{entry['data_in']:X}"
+            data_out = f"0x{entry['data_out']:X}"
+            writer.writerow([entry["timestamp"], row_type, instr, data_in, data_out])
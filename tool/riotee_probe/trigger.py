@@ -0,0 +1,106 @@
+import struct
+from dataclasses import dataclass
+
+from .protocol import (
+    TRIGGER_FLAG_REPEAT,
+    TRIGGER_N_RULES,
+    TRIGGER_PATTERN_MAX,
+    ProbeFeature,
+    ReqType,
+    TriggerAction,
+    TriggerCmd,
+    TriggerSource,
+)
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+@dataclass
+class TriggerRule:
+    """Event the probe watches for and the action it takes without involving the host."""
+
+    source: TriggerSource
+    action: TriggerAction = TriggerAction.TRIGGER_ACT_TIMESTAMP
+    # Byte sequence in the target's UART output for UART sources
+    pattern: bytes = b""
+    # Header GPIO number for edge sources
+    src_pin: int = 0
+    # Header GPIO number and duration of pulses
+    act_pin: int = 0
+    pulse_us: int = 0
+    # Stay armed after firing
+    repeat: bool = False
+
+    FORMAT = f"<BBBBIBB{TRIGGER_PATTERN_MAX}s"
+
+    def to_bytes(self) -> bytes:
+        if len(self.pattern) > TRIGGER_PATTERN_MAX:
+            raise ValueError(f"Pattern must not be longer than {TRIGGER_PATTERN_MAX} bytes")
+        return struct.pack(
+            self.FORMAT,
+            self.source,
+            self.src_pin,
+            self.action,
+            self.act_pin,
+            self.pulse_us,
+            TRIGGER_FLAG_REPEAT if self.repeat else 0,
+            len(self.pattern),
+            self.pattern,
+        )
+
+
+@dataclass
+class TriggerStatus:
+    """State of a rule slot. Times are 32-bit probe timestamps in microseconds."""
+
+    armed: bool
+    # 0 if the last action succeeded, negative otherwise
+    result: int
+    n_fired: int
+    # Reception of the last pattern byte or interrupt of the edge
+    event_us: int
+    # Completion of the action
+    action_us: int
+    max_latency_us: int
+
+    FORMAT = "<BbIIII"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "TriggerStatus":
+        armed, *fields = struct.unpack_from(cls.FORMAT, data)
+        return cls(bool(armed), *fields)
+
+    @property
+    def latency_us(self) -> int:
+        """Time from the last event to the completion of its action."""
+        return (self.action_us - self.event_us) & 0xFFFFFFFF
+
+
+def _check_slot(session: "RioteeProbeSession", slot: int) -> None:
+    if not session.supports(ProbeFeature.FEATURE_TRIGGER):
+        raise Exception("Probe firmware does not support triggers -> try updating firmware")
+    if not 0 <= slot < TRIGGER_N_RULES:
+        raise ValueError(f"Slot must be in range 0..{TRIGGER_N_RULES - 1}")
+
+
+def arm_trigger(session: "RioteeProbeSession", rule: TriggerRule, slot: int = 0) -> None:
+    """Replaces the rule in a slot and arms it. Resets the slot's status."""
+    _check_slot(session, slot)
+    session.vendor_cmd(
+        ReqType.ID_DAP_VENDOR_TRIGGER, struct.pack("=BB", TriggerCmd.TRIGGER_CMD_ARM, slot) + rule.to_bytes()
+    )
+
+
+def disarm_trigger(session: "RioteeProbeSession", slot: int = 0) -> None:
+    _check_slot(session, slot)
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_TRIGGER, struct.pack("=BB", TriggerCmd.TRIGGER_CMD_DISARM, slot))
+
+
+def read_trigger_status(session: "RioteeProbeSession", slot: int = 0) -> TriggerStatus:
+    _check_slot(session, slot)
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_TRIGGER, struct.pack("=BB", TriggerCmd.TRIGGER_CMD_STATUS, slot))
+    return TriggerStatus.from_bytes(rsp)
@@ -0,0 +1,238 @@
+import struct
+from dataclasses import dataclass
+from typing import List, Optional, Tuple
+
+import numpy as np
+from typing_extensions import Self
+
+from .protocol import STREAM_FRAME_SIZE, STREAM_MAX_PAYLOAD, ProbeFeature, ReqType, StreamId, UartCmd
+from .stream import FRAME_DTYPE
+
+from typing import TYPE_CHECKING
+
+if TYPE_CHECKING:
+    # avoid circular import
+    from .session import RioteeProbeSession
+
+
+@dataclass
+class UartStats:
+    """Counters of the probe's UART bridge since power-up."""
+
+    rx_bytes: int
+    tx_bytes: int
+    # Number of hardware FIFO overflows, each loses at least one byte
+    rx_overrun: int
+    # Bytes lost because the host did not read the serial port fast enough
+    rx_dropped: int
+    rx_framing: int
+    rx_parity: int
+    rx_break: int
+    # Highest fill level of the probe's receive buffer in bytes
+    rx_peak: int
+    baudrate: int
+    # Bytes the serial port skipped because they were lost or overwritten in the history before the host read them
+    host_lost: int
+
+    FORMAT = "<10I"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "UartStats":
+        return cls(*struct.unpack_from(cls.FORMAT, data))
+
+    @property
+    def lossless(self) -> bool:
+        return self.rx_overrun == 0 and self.rx_dropped == 0 and self.host_lost == 0
+
+
+def read_uart_stats(session: "RioteeProbeSession") -> UartStats:
+    if not session.supports(ProbeFeature.FEATURE_UART_STATS):
+        raise Exception("Probe firmware does not report UART statistics -> try updating firmware")
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_UART, struct.pack("=B", UartCmd.UART_CMD_STATS))
+    return UartStats.from_bytes(rsp)
+
+
+@dataclass
+class UartHistoryInfo:
+    """State of the probe's record of recent target UART output.
+
+    Positions count bytes received since power-up and wrap after 4GB.
+    """
+
+    size: int
+    # Position after the newest byte
+    head: int
+    # Position of the oldest byte still held
+    oldest: int
+    # Bytes lost before they reached the history since power-up
+    lost: int
+
+    FORMAT = "<4I"
+
+    @classmethod
+    def from_bytes(cls, data: bytes) -> "UartHistoryInfo":
+        return cls(*struct.unpack_from(cls.FORMAT, data))
+
+
+# Header of a history read response: position of the data and number of bytes lost right before it
+HISTORY_READ_FORMAT = "<II"
+
+
+def _check_history(session: "RioteeProbeSession") -> None:
+    if not session.supports(ProbeFeature.FEATURE_UART_HISTORY):
+        raise Exception("Probe firmware does not keep a UART history -> try updating firmware")
+
+
+def read_uart_history_info(session: "RioteeProbeSession") -> UartHistoryInfo:
+    _check_history(session)
+    rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_UART, struct.pack("=B", UartCmd.UART_CMD_HISTORY_INFO))
+    return UartHistoryInfo.from_bytes(rsp)
+
+
+def decode_history_read(rsp: bytes) -> Tuple[int, int, bytes]:
+    """Splits a history read response into position, number of bytes lost before it and data."""
+    pos, lost = struct.unpack_from(HISTORY_READ_FORMAT, rsp)
+    return pos, lost, bytes(rsp[struct.calcsize(HISTORY_READ_FORMAT) :])
+
+
+def read_uart_history(session: "RioteeProbeSession") -> Tuple[bytes, List[Tuple[int, int]]]:
+    """Reads all UART output the probe still holds.
+
+    Returns the data and a list of (offset into the data, number of bytes lost right before that offset).
+    """
+    info = read_uart_history_info(session)
+    pos = info.oldest
+    data = bytearray()
+    losses = []
+    # Positions wrap after 4GB, so compare distances to the head
+    while (info.head - pos) & 0xFFFFFFFF:
+        rsp = session.vendor_cmd(ReqType.ID_DAP_VENDOR_UART, struct.pack("=BI", UartCmd.UART_CMD_HISTORY_READ, pos))
+        # Bytes overwritten since the last read are skipped and counted as lost
+        rsp_pos, lost, chunk = decode_history_read(rsp)
+        if lost:
+            losses.append((len(data), lost))
+        if not chunk:
+            break
+        data += chunk
+        pos = (rsp_pos + len(chunk)) & 0xFFFFFFFF
+    return bytes(data), losses
+
+
+def replay_uart_history(session: "RioteeProbeSession") -> None:
+    """Makes the probe send all UART output it still holds to the serial port again."""
+    _check_history(session)
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_UART, struct.pack("=B", UartCmd.UART_CMD_HISTORY_REPLAY))
+
+
+def set_uart_framed(session: "RioteeProbeSession", enable: bool) -> None:
+    """Switches the serial port between plain bytes and timestamped frames."""
+    if not session.supports(ProbeFeature.FEATURE_UART_FRAMED):
+        raise Exception("Probe firmware does not support timestamped UART frames -> try updating firmware")
+    session.vendor_cmd(ReqType.ID_DAP_VENDOR_UART, struct.pack("=BB", UartCmd.UART_CMD_FRAMED, int(enable)))
+
+
+class UartFrameDecoder:
+    """Splits the serial port data of the framed mode into frames (FRAME_DTYPE).
+
+    In framed mode the probe sends the target's output in frames of the stream interface with stream ID
+    STREAM_ID_UART. The timestamp is the probe time at which the first byte of the frame was received and the
+    dropped field counts bytes lost right before it. Plain bytes sent before the switch are skipped.
+    """
+
+    def __init__(self) -> None:
+        self._pending = np.empty(0, dtype=np.uint8)
+        # Number of times the decoder had to search for the start of a frame
+        self.resyncs = 0
+
+    @staticmethod
+    def _valid(frames: np.ndarray) -> np.ndarray:
+        return (frames["stream_id"] == StreamId.STREAM_ID_UART) & (frames["len"] <= STREAM_MAX_PAYLOAD)
+
+    @staticmethod
+    def _next_start(raw: np.ndarray, start: int) -> int:
+        """Returns the next offset that looks like the start of a frame followed by another one."""
+        ids = np.flatnonzero(raw[start:-1] == StreamId.STREAM_ID_UART) + start
+        nxt = ids + STREAM_FRAME_SIZE
+        ok = (raw[ids + 1] <= STREAM_MAX_PAYLOAD) & (
+            (nxt >= len(raw)) | (raw[np.minimum(nxt, len(raw) - 1)] == StreamId.STREAM_ID_UART)
+        )
+        candidates = ids[ok]
+        if len(candidates):
+            return int(candidates[0])
+        # The last byte may be the start of a frame
+        return len(raw) - 1 if len(raw) and raw[-1] == StreamId.STREAM_ID_UART else len(raw)
+
+    def feed(self, data: bytes) -> np.ndarray:
+        raw = np.concatenate((self._pending, np.frombuffer(data, dtype=np.uint8)))
+        chunks = []
+        start = 0
+        while True:
+            n_frames = (len(raw) - start) // STREAM_FRAME_SIZE
+            frames = raw[start : start + n_frames * STREAM_FRAME_SIZE].view(FRAME_DTYPE)
+            bad = np.flatnonzero(~self._valid(frames))
+            if len(bad) == 0:
+                chunks.append(frames)
+                start += n_frames * STREAM_FRAME_SIZE
+                break
+            chunks.append(frames[: bad[0]])
+            start = self._next_start(raw, start + int(bad[0]) * STREAM_FRAME_SIZE + 1)
+            self.resyncs += 1
+        self._pending = raw[start:].copy()
+        return np.concatenate(chunks)
+
+
+def uart_records(frames: np.ndarray) -> List[Tuple[int, bytes]]:
+    """Returns (probe time in microseconds, bytes) per frame."""
+    return [(int(f["timestamp"]), f["payload"][: f["len"]].tobytes()) for f in frames]
+
+
+def byte_timestamps(frames: np.ndarray, baudrate: int) -> np.ndarray:
+    """Returns the probe time in microseconds at which each payload byte of the frames was received."""
+    lens = frames["len"].astype(np.int64)
+    # Index of every byte within its frame
+    index = np.arange(lens.sum()) - np.repeat(np.cumsum(lens) - lens, lens)
+    start = np.repeat(frames["timestamp"].astype(np.float64), lens)
+    # Start, data and stop bit
+    return start + index * (10e6 / baudrate)
+
+
+def find_serial_port(unique_id: str) -> str:
+    """Returns the serial port of the probe with the given USB serial number."""
+    from serial.tools import list_ports
+
+    for port in list_ports.comports():
+        if port.serial_number == unique_id:
+            return port.device
+    raise Exception(f"Serial port of probe {unique_id} not found")
+
+
+class UartFrameReader:
+    """Reads timestamped target output from the probe's serial port.
+
+    Enables the framed mode before the port is opened, so that output from before is framed as well, and
+    restores plain bytes when leaving the context.
+    """
+
+    def __init__(self, session: "RioteeProbeSession", port: Optional[str] = None, timeout: float = 0.1) -> None:
+        self._session = session
+        self._port = port
+        self._timeout = timeout
+        self._serial = None
+        self.decoder = UartFrameDecoder()
+
+    def __enter__(self) -> Self:
+        import serial
+
+        port = self._port or find_serial_port(self._session.probe.unique_id)
+        set_uart_framed(self._session, True)
+        self._serial = serial.Serial(port, timeout=self._timeout)
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self._serial.close()
+        set_uart_framed(self._session, False)
+
+    def read(self) -> np.ndarray:
+        """Returns the frames (FRAME_DTYPE) received since the last call, waits up to timeout for the first."""
+        data = self._serial.read(max(self._serial.in_waiting, STREAM_FRAME_SIZE))
+        return self.decoder.feed(data)
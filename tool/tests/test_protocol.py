@@ -0,0 +1,512 @@
+import struct
+import zipfile
+from pathlib import Path
+from types import SimpleNamespace
+
+import numpy as np
+import pytest
+import riotee_probe.session
+import usb.core
+from riotee_probe import fw_update
+from riotee_probe.batch import BatchError, VendorBatch
+from riotee_probe.bench import BenchResult
+from riotee_probe.boot import BootConfig, BootCycle, BootResult
+from riotee_probe.clock import SYNC_DTYPE, fit_clock
+from riotee_probe.dump import DumpStats, decode_rle
+from riotee_probe.events import EventLog, describe_event
+from riotee_probe.fw_update import copy_uf2, find_bootloader_drives
+from riotee_probe.image import ImageResult, build_image
+from riotee_probe.logic import LogicCapture, LogicConfig, LogicStatus, decode_logic_rle
+from riotee_probe.protocol import (
+    ID_DAP_INVALID,
+    LEGACY_CAPABILITIES,
+    STATS_N_BUCKETS,
+    STREAM_MAX_PAYLOAD,
+    BenchPrimitive,
+    BootWait,
+    DapRetCode,
+    EventSbw,
+    EventType,
+    ImageStep,
+    ImageTarget,
+    LogicState,
+    LogicTrigger,
+    ProbeCapabilities,
+    ProbeFeature,
+    ReqType,
+    SeqOp,
+    StreamId,
+    TraceType,
+    TriggerAction,
+    TriggerSource,
+)
+from riotee_probe.sequence import Sequence, run_sequence
+from riotee_probe.session import RioteeProbeSession
+from riotee_probe.stats import CommandStats, SystemStats, TaskStats
+from riotee_probe.stream import FRAME_DTYPE, StreamReader, StreamRecorder
+from riotee_probe.trace import TRACE_DTYPE, format_trace
+from riotee_probe.trigger import TriggerRule, TriggerStatus
+from riotee_probe.uart import (
+    UartFrameDecoder,
+    UartHistoryInfo,
+    UartStats,
+    byte_timestamps,
+    decode_history_read,
+    uart_records,
+)
+
+
+class FakeSession:
+    def __init__(self, rsp: bytes) -> None:
+        self.rsp = rsp
+        self.requests = []
+
+    def vendor_cmd_raw(self, cmd_id: int, data: bytes = None) -> bytes:
+        self.requests.append((cmd_id, data))
+        return self.rsp
+
+
+def test_batch_encoding() -> None:
+    rsp = struct.pack(
+        "=BBBBBBHHBB",
+        DapRetCode.DAP_OK,
+        3,
+        ReqType.ID_DAP_VENDOR_SBW_HALT,
+        DapRetCode.DAP_OK,
+        ReqType.ID_DAP_VENDOR_SBW_READ,
+        DapRetCode.DAP_OK,
+        0x1234,
+        0x5678,
+        ReqType.ID_DAP_VENDOR_SBW_RESUME,
+        DapRetCode.DAP_OK,
+    )
+    session = FakeSession(rsp)
+    _, data, _ = VendorBatch(session).sbw_halt().sbw_read(0x4400, 2).sbw_resume().execute()
+
+    cmd_id, req = session.requests[0]
+    assert cmd_id == ReqType.ID_DAP_VENDOR_BATCH
+    assert req == struct.pack(
+        "=BBBIBB",
+        3,
+        ReqType.ID_DAP_VENDOR_SBW_HALT,
+        ReqType.ID_DAP_VENDOR_SBW_READ,
+        0x4400,
+        2,
+        ReqType.ID_DAP_VENDOR_SBW_RESUME,
+    )
+    assert list(data) == [0x1234, 0x5678]
+
+
+def test_batch_stops_at_error() -> None:
+    rsp = struct.pack("=BBBB", DapRetCode.DAP_ERROR, 1, ReqType.ID_DAP_VENDOR_SBW_HALT, DapRetCode.DAP_ERROR)
+    with pytest.raises(BatchError):
+        VendorBatch(FakeSession(rsp)).sbw_halt().sbw_resume().execute()
+
+
+def test_batch_overflow() -> None:
+    with pytest.raises(ValueError):
+        VendorBatch(FakeSession(b"")).sbw_read(0x4400, 28).sbw_read(0x4400, 2)
+
+
+def test_sequence_compile() -> None:
+    seq = Sequence()
+    seq.power(True)
+    seq.label("poll")
+    seq.sbw_read(0x1C00)
+    seq.branch_eq("poll", mask=0x1, value=0x0)
+    with seq.loop(3):
+        seq.capture_time()
+    code = seq.compile()
+
+    assert code == struct.pack(
+        "<BBBIBHHHBHBBB",
+        SeqOp.SEQ_OP_POWER,
+        1,
+        SeqOp.SEQ_OP_SBW_READ,
+        0x1C00,
+        SeqOp.SEQ_OP_BRANCH_EQ,
+        0x1,
+        0x0,
+        2,
+        SeqOp.SEQ_OP_LOOP,
+        3,
+        SeqOp.SEQ_OP_CAPTURE_TIME,
+        SeqOp.SEQ_OP_END_LOOP,
+        SeqOp.SEQ_OP_END,
+    )
+
+
+def test_sequence_undefined_label() -> None:
+    with pytest.raises(ValueError):
+        Sequence().jump("nowhere").compile()
+
+
+def test_sequence_timeout_range() -> None:
+    session = FakeSession(b"")
+    for timeout in (-0.1, 4295.0):
+        with pytest.raises(ValueError, match="Timeout"):
+            run_sequence(session, Sequence().power(True), timeout)
+    assert session.requests == []
+
+
+def test_capabilities_decoding() -> None:
+    rsp = struct.pack("<IHHHII", 0x05, 64, 128, 8192, 250000, 250000)
+    caps = ProbeCapabilities.from_bytes(rsp)
+    assert ProbeFeature.FEATURE_BULK in caps.features
+    assert ProbeFeature.FEATURE_TAGGED not in caps.features
+    assert caps.max_outstanding == 128
+    assert caps.sbw_clk_max_hz == 250000
+
+
+class CapsInterface:
+    def __init__(self, rsp: bytes) -> None:
+        self.rsp = rsp
+
+    def write(self, data: list) -> None:
+        assert data == [ReqType.ID_DAP_VENDOR_CAPS]
+
+    def read(self) -> bytes:
+        if isinstance(self.rsp, Exception):
+            raise self.rsp
+        return self.rsp
+
+
+class CapsLink:
+    def __init__(self, rsp: bytes) -> None:
+        self._interface = CapsInterface(rsp)
+
+    def flush(self) -> None:
+        pass
+
+
+class CapsSession(RioteeProbeSession):
+    def __init__(self, rsp: bytes) -> None:
+        super().__init__()
+        self.link = CapsLink(rsp)
+
+    @property
+    def probe(self) -> SimpleNamespace:
+        return SimpleNamespace(_link=self.link)
+
+
+def test_capabilities_query() -> None:
+    caps = struct.pack("<IHHHII", 0x05, 64, 128, 8192, 250000, 250000)
+    rsp = bytes([ReqType.ID_DAP_VENDOR_CAPS, DapRetCode.DAP_OK]) + caps
+    assert CapsSession(rsp).capabilities.max_outstanding == 128
+    # Firmware without the capability command
+    assert CapsSession(bytes([ID_DAP_INVALID, DapRetCode.DAP_ERROR])).capabilities == LEGACY_CAPABILITIES
+    with pytest.raises(Exception, match="error code"):
+        CapsSession(bytes([ReqType.ID_DAP_VENDOR_CAPS, DapRetCode.DAP_ERROR])).capabilities
+    with pytest.raises(usb.core.USBError):
+        CapsSession(usb.core.USBError("No such device")).capabilities
+
+
+def test_stream_dispatch() -> None:
+    raw = b""
+    for stream_id, payload, dropped in [(0, b"\x01\x02\x03", 0), (1, b"\xff", 0), (0, b"\x04", 2)]:
+        raw += struct.pack("<BBHI", stream_id, len(payload), dropped, 0) + payload.ljust(STREAM_MAX_PAYLOAD, b"\0")
+    frames = np.frombuffer(raw, dtype=FRAME_DTYPE)
+
+    reader = StreamReader(None)
+    recorder = StreamRecorder()
+    reader.subscribe(0, recorder)
+    reader.dispatch(frames)
+
+    assert len(recorder.frames()) == 2
+    assert list(recorder.payload()) == [1, 2, 3, 4]
+    assert reader.dropped[0] == 2
+
+
+def test_stream_reader_error() -> None:
+    class Device:
+        def read(self, *args) -> int:
+            raise usb.core.USBError("No such device")
+
+    reader = StreamReader(None)
+    reader._dev = Device()
+    reader._run()
+    with pytest.raises(usb.core.USBError):
+        reader.check()
+
+
+def test_stats_percentile() -> None:
+    histogram = np.zeros(STATS_N_BUCKETS, dtype=np.uint32)
+    histogram[3] = 90
+    histogram[6] = 10
+    stats = CommandStats(ReqType.ID_DAP_VENDOR_SBW_READ, 100, 0, 100, histogram)
+    assert stats.name == "ID_DAP_VENDOR_SBW_READ"
+    assert stats.percentile(50) == 16
+    assert stats.percentile(99) == 100
+
+
+def test_trace_format() -> None:
+    entries = np.array(
+        [
+            (0xFFFFFFF0, TraceType.TRACE_CMD, 0, ReqType.ID_DAP_VENDOR_SBW_READ, 0),
+            (0xFFFFFFF8, TraceType.TRACE_IR_SHIFT, 0xC8, 0xC8, 0x91),
+            (0x00000004, TraceType.TRACE_DR_SHIFT16, 0xC8, 0x1501, 0x0301),
+        ],
+        dtype=TRACE_DTYPE,
+    )
+    lines = list(format_trace(entries))
+    assert "ID_DAP_VENDOR_SBW_READ" in lines[0]
+    assert "IR_CNTRL_SIG_16BIT" in lines[1]
+    assert lines[2].split()[0] == "20us"
+
+
+def test_bench_result_decoding() -> None:
+    data = struct.pack("<IQIII", 100, 12500, 120, 200, 125_000_000)
+    r = BenchResult.from_bytes(BenchPrimitive.BENCH_SBW_SLOT, data)
+    assert r.n_iter == 100
+    assert r.mean_cycles == 125
+    assert r.cycles_to_ns(r.mean_cycles) == pytest.approx(1000)
+    assert r.cycles_to_ns(r.max_cycles) == pytest.approx(1600)
+
+
+def test_task_stats_decoding() -> None:
+    data = struct.pack("<12sBBBHQ", b"DAP", 1, 2, 0b10, 180, 2_500_000)
+    task = TaskStats.from_bytes(data)
+    assert task.name == "DAP"
+    assert task.state_name == "Blocked"
+    assert task.stack_free_min == 180
+    system = SystemStats(n_cores=2, uptime_us=10_000_000, heap_size=128 * 1024, heap_free=100 * 1024)
+    assert task.cpu_share(system) == pytest.approx(0.25)
+    assert system.heap_used == 28 * 1024
+
+
+def test_image_records() -> None:
+    image = build_image([(0x4400, b"\x01\x02\x03"), (0xFF80, b"\xaa\xbb")], ImageTarget.IMAGE_TARGET_MSP430)
+    # Data is padded to whole words and records to multiples of 4 bytes
+    assert image[:12] == struct.pack("<II", 0x4400, 4) + b"\x01\x02\x03\xff"
+    assert image[12:] == struct.pack("<II", 0xFF80, 2) + b"\xaa\xbb\xff\xff"
+    with pytest.raises(ValueError):
+        build_image([(0x1002, b"\x00" * 4)], ImageTarget.IMAGE_TARGET_NRF52)
+
+
+def test_image_result_decoding() -> None:
+    r = ImageResult.from_bytes(struct.pack("<BBBIIII", 2, 1, 5, 0x1000, 2_500_000, 10, 1))
+    assert not r.passed
+    assert r.step == ImageStep.IMAGE_STEP_VERIFY
+    assert r.cycle_us == 2_500_000
+
+
+def test_fw_update_drives(tmp_path) -> None:
+    for name, info in (("RPI-RP2", "UF2 Bootloader v3.0\nBoard-ID: RPI-RP2\n"), ("OTHER", "Board-ID: NRF52\n")):
+        (tmp_path / name).mkdir()
+        (tmp_path / name / "INFO_UF2.TXT").write_text(info)
+    (tmp_path / "RPI-RP2_2").mkdir()
+    (tmp_path / "RPI-RP2_2" / "INFO_UF2.TXT").write_text("Board-ID: RPI-RP2\n")
+    (tmp_path / "empty").mkdir()
+
+    drives = find_bootloader_drives([tmp_path, tmp_path / "missing"])
+    assert drives == [tmp_path / "RPI-RP2", tmp_path / "RPI-RP2_2"]
+
+    uf2 = tmp_path / "fw.uf2"
+    uf2.write_bytes(b"UF2\n" * 128)
+    errors = copy_uf2(uf2, drives + [tmp_path / "missing"])
+    assert errors[drives[0]] is None and errors[drives[1]] is None
+    assert errors[tmp_path / "missing"] is not None
+    assert all((d / "fw.uf2").read_bytes() == uf2.read_bytes() for d in drives)
+
+
+class FleetSession:
+    """Probe B cannot be opened, closing probe A fails because it left the bus."""
+
+    def __init__(self, unique_id: str) -> None:
+        self.unique_id = unique_id
+
+    def __enter__(self) -> "FleetSession":
+        if self.unique_id == "B":
+            raise Exception("Device busy")
+        return self
+
+    def __exit__(self, *exc) -> None:
+        raise Exception("No such device")
+
+
+def test_fw_update_open_failure(monkeypatch) -> None:
+    probes = [{"Unique ID": uid, "Firmware version": "1.0.0"} for uid in ("A", "B")]
+    monkeypatch.setattr(riotee_probe.session, "get_all_probe_sessions", lambda: probes)
+    monkeypatch.setattr(riotee_probe.session, "RioteeProbeSession", FleetSession)
+    monkeypatch.setattr(fw_update, "reboot_to_bootloader", lambda session: None)
+    monkeypatch.setattr(fw_update, "wait_for_drives", lambda n, timeout, dirs: [Path(f"/drive{i}") for i in range(n)])
+    monkeypatch.setattr(fw_update, "copy_uf2", lambda uf2, drives: {drive: None for drive in drives})
+    monkeypatch.setattr(fw_update, "wait_for_probes", lambda uids, timeout: {uid: "1.1.0" for uid in uids})
+
+    results = {r.unique_id: r for r in fw_update.update_all(Path("fw.uf2"), expect_version="1.1.0")}
+    assert results["A"].ok and results["A"].new_version == "1.1.0"
+    assert results["B"].error == "Device busy" and results["B"].new_version is None
+
+
+def test_rle_decode() -> None:
+    # Literal of 2 words, run of 1000 erased words, literal of 1 word
+    tokens = bytes([0x01]) + struct.pack("<HH", 0x1234, 0x5678)
+    tokens += bytes([0x80 | (999 >> 8), 999 & 0xFF]) + struct.pack("<H", 0xFFFF)
+    tokens += bytes([0x00]) + struct.pack("<H", 0xABCD)
+    words = decode_rle(tokens)
+    assert words.dtype == np.uint16
+    assert len(words) == 1003
+    assert list(words[:2]) == [0x1234, 0x5678]
+    assert np.all(words[2:1002] == 0xFFFF)
+    assert words[-1] == 0xABCD
+    assert len(decode_rle(b"")) == 0
+    assert DumpStats(n_words=1003, n_pkts=1, n_bytes=len(tokens), duration=0.1).ratio == 2006 / 12
+
+
+def test_clock_fit() -> None:
+    rng = np.random.default_rng(1)
+    # Probe booted 3s after the host clock's origin and runs 50ppm fast
+    probe_us = np.sort(rng.integers(10_000_000, 70_000_000, 400)).astype(np.uint64)
+    host_true = 3e9 + probe_us.astype(np.float64) * 1000.0 / (1 + 50e-6)
+    # The probe reads its clock somewhere within the round trip
+    before = rng.uniform(50e3, 1e6, len(probe_us))
+    after = rng.uniform(50e3, 1e6, len(probe_us))
+    samples = np.zeros(len(probe_us), dtype=SYNC_DTYPE)
+    samples["host_tx_ns"] = host_true - before
+    samples["host_rx_ns"] = host_true + after
+    samples["probe_us"] = probe_us
+
+    fit = fit_clock(samples)
+    assert fit.drift_ppm == pytest.approx(50, abs=2)
+    mapped = fit.probe_to_host_ns(probe_us)
+    assert np.max(np.abs(mapped - host_true)) < fit.error_ns + 1e3
+    assert abs(fit.probe_to_host_ns(0) - 3e9) < 1e6
+
+    # 32-bit stream timestamps wrap every 2**32us
+    ref = fit.ref_us
+    assert fit.unwrap_us32((ref + 10) & 0xFFFFFFFF) == ref + 10
+    assert fit.unwrap_us32((ref - 10) & 0xFFFFFFFF) == ref - 10
+
+
+def test_uart_stats_decoding() -> None:
+    s = UartStats.from_bytes(struct.pack("<10I", 1000, 20, 0, 3, 0, 0, 1, 4096, 1_000_000, 0))
+    assert s.rx_dropped == 3
+    assert s.baudrate == 1_000_000
+    assert not s.lossless
+
+
+def test_uart_history_decoding() -> None:
+    info = UartHistoryInfo.from_bytes(struct.pack("<4I", 16384, 20000, 3616, 5))
+    assert info.head - info.oldest == info.size
+    pos, lost, data = decode_history_read(struct.pack("<II", 3616, 100) + b"boot")
+    assert (pos, lost, data) == (3616, 100, b"boot")
+
+
+def _uart_frame(timestamp: int, data: bytes, dropped: int = 0) -> bytes:
+    hdr = struct.pack("<BBHI", StreamId.STREAM_ID_UART, len(data), dropped, timestamp)
+    return hdr + data.ljust(STREAM_MAX_PAYLOAD, b"\0")
+
+
+def test_uart_frame_decoding() -> None:
+    raw = b"plain text before the switch\r\n" + _uart_frame(1000, b"boot\r\n") + _uart_frame(2000, b"x" * 56, 3)
+    decoder = UartFrameDecoder()
+    # Split in the middle of a frame
+    frames = np.concatenate([decoder.feed(raw[:70]), decoder.feed(raw[70:])])
+    assert uart_records(frames) == [(1000, b"boot\r\n"), (2000, b"x" * 56)]
+    assert frames["dropped"].sum() == 3
+    assert decoder.resyncs == 1
+
+    ts = byte_timestamps(frames, 1_000_000)
+    assert len(ts) == 62
+    assert ts[1] == pytest.approx(1010.0)
+    assert ts[6] == 2000
+
+
+def test_trigger_encoding() -> None:
+    rule = TriggerRule(
+        TriggerSource.TRIGGER_SRC_UART, TriggerAction.TRIGGER_ACT_GPIO_PULSE, b"boot", act_pin=2, pulse_us=500
+    )
+    data = rule.to_bytes()
+    # Matches trigger_rule_t in the firmware
+    assert len(data) == 26
+    assert data[:10] == bytes([0, 0, 3, 2]) + struct.pack("<I", 500) + bytes([0, 4])
+    assert data[10:14] == b"boot"
+    with pytest.raises(ValueError):
+        TriggerRule(TriggerSource.TRIGGER_SRC_UART, pattern=b"x" * 17).to_bytes()
+
+    # Action completed after the 32-bit probe clock wrapped
+    status = TriggerStatus.from_bytes(struct.pack("<BbIIII", 1, 0, 3, 0xFFFFFFF0, 0x10, 40))
+    assert status.armed and status.n_fired == 3
+    assert status.latency_us == 0x20
+
+
+def test_boot_results() -> None:
+    config = BootConfig(3, BootWait.BOOT_WAIT_UART | BootWait.BOOT_WAIT_MAILBOX, off_us=5000)
+    data = config.to_bytes()
+    # Matches boot_config_t in the firmware
+    assert len(data) == 13
+    assert data[:3] == bytes([3, 0, 5]) and data[5:9] == struct.pack("<I", 5000)
+    with pytest.raises(ValueError):
+        BootConfig(0, BootWait.BOOT_WAIT_UART).to_bytes()
+
+    rsp = bytes([3])
+    for uart_us, mailbox_us in ((1200, 3000), (1000, 0xFFFFFFFF), (1400, 5000)):
+        rsp += struct.pack("<IIIH", uart_us, 0xFFFFFFFF, mailbox_us, 0xA5A5)
+    cycles = [BootCycle.from_bytes(rsp, 1 + i * BootCycle.SIZE) for i in range(rsp[0])]
+    assert cycles[1].mailbox_us is None and cycles[1].gpio_us is None
+
+    stats = BootResult(config, cycles).stats()
+    assert set(stats) == {"uart", "mailbox"}
+    assert stats["uart"].n_seen == 3 and stats["uart"].median == 1200 and stats["uart"].max == 1400
+    assert stats["mailbox"].n_missed == 1 and stats["mailbox"].mean == 4000
+
+
+def test_logic_capture(tmp_path) -> None:
+    config = LogicConfig(10_000_000, 100, 20, LogicTrigger.LOGIC_TRIG_RISE, 4)
+    # Matches logic_config_t in the firmware
+    assert len(config.to_bytes()) == 15
+    with pytest.raises(ValueError):
+        LogicConfig(1000, 0).to_bytes()
+
+    status = LogicStatus.from_bytes(struct.pack("<BIIIII", 5, 10_416_666, 1234, 2, 6, 1))
+    assert status.state == LogicState.LOGIC_STATE_DONE and status.n_samples == 6
+
+    # Levels in the low five bits, run length minus one above
+    samples = decode_logic_rle(struct.pack("<3H", 0x00 | (1 << 5), 0x10 | (0 << 5), 0x11 | (2 << 5)))
+    assert samples.tolist() == [0x00, 0x00, 0x10, 0x11, 0x11, 0x11]
+
+    capture = LogicCapture(samples, 1_000_000, trigger_index=2)
+    assert capture.channel(4).tolist() == [False, False, True, True, True, True]
+    assert capture.times[2] == 0
+
+    capture.write_vcd(tmp_path / "capture.vcd")
+    vcd = (tmp_path / "capture.vcd").read_text()
+    assert "$var wire 1 % UART_RX $end" in vcd
+    assert "#-2000\n$dumpvars\n0!" in vcd
+    assert "#0\n1%\n#1000\n1!\n" in vcd
+
+    capture.write_sigrok(tmp_path / "capture.sr")
+    with zipfile.ZipFile(tmp_path / "capture.sr") as zf:
+        assert zf.read("logic-1-1") == bytes(samples)
+        assert "samplerate=1000000 Hz" in zf.read("metadata").decode()
+
+
+def _event_frame(records: bytes, dropped: int = 0) -> np.ndarray:
+    frame = np.zeros(1, dtype=FRAME_DTYPE)
+    frame["stream_id"] = StreamId.STREAM_ID_EVENT
+    frame["len"] = len(records)
+    frame["dropped"] = dropped
+    frame["payload"][0, : len(records)] = np.frombuffer(records, dtype=np.uint8)
+    return frame
+
+
+def test_event_decoding() -> None:
+    log = EventLog()
+    # UART data of the second record started before the GPIO edge was recorded
+    log.feed(
+        _event_frame(
+            struct.pack("<IBBH", 0xFFFFFF00, EventType.EVENT_GPIO, 1, 1)
+            + struct.pack("<IBBH", 0xFFFFFE00, EventType.EVENT_UART, 4, 2)
+            + b"boot"
+        )
+    )
+    # The probe clock wrapped in between
+    log.feed(_event_frame(struct.pack("<IBBH", 0x10, EventType.EVENT_SBW, EventSbw.EVENT_SBW_HALT, 0), dropped=1))
+
+    records = log.records
+    assert list(records["type"]) == [EventType.EVENT_UART, EventType.EVENT_GPIO, EventType.EVENT_SBW]
+    assert list(records["time_us"]) == [0xFFFFFE00, 0xFFFFFF00, 0x100000010]
+    assert log.uart_data(records[0]) == b"boot"
+    assert log.dropped_frames == 1
+    assert describe_event(records[0], b"boot") == "uart   b'boot' (2B lost before)"
+    assert describe_event(records[2]) == "sbw    halt"